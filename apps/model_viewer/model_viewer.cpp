@@ -26,7 +26,7 @@ private:
 	virtual bool loadAssets() final;
 	virtual bool setupScene() final;
 	virtual bool createGraphicsPipeline() final;
-	virtual RecordCommandsResult renderFrame(uint32_t swapchain_image) final;
+	virtual RecordCommandsResult renderFrame(uint32_t frame_index, uint32_t swapchain_image) final;
 	virtual void updateScene() final;
 	virtual void cleanupSwapChainAssets() final;
 	virtual void cleanup() final;
@@ -34,7 +34,6 @@ private:
 	void drawUi();
 
 	std::unique_ptr<ImGuiRenderer> imgui_renderer_;
-	std::vector<VkCommandBuffer> main_command_buffers_;
 
 	std::unique_ptr<SceneManager> scene_manager_;
 	std::unique_ptr<RenderPass> render_pass_;
@@ -56,10 +55,11 @@ private:
 // Implementation
 
 bool ModelViewer::loadAssets() {
-	main_command_buffers_ = vulkan_backend_.createPrimaryCommandBuffers(vulkan_backend_.getSwapChainSize());
 
 	auto extent = vulkan_backend_.getSwapChainExtent();
 	scene_manager_ = SceneManager::create(&vulkan_backend_);
+	scene_manager_->setIndirectDraw(scene_indirect_draw_);
+	scene_manager_->setGpuCulling(scene_gpu_culling_);
 	scene_manager_->setCameraProperties(camera_fov_deg_, extent.width / (float)extent.height, 0.1f, 10.0f);
 	scene_manager_->setCameraPosition(cam_pos_);
 	scene_manager_->setCameraTarget(glm::vec3(0.0f, 0.0f, 0.0f));
@@ -71,26 +71,13 @@ bool ModelViewer::loadAssets() {
 	imgui_renderer_->setUp(window_);
 
 #ifndef NDEBUG
-	vulkan_backend_.enableTimestampQueries(4);
+	vulkan_backend_.enableGpuProfiler();
 #endif
 
 	return true;
 }
 
 bool ModelViewer::setupScene() {
-	DescriptorPoolConfig pool_config;
-
-	auto scene_pool = scene_manager_->getDescriptorsCount(1);
-	auto ui_pool = imgui_renderer_->getDescriptorsCount();
-
-	pool_config = scene_pool + ui_pool;
-	
-	pool_config.uniform_buffers_count *= vulkan_backend_.getSwapChainSize();
-	pool_config.image_samplers_count *= vulkan_backend_.getSwapChainSize();
-	pool_config.image_storage_buffers_count *= vulkan_backend_.getSwapChainSize();
-
-	vulkan_backend_.createDescriptorPool(pool_config);
-
 	RenderPassConfig render_pass_config;
 	render_pass_config.msaa_samples = vulkan_backend_.getMaxMSAASamples();
 	
@@ -133,13 +120,11 @@ bool ModelViewer::setupScene() {
 }
 
 bool ModelViewer::createGraphicsPipeline() {
-	if (!scene_manager_->createGraphicsPipeline("model_viewer", *render_pass_, 0)) {
-		return false;
-	}
-	if (!imgui_renderer_->createGraphicsPipeline(*render_pass_, 1)) {
-		return false;
-	}
-	return true;
+	std::vector<PipelineBuild> builds;
+	builds.push_back(scene_manager_->createGraphicsPipeline("model_viewer", *render_pass_, 0));
+	builds.push_back(imgui_renderer_->createGraphicsPipeline(*render_pass_, 1));
+
+	return vulkan_backend_.finishPipelineBuilds(builds);
 }
 
 void ModelViewer::cleanupSwapChainAssets() {
@@ -151,7 +136,6 @@ void ModelViewer::cleanupSwapChainAssets() {
 void ModelViewer::cleanup() {
 	cleanupSwapChainAssets();
 	imgui_renderer_->shutDown();
-	vulkan_backend_.freeCommandBuffers(main_command_buffers_);
 	scene_manager_.reset();
 }
 
@@ -184,12 +168,11 @@ void ModelViewer::updateScene() {
 	drawUi();
 }
 
-RecordCommandsResult ModelViewer::renderFrame(uint32_t swapchain_image) {
-	auto& main_command_buffer = main_command_buffers_[swapchain_image];
+RecordCommandsResult ModelViewer::renderFrame(uint32_t frame_index, uint32_t swapchain_image) {
+	auto main_command_buffer = vulkan_backend_.getFrameCommandBuffer();  // recycled by the backend once this frame completes
 
 	// might need to combine multiple command buffers in one frame in the future
 	std::vector<VkCommandBuffer> command_buffers = { main_command_buffer };
-	vulkan_backend_.resetCommandBuffers(command_buffers);
 
 	VkCommandBufferBeginInfo begin_info{};
 	begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
@@ -201,7 +184,8 @@ RecordCommandsResult ModelViewer::renderFrame(uint32_t swapchain_image) {
 		return makeRecordCommandsResult(false, command_buffers);
 	}
 
-	vulkan_backend_.resetAllTimestampQueries(command_buffers[0]);
+	// compute work on the graphics queue, it can't be recorded within the render pass
+	scene_manager_->cullGeometry(command_buffers[0], frame_index);
 
 	VkRenderPassBeginInfo render_pass_info{};
 	render_pass_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
@@ -219,8 +203,8 @@ RecordCommandsResult ModelViewer::renderFrame(uint32_t swapchain_image) {
 
 	vkCmdBeginRenderPass(command_buffers[0], &render_pass_info, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
 	
-	ProfileConfig scene_profile_config = { true, 0, 1 };
-	auto scene_commands = scene_manager_->renderFrame(swapchain_image, render_pass_info, scene_profile_config);
+	ProfileConfig scene_profile_config = { true, "Geometry draw" };
+	auto scene_commands = scene_manager_->renderFrame(frame_index, render_pass_info, scene_profile_config);
 	auto success = std::get<0>(scene_commands);
 
 	if (success) {
@@ -231,8 +215,8 @@ RecordCommandsResult ModelViewer::renderFrame(uint32_t swapchain_image) {
 	// register UI overlay commands
 	vkCmdNextSubpass(command_buffers[0], VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
 
-	ProfileConfig ui_profile_config = { true, 2, 3 };
-	auto commands = imgui_renderer_->renderFrame(swapchain_image, render_pass_info, ui_profile_config);
+	ProfileConfig ui_profile_config = { true, "UI draw" };
+	auto commands = imgui_renderer_->renderFrame(frame_index, render_pass_info, ui_profile_config);
 	success = std::get<0>(commands);
 
 	if (success) {
@@ -250,13 +234,15 @@ RecordCommandsResult ModelViewer::renderFrame(uint32_t swapchain_image) {
 }
 
 void ModelViewer::drawUi() {
-	static auto time_to_draw_geometry = 0.0f;
-	static auto time_to_draw_ui = 0.0f;
+	auto time_to_draw_geometry = 0.0f;
+	auto time_to_draw_ui = 0.0f;
 	
-	auto vulkan_stats = vulkan_backend_.retrieveTimestampQueries();
-	if (!vulkan_stats.empty()) {
-		time_to_draw_geometry = vulkan_stats[1] - vulkan_stats[0];
-		time_to_draw_ui = vulkan_stats[3] - vulkan_stats[2];
+	const auto& gpu_timings = vulkan_backend_.getGpuTimings();
+	if (gpu_timings.count("Geometry draw") > 0) {
+		time_to_draw_geometry = gpu_timings.at("Geometry draw").last_ms;
+	}
+	if (gpu_timings.count("UI draw") > 0) {
+		time_to_draw_ui = gpu_timings.at("UI draw").last_ms;
 	}
 
 	imgui_renderer_->beginFrame();
@@ -324,7 +310,7 @@ void ModelViewer::drawUi() {
 
 int main(int argc, char** argv) {
 	ModelViewer app;
-	if (!app.setup()) {
+	if (!app.setup(argc, argv)) {
 		return -1;
 	}
 	if (!app.run()) {
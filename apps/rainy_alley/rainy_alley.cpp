@@ -14,9 +14,18 @@
 #include "particles/rain_emitter_inst.hpp"
 #include "particles/rain_emitter_mesh.hpp"
 #include "render_pass.hpp"
+#include "frame_stats.hpp"
+#include "profilers.hpp"
 
+#include <array>
+#include <charconv>
 #include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <limits>
 #include <numeric>
+#include <sstream>
 
 // Declarations
 const char* const kEmitterTypes[] = {
@@ -31,7 +40,8 @@ enum EmitterType : int {
 	GEOMETRY_SHADER,
 	PRIMITIVE_RESTART,
 	INSTANCING,
-	MESH
+	MESH,
+	EMITTER_TYPES_COUNT
 };
 
 
@@ -41,22 +51,49 @@ public:
 		setWindowTitle("Rainy Alley");
 	}
 
+	// builds every supported emitter up front so that switching between them doesn't rebuild the swapchain
+	void setPrecompileEmitters(bool precompile) { precompile_emitters_ = precompile; }
+	// runs every supported emitter with each particle count, with a fixed time step and camera path, then writes
+	// the per-frame timings and their percentiles to output_path as JSON and exits. always headless, the swapchain
+	// presentation would otherwise end up in the timings
+	void setBenchmark(const std::string& output_path, const std::vector<int>& particle_counts, uint32_t warmup_frames, uint32_t measured_frames);
+
 private:
 	virtual bool loadAssets() final;
 	virtual bool setupScene() final;
 	virtual bool createGraphicsPipeline() final;
-	virtual RecordCommandsResult renderFrame(uint32_t swapchain_image) final;
+	virtual RecordCommandsResult renderFrame(uint32_t frame_index, uint32_t swapchain_image) final;
 	virtual void updateScene() final;
 	virtual void cleanupSwapChainAssets() final;
 	virtual void cleanup() final;
 
 	void updateDescriptorSets();
 	void drawUi();
+	bool isEmitterSupported(EmitterType type) const;
+	std::shared_ptr<ParticleEmitterBase> createEmitter(EmitterType type, const ParticleEmitterConfig& config);
+
+	// benchmark
+	struct BenchmarkFrame {
+		float cpu_ms = 0.f;  // wall time of the whole frame loop iteration
+		float gpu_frame_ms = -1.f;  // < 0 if no new sample of the scope was collected since the previous frame
+		float gpu_update_ms = -1.f;
+		float gpu_draw_ms = -1.f;
+	};
+
+	struct BenchmarkRun {
+		EmitterType emitter_type;
+		int particles_count;
+		std::vector<BenchmarkFrame> frames;
+	};
+
+	void updateBenchmark();
+	bool writeBenchmarkResults() const;
 
 	std::unique_ptr<ImGuiRenderer> imgui_renderer_;
-	std::vector<VkCommandBuffer> graphics_command_buffers_;
 
-	std::shared_ptr<ParticleEmitterBase> rain_drops_emitter_;
+	std::shared_ptr<ParticleEmitterBase> rain_drops_emitter_;  // the one being simulated and drawn
+	bool particles_updated_ = false;  // its compute update for this frame was submitted
+	std::array<std::shared_ptr<ParticleEmitterBase>, EMITTER_TYPES_COUNT> emitters_;  // only the active one unless precompiled
 	std::unique_ptr<SceneManager> scene_manager_;
 	std::unique_ptr<RenderPass> render_pass_;
 
@@ -65,20 +102,68 @@ private:
 	int number_of_particles_ = 1000;
 	float lifetime_after_collision_ = 0.12f;
 	EmitterType selected_emitter_type_ = GEOMETRY_SHADER;
+	EmitterType active_emitter_type_ = GEOMETRY_SHADER;
+	bool precompile_emitters_ = false;
 	bool show_average_stats_ = true;
+	FrameStats frame_stats_{ 1000 };  // cpu frame and total rain time since the last emitter change, for the plot and percentiles
+
+	// benchmark
+	const float kBenchmarkDeltaTime = 1.0f / 60.0f;  // s
+	const uint32_t kBenchmarkSeed = 1234;
+	bool benchmark_ = false;
+	std::string benchmark_output_;
+	std::vector<int> benchmark_particle_counts_;
+	uint32_t benchmark_warmup_frames_ = 60;
+	uint32_t benchmark_measured_frames_ = 240;
+	std::vector<BenchmarkRun> benchmark_runs_;
+	size_t benchmark_run_ = 0;
+	uint32_t benchmark_frame_ = 0;  // since the start of the current run, warm-up included
+	std::chrono::steady_clock::time_point benchmark_last_update_;
+	std::map<std::string, uint64_t> benchmark_samples_seen_;  // GpuScopeStats::samples_count by scope, at the previous frame
 };
 
 // Implementation
 
+void RainyAlley::setBenchmark(const std::string& output_path, const std::vector<int>& particle_counts, uint32_t warmup_frames, uint32_t measured_frames) {
+	benchmark_ = true;
+	headless_ = true;
+	benchmark_output_ = output_path;
+	benchmark_particle_counts_ = particle_counts;
+	benchmark_warmup_frames_ = warmup_frames;
+	benchmark_measured_frames_ = measured_frames;
+}
+
 bool RainyAlley::loadAssets() {
-	graphics_command_buffers_ = vulkan_backend_.createPrimaryCommandBuffers(vulkan_backend_.getSwapChainSize());
-	
+	if (benchmark_) {
+		// timestamps only, the statistics queries would add their own cost to what is being measured
+		vulkan_backend_.enableGpuProfiler();
+		headless_frames_ = std::numeric_limits<uint64_t>::max();  // the benchmark decides when to stop
+
+		for (int type = 0; type < EMITTER_TYPES_COUNT; ++type) {
+			if (isEmitterSupported(static_cast<EmitterType>(type))) {
+				for (auto particles_count : benchmark_particle_counts_) {
+					benchmark_runs_.push_back({ static_cast<EmitterType>(type), particles_count, {} });
+				}
+			}
+		}
+		if (benchmark_runs_.empty()) {
+			std::cerr << "Nothing to benchmark!" << std::endl;
+			return false;
+		}
+
+		selected_emitter_type_ = benchmark_runs_[0].emitter_type;
+		number_of_particles_ = benchmark_runs_[0].particles_count;
+		benchmark_last_update_ = std::chrono::steady_clock::now();
+	} else {
 #ifndef NDEBUG
-	vulkan_backend_.enableTimestampQueries(8);
+		vulkan_backend_.enableGpuProfiler(32, true);  // with pipeline statistics, to compare the emitters by invocation counts
 #endif
+	}
 
 	auto extent = vulkan_backend_.getSwapChainExtent();
 	scene_manager_ = SceneManager::create(&vulkan_backend_);
+	scene_manager_->setIndirectDraw(scene_indirect_draw_);
+	scene_manager_->setGpuCulling(scene_gpu_culling_);
 	scene_manager_->setCameraProperties(camera_fov_deg_, extent.width / (float)extent.height, 0.1f, 1000.0f);
 	scene_manager_->setCameraPosition(glm::vec3(-10.0f, 0.0f, 4.0f));
 	scene_manager_->setCameraTarget(glm::vec3(0.0f, 0.0f, 2.0f));
@@ -98,6 +183,11 @@ bool RainyAlley::loadAssets() {
 }
 
 bool RainyAlley::setupScene() {
+	if (!isEmitterSupported(selected_emitter_type_)) {
+		std::cerr << kEmitterTypes[selected_emitter_type_] << " emitter is not supported by this device. Falling back to " << kEmitterTypes[PRIMITIVE_RESTART] << std::endl;
+		selected_emitter_type_ = PRIMITIVE_RESTART;
+	}
+
 	ParticleEmitterConfig emitter_config;
 	emitter_config.name = "rain_drops_emitter";
 	emitter_config.starting_transform = glm::identity<glm::mat4>();
@@ -108,42 +198,27 @@ bool RainyAlley::setupScene() {
 	emitter_config.lifetime_after_collision = lifetime_after_collision_;
 	emitter_config.texture_atlas = "textures/rain_drops.png";
 	emitter_config.subpass_number = 1;
+	emitter_config.random_seed = benchmark_ ? kBenchmarkSeed : 0;
+	emitter_config.profile = benchmark_;
 #ifndef NDEBUG
 	emitter_config.profile = true;
-	emitter_config.start_query_num = 0;
-	emitter_config.stop_query_num = 1;
 #endif
 
-	switch (selected_emitter_type_) {
-		case GEOMETRY_SHADER:
-			rain_drops_emitter_ = RainEmitterGS::createParticleEmitter(emitter_config, &vulkan_backend_);
-			break;
-		case PRIMITIVE_RESTART:
-			rain_drops_emitter_ = RainEmitterPR::createParticleEmitter(emitter_config, &vulkan_backend_);
-			break;
-		case INSTANCING:
-			rain_drops_emitter_ = RainEmitterInst::createParticleEmitter(emitter_config, &vulkan_backend_);
-			break;
-		case MESH:
-			rain_drops_emitter_ = RainEmitterMesh::createParticleEmitter(emitter_config, &vulkan_backend_);
-			break;
+	for (int type = 0; type < EMITTER_TYPES_COUNT; ++type) {
+		auto emitter_type = static_cast<EmitterType>(type);
+		if (emitter_type == selected_emitter_type_ || (precompile_emitters_ && isEmitterSupported(emitter_type))) {
+			emitters_[type] = createEmitter(emitter_type, emitter_config);
+		}
 	}
 
-	DescriptorPoolConfig pool_config;
+	rain_drops_emitter_ = emitters_[selected_emitter_type_];
+	active_emitter_type_ = selected_emitter_type_;
 
-	auto scene_pool = scene_manager_->getDescriptorsCount(2);
-	auto emitter_pool = rain_drops_emitter_->getDescriptorsCount();
-	auto ui_pool = imgui_renderer_->getDescriptorsCount();
-	
-	pool_config = scene_pool + emitter_pool + ui_pool;
-
-	pool_config.uniform_buffers_count *= vulkan_backend_.getSwapChainSize();
-	pool_config.image_samplers_count *= vulkan_backend_.getSwapChainSize();
-	pool_config.image_storage_buffers_count *= vulkan_backend_.getSwapChainSize();
-	
-	vulkan_backend_.createDescriptorPool(pool_config);
-
-	rain_drops_emitter_->createParticles(number_of_particles_);
+	for (auto& emitter : emitters_) {
+		if (emitter) {
+			emitter->createParticles(number_of_particles_);
+		}
+	}
 
 	RenderPassConfig render_pass_config;
 	render_pass_config.msaa_samples = vulkan_backend_.getMaxMSAASamples();
@@ -200,6 +275,7 @@ bool RainyAlley::setupScene() {
 
 void RainyAlley::cleanupSwapChainAssets() {
 	rain_drops_emitter_.reset();
+	emitters_.fill(nullptr);
 	scene_manager_->cleanupSwapChainAssets();
 	imgui_renderer_->cleanupGraphicsPipeline();
 	render_pass_.reset();
@@ -208,54 +284,68 @@ void RainyAlley::cleanupSwapChainAssets() {
 void RainyAlley::cleanup() {
 	cleanupSwapChainAssets();
 	imgui_renderer_->shutDown();
-	vulkan_backend_.freeCommandBuffers(graphics_command_buffers_);
 	rain_drops_emitter_.reset();
 	scene_manager_.reset();
 }
 
 void RainyAlley::updateScene() {
+	CPU_PROFILE_SCOPE("RainyAlley::updateScene");
 	static auto time_last_call = std::chrono::steady_clock::now();
 
 	auto time_now = std::chrono::steady_clock::now();
 	auto delta_time_s = std::chrono::duration_cast<std::chrono::microseconds>(time_now - time_last_call).count() * 1e-6f;
 	time_last_call = time_now;
 
+	if (benchmark_) {
+		delta_time_s = kBenchmarkDeltaTime;  // the same simulation for every run, however fast the device is
+		updateBenchmark();
+	}
+
+	// a precompiled emitter is ready to go, switching to it doesn't need to wait for the device
+	if (selected_emitter_type_ != active_emitter_type_ && emitters_[selected_emitter_type_]) {
+		rain_drops_emitter_ = emitters_[selected_emitter_type_];
+		active_emitter_type_ = selected_emitter_type_;
+	}
+
 	scene_manager_->update();
 
 	auto result = rain_drops_emitter_->update(delta_time_s, scene_manager_->getSceneData());
 
 	// dispatch is handled here instead of within rain_drops_emitter_
 	// so that it's possible to stack multiple compute buffers in one queue.
-	if (std::get<0>(result)) {
-		vulkan_backend_.submitComputeCommands(std::get<1>(result));
-	}
+	// the update only touches the draw buffer and the scene depth of this frame, so it waits for the graphics work that
+	// last used them rather than the last frame, which it can run alongside
+	particles_updated_ = std::get<0>(result) && vulkan_backend_.submitComputeCommands(std::get<1>(result), vulkan_backend_.getFrameGraphicsValue()) == VK_SUCCESS;
 
 	drawUi();
 }
 
 bool RainyAlley::createGraphicsPipeline() {
-	if (!scene_manager_->createGraphicsPipeline("alley", *render_pass_, 0)) {
-		return false;
-	}
-	if (!rain_drops_emitter_->createGraphicsPipeline(*render_pass_, 1)) {
-		return false;
-	}
-	if (!imgui_renderer_->createGraphicsPipeline(*render_pass_, 2)) {
-		return false;
+	// all pipelines compile concurrently, descriptor sets are created once they are all done
+	std::vector<PipelineBuild> builds;
+	builds.push_back(scene_manager_->createGraphicsPipeline("alley", *render_pass_, 0));
+	builds.push_back(imgui_renderer_->createGraphicsPipeline(*render_pass_, 2));
+	for (auto& emitter : emitters_) {
+		if (emitter) {
+			builds.push_back(emitter->createGraphicsPipeline(*render_pass_, 1));
+			builds.push_back(emitter->createComputePipeline(scene_manager_->getSceneDepthBuffers()));
+		}
 	}
-	if (!rain_drops_emitter_->createComputePipeline(scene_manager_->getSceneDepthBuffer())) {
+
+	if (!vulkan_backend_.finishPipelineBuilds(builds)) {
 		return false;
 	}
 
+	// the depth storage is new, and read by whichever emitter is active. the emitters hand over their own buffers
+	scene_manager_->releaseToCompute();
 	return true;
 }
 
-RecordCommandsResult RainyAlley::renderFrame(uint32_t swapchain_image) {
-	auto& main_command_buffer = graphics_command_buffers_[swapchain_image];
+RecordCommandsResult RainyAlley::renderFrame(uint32_t frame_index, uint32_t swapchain_image) {
+	auto main_command_buffer = vulkan_backend_.getFrameCommandBuffer();  // recycled by the backend once this frame completes
 
 	// we might need to combine multiple command buffers in one frame in the future
 	std::vector<VkCommandBuffer> command_buffers = { main_command_buffer };
-	vulkan_backend_.resetCommandBuffers(command_buffers);
 
 	VkCommandBufferBeginInfo begin_info{};
 	begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
@@ -267,7 +357,19 @@ RecordCommandsResult RainyAlley::renderFrame(uint32_t swapchain_image) {
 		return makeRecordCommandsResult(false, command_buffers);
 	}
 
-	vulkan_backend_.resetTimestampQueries(command_buffers[0], 2, 6);
+	// the scopes recorded in the secondary command buffers nest inside this one
+	vulkan_backend_.beginGpuScope(command_buffers[0], "Frame");
+
+	// take the particles and the scene depth of this frame back from the compute queue. no-op if compute shares the graphics
+	// queue. without an update this frame they are still with compute, released at the end of the frame that used them
+	// last, and stay there
+	if (particles_updated_) {
+		rain_drops_emitter_->acquireFromCompute(command_buffers[0], frame_index);
+		vulkan_backend_.acquireFromCompute(command_buffers[0], scene_manager_->getComputeSharedResources(frame_index));
+	}
+
+	// compute work on the graphics queue, it can't be recorded within the render pass
+	scene_manager_->cullGeometry(command_buffers[0], frame_index);
 
 	VkRenderPassBeginInfo render_pass_info{};
 	render_pass_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
@@ -285,8 +387,8 @@ RecordCommandsResult RainyAlley::renderFrame(uint32_t swapchain_image) {
 
 	vkCmdBeginRenderPass(command_buffers[0], &render_pass_info, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
 	
-	ProfileConfig scene_profile_config = { true, 2, 3 };
-	auto scene_commands = scene_manager_->renderFrame(swapchain_image, render_pass_info, scene_profile_config);
+	ProfileConfig scene_profile_config = { true, "Alley draw", true };
+	auto scene_commands = scene_manager_->renderFrame(frame_index, render_pass_info, scene_profile_config);
 	auto success = std::get<0>(scene_commands);
 
 	if (success) {
@@ -296,10 +398,10 @@ RecordCommandsResult RainyAlley::renderFrame(uint32_t swapchain_image) {
 
 	vkCmdNextSubpass(command_buffers[0], VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
 
-	auto rain_commands = rain_drops_emitter_->renderFrame(swapchain_image, render_pass_info);
+	auto rain_commands = rain_drops_emitter_->renderFrame(frame_index, render_pass_info);
 	success = std::get<0>(rain_commands);
 
-	if (success) {
+	if (success && particles_updated_) {
 		auto rain_cmd_buffers = std::get<1>(rain_commands);
 		vkCmdExecuteCommands(command_buffers[0], static_cast<uint32_t>(rain_cmd_buffers.size()), rain_cmd_buffers.data());
 	}
@@ -307,8 +409,8 @@ RecordCommandsResult RainyAlley::renderFrame(uint32_t swapchain_image) {
 	// register UI overlay commands
 	vkCmdNextSubpass(command_buffers[0], VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
 	
-	ProfileConfig ui_profile_config = { true, 6, 7 };
-	auto ui_commands = imgui_renderer_->renderFrame(swapchain_image, render_pass_info, ui_profile_config);
+	ProfileConfig ui_profile_config = { true, "UI draw" };
+	auto ui_commands = imgui_renderer_->renderFrame(frame_index, render_pass_info, ui_profile_config);
 	success = std::get<0>(ui_commands);
 
 	if (success) {
@@ -317,6 +419,14 @@ RecordCommandsResult RainyAlley::renderFrame(uint32_t swapchain_image) {
 	}
 	
 	vkCmdEndRenderPass(command_buffers[0]);
+
+	if (particles_updated_) {
+		rain_drops_emitter_->releaseToCompute(command_buffers[0], frame_index);
+		vulkan_backend_.releaseToCompute(command_buffers[0], scene_manager_->getComputeSharedResources(frame_index));
+	}
+
+	vulkan_backend_.endGpuScope(command_buffers[0], "Frame");
+
 	if (vkEndCommandBuffer(command_buffers[0]) != VK_SUCCESS) {
 		std::cerr << "Failed to record command buffer!" << std::endl;
 		return makeRecordCommandsResult(false, command_buffers);
@@ -326,25 +436,30 @@ RecordCommandsResult RainyAlley::renderFrame(uint32_t swapchain_image) {
 }
 
 void RainyAlley::drawUi() {
-	static auto time_to_exec_compute = 0.0f;
-	static auto time_to_draw_geometry = 0.0f;
-	static auto time_to_draw_particles = 0.0f;
-	static auto time_to_draw_ui = 0.0f;
-
-	auto vulkan_stats = vulkan_backend_.retrieveTimestampQueries();
-	if (!vulkan_stats.empty()) {
-		time_to_exec_compute = vulkan_stats[1] - vulkan_stats[0];
-		time_to_draw_geometry = vulkan_stats[3] - vulkan_stats[2];
-		time_to_draw_particles = vulkan_stats[5] - vulkan_stats[4];
-		time_to_draw_ui = vulkan_stats[7] - vulkan_stats[6];
-	}
+	// GPU timings by profiler scope, a few frames behind
+	const auto& gpu_timings = vulkan_backend_.getGpuTimings();
+	auto scope_timing = [&gpu_timings](const std::string& scope) -> const GpuScopeStats& {
+		static const GpuScopeStats not_recorded;
+		auto iter = gpu_timings.find(scope);
+		return iter != gpu_timings.end() ? iter->second : not_recorded;
+	};
+
+	const auto& compute_timing = scope_timing(rain_drops_emitter_->getUpdateScopeName());
+	const auto& geometry_timing = scope_timing("Alley draw");
+	const auto& culling_timing = scope_timing("Scene culling");
+	const auto& particles_timing = scope_timing(rain_drops_emitter_->getDrawScopeName());
+	const auto& ui_timing = scope_timing("UI draw");
+	const auto& frame_timing = scope_timing("Frame");
+	// the compute timestamps are written on the compute queue. a frame waits for its own update, which can only run
+	// alongside the previous frame: how much of the update ran while that one was drawing
+	auto compute_overlap = std::max(0.0, std::min(compute_timing.last_end_ms, frame_timing.previous_end_ms) - std::max(compute_timing.last_begin_ms, frame_timing.previous_begin_ms));
 
 	imgui_renderer_->beginFrame();
 
 	ImGui::SetNextWindowPos(ImVec2(10, 10));
 
 	const auto high_dpi_scale = imgui_renderer_->getHighDpiScale();
-	ImGui::SetNextWindowSizeConstraints(ImVec2(300 * high_dpi_scale, 100 * high_dpi_scale), ImVec2(450 * high_dpi_scale, 150 * high_dpi_scale));
+	ImGui::SetNextWindowSizeConstraints(ImVec2(300 * high_dpi_scale, 100 * high_dpi_scale), ImVec2(450 * high_dpi_scale, 180 * high_dpi_scale));
 
 	ImGui::Begin("Options");
 
@@ -353,9 +468,22 @@ void RainyAlley::drawUi() {
 		++available_emitters;
 	}
 
+	auto previous_emitter_type = selected_emitter_type_;
 	if (ImGui::Combo("Emitter Type", (int*)&selected_emitter_type_, kEmitterTypes, available_emitters)) {
-		force_recreate_swapchain_ = true;
+		if (isEmitterSupported(selected_emitter_type_)) {
+			// precompiled emitters are swapped in at the start of the next frame
+			if (!emitters_[selected_emitter_type_]) {
+				force_recreate_swapchain_ = true;
+			}
+		} else {
+			std::cerr << kEmitterTypes[selected_emitter_type_] << " emitter is not supported by this device." << std::endl;
+			selected_emitter_type_ = previous_emitter_type;
+		}
 	}  
+
+	if (ImGui::Checkbox("Precompile all emitters", &precompile_emitters_)) {
+		force_recreate_swapchain_ = true;
+	}
 	
 	ImGui::Text("Particles: ");
 	ImGui::SameLine();
@@ -381,88 +509,345 @@ void RainyAlley::drawUi() {
 	auto stats_width = 270 * high_dpi_scale;
 	auto stats_pos = extent.width - stats_width - 50;
 	ImGui::SetNextWindowPos(ImVec2(stats_pos, 10));
-	ImGui::SetNextWindowSizeConstraints(ImVec2(stats_width, 150 * high_dpi_scale), ImVec2(stats_width + 50, 320 * high_dpi_scale));
+	ImGui::SetNextWindowSizeConstraints(ImVec2(stats_width, 150 * high_dpi_scale), ImVec2(stats_width + 50, 560 * high_dpi_scale));
 
 	ImGui::Begin("Stats");
 
-	static auto compute_avg = 0.f;
-	static auto scene_avg = 0.f;
-	static auto rain_avg = 0.f;
-	static auto ui_avg = 0.f;
-
-	int avg_size = 100;
-	static std::vector<float> compute_history(avg_size, 0.f);
-	static std::vector<float> scene_history(avg_size, 0.f);
-	static std::vector<float> rain_history(avg_size, 0.f);
-	static std::vector<float> ui_history(avg_size, 0.f);
-
-	static std::vector<float> plot_values(1000, 0.f);
-	auto total_particles_time = time_to_exec_compute + time_to_draw_particles;
-	int plot_idx = frame_ % 1000;
+	auto& rain_time = frame_stats_.metric("Rain update + draw");
+	auto& cpu_frame_time = frame_stats_.metric("CPU frame");
 	
-	int history_idx = frame_ % avg_size;
-	if (force_recreate_swapchain_) {
-		compute_history.clear(); 
-		compute_history.insert(compute_history.begin(), avg_size, 0.f);
-		scene_history.clear();
-		scene_history.insert(scene_history.begin(), avg_size, 0.f);
-		rain_history.clear();
-		rain_history.insert(rain_history.begin(), avg_size, 0.f);
-		ui_history.clear();
-		ui_history.insert(ui_history.begin(), avg_size, 0.f);
-		plot_values.clear();
-		plot_values.insert(plot_values.begin(), 1000, 0.f);
+	if (force_recreate_swapchain_ || selected_emitter_type_ != active_emitter_type_) {
+		vulkan_backend_.clearGpuTimings();
+		rain_time.reset();
+		cpu_frame_time.reset();
+		frame_stats_.increment("Emitter changes");
 	} else {
-		compute_history[history_idx] = time_to_exec_compute;
-		scene_history[history_idx] = time_to_draw_geometry;
-		rain_history[history_idx] = time_to_draw_particles;
-		ui_history[history_idx] = time_to_draw_ui;
-
-		compute_avg = std::accumulate(compute_history.begin(), compute_history.end(), 0.f) / avg_size;
-		scene_avg = std::accumulate(scene_history.begin(), scene_history.end(), 0.f) / avg_size;
-		rain_avg = std::accumulate(rain_history.begin(), rain_history.end(), 0.f) / avg_size;
-		ui_avg = std::accumulate(ui_history.begin(), ui_history.end(), 0.f) / avg_size;
-
-		plot_values[plot_idx] = total_particles_time;
+		rain_time.addSample(compute_timing.last_ms + particles_timing.last_ms);
+		cpu_frame_time.addSample(ImGui::GetIO().DeltaTime * 1000.0f);
 	}
 
 	ImGui::Text("Frame time: %.3f ms/frame", 1000.0f / ImGui::GetIO().Framerate);
 	ImGui::Text("FPS: %.1f", ImGui::GetIO().Framerate);
 
+	auto memory_stats = vulkan_backend_.getMemoryStats();
+	ImGui::Text("Device memory: %.1f / %.1f MB (%u blocks)", memory_stats.bytes_used / (1024.f * 1024.f), memory_stats.bytes_reserved / (1024.f * 1024.f), memory_stats.blocks_count);
+
+	auto descriptor_stats = vulkan_backend_.getDescriptorStats();
+	ImGui::Text("Descriptor sets: %u in %u pools", descriptor_stats.sets_count, descriptor_stats.pools_count);
+	ImGui::Text("Scene surfaces: %u (%s)", scene_manager_->getDrawsCount(), scene_manager_->indirectDrawEnabled() ? "one indirect draw" : "one draw each");
+	if (scene_manager_->gpuCullingEnabled()) {
+		auto camera_culling = scene_manager_->getCullingStats();
+		auto shadow_culling = scene_manager_->getShadowCullingStats();
+		ImGui::Text("GPU culling: %u visible, %u culled", camera_culling.visible, camera_culling.culled);
+		ImGui::Text("Shadow map culling: %u visible, %u culled", shadow_culling.visible, shadow_culling.culled);
+	}
+	if (vulkan_backend_.bindlessTexturesEnabled()) {
+		ImGui::Text("Bindless textures: %u", vulkan_backend_.getBindlessTexturesCount());
+	}
+
+	if (vulkan_backend_.hasDedicatedComputeQueue()) {
+		ImGui::Text("Async compute overlap: %.4f ms", compute_overlap);
+	} else {
+		ImGui::Text("Async compute: not available, shares the graphics queue");
+	}
+
 	ImGui::Checkbox("Show Average", &show_average_stats_);
 	
 	ImGui::PushStyleColor(ImGuiCol_Text, ImVec4(0.8f, 0.35f, 0.35f, 1.0f));
 
 	if (show_average_stats_) {
-		ImGui::Text("Rain update time: %.4f ms", compute_avg);
-		ImGui::Text("Alley draw time: %.4f ms", scene_avg);
-		ImGui::Text("Rain draw time: %.4f ms", rain_avg);
-		ImGui::Text("UI draw time: %.4f ms", ui_avg);
+		ImGui::Text("Rain update time: %.4f ms", compute_timing.avg_ms);
+		ImGui::Text("Alley draw time: %.4f ms", geometry_timing.avg_ms);
+		if (scene_manager_->gpuCullingEnabled()) {
+			ImGui::Text("Alley culling time: %.4f ms", culling_timing.avg_ms);
+		}
+		ImGui::Text("Rain draw time: %.4f ms", particles_timing.avg_ms);
+		ImGui::Text("UI draw time: %.4f ms", ui_timing.avg_ms);
+		ImGui::Text("GPU frame time: %.4f ms", frame_timing.avg_ms);
 	} else {
-		ImGui::Text("Rain update time: %.4f ms", time_to_exec_compute);
-		ImGui::Text("Alley draw time: %.4f ms", time_to_draw_geometry);
-		ImGui::Text("Rain draw time: %.4f ms", time_to_draw_particles);
-		ImGui::Text("UI draw time: %.4f ms", time_to_draw_ui);
+		ImGui::Text("Rain update time: %.4f ms", compute_timing.last_ms);
+		ImGui::Text("Alley draw time: %.4f ms", geometry_timing.last_ms);
+		if (scene_manager_->gpuCullingEnabled()) {
+			ImGui::Text("Alley culling time: %.4f ms", culling_timing.last_ms);
+		}
+		ImGui::Text("Rain draw time: %.4f ms", particles_timing.last_ms);
+		ImGui::Text("UI draw time: %.4f ms", ui_timing.last_ms);
+		ImGui::Text("GPU frame time: %.4f ms", frame_timing.last_ms);
 	}
 
 	ImGui::PopStyleColor();
 
-	auto max_value = std::max_element(plot_values.begin(), plot_values.end());
-	auto overlay = std::to_string(*max_value);
+	if (particles_timing.has_statistics) {
+		const auto& draw_statistics = particles_timing.statistics;
+		auto pixels_count = static_cast<float>(extent.width) * extent.height;
+		ImGui::Text("Rain vertex invocations: %llu", static_cast<unsigned long long>(draw_statistics.vertex_shader_invocations));
+		if (active_emitter_type_ == GEOMETRY_SHADER) {
+			ImGui::Text("Rain geometry invocations: %llu", static_cast<unsigned long long>(draw_statistics.geometry_shader_invocations));
+			ImGui::Text("Rain geometry primitives: %llu", static_cast<unsigned long long>(draw_statistics.geometry_shader_primitives));
+		}
+		ImGui::Text("Rain primitives after clipping: %llu", static_cast<unsigned long long>(draw_statistics.clipping_primitives));
+		ImGui::Text("Rain fragment invocations: %llu", static_cast<unsigned long long>(draw_statistics.fragment_shader_invocations));
+		ImGui::Text("Rain overdraw: %.3f fragments / pixel", draw_statistics.fragment_shader_invocations / pixels_count);
+	}
+	if (compute_timing.has_statistics) {
+		ImGui::Text("Rain compute invocations: %llu", static_cast<unsigned long long>(compute_timing.statistics.compute_shader_invocations));
+	}
+
+	ImGui::Text("CPU frame time p50 / p95 / p99: %.3f / %.3f / %.3f ms", cpu_frame_time.p50(), cpu_frame_time.p95(), cpu_frame_time.p99());
+	ImGui::Text("Rain time p50 / p95 / p99: %.4f / %.4f / %.4f ms", rain_time.p50(), rain_time.p95(), rain_time.p99());
+	ImGui::Text("Rain time std dev: %.4f ms", rain_time.stddev());
+	ImGui::Text("Emitter changes: %llu", static_cast<unsigned long long>(frame_stats_.counter("Emitter changes")));
 
 	ImGui::Text("Total Rain Frame Time:");
-	ImGui::PlotLines("##Total Rain Update Time", plot_values.data(), 1000, 0, overlay.c_str(), 0.f, (*max_value) + (*max_value) * 0.2f);
+	rain_time.plot("##Total Rain Update Time");
 
 	ImGui::End();
 
 	imgui_renderer_->endFrame();
 }
 
+bool RainyAlley::isEmitterSupported(EmitterType type) const {
+	switch (type) {
+		case GEOMETRY_SHADER:
+			return vulkan_backend_.geometryShaderSupported();
+		case MESH:
+			return vulkan_backend_.meshShaderSupported();
+		default:
+			return true;
+	}
+}
+
+std::shared_ptr<ParticleEmitterBase> RainyAlley::createEmitter(EmitterType type, const ParticleEmitterConfig& config) {
+	switch (type) {
+		case GEOMETRY_SHADER:
+			return RainEmitterGS::createParticleEmitter(config, &vulkan_backend_);
+		case PRIMITIVE_RESTART:
+			return RainEmitterPR::createParticleEmitter(config, &vulkan_backend_);
+		case INSTANCING:
+			return RainEmitterInst::createParticleEmitter(config, &vulkan_backend_);
+		case MESH:
+			return RainEmitterMesh::createParticleEmitter(config, &vulkan_backend_);
+		default:
+			return nullptr;
+	}
+}
+
+void RainyAlley::updateBenchmark() {
+	auto time_now = std::chrono::steady_clock::now();
+	auto cpu_ms = std::chrono::duration_cast<std::chrono::microseconds>(time_now - benchmark_last_update_).count() * 1e-3f;
+	benchmark_last_update_ = time_now;
+
+	auto& run = benchmark_runs_[benchmark_run_];
+
+	// only the samples collected since the previous frame, a scope that wasn't read back keeps its last one.
+	// followed through the warm-up too, so that the first measured frame doesn't pick up an old sample
+	const auto& gpu_timings = vulkan_backend_.getGpuTimings();
+	auto new_sample_ms = [this, &gpu_timings](const std::string& scope) {
+		auto iter = gpu_timings.find(scope);
+		if (iter == gpu_timings.end()) {
+			return -1.f;
+		}
+		auto& seen = benchmark_samples_seen_[scope];
+		auto is_new = iter->second.samples_count != seen;
+		seen = iter->second.samples_count;
+		return is_new ? iter->second.last_ms : -1.f;
+	};
+
+	BenchmarkFrame frame;
+	frame.cpu_ms = cpu_ms;
+	frame.gpu_frame_ms = new_sample_ms("Frame");
+	frame.gpu_update_ms = new_sample_ms(rain_drops_emitter_->getUpdateScopeName());
+	frame.gpu_draw_ms = new_sample_ms(rain_drops_emitter_->getDrawScopeName());
+
+	// the previous iteration is over, its GPU timings are a few frames behind but the warm-up is longer than that
+	if (benchmark_frame_ > benchmark_warmup_frames_) {
+		run.frames.push_back(frame);
+	}
+
+	if (run.frames.size() >= benchmark_measured_frames_) {
+		std::cout << "[Benchmark] " << kEmitterTypes[run.emitter_type] << ", " << run.particles_count << " particles: done" << std::endl;
+
+		benchmark_frame_ = 0;
+		if (++benchmark_run_ == benchmark_runs_.size()) {
+			writeBenchmarkResults();
+			requestQuit();
+			return;
+		}
+
+		// rebuilds the emitter with the new particle count, the same way the options window does
+		selected_emitter_type_ = benchmark_runs_[benchmark_run_].emitter_type;
+		number_of_particles_ = benchmark_runs_[benchmark_run_].particles_count;
+		force_recreate_swapchain_ = true;
+	}
+
+	// fixed camera path, restarted with every run
+	auto t = benchmark_frame_ * kBenchmarkDeltaTime;
+	scene_manager_->setCameraPosition(glm::vec3(-10.0f + 1.5f * std::sin(0.4f * t), 2.0f * std::sin(0.25f * t), 4.0f + 0.5f * std::sin(0.3f * t)));
+	++benchmark_frame_;
+}
+
+namespace {
+	// nearest rank, samples < 0 were not available and are left out
+	std::array<float, 4> benchmarkPercentiles(const std::vector<float>& samples) {
+		std::vector<float> valid;
+		for (auto sample : samples) {
+			if (sample >= 0.f) {
+				valid.push_back(sample);
+			}
+		}
+		if (valid.empty()) {
+			return { -1.f, -1.f, -1.f, -1.f };
+		}
+
+		std::sort(valid.begin(), valid.end());
+		auto rank = [&valid](float p) {
+			auto index = static_cast<size_t>(std::ceil(p * valid.size()));
+			return valid[std::min(std::max(index, size_t(1)), valid.size()) - 1];
+		};
+		auto mean = std::accumulate(valid.begin(), valid.end(), 0.0) / valid.size();
+		return { static_cast<float>(mean), rank(0.5f), rank(0.95f), rank(0.99f) };
+	}
+
+	void writeBenchmarkValue(std::ostream& out, float value) {
+		if (value < 0.f) {
+			out << "null";
+		} else {
+			out << value;
+		}
+	}
+}
+
+bool RainyAlley::writeBenchmarkResults() const {
+	std::ofstream out(benchmark_output_, std::ios::out | std::ios::trunc);
+	if (!out.is_open()) {
+		std::cerr << "Failed to open " << benchmark_output_ << " to write the benchmark results!" << std::endl;
+		return false;
+	}
+
+	out << std::fixed << std::setprecision(4);
+	out << "{\n";
+	out << "\t\"device\": \"" << escapeJson(vulkan_backend_.getDeviceName()) << "\",\n";
+	out << "\t\"headless\": " << (headless_ ? "true" : "false") << ",\n";
+	out << "\t\"extent\": [" << vulkan_backend_.getSwapChainExtent().width << ", " << vulkan_backend_.getSwapChainExtent().height << "],\n";
+	out << "\t\"frames_in_flight\": " << vulkan_backend_.getFramesInFlight() << ",\n";
+	out << "\t\"delta_time_s\": " << kBenchmarkDeltaTime << ",\n";
+	out << "\t\"warmup_frames\": " << benchmark_warmup_frames_ << ",\n";
+	out << "\t\"measured_frames\": " << benchmark_measured_frames_ << ",\n";
+	out << "\t\"runs\": [";
+
+	std::cout << std::endl << "[Benchmark] emitter, particles: cpu / gpu frame / gpu update / gpu draw ms (p50, p95, p99)" << std::endl;
+
+	for (size_t r = 0; r < benchmark_runs_.size(); ++r) {
+		const auto& run = benchmark_runs_[r];
+		const std::pair<const char*, float BenchmarkFrame::*> metrics[] = {
+			{ "cpu_ms", &BenchmarkFrame::cpu_ms },
+			{ "gpu_frame_ms", &BenchmarkFrame::gpu_frame_ms },
+			{ "gpu_update_ms", &BenchmarkFrame::gpu_update_ms },
+			{ "gpu_draw_ms", &BenchmarkFrame::gpu_draw_ms },
+		};
+
+		out << (r == 0 ? "\n" : ",\n");
+		out << "\t\t{\n";
+		out << "\t\t\t\"emitter\": \"" << kEmitterTypes[run.emitter_type] << "\",\n";
+		out << "\t\t\t\"particles\": " << run.particles_count << ",\n";
+
+		std::ostringstream summary;
+		summary << std::fixed << std::setprecision(3) << "[Benchmark] " << kEmitterTypes[run.emitter_type] << ", " << run.particles_count << ":";
+
+		for (const auto& metric : metrics) {
+			std::vector<float> samples;
+			for (const auto& frame : run.frames) {
+				samples.push_back(frame.*metric.second);
+			}
+			auto percentiles = benchmarkPercentiles(samples);
+
+			out << "\t\t\t\"" << metric.first << "\": { \"mean\": ";
+			writeBenchmarkValue(out, percentiles[0]);
+			out << ", \"p50\": ";
+			writeBenchmarkValue(out, percentiles[1]);
+			out << ", \"p95\": ";
+			writeBenchmarkValue(out, percentiles[2]);
+			out << ", \"p99\": ";
+			writeBenchmarkValue(out, percentiles[3]);
+			out << ", \"frames\": [";
+			for (size_t f = 0; f < samples.size(); ++f) {
+				out << (f == 0 ? "" : ", ");
+				writeBenchmarkValue(out, samples[f]);
+			}
+			out << "] }" << (metric.second == &BenchmarkFrame::gpu_draw_ms ? "\n" : ",\n");
+
+			summary << " " << percentiles[1] << ", " << percentiles[2] << ", " << percentiles[3] << " |";
+		}
+
+		out << "\t\t}";
+		std::cout << summary.str() << std::endl;
+	}
+
+	out << "\n\t]\n}\n";
+	out.close();
+
+	std::cout << "[Benchmark] results written to " << benchmark_output_ << std::endl;
+	return true;
+}
+
 // Entry point
 
+namespace {
+	// the whole argument must be a number no smaller than min_value, anything else is a usage error
+	template<typename T>
+	bool parseNumber(const std::string& option, const std::string& text, T& value, T min_value = 0) {
+		const char* end = text.data() + text.size();
+		auto result = std::from_chars(text.data(), end, value);
+		if (result.ec != std::errc() || result.ptr != end || text[0] == '-') {
+			std::cerr << "Invalid value for " << option << ": " << text << ", expected an unsigned integer" << std::endl;
+			return false;
+		}
+		if (value < min_value) {
+			std::cerr << "Invalid value for " << option << ": " << text << ", expected at least " << min_value << std::endl;
+			return false;
+		}
+		return true;
+	}
+}
+
 int main(int argc, char** argv) {
 	RainyAlley app;
-	if (!app.setup()) {
+	std::string benchmark_output;
+	std::vector<int> benchmark_particles = { 1000, 10000, 50000, 100000, 250000 };
+	uint32_t benchmark_warmup = 60;
+	uint32_t benchmark_frames = 240;
+	for (int i = 1; i < argc; ++i) {
+		std::string arg = argv[i];
+		if (arg == "--precompile-emitters") {
+			app.setPrecompileEmitters(true);
+		} else if (arg == "--benchmark" && i + 1 < argc) {
+			benchmark_output = argv[++i];
+		} else if (arg == "--benchmark-particles" && i + 1 < argc) {
+			// comma separated list
+			benchmark_particles.clear();
+			std::stringstream counts(argv[++i]);
+			std::string count;
+			while (std::getline(counts, count, ',')) {
+				int particles_count = 0;
+				if (!parseNumber(arg, count, particles_count, 1)) {
+					return -1;
+				}
+				benchmark_particles.push_back(particles_count);
+			}
+		} else if (arg == "--benchmark-warmup" && i + 1 < argc) {
+			if (!parseNumber(arg, argv[++i], benchmark_warmup)) {
+				return -1;
+			}
+		} else if (arg == "--benchmark-frames" && i + 1 < argc) {
+			if (!parseNumber(arg, argv[++i], benchmark_frames, 1u)) {
+				return -1;
+			}
+		}
+	}
+	if (!benchmark_output.empty()) {
+		app.setBenchmark(benchmark_output, benchmark_particles, benchmark_warmup, benchmark_frames);
+	}
+	if (!app.setup(argc, argv)) {
 		return -1;
 	}
 	if (!app.run()) {
@@ -6,12 +6,19 @@ glslc $ROOT_PATH/shaders/imgui.vert -o $ROOT_PATH/shaders/imgui_vs.spv
 glslc $ROOT_PATH/shaders/imgui.frag -o $ROOT_PATH/shaders/imgui_fs.spv
 
 glslc $ROOT_PATH/shaders/shadow_map.vert -o $ROOT_PATH/shaders/shadow_map_vs.spv
+glslc -DINDIRECT_DRAW $ROOT_PATH/shaders/shadow_map.vert -o $ROOT_PATH/shaders/shadow_map_indirect_vs.spv
 
 glslc $ROOT_PATH/shaders/model_viewer.vert -o $ROOT_PATH/shaders/model_viewer_vs.spv
 glslc $ROOT_PATH/shaders/model_viewer.frag -o $ROOT_PATH/shaders/model_viewer_fs.spv
+glslc -DBINDLESS_TEXTURES $ROOT_PATH/shaders/model_viewer.frag -o $ROOT_PATH/shaders/model_viewer_bindless_fs.spv
+glslc -DINDIRECT_DRAW $ROOT_PATH/shaders/model_viewer.vert -o $ROOT_PATH/shaders/model_viewer_indirect_vs.spv
+glslc -DINDIRECT_DRAW -DBINDLESS_TEXTURES $ROOT_PATH/shaders/model_viewer.frag -o $ROOT_PATH/shaders/model_viewer_indirect_fs.spv
 
 glslc $ROOT_PATH/shaders/alley.vert -o $ROOT_PATH/shaders/alley_vs.spv
 glslc $ROOT_PATH/shaders/alley.frag -o $ROOT_PATH/shaders/alley_fs.spv
+glslc -DBINDLESS_TEXTURES $ROOT_PATH/shaders/alley.frag -o $ROOT_PATH/shaders/alley_bindless_fs.spv
+glslc -DINDIRECT_DRAW $ROOT_PATH/shaders/alley.vert -o $ROOT_PATH/shaders/alley_indirect_vs.spv
+glslc -DINDIRECT_DRAW -DBINDLESS_TEXTURES $ROOT_PATH/shaders/alley.frag -o $ROOT_PATH/shaders/alley_indirect_fs.spv
 glslc $ROOT_PATH/shaders/rain_drops_geom.vert -o $ROOT_PATH/shaders/rain_drops_geom_vs.spv
 glslc $ROOT_PATH/shaders/rain_drops_geom.geom -o $ROOT_PATH/shaders/rain_drops_geom_gm.spv
 glslc $ROOT_PATH/shaders/rain_drops_pr.vert -o $ROOT_PATH/shaders/rain_drops_pr_vs.spv
@@ -21,6 +28,7 @@ glslc $ROOT_PATH/shaders/rain_drops_pr.frag -o $ROOT_PATH/shaders/rain_drops_pr_
 glslc $ROOT_PATH/shaders/rain_drops_inst.frag -o $ROOT_PATH/shaders/rain_drops_inst_fs.spv
 glslc $ROOT_PATH/shaders/rainfall_geom.comp -o $ROOT_PATH/shaders/rainfall_geom_cp.spv
 glslc $ROOT_PATH/shaders/rainfall_pr.comp -o $ROOT_PATH/shaders/rainfall_pr_cp.spv
+glslc $ROOT_PATH/shaders/scene_culling.comp -o $ROOT_PATH/shaders/scene_culling_cp.spv
 
 # glslc doesn't support mesh shaders yet
 glslangValidator -V $ROOT_PATH/shaders/rain_drops_mesh.mesh -o $ROOT_PATH/shaders/rain_drops_mesh_ms.spv
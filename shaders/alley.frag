@@ -1,5 +1,8 @@
 #version 450
 #extension GL_ARB_separate_shader_objects : enable
+#ifdef BINDLESS_TEXTURES
+#extension GL_EXT_nonuniform_qualifier : require
+#endif
 #extension GL_GOOGLE_include_directive : enable
 #include "common.glsl"
 #include "lighting.glsl"
@@ -13,8 +16,41 @@ layout(location = 5) in vec4 light_intensity;
 layout(location = 6) in vec4 ambient_intensity;
 layout(location = 7) in vec3 shadow_tex_coord;
 
+#ifdef BINDLESS_TEXTURES
+layout(set = 4, binding = 0) uniform sampler2D bindless_textures[];
+#ifdef INDIRECT_DRAW
+// one draw covers every surface, so the material can change within a subgroup
+#define material_texture(idx) bindless_textures[nonuniformEXT(idx)]
+#else
+// material indices are the same for the whole draw, so they don't need nonuniformEXT
+#define material_texture(idx) bindless_textures[idx]
+#endif
+#else
 layout(set = 0, binding = 1) uniform sampler2D scene_textures[18];
+#define material_texture(idx) scene_textures[idx]
+#endif
 
+#ifdef INDIRECT_DRAW
+// all the scene materials, indexed by the draw (requires BINDLESS_TEXTURES)
+layout(location = 8) flat in uint material_idx;
+
+struct MaterialData {
+    vec3 emissive_factor;
+    float metallic_factor;
+    float roughness_factor;
+
+    int diffuse_idx;
+    int metal_rough_idx;
+    int normal_idx;
+    int emissive_idx;
+};
+
+layout(std430, set = 2, binding = 0) readonly buffer Materials {
+    MaterialData items[];
+} materials;
+
+#define material materials.items[material_idx]
+#else
 layout(set = 2, binding = 0) uniform MaterialData {
     vec3 emissive_factor;
     float metallic_factor;
@@ -25,6 +61,7 @@ layout(set = 2, binding = 0) uniform MaterialData {
     int normal_idx;
     int emissive_idx;
 } material;
+#endif
 
 layout(set = 0, binding = 2, rgba32f) uniform image2D scene_depth_buffer;
 layout(set = 3, binding = 1) uniform sampler2D shadow_map;
@@ -32,19 +69,19 @@ layout(set = 3, binding = 1) uniform sampler2D shadow_map;
 layout(location = 0) out vec4 out_colour;
 
 vec4 emissive_surface() {
-    vec4 emissive_colour = texture(scene_textures[material.emissive_idx], frag_tex_coord);
+    vec4 emissive_colour = texture(material_texture(material.emissive_idx), frag_tex_coord);
     return vec4(emissive_colour.rgb * material.emissive_factor, 1.0);
 }
 
 vec4 lit_surface() {
-    vec4 diffuse_colour = texture(scene_textures[material.diffuse_idx], frag_tex_coord);
-    vec4 normal_map = texture(scene_textures[material.normal_idx], frag_tex_coord);
+    vec4 diffuse_colour = texture(material_texture(material.diffuse_idx), frag_tex_coord);
+    vec4 normal_map = texture(material_texture(material.normal_idx), frag_tex_coord);
     vec3 normal = normalize(normal_map.xyz * 2.0 - 1.0);
 
     float metalness;
     float roughness;
     if (material.roughness_factor < 0.0) {
-        vec4 metal_rough = texture(scene_textures[material.metal_rough_idx], frag_tex_coord);
+        vec4 metal_rough = texture(material_texture(material.metal_rough_idx), frag_tex_coord);
         metalness = metal_rough.b;
         roughness = metal_rough.g;
     } else {
@@ -25,9 +25,27 @@ layout(set = 0, binding = 0) uniform SceneData {
     vec4 ambient_intensity;
 } scene;
 
+#ifdef INDIRECT_DRAW
+// the whole scene is one indirect draw. every surface is drawn as one instance, with firstInstance set to its index in draws
+struct DrawData {
+    uint transform_idx;
+    uint material_idx;
+};
+
+layout(std430, set = 1, binding = 0) readonly buffer Draws {
+    DrawData items[];
+} draws;
+
+layout(std430, set = 1, binding = 1) readonly buffer Transforms {
+    mat4 items[];
+} transforms;
+
+layout(location = 8) flat out uint material_idx;
+#else
 layout(set = 1, binding = 0) uniform ModelData {
     mat4 transform;
 } model;
+#endif
 
 layout(set = 3, binding = 0) uniform ShadowMapData {
     mat4 view;
@@ -36,7 +54,14 @@ layout(set = 3, binding = 0) uniform ShadowMapData {
 
 
 void main() {
-    mat4 model_view = scene.view * model.transform;
+#ifdef INDIRECT_DRAW
+    DrawData draw = draws.items[gl_InstanceIndex];
+    mat4 model_transform = transforms.items[draw.transform_idx];
+    material_idx = draw.material_idx;
+#else
+    mat4 model_transform = model.transform;
+#endif
+    mat4 model_view = scene.view * model_transform;
     mat4 proj = scene.proj;
     worldToVulkan(model_view);
     projectionToVulkan(proj);
@@ -63,7 +88,7 @@ void main() {
     normal_world = in_normal;   
 
     // finally, calculate the vertex position in light space for shadow map lookup
-    mat4 light_model_view = shadow_map_data.view * model.transform;
+    mat4 light_model_view = shadow_map_data.view * model_transform;
     mat4 light_proj = shadow_map_data.proj;
     worldToVulkan(light_model_view);
     projectionToVulkan(light_proj);
@@ -1,10 +1,46 @@
 #version 450
 #extension GL_ARB_separate_shader_objects : enable
+#ifdef BINDLESS_TEXTURES
+#extension GL_EXT_nonuniform_qualifier : require
+#endif
 
 layout(location = 0) in vec2 frag_tex_coord;
 
+#ifdef BINDLESS_TEXTURES
+layout(set = 4, binding = 0) uniform sampler2D bindless_textures[];
+#ifdef INDIRECT_DRAW
+// one draw covers every surface, so the material can change within a subgroup
+#define material_texture(idx) bindless_textures[nonuniformEXT(idx)]
+#else
+// material indices are the same for the whole draw, so they don't need nonuniformEXT
+#define material_texture(idx) bindless_textures[idx]
+#endif
+#else
 layout(set = 0, binding = 1) uniform sampler2D scene_textures[1];
+#define material_texture(idx) scene_textures[idx]
+#endif
 
+#ifdef INDIRECT_DRAW
+// all the scene materials, indexed by the draw (requires BINDLESS_TEXTURES)
+layout(location = 1) flat in uint material_idx;
+
+struct MaterialData {
+    vec3 emissive_factor;
+    float metallic_factor;
+    float roughness_factor;
+
+    int diffuse_idx;
+    int metal_rough_idx;
+    int normal_idx;
+    int emissive_idx;
+};
+
+layout(std430, set = 2, binding = 0) readonly buffer Materials {
+    MaterialData items[];
+} materials;
+
+#define material materials.items[material_idx]
+#else
 layout(set = 2, binding = 0) uniform MaterialData {
     vec3 emissive_factor;
     float metallic_factor;
@@ -15,12 +51,13 @@ layout(set = 2, binding = 0) uniform MaterialData {
     int normal_idx;
     int emissive_idx;
 } material;
+#endif
 
 
 layout(location = 0) out vec4 out_color;
 
 void main() {
-    out_color = texture(scene_textures[material.diffuse_idx], frag_tex_coord);
+    out_color = texture(material_texture(material.diffuse_idx), frag_tex_coord);
     // fix texture color space
     out_color = vec4(pow(out_color.xyz, vec3(2.2)), out_color.w);
 }
@@ -18,12 +18,37 @@ layout(set = 0, binding = 0) uniform SceneData {
     vec4 ambient_intensity; // unused
 } scene;
 
+#ifdef INDIRECT_DRAW
+// the whole scene is one indirect draw. every surface is drawn as one instance, with firstInstance set to its index in draws
+struct DrawData {
+    uint transform_idx;
+    uint material_idx;
+};
+
+layout(std430, set = 1, binding = 0) readonly buffer Draws {
+    DrawData items[];
+} draws;
+
+layout(std430, set = 1, binding = 1) readonly buffer Transforms {
+    mat4 items[];
+} transforms;
+
+layout(location = 1) flat out uint material_idx;
+#else
 layout(set = 1, binding = 0) uniform ModelData {
     mat4 transform;
 } model;
+#endif
 
 void main() {
-    mat4 model_view = scene.view * model.transform;
+#ifdef INDIRECT_DRAW
+    DrawData draw = draws.items[gl_InstanceIndex];
+    mat4 model_transform = transforms.items[draw.transform_idx];
+    material_idx = draw.material_idx;
+#else
+    mat4 model_transform = model.transform;
+#endif
+    mat4 model_view = scene.view * model_transform;
     mat4 proj = scene.proj;
     worldToVulkan(model_view);
     projectionToVulkan(proj);
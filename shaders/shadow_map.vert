@@ -13,12 +13,34 @@ layout(set = 0, binding = 0) uniform ShadowMapData {
     mat4 proj;
 } shadow;
 
+#ifdef INDIRECT_DRAW
+// the whole scene is one indirect draw. every surface is drawn as one instance, with firstInstance set to its index in draws
+struct DrawData {
+    uint transform_idx;
+    uint material_idx;
+};
+
+layout(std430, set = 1, binding = 0) readonly buffer Draws {
+    DrawData items[];
+} draws;
+
+layout(std430, set = 1, binding = 1) readonly buffer Transforms {
+    mat4 items[];
+} transforms;
+#else
 layout(set = 1, binding = 0) uniform ModelData {
     mat4 transform;
 } model;
+#endif
 
 void main() {
-    mat4 model_view = shadow.view * model.transform;
+#ifdef INDIRECT_DRAW
+    DrawData draw = draws.items[gl_InstanceIndex];
+    mat4 model_transform = transforms.items[draw.transform_idx];
+#else
+    mat4 model_transform = model.transform;
+#endif
+    mat4 model_view = shadow.view * model_transform;
     mat4 proj = shadow.proj;
     worldToVulkan(model_view);
     projectionToVulkan(proj);
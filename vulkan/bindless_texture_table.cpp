@@ -0,0 +1,118 @@
+/*
+* bindless_texture_table.cpp
+*
+* Copyright (C) 2021 Riccardo Marson
+*/
+
+#include "bindless_texture_table.hpp"
+
+BindlessTextureTable::BindlessTextureTable(VkDevice device, uint32_t capacity) :
+    device_(device),
+    capacity_(capacity) {
+
+    VkDescriptorSetLayoutBinding binding{};
+    binding.binding = 0;
+    binding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    binding.descriptorCount = capacity_;
+    binding.stageFlags = VK_SHADER_STAGE_ALL_GRAPHICS | VK_SHADER_STAGE_COMPUTE_BIT;
+
+    VkDescriptorBindingFlags binding_flags = VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT |
+        VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT |
+        VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT;
+
+    VkDescriptorSetLayoutBindingFlagsCreateInfo binding_flags_info{};
+    binding_flags_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO;
+    binding_flags_info.bindingCount = 1;
+    binding_flags_info.pBindingFlags = &binding_flags;
+
+    VkDescriptorSetLayoutCreateInfo layout_info{};
+    layout_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layout_info.pNext = &binding_flags_info;
+    layout_info.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT;
+    layout_info.bindingCount = 1;
+    layout_info.pBindings = &binding;
+
+    if (vkCreateDescriptorSetLayout(device_, &layout_info, nullptr, &vk_layout_) != VK_SUCCESS) {
+        std::cerr << "Failed to create bindless textures descriptor set layout!" << std::endl;
+        return;
+    }
+
+    VkDescriptorPoolSize pool_size{};
+    pool_size.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    pool_size.descriptorCount = capacity_;
+
+    VkDescriptorPoolCreateInfo pool_info{};
+    pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    pool_info.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT;
+    pool_info.maxSets = 1;
+    pool_info.poolSizeCount = 1;
+    pool_info.pPoolSizes = &pool_size;
+
+    if (vkCreateDescriptorPool(device_, &pool_info, nullptr, &vk_pool_) != VK_SUCCESS) {
+        std::cerr << "Failed to create bindless textures descriptor pool!" << std::endl;
+        return;
+    }
+
+    VkDescriptorSetAllocateInfo alloc_info{};
+    alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    alloc_info.descriptorPool = vk_pool_;
+    alloc_info.descriptorSetCount = 1;
+    alloc_info.pSetLayouts = &vk_layout_;
+
+    if (vkAllocateDescriptorSets(device_, &alloc_info, &vk_descriptor_set_) != VK_SUCCESS) {
+        std::cerr << "Failed to allocate bindless textures descriptor set!" << std::endl;
+        vk_descriptor_set_ = VK_NULL_HANDLE;
+    }
+}
+
+BindlessTextureTable::~BindlessTextureTable() {
+    if (vk_pool_ != VK_NULL_HANDLE) {
+        vkDestroyDescriptorPool(device_, vk_pool_, nullptr);  // frees the set too
+    }
+    if (vk_layout_ != VK_NULL_HANDLE) {
+        vkDestroyDescriptorSetLayout(device_, vk_layout_, nullptr);
+    }
+}
+
+uint32_t BindlessTextureTable::add(VkImageView image_view, VkSampler sampler, VkImageLayout image_layout) {
+    if (!isValid()) {
+        return INVALID_BINDLESS_INDEX;
+    }
+
+    uint32_t index;
+    if (!free_slots_.empty()) {
+        index = free_slots_.back();
+        free_slots_.pop_back();
+    } else if (next_slot_ < capacity_) {
+        index = next_slot_++;
+    } else {
+        std::cerr << "Bindless textures table is full (" << capacity_ << " textures)!" << std::endl;
+        return INVALID_BINDLESS_INDEX;
+    }
+
+    VkDescriptorImageInfo image_info{};
+    image_info.imageLayout = image_layout;
+    image_info.imageView = image_view;
+    image_info.sampler = sampler;
+
+    VkWriteDescriptorSet descriptor_write{};
+    descriptor_write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    descriptor_write.dstSet = vk_descriptor_set_;
+    descriptor_write.dstBinding = 0;
+    descriptor_write.dstArrayElement = index;
+    descriptor_write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    descriptor_write.descriptorCount = 1;
+    descriptor_write.pImageInfo = &image_info;
+
+    vkUpdateDescriptorSets(device_, 1, &descriptor_write, 0, nullptr);
+
+    return index;
+}
+
+void BindlessTextureTable::release(uint32_t index) {
+    // the stale descriptor stays in the slot until it is reused, partially bound sets allow that as long as
+    // nothing reads it
+    if (index < next_slot_) {
+        free_slots_.push_back(index);
+    }
+}
@@ -0,0 +1,40 @@
+/*
+* bindless_texture_table.hpp
+*
+* Copyright (C) 2021 Riccardo Marson
+*/
+
+#pragma once
+
+#include "common_definitions.hpp"
+
+// One large array of combined image samplers (descriptor indexing), bound once at BINDLESS_TEXTURES_SET_ID and
+// shared by every pipeline that samples textures by index. The binding is partially bound and update-after-bind,
+// so slots can be filled while the set is in use by frames in flight, as long as those frames don't read them.
+// A slot keeps its index for as long as the texture lives, released slots are reused by later textures.
+class BindlessTextureTable {
+public:
+    BindlessTextureTable(VkDevice device, uint32_t capacity);
+    ~BindlessTextureTable();
+
+    bool isValid() const { return vk_descriptor_set_ != VK_NULL_HANDLE; }
+    VkDescriptorSetLayout layout() const { return vk_layout_; }
+    VkDescriptorSet descriptorSet() const { return vk_descriptor_set_; }
+
+    uint32_t getCapacity() const { return capacity_; }
+    uint32_t getTexturesCount() const { return next_slot_ - static_cast<uint32_t>(free_slots_.size()); }
+
+    // returns INVALID_BINDLESS_INDEX when the table is full
+    uint32_t add(VkImageView image_view, VkSampler sampler, VkImageLayout image_layout);
+    void release(uint32_t index);  // the caller makes sure no frame in flight still samples it
+
+private:
+    VkDevice device_;
+    uint32_t capacity_;
+    VkDescriptorSetLayout vk_layout_ = VK_NULL_HANDLE;
+    VkDescriptorPool vk_pool_ = VK_NULL_HANDLE;
+    VkDescriptorSet vk_descriptor_set_ = VK_NULL_HANDLE;
+
+    uint32_t next_slot_ = 0;  // slots past this one have never been used
+    std::vector<uint32_t> free_slots_;
+};
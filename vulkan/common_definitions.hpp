@@ -31,6 +31,18 @@
 using VertexFormatInfo = std::pair<size_t, std::vector<size_t>>;
 class Texture;
 
+// handle to a range of device memory sub-allocated from one of the MemoryAllocator blocks
+struct MemoryAllocation {
+    VkDeviceMemory vk_memory = VK_NULL_HANDLE;  // the block this allocation lives in (shared with other allocations)
+    VkDeviceSize offset = 0;
+    VkDeviceSize size = 0;
+    uint32_t memory_type = 0;
+    uint32_t block_id = 0;
+    void* mapped_data = nullptr;  // only set for host visible memory, already offset to the start of the allocation
+
+    bool isValid() const { return vk_memory != VK_NULL_HANDLE; }
+};
+
 struct Buffer {
     std::string name;
     bool host_visible = false;
@@ -38,10 +50,18 @@ struct Buffer {
 
     VkBufferUsageFlags type = VK_BUFFER_USAGE_FLAG_BITS_MAX_ENUM;
     VkBuffer vk_buffer = VK_NULL_HANDLE;
-    VkDeviceMemory vk_buffer_memory = VK_NULL_HANDLE;
+    MemoryAllocation memory;
     VkBufferView vk_buffer_view = VK_NULL_HANDLE; // optional
 };
 
+// a slice of the per-frame UniformRing. dynamic_offset is passed to vkCmdBindDescriptorSets for dynamic uniform bindings
+struct UniformAllocation {
+    VkBuffer vk_buffer = VK_NULL_HANDLE;
+    uint32_t dynamic_offset = 0;
+
+    bool isValid() const { return vk_buffer != VK_NULL_HANDLE; }
+};
+
 struct UniformBuffer {
     std::string name;
     size_t buffer_size = 0;
@@ -65,30 +85,6 @@ struct Material {
     UniformBuffer material_uniform;
 };
 
-struct DescriptorPoolConfig {
-    uint32_t uniform_buffers_count = 0;
-    uint32_t image_samplers_count = 0;
-    uint32_t storage_texel_buffers_count = 0;
-    uint32_t image_storage_buffers_count = 0;
-    uint32_t max_sets = 0;
-
-    DescriptorPoolConfig& operator +(const DescriptorPoolConfig& other) {
-        uniform_buffers_count += other.uniform_buffers_count;
-        image_samplers_count += other.image_samplers_count;
-        storage_texel_buffers_count += other.storage_texel_buffers_count;
-        image_storage_buffers_count += other.image_storage_buffers_count;
-        return *this;
-    }
-
-    DescriptorPoolConfig& operator *(uint32_t multiplier) {
-        uniform_buffers_count *= multiplier;
-        image_samplers_count *= multiplier;
-        storage_texel_buffers_count *= multiplier;
-        image_storage_buffers_count *= multiplier;
-        return *this;
-    }
-};
-
 struct SwapChainSupportDetails {
     VkSurfaceCapabilitiesKHR capabilities{};
     std::vector<VkSurfaceFormatKHR> formats;
@@ -102,8 +98,8 @@ inline RecordCommandsResult makeRecordCommandsResult(bool success, std::vector<V
 
 struct ProfileConfig {
 	bool profile_draw = false;
-	uint32_t start_query_num = 0;
-	uint32_t stop_query_num = 0;
+	std::string scope_name;  // GPU profiler scope around the draw commands
+	bool pipeline_statistics = false;  // graphics pipeline statistics for the scope, if enabled in the profiler
 };
 
 // shader interfaces
@@ -175,13 +171,51 @@ const std::string MODEL_DATA_BINDING_NAME = "model";  // holds model-specific nu
 const uint32_t SURFACE_UNIFORM_SET_ID = 2;  // all samplers that apply to one surface (one object can have multiple surfaces)
 const std::string SURFACE_MATERIAL_BINDING_NAME = "material";
 
+// indirect draws of the static scene: one VkDrawIndexedIndirectCommand per surface, drawn as a single instance whose
+// firstInstance is the index of its DrawData. the *_indirect shader variants replace the per-mesh and per-surface
+// uniforms with these storage buffers, in the same sets
+struct DrawData {
+    uint32_t transform_idx = 0;
+    uint32_t material_idx = 0;
+};
+
+const std::string DRAW_DATA_BINDING_NAME = "draws";  // MODEL_UNIFORM_SET_ID
+const std::string MODEL_TRANSFORMS_BINDING_NAME = "transforms";  // MODEL_UNIFORM_SET_ID, every mesh transform for this frame
+const std::string MATERIALS_BINDING_NAME = "materials";  // SURFACE_UNIFORM_SET_ID
+
+// GPU culling of the indirect draws: each surface bounding sphere is tested against the frustum planes and the
+// commands that survive are compacted into a list drawn with vkCmdDrawIndexedIndirectCount
+struct CullingData {
+    glm::vec4 frustum_planes[6];  // xyz inward normal, w distance. world space
+    uint32_t draws_count = 0;
+}; // push constant
+const std::string CULLING_DATA_PC = "CullingData";
+
+struct DrawCount {
+    uint32_t visible = 0;  // the draw count, read by vkCmdDrawIndexedIndirectCount
+    uint32_t culled = 0;
+};
+
+const uint32_t CULLING_INPUT_SET_ID = 0;  // the draws (DRAW_DATA_BINDING_NAME) and transforms (MODEL_TRANSFORMS_BINDING_NAME) are also in this set
+const std::string DRAW_BOUNDS_BINDING_NAME = "draw_bounds";  // local space bounding sphere per surface, xyz centre and w radius
+const std::string INPUT_COMMANDS_BINDING_NAME = "input_commands";
+const uint32_t CULLING_OUTPUT_SET_ID = 1;  // one set per culled list
+const std::string OUTPUT_COMMANDS_BINDING_NAME = "output_commands";
+const std::string DRAW_COUNT_BINDING_NAME = "draw_count";
+
 // SCENE_DEPTH_BUFFER_STORAGE is also part of this set at binding 1, 1
 
+// bindless mode: every sampled texture lives in one backend-owned array, materials only store indices into it
+const uint32_t BINDLESS_TEXTURES_SET_ID = 4;
+const std::string BINDLESS_TEXTURES_ARRAY = "bindless_textures";
+const uint32_t INVALID_BINDLESS_INDEX = UINT32_MAX;
+
 struct ParticlesGlobalState {
     uint32_t particles_count = 0;
     float delta_time_s = 0.0f;
 }; // push constant
 const std::string COMPUTE_PARTICLES_GLOBAL_STATE_PC = "GlobalState";
+const std::string COMPUTE_CAMERA_BINDING_NAME = "camera";  // camera / scene related data passed to the particles compute shaders
 
 struct UiTransform {
     glm::vec2 scale;
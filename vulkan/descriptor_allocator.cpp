@@ -0,0 +1,120 @@
+/*
+* descriptor_allocator.cpp
+*
+* Copyright (C) 2021 Riccardo Marson
+*/
+
+#include "descriptor_allocator.hpp"
+
+namespace {
+    // descriptors of each type per set in a pool, roughly what the scene, emitters and UI use between them
+    const std::vector<std::pair<VkDescriptorType, float>> kPoolSizeRatios = {
+        { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1.0f },
+        { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1.0f },
+        { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 2.0f },
+        { VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER, 1.0f },
+        { VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 0.5f },
+        { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1.0f },
+        { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, 0.5f }
+    };
+}
+
+DescriptorAllocator::DescriptorAllocator(VkDevice device, uint32_t sets_per_pool) :
+    device_(device),
+    sets_per_pool_(sets_per_pool) {
+
+}
+
+DescriptorAllocator::~DescriptorAllocator() {
+    for (auto pool : used_pools_) {
+        vkDestroyDescriptorPool(device_, pool, nullptr);
+    }
+    for (auto pool : free_pools_) {
+        vkDestroyDescriptorPool(device_, pool, nullptr);
+    }
+}
+
+bool DescriptorAllocator::allocate(const std::vector<VkDescriptorSetLayout>& layouts, std::vector<VkDescriptorSet>& descriptor_sets) {
+    descriptor_sets.resize(layouts.size());
+    if (layouts.empty()) {
+        return true;
+    }
+
+    if (current_pool_ == VK_NULL_HANDLE && !nextPool()) {
+        return false;
+    }
+
+    VkDescriptorSetAllocateInfo alloc_info{};
+    alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    alloc_info.descriptorPool = current_pool_;
+    alloc_info.descriptorSetCount = static_cast<uint32_t>(layouts.size());
+    alloc_info.pSetLayouts = layouts.data();
+
+    VkResult result = vkAllocateDescriptorSets(device_, &alloc_info, descriptor_sets.data());
+    if (result == VK_ERROR_OUT_OF_POOL_MEMORY || result == VK_ERROR_FRAGMENTED_POOL) {
+        // the current pool is full, a fresh one is sized to take any reasonable request
+        ++stats_.pool_overflows;
+        if (!nextPool()) {
+            return false;
+        }
+
+        alloc_info.descriptorPool = current_pool_;
+        result = vkAllocateDescriptorSets(device_, &alloc_info, descriptor_sets.data());
+    }
+
+    if (result != VK_SUCCESS) {
+        std::cerr << "Failed to allocate descriptor sets!" << std::endl;
+        descriptor_sets.clear();
+        return false;
+    }
+
+    stats_.sets_count += static_cast<uint32_t>(layouts.size());
+    return true;
+}
+
+void DescriptorAllocator::reset() {
+    for (auto pool : used_pools_) {
+        vkResetDescriptorPool(device_, pool, 0);
+        free_pools_.push_back(pool);
+    }
+    used_pools_.clear();
+    current_pool_ = VK_NULL_HANDLE;
+    stats_.sets_count = 0;
+}
+
+VkDescriptorPool DescriptorAllocator::createPool() const {
+    std::vector<VkDescriptorPoolSize> pool_sizes;
+    for (const auto& ratio : kPoolSizeRatios) {
+        pool_sizes.push_back({ ratio.first, static_cast<uint32_t>(ratio.second * sets_per_pool_) });
+    }
+
+    VkDescriptorPoolCreateInfo pool_info{};
+    pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    pool_info.poolSizeCount = static_cast<uint32_t>(pool_sizes.size());
+    pool_info.pPoolSizes = pool_sizes.data();
+    pool_info.maxSets = sets_per_pool_;
+
+    VkDescriptorPool pool = VK_NULL_HANDLE;
+    if (vkCreateDescriptorPool(device_, &pool_info, nullptr, &pool) != VK_SUCCESS) {
+        std::cerr << "Failed to create descriptor pool!" << std::endl;
+        return VK_NULL_HANDLE;
+    }
+
+    return pool;
+}
+
+bool DescriptorAllocator::nextPool() {
+    if (!free_pools_.empty()) {
+        current_pool_ = free_pools_.back();
+        free_pools_.pop_back();
+    } else {
+        current_pool_ = createPool();
+        if (current_pool_ == VK_NULL_HANDLE) {
+            return false;
+        }
+        ++stats_.pools_count;
+    }
+
+    used_pools_.push_back(current_pool_);
+    return true;
+}
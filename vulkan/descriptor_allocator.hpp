@@ -0,0 +1,40 @@
+/*
+* descriptor_allocator.hpp
+*
+* Copyright (C) 2021 Riccardo Marson
+*/
+
+#pragma once
+
+#include "common_definitions.hpp"
+
+struct DescriptorAllocatorStats {
+    uint32_t pools_count = 0;  // created so far, including the ones waiting for reuse
+    uint32_t sets_count = 0;  // allocated since the last reset
+    uint32_t pool_overflows = 0;  // allocations that had to move on to another pool
+};
+
+// Hands out descriptor sets from a chain of fixed-size pools, moving on to a new pool whenever the current one runs
+// out. Nothing needs to know the descriptor counts up front. Sets can't be freed one by one, reset() recycles all of
+// them at once and keeps the pools around for the next round.
+class DescriptorAllocator {
+public:
+    DescriptorAllocator(VkDevice device, uint32_t sets_per_pool = 256);
+    ~DescriptorAllocator();
+
+    bool allocate(const std::vector<VkDescriptorSetLayout>& layouts, std::vector<VkDescriptorSet>& descriptor_sets);
+    void reset();  // every set allocated so far becomes invalid
+
+    DescriptorAllocatorStats getStats() const { return stats_; }
+
+private:
+    VkDescriptorPool createPool() const;
+    bool nextPool();
+
+    VkDevice device_;
+    uint32_t sets_per_pool_;
+    VkDescriptorPool current_pool_ = VK_NULL_HANDLE;
+    std::vector<VkDescriptorPool> used_pools_;
+    std::vector<VkDescriptorPool> free_pools_;
+    DescriptorAllocatorStats stats_;
+};
@@ -0,0 +1,116 @@
+/*
+* descriptor_set_layout_cache.cpp
+*
+* Copyright (C) 2021 Riccardo Marson
+*/
+
+#include "descriptor_set_layout_cache.hpp"
+
+#include <algorithm>
+
+namespace {
+    uint64_t hashBindings(const std::vector<VkDescriptorSetLayoutBinding>& bindings) {
+        // FNV-1a over the fields that define the layout. immutable samplers are not used by any pipeline
+        uint64_t hash = 14695981039346656037ull;
+        auto combine = [&hash](uint32_t value) {
+            for (uint32_t i = 0; i < 4; ++i) {
+                hash ^= (value >> (i * 8)) & 0xff;
+                hash *= 1099511628211ull;
+            }
+        };
+
+        for (const auto& binding : bindings) {
+            combine(binding.binding);
+            combine(static_cast<uint32_t>(binding.descriptorType));
+            combine(binding.descriptorCount);
+            combine(binding.stageFlags);
+        }
+        return hash;
+    }
+
+    bool sameBindings(const std::vector<VkDescriptorSetLayoutBinding>& a, const std::vector<VkDescriptorSetLayoutBinding>& b) {
+        return std::equal(a.begin(), a.end(), b.begin(), b.end(), 
+            [](const VkDescriptorSetLayoutBinding& x, const VkDescriptorSetLayoutBinding& y) {
+                return x.binding == y.binding && 
+                    x.descriptorType == y.descriptorType && 
+                    x.descriptorCount == y.descriptorCount && 
+                    x.stageFlags == y.stageFlags;
+            });
+    }
+}
+
+DescriptorSetLayoutCache::~DescriptorSetLayoutCache() {
+    for (auto& entry : layouts_) {
+        vkDestroyDescriptorSetLayout(device_, entry.second.layout, nullptr);
+    }
+    layouts_.clear();
+}
+
+VkDescriptorSetLayout DescriptorSetLayoutCache::getLayout(std::vector<VkDescriptorSetLayoutBinding> bindings) {
+    std::sort(bindings.begin(), bindings.end(), 
+        [](const VkDescriptorSetLayoutBinding& a, const VkDescriptorSetLayoutBinding& b) { return a.binding < b.binding; });
+
+    const auto hash = hashBindings(bindings);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    auto range = layouts_.equal_range(hash);
+    for (auto it = range.first; it != range.second; ++it) {
+        if (sameBindings(it->second.bindings, bindings)) {
+            ++hits_;
+            return it->second.layout;
+        }
+    }
+
+    VkDescriptorSetLayoutCreateInfo layout_create_info{};
+    layout_create_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layout_create_info.bindingCount = static_cast<uint32_t>(bindings.size());
+    layout_create_info.pBindings = bindings.data();
+
+    VkDescriptorSetLayout layout = VK_NULL_HANDLE;
+    if (vkCreateDescriptorSetLayout(device_, &layout_create_info, nullptr, &layout) != VK_SUCCESS) {
+        std::cerr << "Failed to create descriptor set layout!" << std::endl;
+        return VK_NULL_HANDLE;
+    }
+
+    layouts_.emplace(hash, Entry{ std::move(bindings), layout });
+    return layout;
+}
+
+VkDescriptorSetLayout DescriptorSetLayoutCache::getLayout(uint32_t set_id, std::vector<VkDescriptorSetLayoutBinding> bindings) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto external = external_layouts_.find(set_id);
+        if (external != external_layouts_.end()) {
+            return external->second;
+        }
+    }
+
+    return getLayout(std::move(bindings));
+}
+
+void DescriptorSetLayoutCache::setExternalLayout(uint32_t set_id, VkDescriptorSetLayout layout) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    external_layouts_[set_id] = layout;
+}
+
+bool DescriptorSetLayoutCache::getBindings(VkDescriptorSetLayout layout, std::vector<VkDescriptorSetLayoutBinding>& bindings) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const auto& entry : layouts_) {
+        if (entry.second.layout == layout) {
+            bindings = entry.second.bindings;
+            return true;
+        }
+    }
+    return false;
+}
+
+size_t DescriptorSetLayoutCache::getLayoutsCount() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return layouts_.size();
+}
+
+uint32_t DescriptorSetLayoutCache::getHitsCount() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return hits_;
+}
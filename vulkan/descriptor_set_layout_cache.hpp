@@ -0,0 +1,47 @@
+/*
+* descriptor_set_layout_cache.hpp
+*
+* Copyright (C) 2021 Riccardo Marson
+*/
+
+#pragma once
+
+#include "common_definitions.hpp"
+
+#include <mutex>
+#include <unordered_map>
+
+// Backend-wide store of descriptor set layouts, keyed by their bindings. Pipelines with identical sets get the same
+// VkDescriptorSetLayout, so a descriptor set allocated once can be bound to any of them.
+// Layouts live as long as the cache, which keeps the handles stable across swapchain rebuilds.
+// Safe to call from the pipeline compilation threads.
+class DescriptorSetLayoutCache {
+public:
+    explicit DescriptorSetLayoutCache(VkDevice device) : device_(device) {}
+    ~DescriptorSetLayoutCache();
+
+    // the order of the bindings doesn't matter. returns VK_NULL_HANDLE on failure
+    VkDescriptorSetLayout getLayout(std::vector<VkDescriptorSetLayoutBinding> bindings);
+    // same, unless the set number has a layout owned elsewhere (the bindless textures table), which wins over the
+    // bindings reflected from the shaders
+    VkDescriptorSetLayout getLayout(uint32_t set_id, std::vector<VkDescriptorSetLayoutBinding> bindings);
+    void setExternalLayout(uint32_t set_id, VkDescriptorSetLayout layout);  // not destroyed by the cache
+
+    // the bindings a layout was created from, sorted by binding number. false for layouts not created by the cache
+    bool getBindings(VkDescriptorSetLayout layout, std::vector<VkDescriptorSetLayoutBinding>& bindings) const;
+
+    size_t getLayoutsCount() const;
+    uint32_t getHitsCount() const;
+
+private:
+    struct Entry {
+        std::vector<VkDescriptorSetLayoutBinding> bindings;
+        VkDescriptorSetLayout layout;
+    };
+
+    VkDevice device_;
+    mutable std::mutex mutex_;
+    std::unordered_multimap<uint64_t, Entry> layouts_;  // by bindings hash, collisions are told apart by comparing
+    std::map<uint32_t, VkDescriptorSetLayout> external_layouts_;  // by set number
+    uint32_t hits_ = 0;
+};
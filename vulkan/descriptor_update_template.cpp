@@ -0,0 +1,112 @@
+/*
+* descriptor_update_template.cpp
+*
+* Copyright (C) 2021 Riccardo Marson
+*/
+
+#include "descriptor_update_template.hpp"
+
+DescriptorUpdateTemplate::DescriptorUpdateTemplate(VkDevice device,
+                                                   VkDescriptorSetLayout layout,
+                                                   const std::vector<VkDescriptorSetLayoutBinding>& bindings,
+                                                   const BindingsMap& binding_names) :
+    device_(device),
+    binding_names_(binding_names) {
+
+    std::vector<VkDescriptorUpdateTemplateEntry> entries;
+    uint32_t slots_count = 0;
+    for (const auto& binding : bindings) {
+        if (binding.descriptorCount == 0) {
+            continue;
+        }
+
+        VkDescriptorUpdateTemplateEntry entry{};
+        entry.dstBinding = binding.binding;
+        entry.dstArrayElement = 0;
+        entry.descriptorCount = binding.descriptorCount;
+        entry.descriptorType = binding.descriptorType;
+        entry.offset = slots_count * sizeof(DescriptorInfo);
+        entry.stride = sizeof(DescriptorInfo);
+        entries.push_back(entry);
+
+        slots_[binding.binding] = BindingSlots{ slots_count, binding.descriptorCount };
+        slots_count += binding.descriptorCount;
+    }
+
+    data_.resize(slots_count);
+    assigned_.resize(slots_count, false);
+
+    VkDescriptorUpdateTemplateCreateInfo create_info{};
+    create_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_UPDATE_TEMPLATE_CREATE_INFO;
+    create_info.descriptorUpdateEntryCount = static_cast<uint32_t>(entries.size());
+    create_info.pDescriptorUpdateEntries = entries.data();
+    create_info.templateType = VK_DESCRIPTOR_UPDATE_TEMPLATE_TYPE_DESCRIPTOR_SET;
+    create_info.descriptorSetLayout = layout;
+
+    if (vkCreateDescriptorUpdateTemplate(device_, &create_info, nullptr, &vk_template_) != VK_SUCCESS) {
+        std::cerr << "Failed to create descriptor update template!" << std::endl;
+        vk_template_ = VK_NULL_HANDLE;
+    }
+}
+
+DescriptorUpdateTemplate::~DescriptorUpdateTemplate() {
+    if (vk_template_ != VK_NULL_HANDLE) {
+        vkDestroyDescriptorUpdateTemplate(device_, vk_template_, nullptr);
+    }
+}
+
+void DescriptorUpdateTemplate::setBuffer(const std::string& name, const VkDescriptorBufferInfo& buffer_info) {
+    if (auto info = slot(name, 0)) {
+        info->buffer = buffer_info;
+    }
+}
+
+void DescriptorUpdateTemplate::setTexelBuffer(const std::string& name, VkBufferView buffer_view) {
+    if (auto info = slot(name, 0)) {
+        info->buffer_view = buffer_view;
+    }
+}
+
+void DescriptorUpdateTemplate::setImage(const std::string& name, const VkDescriptorImageInfo& image_info, uint32_t array_element) {
+    if (auto info = slot(name, array_element)) {
+        info->image = image_info;
+    }
+}
+
+bool DescriptorUpdateTemplate::update(VkDescriptorSet descriptor_set) {
+    if (!isValid()) {
+        return false;
+    }
+
+    for (const auto& binding : slots_) {
+        const auto& slots = binding.second;
+        if (!assigned_[slots.first]) {
+            std::cerr << "Descriptor update template: binding " << binding.first << " was never set!" << std::endl;
+            return false;
+        }
+        for (uint32_t i = 1; i < slots.count; ++i) {
+            if (!assigned_[slots.first + i]) {
+                data_[slots.first + i] = data_[slots.first];
+            }
+        }
+    }
+
+    vkUpdateDescriptorSetWithTemplate(device_, descriptor_set, vk_template_, data_.data());
+    return true;
+}
+
+DescriptorUpdateTemplate::DescriptorInfo* DescriptorUpdateTemplate::slot(const std::string& name, uint32_t array_element) {
+    auto name_iter = binding_names_.find(name);
+    if (name_iter == binding_names_.end()) {
+        return nullptr;
+    }
+
+    auto slots_iter = slots_.find(name_iter->second);
+    if (slots_iter == slots_.end() || array_element >= slots_iter->second.count) {
+        return nullptr;
+    }
+
+    uint32_t index = slots_iter->second.first + array_element;
+    assigned_[index] = true;
+    return &data_[index];
+}
@@ -0,0 +1,55 @@
+/*
+* descriptor_update_template.hpp
+*
+* Copyright (C) 2021 Riccardo Marson
+*/
+
+#pragma once
+
+#include "common_definitions.hpp"
+#include "pipelines/pipeline.hpp"
+
+// Writes every binding of a descriptor set with one vkUpdateDescriptorSetWithTemplate call. The template is built
+// from the set layout bindings, and the bindings are addressed by the names reflected from the shaders.
+// The values are kept between updates, so writing the same set for each frame in flight only needs to change
+// what differs between them. Every binding must be given a value before the first update. Array elements that
+// were never set repeat the first one.
+class DescriptorUpdateTemplate {
+public:
+    DescriptorUpdateTemplate(VkDevice device,
+                             VkDescriptorSetLayout layout,
+                             const std::vector<VkDescriptorSetLayoutBinding>& bindings,
+                             const BindingsMap& binding_names);
+    ~DescriptorUpdateTemplate();
+
+    bool isValid() const { return vk_template_ != VK_NULL_HANDLE; }
+    bool hasBinding(const std::string& name) const { return binding_names_.find(name) != binding_names_.end(); }
+
+    void setBuffer(const std::string& name, const VkDescriptorBufferInfo& buffer_info);
+    void setTexelBuffer(const std::string& name, VkBufferView buffer_view);
+    void setImage(const std::string& name, const VkDescriptorImageInfo& image_info, uint32_t array_element = 0);
+
+    bool update(VkDescriptorSet descriptor_set);
+
+private:
+    // one per array element, the template entries read the member that matches their descriptor type
+    union DescriptorInfo {
+        VkDescriptorBufferInfo buffer;
+        VkDescriptorImageInfo image;
+        VkBufferView buffer_view;
+    };
+
+    struct BindingSlots {
+        uint32_t first = 0;  // index in data_
+        uint32_t count = 0;
+    };
+
+    DescriptorInfo* slot(const std::string& name, uint32_t array_element);
+
+    VkDevice device_;
+    VkDescriptorUpdateTemplate vk_template_ = VK_NULL_HANDLE;
+    BindingsMap binding_names_;
+    std::map<uint32_t, BindingSlots> slots_;  // by binding number
+    std::vector<DescriptorInfo> data_;
+    std::vector<bool> assigned_;
+};
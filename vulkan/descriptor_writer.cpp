@@ -0,0 +1,79 @@
+/*
+* descriptor_writer.cpp
+*
+* Copyright (C) 2021 Riccardo Marson
+*/
+
+#include "descriptor_writer.hpp"
+
+void DescriptorWriter::endBatch() {
+    if (batch_depth_ == 0) {
+        return;
+    }
+
+    if (--batch_depth_ == 0) {
+        flush();
+    }
+}
+
+void DescriptorWriter::writeBuffer(VkDescriptorSet set, uint32_t binding, VkDescriptorType type, const VkDescriptorBufferInfo& buffer_info) {
+    buffer_infos_.push_back(buffer_info);
+    addWrite(set, binding, type, 1).pBufferInfo = &buffer_infos_.back();
+}
+
+void DescriptorWriter::writeTexelBuffer(VkDescriptorSet set, uint32_t binding, VkDescriptorType type, VkBufferView buffer_view) {
+    buffer_views_.push_back(buffer_view);
+    addWrite(set, binding, type, 1).pTexelBufferView = &buffer_views_.back();
+}
+
+void DescriptorWriter::writeImages(VkDescriptorSet set, uint32_t binding, VkDescriptorType type, const std::vector<VkDescriptorImageInfo>& image_infos) {
+    if (image_infos.empty()) {
+        return;
+    }
+
+    // array elements must be contiguous, and deques only guarantee that within a block. keep them in a vector of their own
+    // when there is more than one
+    if (image_infos.size() == 1) {
+        image_infos_.push_back(image_infos[0]);
+        addWrite(set, binding, type, 1).pImageInfo = &image_infos_.back();
+        return;
+    }
+
+    image_arrays_.push_back(image_infos);
+    addWrite(set, binding, type, static_cast<uint32_t>(image_infos.size())).pImageInfo = image_arrays_.back().data();
+}
+
+void DescriptorWriter::flushIfNotBatching() {
+    if (!isBatching()) {
+        flush();
+    }
+}
+
+void DescriptorWriter::flush() {
+    if (writes_.empty()) {
+        return;
+    }
+
+    vkUpdateDescriptorSets(device_, static_cast<uint32_t>(writes_.size()), writes_.data(), 0, nullptr);
+    ++flushes_count_;
+    writes_count_ += static_cast<uint32_t>(writes_.size());
+
+    writes_.clear();
+    buffer_infos_.clear();
+    image_infos_.clear();
+    image_arrays_.clear();
+    buffer_views_.clear();
+}
+
+VkWriteDescriptorSet& DescriptorWriter::addWrite(VkDescriptorSet set, uint32_t binding, VkDescriptorType type, uint32_t count) {
+    VkWriteDescriptorSet descriptor_write{};
+    descriptor_write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    descriptor_write.dstSet = set;
+    descriptor_write.dstBinding = binding;
+    descriptor_write.dstArrayElement = 0;
+    descriptor_write.descriptorType = type;
+    descriptor_write.descriptorCount = count;
+
+    writes_.push_back(descriptor_write);
+    return writes_.back();
+}
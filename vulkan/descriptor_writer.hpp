@@ -0,0 +1,50 @@
+/*
+* descriptor_writer.hpp
+*
+* Copyright (C) 2021 Riccardo Marson
+*/
+
+#pragma once
+
+#include "common_definitions.hpp"
+
+#include <deque>
+
+// Collects descriptor writes and hands them to the driver with a single vkUpdateDescriptorSets call.
+// Outside of a batch the writes are flushed by whoever queued them, once they are done queueing (one call for all the
+// frames in flight instead of one per set). Inside a batch they wait for the outermost endBatch.
+// Sets written in a batch must not be bound in a command buffer before the batch is over.
+class DescriptorWriter {
+public:
+    explicit DescriptorWriter(VkDevice device) : device_(device) {}
+
+    bool isBatching() const { return batch_depth_ > 0; }
+    uint32_t getFlushesCount() const { return flushes_count_; }
+    uint32_t getWritesCount() const { return writes_count_; }  // written so far, over all the flushes
+
+    // batches can be nested, only the outermost end call flushes
+    void beginBatch() { ++batch_depth_; }
+    void endBatch();
+
+    void writeBuffer(VkDescriptorSet set, uint32_t binding, VkDescriptorType type, const VkDescriptorBufferInfo& buffer_info);
+    void writeTexelBuffer(VkDescriptorSet set, uint32_t binding, VkDescriptorType type, VkBufferView buffer_view);
+    void writeImages(VkDescriptorSet set, uint32_t binding, VkDescriptorType type, const std::vector<VkDescriptorImageInfo>& image_infos);
+
+    void flushIfNotBatching();
+    void flush();
+
+private:
+    VkWriteDescriptorSet& addWrite(VkDescriptorSet set, uint32_t binding, VkDescriptorType type, uint32_t count);
+
+    VkDevice device_;
+    uint32_t batch_depth_ = 0;
+    uint32_t flushes_count_ = 0;
+    uint32_t writes_count_ = 0;
+
+    std::vector<VkWriteDescriptorSet> writes_;
+    // the writes point into these, deques don't move their elements when growing
+    std::deque<VkDescriptorBufferInfo> buffer_infos_;
+    std::deque<VkDescriptorImageInfo> image_infos_;
+    std::deque<std::vector<VkDescriptorImageInfo>> image_arrays_;
+    std::deque<VkBufferView> buffer_views_;
+};
@@ -8,6 +8,7 @@
 
 
 PFN_vkCmdDrawMeshTasksNV VkDrawMeshTasksNV = nullptr;
+PFN_vkCmdDrawIndexedIndirectCountKHR VkDrawIndexedIndirectCountKHR = nullptr;
 
 
 void loadOptionalVkExtensions(VkInstance instance) {
@@ -15,4 +16,9 @@ void loadOptionalVkExtensions(VkInstance instance) {
     if (fn) {
         VkDrawMeshTasksNV = reinterpret_cast<PFN_vkCmdDrawMeshTasksNV>(fn);
     }
+
+    fn = vkGetInstanceProcAddr(instance, "vkCmdDrawIndexedIndirectCountKHR");
+    if (fn) {
+        VkDrawIndexedIndirectCountKHR = reinterpret_cast<PFN_vkCmdDrawIndexedIndirectCountKHR>(fn);
+    }
 }
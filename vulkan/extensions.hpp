@@ -11,6 +11,7 @@
 
 
 extern PFN_vkCmdDrawMeshTasksNV VkDrawMeshTasksNV;
+extern PFN_vkCmdDrawIndexedIndirectCountKHR VkDrawIndexedIndirectCountKHR;
 
 
 void loadOptionalVkExtensions(VkInstance instance);
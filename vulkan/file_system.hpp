@@ -6,9 +6,11 @@
 
 #pragma once
 
+#include <cstdint>
 #include <fstream>
 #include <iostream>
 #include <string>
+#include <vector>
 
 
 inline std::vector<char> readFile(const std::string& filename) {
@@ -27,3 +29,13 @@ inline std::vector<char> readFile(const std::string& filename) {
 
     return buffer;
 }
+
+inline uint64_t hashFileContents(const std::vector<char>& data) {
+    // FNV-1a, good enough to tell SPIR-V binaries apart
+    uint64_t hash = 14695981039346656037ull;
+    for (char c : data) {
+        hash ^= static_cast<uint8_t>(c);
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
@@ -0,0 +1,281 @@
+/*
+* frame_stats.cpp
+*
+* Copyright (C) 2021 Riccardo Marson
+*/
+
+#include "frame_stats.hpp"
+
+#include <imgui.h>
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+
+// StreamingQuantile
+
+StreamingQuantile::StreamingQuantile(double quantile) :
+    quantile_(quantile) {
+    reset();
+}
+
+void StreamingQuantile::reset() {
+    count_ = 0;
+    for (int i = 0; i < 5; ++i) {
+        heights_[i] = 0.0;
+        positions_[i] = static_cast<double>(i);
+    }
+
+    desired_positions_[0] = 0.0;
+    desired_positions_[1] = 2.0 * quantile_;
+    desired_positions_[2] = 4.0 * quantile_;
+    desired_positions_[3] = 2.0 + 2.0 * quantile_;
+    desired_positions_[4] = 4.0;
+
+    increments_[0] = 0.0;
+    increments_[1] = quantile_ / 2.0;
+    increments_[2] = quantile_;
+    increments_[3] = (1.0 + quantile_) / 2.0;
+    increments_[4] = 1.0;
+}
+
+void StreamingQuantile::addSample(double value) {
+    // the first five samples are the initial markers
+    if (count_ < 5) {
+        heights_[count_++] = value;
+        if (count_ == 5) {
+            std::sort(heights_, heights_ + 5);
+        }
+        return;
+    }
+    ++count_;
+
+    int cell = 0;
+    if (value < heights_[0]) {
+        heights_[0] = value;
+    } else if (value >= heights_[4]) {
+        heights_[4] = value;
+        cell = 3;
+    } else {
+        while (cell < 3 && value >= heights_[cell + 1]) {
+            ++cell;
+        }
+    }
+
+    for (int i = cell + 1; i < 5; ++i) {
+        positions_[i] += 1.0;
+    }
+    for (int i = 0; i < 5; ++i) {
+        desired_positions_[i] += increments_[i];
+    }
+
+    // move the middle markers by one position if they are off by more than one
+    for (int i = 1; i < 4; ++i) {
+        auto offset = desired_positions_[i] - positions_[i];
+        if ((offset >= 1.0 && positions_[i + 1] - positions_[i] > 1.0) || (offset <= -1.0 && positions_[i - 1] - positions_[i] < -1.0)) {
+            int d = offset > 0.0 ? 1 : -1;
+            auto height = parabolic(i, d);
+            if (heights_[i - 1] < height && height < heights_[i + 1]) {
+                heights_[i] = height;
+            } else {
+                heights_[i] = linear(i, d);
+            }
+            positions_[i] += d;
+        }
+    }
+}
+
+double StreamingQuantile::value() const {
+    if (count_ == 0) {
+        return 0.0;
+    }
+
+    if (count_ < 5) {
+        // nearest rank
+        double sorted[5];
+        std::copy(heights_, heights_ + count_, sorted);
+        std::sort(sorted, sorted + count_);
+        auto rank = static_cast<size_t>(std::ceil(quantile_ * count_));
+        return sorted[std::min(std::max(rank, size_t(1)), static_cast<size_t>(count_)) - 1];
+    }
+
+    return heights_[2];
+}
+
+double StreamingQuantile::parabolic(int i, int d) const {
+    return heights_[i] + d / (positions_[i + 1] - positions_[i - 1]) *
+        ((positions_[i] - positions_[i - 1] + d) * (heights_[i + 1] - heights_[i]) / (positions_[i + 1] - positions_[i]) +
+         (positions_[i + 1] - positions_[i] - d) * (heights_[i] - heights_[i - 1]) / (positions_[i] - positions_[i - 1]));
+}
+
+double StreamingQuantile::linear(int i, int d) const {
+    return heights_[i] + d * (heights_[i + d] - heights_[i]) / (positions_[i + d] - positions_[i]);
+}
+
+// RollingMetric
+
+RollingMetric::RollingMetric(size_t window) :
+    samples_(window),
+    min_queue_(samples_.capacity()),
+    max_queue_(samples_.capacity()) {
+
+}
+
+void RollingMetric::addSample(float value) {
+    if (samples_.full()) {
+        auto oldest = static_cast<double>(samples_.front());
+        sum_ -= oldest;
+        sum_squares_ -= oldest * oldest;
+    }
+    samples_.push(value);
+    sum_ += value;
+    sum_squares_ += static_cast<double>(value) * value;
+
+    pushExtreme(min_queue_, value, true);
+    pushExtreme(max_queue_, value, false);
+    ++count_;
+
+    // the running sums drift with every subtraction, start again from the window once in a while
+    if (count_ % samples_.capacity() == 0) {
+        recomputeSums();
+    }
+
+    p50_.addSample(value);
+    p95_.addSample(value);
+    p99_.addSample(value);
+}
+
+void RollingMetric::reset() {
+    samples_.clear();
+    count_ = 0;
+    sum_ = 0.0;
+    sum_squares_ = 0.0;
+    min_queue_.head = min_queue_.count = 0;
+    max_queue_.head = max_queue_.count = 0;
+    p50_.reset();
+    p95_.reset();
+    p99_.reset();
+}
+
+float RollingMetric::mean() const {
+    return samples_.empty() ? 0.f : static_cast<float>(sum_ / samples_.size());
+}
+
+float RollingMetric::variance() const {
+    if (samples_.size() < 2) {
+        return 0.f;
+    }
+
+    auto n = static_cast<double>(samples_.size());
+    auto mean = sum_ / n;
+    return static_cast<float>(std::max((sum_squares_ - n * mean * mean) / (n - 1.0), 0.0));  // sample variance
+}
+
+float RollingMetric::stddev() const {
+    return std::sqrt(variance());
+}
+
+float RollingMetric::min() const {
+    return min_queue_.count > 0 ? min_queue_.items[min_queue_.head].second : 0.f;
+}
+
+float RollingMetric::max() const {
+    return max_queue_.count > 0 ? max_queue_.items[max_queue_.head].second : 0.f;
+}
+
+void RollingMetric::plot(const char* label, float height) const {
+    auto max_value = max();
+    auto overlay = std::to_string(max_value);
+    ImGui::PlotLines(label, samples_.data(), static_cast<int>(samples_.size()), static_cast<int>(samples_.oldestOffset()),
+                     overlay.c_str(), 0.f, max_value * 1.2f, ImVec2(0.f, height));
+}
+
+void RollingMetric::pushExtreme(MonotonicQueue& queue, float value, bool keep_smaller) {
+    auto capacity = queue.items.size();
+
+    // the front leaves the window first
+    if (queue.count > 0 && queue.items[queue.head].first + capacity <= count_) {
+        queue.head = (queue.head + 1) % capacity;
+        --queue.count;
+    }
+
+    // anything the new sample beats can never be the extreme again
+    while (queue.count > 0) {
+        auto back = queue.items[(queue.head + queue.count - 1) % capacity].second;
+        if (keep_smaller ? back < value : back > value) {
+            break;
+        }
+        --queue.count;
+    }
+
+    queue.items[(queue.head + queue.count) % capacity] = { count_, value };
+    ++queue.count;
+}
+
+void RollingMetric::recomputeSums() {
+    sum_ = 0.0;
+    sum_squares_ = 0.0;
+    for (size_t i = 0; i < samples_.size(); ++i) {
+        auto sample = static_cast<double>(samples_[i]);
+        sum_ += sample;
+        sum_squares_ += sample * sample;
+    }
+}
+
+// FrameStats
+
+RollingMetric& FrameStats::metric(std::string_view name) {
+    auto iter = metrics_.find(name);
+    if (iter == metrics_.end()) {
+        iter = metrics_.emplace(std::string(name), RollingMetric(window_)).first;
+    }
+    return iter->second;
+}
+
+uint64_t& FrameStats::counter(std::string_view name) {
+    auto iter = counters_.find(name);
+    if (iter == counters_.end()) {
+        iter = counters_.emplace(std::string(name), 0).first;
+    }
+    return iter->second;
+}
+
+void FrameStats::reset() {
+    for (auto& metric : metrics_) {
+        metric.second.reset();
+    }
+    for (auto& counter : counters_) {
+        counter.second = 0;
+    }
+}
+
+void FrameStats::drawImGui() const {
+    for (const auto& metric : metrics_) {
+        ImGui::Text("%s: %.4f (p95 %.4f, max %.4f)", metric.first.c_str(), metric.second.mean(), metric.second.p95(), metric.second.max());
+    }
+    for (const auto& counter : counters_) {
+        ImGui::Text("%s: %llu", counter.first.c_str(), static_cast<unsigned long long>(counter.second));
+    }
+}
+
+bool FrameStats::exportCsv(const std::string& path) const {
+    std::ofstream out(path, std::ios::out | std::ios::trunc);
+    if (!out.is_open()) {
+        std::cerr << "Failed to open " << path << " to write the frame stats!" << std::endl;
+        return false;
+    }
+
+    out << "name,samples,last,mean,stddev,min,max,p50,p95,p99\n";
+    for (const auto& metric : metrics_) {
+        const auto& m = metric.second;
+        out << metric.first << "," << m.count() << "," << m.last() << "," << m.mean() << "," << m.stddev() << ","
+            << m.min() << "," << m.max() << "," << m.p50() << "," << m.p95() << "," << m.p99() << "\n";
+    }
+    // counters only have a value, in the samples column
+    for (const auto& counter : counters_) {
+        out << counter.first << "," << counter.second << ",,,,,,,,\n";
+    }
+
+    return true;
+}
@@ -0,0 +1,158 @@
+/*
+* frame_stats.hpp
+*
+* Copyright (C) 2021 Riccardo Marson
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Fixed capacity ring, allocated once. Index 0 is the oldest element.
+template <typename T>
+class RingBuffer {
+public:
+    explicit RingBuffer(size_t capacity) : data_(capacity > 0 ? capacity : 1) {}
+
+    size_t capacity() const { return data_.size(); }
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+    bool full() const { return size_ == data_.size(); }
+
+    // overwrites the oldest element once full
+    void push(const T& value) {
+        data_[next_] = value;
+        next_ = (next_ + 1) % data_.size();
+        if (size_ < data_.size()) {
+            ++size_;
+        }
+    }
+
+    void clear() {
+        next_ = 0;
+        size_ = 0;
+    }
+
+    const T& operator[](size_t i) const { return data_[(oldestOffset() + i) % data_.size()]; }
+    const T& front() const { return (*this)[0]; }
+    const T& back() const { return (*this)[size_ - 1]; }
+
+    // raw storage, the oldest element is at oldestOffset() (what ImGui::PlotLines calls values_offset)
+    const T* data() const { return data_.data(); }
+    size_t oldestOffset() const { return full() ? next_ : 0; }
+
+private:
+    std::vector<T> data_;
+    size_t next_ = 0;
+    size_t size_ = 0;
+};
+
+// P-square estimator (Jain and Chlamtac) of one quantile of a stream, in constant time and memory:
+// five markers are moved towards their ideal positions with a piecewise parabolic fit, no samples are kept.
+class StreamingQuantile {
+public:
+    explicit StreamingQuantile(double quantile);
+
+    void addSample(double value);
+    void reset();
+    double value() const;  // exact until the fifth sample
+    uint64_t count() const { return count_; }
+
+private:
+    double parabolic(int i, int d) const;
+    double linear(int i, int d) const;
+
+    double quantile_;
+    uint64_t count_ = 0;
+    double heights_[5] = {};
+    double positions_[5] = {};
+    double desired_positions_[5] = {};
+    double increments_[5] = {};
+};
+
+// A named metric, like a frame or scope time. Mean, variance, min and max are over the last window samples and are
+// updated incrementally; the percentiles are streaming estimates over every sample since the last reset.
+// Adding a sample is O(1) (amortised for min and max) and never allocates.
+class RollingMetric {
+public:
+    static const size_t kDefaultWindow = 100;
+
+    explicit RollingMetric(size_t window = kDefaultWindow);
+
+    void addSample(float value);
+    void reset();
+
+    size_t window() const { return samples_.capacity(); }
+    uint64_t count() const { return count_; }  // since the last reset
+    float last() const { return samples_.empty() ? 0.f : samples_.back(); }
+
+    float mean() const;
+    float variance() const;
+    float stddev() const;
+    float min() const;
+    float max() const;
+
+    float p50() const { return static_cast<float>(p50_.value()); }
+    float p95() const { return static_cast<float>(p95_.value()); }
+    float p99() const { return static_cast<float>(p99_.value()); }
+
+    const RingBuffer<float>& getSamples() const { return samples_; }
+
+    // the window as an ImGui line plot, scaled from 0 to the window max. must be called inside an ImGui window
+    void plot(const char* label, float height = 0.f) const;
+
+private:
+    // sliding window extreme: indices and values kept monotonic, so that the front is the min (or max) of the window
+    struct MonotonicQueue {
+        explicit MonotonicQueue(size_t capacity) : items(capacity) {}
+
+        std::vector<std::pair<uint64_t, float>> items;
+        size_t head = 0;
+        size_t count = 0;
+    };
+
+    void pushExtreme(MonotonicQueue& queue, float value, bool keep_smaller);
+    void recomputeSums();
+
+    RingBuffer<float> samples_;
+    uint64_t count_ = 0;
+    double sum_ = 0.0;
+    double sum_squares_ = 0.0;
+    MonotonicQueue min_queue_;
+    MonotonicQueue max_queue_;
+    StreamingQuantile p50_{ 0.5 };
+    StreamingQuantile p95_{ 0.95 };
+    StreamingQuantile p99_{ 0.99 };
+};
+
+// Named metrics and counters, created the first time they are used. Looking up an existing one doesn't allocate,
+// and the references returned stay valid for the lifetime of the object.
+class FrameStats {
+public:
+    explicit FrameStats(size_t window = RollingMetric::kDefaultWindow) : window_(window) {}
+
+    RollingMetric& metric(std::string_view name);
+    void addSample(std::string_view name, float value) { metric(name).addSample(value); }
+
+    uint64_t& counter(std::string_view name);
+    void increment(std::string_view name, uint64_t amount = 1) { counter(name) += amount; }
+
+    const std::map<std::string, RollingMetric, std::less<>>& getMetrics() const { return metrics_; }
+    const std::map<std::string, uint64_t, std::less<>>& getCounters() const { return counters_; }
+
+    void reset();  // every metric and counter starts again, they stay registered
+
+    // a line per metric (mean, p95, max) and counter. must be called inside an ImGui window
+    void drawImGui() const;
+    // csv, one row per metric and per counter
+    bool exportCsv(const std::string& path) const;
+
+private:
+    size_t window_;
+    std::map<std::string, RollingMetric, std::less<>> metrics_;
+    std::map<std::string, uint64_t, std::less<>> counters_;
+};
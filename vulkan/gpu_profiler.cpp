@@ -0,0 +1,359 @@
+/*
+* gpu_profiler.cpp
+*
+* Copyright (C) 2021 Riccardo Marson
+*/
+
+#include "gpu_profiler.hpp"
+
+namespace {
+    // in the order the results are written in, which is the order of the flag bits
+    const std::pair<VkQueryPipelineStatisticFlagBits, uint64_t PipelineStatistics::*> kStatisticsCounters[] = {
+        { VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_VERTICES_BIT, &PipelineStatistics::input_assembly_vertices },
+        { VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_PRIMITIVES_BIT, &PipelineStatistics::input_assembly_primitives },
+        { VK_QUERY_PIPELINE_STATISTIC_VERTEX_SHADER_INVOCATIONS_BIT, &PipelineStatistics::vertex_shader_invocations },
+        { VK_QUERY_PIPELINE_STATISTIC_GEOMETRY_SHADER_INVOCATIONS_BIT, &PipelineStatistics::geometry_shader_invocations },
+        { VK_QUERY_PIPELINE_STATISTIC_GEOMETRY_SHADER_PRIMITIVES_BIT, &PipelineStatistics::geometry_shader_primitives },
+        { VK_QUERY_PIPELINE_STATISTIC_CLIPPING_INVOCATIONS_BIT, &PipelineStatistics::clipping_invocations },
+        { VK_QUERY_PIPELINE_STATISTIC_CLIPPING_PRIMITIVES_BIT, &PipelineStatistics::clipping_primitives },
+        { VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT, &PipelineStatistics::fragment_shader_invocations },
+        { VK_QUERY_PIPELINE_STATISTIC_COMPUTE_SHADER_INVOCATIONS_BIT, &PipelineStatistics::compute_shader_invocations },
+    };
+
+    void addStatistics(PipelineStatistics& sum, const PipelineStatistics& value) {
+        for (const auto& counter : kStatisticsCounters) {
+            sum.*counter.second += value.*counter.second;
+        }
+    }
+}
+
+GpuProfiler::GpuProfiler(VkDevice device, VkSemaphore compute_timeline, float timestamp_period, uint32_t frames_count, uint32_t scopes_per_frame, VkQueryPipelineStatisticFlags graphics_statistics) :
+    device_(device),
+    compute_timeline_(compute_timeline),
+    timestamp_period_(timestamp_period),
+    scopes_per_frame_(scopes_per_frame),
+    queries_per_frame_(2 * scopes_per_frame) {
+
+    VkQueryPoolCreateInfo info{};
+    info.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    info.queryType = VK_QUERY_TYPE_TIMESTAMP;
+    info.queryCount = queries_per_frame_ * frames_count + 1;  // + the calibration query
+    calibration_query_ = info.queryCount - 1;
+
+    if (vkCreateQueryPool(device_, &info, nullptr, &vk_query_pool_) != VK_SUCCESS) {
+        std::cerr << "Failed to create GPU profiler query pool!" << std::endl;
+        vk_query_pool_ = VK_NULL_HANDLE;
+        return;
+    }
+
+    // queries must be reset before their first use
+    vkResetQueryPool(device_, vk_query_pool_, 0, info.queryCount);
+
+    slices_.resize(frames_count);
+    for (uint32_t i = 0; i < frames_count; ++i) {
+        slices_[i].first_query = i * queries_per_frame_;
+        slices_[i].first_statistics_query = i * scopes_per_frame_;
+    }
+
+    if (graphics_statistics != 0) {
+        // the compute pool can't have graphics counters, the graphics pool counts dispatches too
+        if (!createStatisticsPool(graphics_statistics_pool_, graphics_statistics | VK_QUERY_PIPELINE_STATISTIC_COMPUTE_SHADER_INVOCATIONS_BIT, scopes_per_frame_ * frames_count) ||
+            !createStatisticsPool(compute_statistics_pool_, VK_QUERY_PIPELINE_STATISTIC_COMPUTE_SHADER_INVOCATIONS_BIT, scopes_per_frame_ * frames_count)) {
+            std::cerr << "GPU profiler: pipeline statistics are not available!" << std::endl;
+            for (auto pool : { &graphics_statistics_pool_, &compute_statistics_pool_ }) {
+                if (pool->vk_query_pool != VK_NULL_HANDLE) {
+                    vkDestroyQueryPool(device_, pool->vk_query_pool, nullptr);
+                }
+                *pool = StatisticsPool{};
+            }
+        }
+    }
+}
+
+GpuProfiler::~GpuProfiler() {
+    for (auto pool : { vk_query_pool_, graphics_statistics_pool_.vk_query_pool, compute_statistics_pool_.vk_query_pool }) {
+        if (pool != VK_NULL_HANDLE) {
+            vkDestroyQueryPool(device_, pool, nullptr);
+        }
+    }
+}
+
+void GpuProfiler::beginScope(VkCommandBuffer command_buffer, const std::string& name, PipelineStatisticsType statistics, VkPipelineStageFlagBits stage) {
+    if (!isValid()) {
+        return;
+    }
+
+    auto& slice = slices_[current_slice_];
+    if (slice.used_queries + 2 > queries_per_frame_) {
+        if (!reported_full_) {
+            std::cerr << "GPU profiler: more than " << queries_per_frame_ / 2 << " scopes in one frame, " << name << " is not profiled!" << std::endl;
+            reported_full_ = true;
+        }
+        return;
+    }
+
+    Scope scope;
+    scope.name = name;
+    scope.begin_query = slice.first_query + slice.used_queries;
+    scope.end_query = scope.begin_query + 1;
+    scope.depth = static_cast<uint32_t>(open_scopes_.size());
+    slice.used_queries += 2;
+
+    vkCmdWriteTimestamp(command_buffer, stage, vk_query_pool_, scope.begin_query);
+
+    // one statistics query per scope at most, so the slices of the statistics pools can't run out before the timestamps
+    if (statistics != PipelineStatisticsType::NONE && pipelineStatisticsEnabled()) {
+        bool graphics = statistics == PipelineStatisticsType::GRAPHICS;
+        auto& used = graphics ? slice.used_graphics_statistics : slice.used_compute_statistics;
+        scope.statistics = statistics;
+        scope.statistics_query = slice.first_statistics_query + used++;
+        vkCmdBeginQuery(command_buffer, graphics ? graphics_statistics_pool_.vk_query_pool : compute_statistics_pool_.vk_query_pool, scope.statistics_query, 0);
+    }
+
+    open_scopes_.push_back(slice.scopes.size());
+    slice.scopes.push_back(scope);
+}
+
+void GpuProfiler::endScope(VkCommandBuffer command_buffer, const std::string& name, VkPipelineStageFlagBits stage) {
+    if (!isValid()) {
+        return;
+    }
+
+    auto& slice = slices_[current_slice_];
+    if (open_scopes_.empty() || slice.scopes[open_scopes_.back()].name != name) {
+        // also the case when the beginning was dropped because the slice was full
+        return;
+    }
+
+    auto& scope = slice.scopes[open_scopes_.back()];
+    if (scope.statistics != PipelineStatisticsType::NONE) {
+        auto pool = scope.statistics == PipelineStatisticsType::GRAPHICS ? graphics_statistics_pool_.vk_query_pool : compute_statistics_pool_.vk_query_pool;
+        vkCmdEndQuery(command_buffer, pool, scope.statistics_query);
+    }
+    vkCmdWriteTimestamp(command_buffer, stage, vk_query_pool_, scope.end_query);
+    scope.ended = true;
+    open_scopes_.pop_back();
+}
+
+void GpuProfiler::nextFrame(uint64_t compute_value) {
+    if (!isValid()) {
+        return;
+    }
+
+    if (!open_scopes_.empty()) {
+        std::cerr << "GPU profiler: scope " << slices_[current_slice_].scopes[open_scopes_.back()].name << " was never ended!" << std::endl;
+        open_scopes_.clear();
+    }
+
+    slices_[current_slice_].compute_value = compute_value;
+    current_slice_ = (current_slice_ + 1) % static_cast<uint32_t>(slices_.size());
+    collect(slices_[current_slice_]);
+}
+
+bool GpuProfiler::createStatisticsPool(StatisticsPool& pool, VkQueryPipelineStatisticFlags flags, uint32_t queries_count) {
+    VkQueryPoolCreateInfo info{};
+    info.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    info.queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS;
+    info.queryCount = queries_count;
+    info.pipelineStatistics = flags;
+
+    if (vkCreateQueryPool(device_, &info, nullptr, &pool.vk_query_pool) != VK_SUCCESS) {
+        pool.vk_query_pool = VK_NULL_HANDLE;
+        return false;
+    }
+
+    vkResetQueryPool(device_, pool.vk_query_pool, 0, queries_count);
+
+    pool.flags = flags;
+    pool.counters = 0;
+    for (const auto& counter : kStatisticsCounters) {
+        if (flags & counter.first) {
+            ++pool.counters;
+        }
+    }
+
+    return true;
+}
+
+std::vector<std::optional<PipelineStatistics>> GpuProfiler::readStatistics(const StatisticsPool& pool, uint32_t first_query, uint32_t count) {
+    std::vector<std::optional<PipelineStatistics>> statistics(count);
+    if (count == 0) {
+        return statistics;
+    }
+
+    // the enabled counters + availability for each query
+    const size_t stride = pool.counters + 1;
+    std::vector<uint64_t> results(stride * count);
+    vkGetQueryPoolResults(device_, pool.vk_query_pool, first_query, count,
+                          results.size() * sizeof(uint64_t), results.data(), stride * sizeof(uint64_t),
+                          VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+
+    for (uint32_t q = 0; q < count; ++q) {
+        const uint64_t* values = &results[q * stride];
+        if (values[pool.counters] == 0) {
+            continue;
+        }
+
+        PipelineStatistics query_statistics;
+        for (const auto& counter : kStatisticsCounters) {
+            if (pool.flags & counter.first) {
+                query_statistics.*counter.second = *values++;
+            }
+        }
+        statistics[q] = query_statistics;
+    }
+
+    vkResetQueryPool(device_, pool.vk_query_pool, first_query, count);
+    return statistics;
+}
+
+void GpuProfiler::collectAll() {
+    if (!isValid()) {
+        return;
+    }
+
+    for (auto& slice : slices_) {
+        collect(slice);
+    }
+}
+
+void GpuProfiler::writeCalibrationTimestamp(VkCommandBuffer command_buffer) {
+    if (isValid()) {
+        vkResetQueryPool(device_, vk_query_pool_, calibration_query_, 1);
+        vkCmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, vk_query_pool_, calibration_query_);
+    }
+}
+
+bool GpuProfiler::calibrate(int64_t cpu_before_ns, int64_t cpu_after_ns) {
+    if (!isValid()) {
+        return false;
+    }
+
+    uint64_t result[2] = { 0, 0 };
+    vkGetQueryPoolResults(device_, vk_query_pool_, calibration_query_, 1, sizeof(result), result, sizeof(result),
+                          VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+    if (result[1] == 0) {
+        std::cerr << "GPU profiler: the calibration timestamp is not available!" << std::endl;
+        return false;
+    }
+
+    // the timestamp was written somewhere between the two, the error is at most half the round trip
+    auto cpu_ns = 0.5 * (static_cast<double>(cpu_before_ns) + static_cast<double>(cpu_after_ns));
+    clock_offset_ns_ = cpu_ns - result[0] * static_cast<double>(timestamp_period_);
+    return true;
+}
+
+std::vector<TraceEvent> GpuProfiler::getTraceEvents() const {
+    std::vector<TraceEvent> events;
+    events.reserve(trace_events_.size());
+    for (const auto& gpu_event : trace_events_) {
+        TraceEvent event;
+        event.name = gpu_event.name;
+        event.begin_ns = static_cast<int64_t>(gpu_event.begin_ticks * static_cast<double>(timestamp_period_) + clock_offset_ns_);
+        event.end_ns = static_cast<int64_t>(gpu_event.end_ticks * static_cast<double>(timestamp_period_) + clock_offset_ns_);
+        event.depth = gpu_event.depth;
+        events.push_back(event);
+    }
+    return events;
+}
+
+void GpuProfiler::collect(FrameSlice& slice) {
+    if (slice.used_queries == 0) {
+        return;
+    }
+
+    // the graphics fences say nothing about the compute queue. once this value is reached every query of the slice
+    // has either been written or was recorded in a command buffer that was never submitted, so resetting is safe
+    if (slice.compute_value > 0 && compute_timeline_ != VK_NULL_HANDLE) {
+        VkSemaphoreWaitInfo wait_info{};
+        wait_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+        wait_info.semaphoreCount = 1;
+        wait_info.pSemaphores = &compute_timeline_;
+        wait_info.pValues = &slice.compute_value;
+        vkWaitSemaphores(device_, &wait_info, UINT64_MAX);
+    }
+
+    // value + availability for each query. queries that are not available are skipped
+    std::vector<uint64_t> results(2 * static_cast<size_t>(slice.used_queries));
+    vkGetQueryPoolResults(device_, vk_query_pool_, slice.first_query, slice.used_queries,
+                          results.size() * sizeof(uint64_t), results.data(), 2 * sizeof(uint64_t),
+                          VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+
+    auto graphics_statistics = readStatistics(graphics_statistics_pool_, slice.first_statistics_query, slice.used_graphics_statistics);
+    auto compute_statistics = readStatistics(compute_statistics_pool_, slice.first_statistics_query, slice.used_compute_statistics);
+
+    // same name, same frame: the durations and the counters add up
+    std::map<std::string, Scope> frame_scopes;
+    std::map<std::string, float> frame_durations;
+    std::map<std::string, PipelineStatistics> frame_statistics;
+    for (const auto& scope : slice.scopes) {
+        if (!scope.ended) {
+            continue;
+        }
+
+        size_t begin = 2 * static_cast<size_t>(scope.begin_query - slice.first_query);
+        size_t end = 2 * static_cast<size_t>(scope.end_query - slice.first_query);
+        if (results[begin + 1] == 0 || results[end + 1] == 0) {
+            continue;
+        }
+
+        if (tracing_) {
+            trace_events_.push_back(GpuEvent{ scope.name, results[begin], results[end], scope.depth });
+            if (trace_events_.size() > kTraceEventsCount) {
+                trace_events_.pop_front();
+            }
+        }
+
+        auto ticks = results[end] > results[begin] ? results[end] - results[begin] : 0;
+        frame_durations[scope.name] += static_cast<float>(ticks * timestamp_period_ * 1e-6);  // nanoseconds -> milliseconds
+        if (frame_scopes.find(scope.name) == frame_scopes.end()) {
+            frame_scopes[scope.name] = scope;
+        }
+        frame_scopes[scope.name].end_query = scope.end_query;  // the begin of the first, the end of the last
+
+        if (scope.statistics != PipelineStatisticsType::NONE) {
+            const auto& statistics = scope.statistics == PipelineStatisticsType::GRAPHICS ? graphics_statistics : compute_statistics;
+            const auto& query_statistics = statistics[scope.statistics_query - slice.first_statistics_query];
+            if (query_statistics) {
+                addStatistics(frame_statistics[scope.name], *query_statistics);
+            }
+        }
+    }
+
+    for (const auto& entry : frame_scopes) {
+        const auto& scope = entry.second;
+        size_t begin = 2 * static_cast<size_t>(scope.begin_query - slice.first_query);
+        size_t end = 2 * static_cast<size_t>(scope.end_query - slice.first_query);
+        addSample(entry.first, scope.depth, frame_durations[entry.first],
+                  results[begin] * timestamp_period_ * 1e-6, results[end] * timestamp_period_ * 1e-6);
+
+        auto statistics_iter = frame_statistics.find(entry.first);
+        auto& stats = timings_[entry.first];
+        stats.has_statistics = statistics_iter != frame_statistics.end();
+        stats.statistics = stats.has_statistics ? statistics_iter->second : PipelineStatistics{};
+    }
+
+    vkResetQueryPool(device_, vk_query_pool_, slice.first_query, slice.used_queries);
+    slice.used_queries = 0;
+    slice.used_graphics_statistics = 0;
+    slice.used_compute_statistics = 0;
+    slice.compute_value = 0;
+    slice.scopes.clear();
+}
+
+void GpuProfiler::addSample(const std::string& name, uint32_t depth, float duration_ms, double begin_ms, double end_ms) {
+    auto& stats = timings_[name];
+    stats.samples.addSample(duration_ms);
+    ++stats.samples_count;
+
+    stats.last_ms = duration_ms;
+    stats.previous_begin_ms = stats.last_begin_ms;
+    stats.previous_end_ms = stats.last_end_ms;
+    stats.last_begin_ms = begin_ms;
+    stats.last_end_ms = end_ms;
+    stats.depth = depth;
+
+    stats.avg_ms = stats.samples.mean();
+    stats.min_ms = stats.samples.min();
+    stats.max_ms = stats.samples.max();
+}
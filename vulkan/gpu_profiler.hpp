@@ -0,0 +1,156 @@
+/*
+* gpu_profiler.hpp
+*
+* Copyright (C) 2021 Riccardo Marson
+*/
+
+#pragma once
+
+#include "common_definitions.hpp"
+#include "profilers.hpp"
+#include "frame_stats.hpp"
+
+#include <deque>
+
+#include <optional>
+
+// which pipeline statistics query a scope records, if any. compute scopes use a pool without the graphics
+// counters, so that they can be recorded on a compute-only queue
+enum class PipelineStatisticsType { NONE = 0, GRAPHICS, COMPUTE };
+
+// counters of a VK_QUERY_TYPE_PIPELINE_STATISTICS query. the geometry shader ones stay at 0 on devices without
+// geometry shaders, and so do all the graphics ones in compute scopes
+struct PipelineStatistics {
+    uint64_t input_assembly_vertices = 0;
+    uint64_t input_assembly_primitives = 0;
+    uint64_t vertex_shader_invocations = 0;
+    uint64_t geometry_shader_invocations = 0;
+    uint64_t geometry_shader_primitives = 0;
+    uint64_t clipping_invocations = 0;
+    uint64_t clipping_primitives = 0;  // output by the clipping stage
+    uint64_t fragment_shader_invocations = 0;
+    uint64_t compute_shader_invocations = 0;
+};
+
+// rolling statistics of a named GPU scope, over the last RollingMetric::kDefaultWindow frames it was recorded in
+struct GpuScopeStats {
+    float last_ms = 0.f;
+    float avg_ms = 0.f;
+    float min_ms = 0.f;
+    float max_ms = 0.f;
+    // raw timestamps of the last sample, to compare scopes recorded on different queues
+    double last_begin_ms = 0.0;
+    double last_end_ms = 0.0;
+    double previous_begin_ms = 0.0;  // of the sample before, i.e. the previous frame
+    double previous_end_ms = 0.0;
+    uint32_t depth = 0;  // how many scopes were open around it when it was recorded
+    uint64_t samples_count = 0;  // collected so far, a change means last_ms is a new sample
+
+    bool has_statistics = false;
+    PipelineStatistics statistics;  // last sample
+
+    RollingMetric samples;  // the statistics above are read from it, percentiles included
+};
+
+using GpuTimings = std::map<std::string, GpuScopeStats>;
+
+// Timestamp scopes allocated on demand from a query pool split in one slice per frame.
+// Scopes nest in recording order, across command buffers too: a scope opened in a primary command buffer
+// contains the scopes recorded in the secondaries executed within it. Scopes with the same name recorded in
+// the same frame are added together.
+// A scope can also record a pipeline statistics query. Unlike timestamps those can't be nested in the same command
+// buffer, or span vkCmdExecuteCommands, so they are meant for the innermost scopes around the actual draws and dispatches.
+// With tracing on, the last kTraceEventsCount scopes are also kept one by one, to be exported with the CPU profiler
+// trace. The GPU clock is mapped to the CPU one with a calibration timestamp, see calibrate.
+// A frame is closed by nextFrame, called once its graphics work has been submitted. Its slice is read back
+// when it comes around again, by which time the fences of the frames in flight guarantee the graphics queue is done
+// with it, and reset from the host (hostQueryReset) so that nothing has to be recorded mid-frame. The fences don't
+// cover the scopes recorded on a dedicated compute queue, so the compute timeline value submitted with the frame
+// is waited on first. It has normally been reached long before.
+class GpuProfiler {
+public:
+    static const size_t kTraceEventsCount = 16384;
+
+    // graphics_statistics are the counters of the graphics statistics queries, none if 0
+    GpuProfiler(VkDevice device, VkSemaphore compute_timeline, float timestamp_period, uint32_t frames_count, uint32_t scopes_per_frame = 32, VkQueryPipelineStatisticFlags graphics_statistics = 0);
+    ~GpuProfiler();
+
+    bool isValid() const { return vk_query_pool_ != VK_NULL_HANDLE; }
+    bool pipelineStatisticsEnabled() const { return graphics_statistics_pool_.vk_query_pool != VK_NULL_HANDLE; }
+    const GpuTimings& getTimings() const { return timings_; }
+    void clearTimings() { timings_.clear(); }
+
+    // stage is where the timestamp is written: the top of the pipe for the beginning of a scope, the bottom for the end
+    void beginScope(VkCommandBuffer command_buffer, const std::string& name, PipelineStatisticsType statistics = PipelineStatisticsType::NONE, VkPipelineStageFlagBits stage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT);
+    void endScope(VkCommandBuffer command_buffer, const std::string& name, VkPipelineStageFlagBits stage = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT);
+
+    void nextFrame(uint64_t compute_value);  // the last compute timeline value submitted up to this frame
+    void collectAll();  // reads back every slice, only once the device is idle
+
+    void setTracing(bool tracing) { tracing_ = tracing; }
+    // records a timestamp to match with the CPU clock. once the command buffer has been submitted and has completed,
+    // calibrate takes the CPU times from just before the submission and just after the wait
+    void writeCalibrationTimestamp(VkCommandBuffer command_buffer);
+    bool calibrate(int64_t cpu_before_ns, int64_t cpu_after_ns);
+    std::vector<TraceEvent> getTraceEvents() const;  // on the CPU profiler clock
+
+private:
+    struct Scope {
+        std::string name;
+        uint32_t begin_query = 0;
+        uint32_t end_query = 0;
+        uint32_t depth = 0;
+        bool ended = false;
+        PipelineStatisticsType statistics = PipelineStatisticsType::NONE;
+        uint32_t statistics_query = 0;
+    };
+
+    struct FrameSlice {
+        uint32_t first_query = 0;
+        uint32_t used_queries = 0;
+        uint32_t used_graphics_statistics = 0;  // from first_statistics_query in the statistics pools
+        uint32_t used_compute_statistics = 0;
+        uint32_t first_statistics_query = 0;
+        uint64_t compute_value = 0;  // reached once the compute scopes of the slice have completed
+        std::vector<Scope> scopes;
+    };
+
+    struct GpuEvent {
+        std::string name;
+        uint64_t begin_ticks = 0;
+        uint64_t end_ticks = 0;
+        uint32_t depth = 0;
+    };
+
+    struct StatisticsPool {
+        VkQueryPool vk_query_pool = VK_NULL_HANDLE;
+        VkQueryPipelineStatisticFlags flags = 0;
+        uint32_t counters = 0;  // values in each result
+    };
+
+    bool createStatisticsPool(StatisticsPool& pool, VkQueryPipelineStatisticFlags flags, uint32_t queries_count);
+    std::vector<std::optional<PipelineStatistics>> readStatistics(const StatisticsPool& pool, uint32_t first_query, uint32_t count);
+    void collect(FrameSlice& slice);
+    void addSample(const std::string& name, uint32_t depth, float duration_ms, double begin_ms, double end_ms);
+
+    VkDevice device_;
+    VkSemaphore compute_timeline_;  // owned by the backend
+    float timestamp_period_;  // nanoseconds per tick
+    uint32_t scopes_per_frame_;
+    uint32_t queries_per_frame_;
+
+    VkQueryPool vk_query_pool_ = VK_NULL_HANDLE;
+    StatisticsPool graphics_statistics_pool_;
+    StatisticsPool compute_statistics_pool_;
+    std::vector<FrameSlice> slices_;
+    uint32_t current_slice_ = 0;
+    std::vector<size_t> open_scopes_;  // indices in the current slice scopes, innermost last
+    bool reported_full_ = false;
+
+    bool tracing_ = false;
+    std::deque<GpuEvent> trace_events_;
+    uint32_t calibration_query_ = 0;  // the last one in the pool, after the slices
+    double clock_offset_ns_ = 0.0;  // CPU time - GPU time
+
+    GpuTimings timings_;
+};
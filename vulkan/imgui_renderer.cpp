@@ -142,6 +142,11 @@ void ImGuiRenderer::shutDown() {
 
     vulkan_backend_->freeCommandBuffers(vk_drawing_buffers_);
 
+    if (glfw_interface.glfw_window == nullptr) {
+        ImGui::DestroyContext();
+        return;
+    }
+
     glfwSetMouseButtonCallback(glfw_interface.glfw_window, glfw_interface.external_callbacks.mouseButtonCallback);
     glfwSetScrollCallback(glfw_interface.glfw_window, glfw_interface.external_callbacks.scrollCallback);
     glfwSetKeyCallback(glfw_interface.glfw_window, glfw_interface.external_callbacks.keyCallback);
@@ -150,7 +155,7 @@ void ImGuiRenderer::shutDown() {
     ImGui::DestroyContext();
 }
 
-bool ImGuiRenderer::createGraphicsPipeline(const RenderPass& render_pass, uint32_t subpass_number) {
+PipelineBuild ImGuiRenderer::createGraphicsPipeline(const RenderPass& render_pass, uint32_t subpass_number) {
     ui_pipeline_ = vulkan_backend_->createGraphicsPipeline("UI Overlay");
 
     GraphicsPipelineConfig config;
@@ -166,29 +171,30 @@ bool ImGuiRenderer::createGraphicsPipeline(const RenderPass& render_pass, uint32
     config.enableTransparency = true;
     config.dynamicStates = true;
 
-    if (ui_pipeline_->buildPipeline(config)) {
+    subpass_number_ = subpass_number;
+
+    return vulkan_backend_->buildPipelineAsync(*ui_pipeline_, config).then([this]() {
         createDescriptorSets(ui_pipeline_->descriptorSets());
         updateDescriptorSets(ui_pipeline_->descriptorMetadata());
-
-        subpass_number_ = subpass_number;
         return true;
-    }
-
-    return false;
+    });
 }
 
 void ImGuiRenderer::cleanupGraphicsPipeline() {
     ui_pipeline_.reset();
 }
 
-DescriptorPoolConfig ImGuiRenderer::getDescriptorsCount() const {
-    DescriptorPoolConfig config;
-    config.image_samplers_count = 1;
-    return config;
-}
-
 void ImGuiRenderer::beginFrame() {
     ImGuiIO& io = ImGui::GetIO();
+
+    if (glfw_interface.glfw_window == nullptr) {
+        // headless: draw to the offscreen image size, at a fixed time step and without any input
+        auto extent = vulkan_backend_->getSwapChainExtent();
+        io.DisplaySize = ImVec2((float)extent.width, (float)extent.height);
+        io.DeltaTime = 1.0f / 60.0f;
+        ImGui::NewFrame();
+        return;
+    }
    
     // Setup display size (every frame to accommodate for window resizing)
     int w, h;
@@ -271,11 +277,11 @@ void ImGuiRenderer::endFrame() {
 }
 
 
-RecordCommandsResult ImGuiRenderer::renderFrame(uint32_t swapchain_image, VkRenderPassBeginInfo& render_pass_info, const ProfileConfig& profile_config) {
+RecordCommandsResult ImGuiRenderer::renderFrame(uint32_t frame_index, VkRenderPassBeginInfo& render_pass_info, const ProfileConfig& profile_config) {
     ImDrawData* draw_data = ImGui::GetDrawData();
 
     // we might need to combine multiple command buffers in one frame in the future
-    std::vector<VkCommandBuffer> command_buffers = { vk_drawing_buffers_[swapchain_image] };
+    std::vector<VkCommandBuffer> command_buffers = { vk_drawing_buffers_[frame_index] };
     vulkan_backend_->resetCommandBuffers(command_buffers);
 
     if (draw_data->TotalVtxCount <= 0) {
@@ -322,7 +328,7 @@ RecordCommandsResult ImGuiRenderer::renderFrame(uint32_t swapchain_image, VkRend
     vkCmdPushConstants(command_buffers[0], ui_pipeline_->layout(), pc.stageFlags, pc.offset, pc.size, &ui_transform_push_constant_);
 
     vkCmdBindPipeline(command_buffers[0], VK_PIPELINE_BIND_POINT_GRAPHICS, ui_pipeline_->handle());
-    vkCmdBindDescriptorSets(command_buffers[0], VK_PIPELINE_BIND_POINT_GRAPHICS, ui_pipeline_->layout(), UI_UNIFORM_SET_ID, 1, &vk_descriptor_sets_[swapchain_image], 0, NULL);
+    vkCmdBindDescriptorSets(command_buffers[0], VK_PIPELINE_BIND_POINT_GRAPHICS, ui_pipeline_->layout(), UI_UNIFORM_SET_ID, 1, &vk_descriptor_sets_[frame_index], 0, NULL);
 
     VkBuffer vertex_buffers[1] = { vertex_buffer_.vk_buffer };
     VkDeviceSize vertex_offset[1] = { 0 };
@@ -342,7 +348,8 @@ RecordCommandsResult ImGuiRenderer::renderFrame(uint32_t swapchain_image, VkRend
     ImVec2 clip_scale = draw_data->FramebufferScale; // (1,1) unless using retina display which are often (2,2)
 
     if (profile_config.profile_draw) {
-        vulkan_backend_->writeTimestampQuery(command_buffers[0], VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, profile_config.start_query_num); // does nothing if not in debug
+        auto statistics = profile_config.pipeline_statistics ? PipelineStatisticsType::GRAPHICS : PipelineStatisticsType::NONE;
+        vulkan_backend_->beginGpuScope(command_buffers[0], profile_config.scope_name, statistics); // does nothing unless the profiler is enabled
     }
 
     // Render command lists
@@ -386,7 +393,7 @@ RecordCommandsResult ImGuiRenderer::renderFrame(uint32_t swapchain_image, VkRend
     }
 
     if (profile_config.profile_draw) {
-        vulkan_backend_->writeTimestampQuery(command_buffers[0], VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, profile_config.stop_query_num); // does nothing if not in debug
+        vulkan_backend_->endGpuScope(command_buffers[0], profile_config.scope_name);
     }
 
     if (vkEndCommandBuffer(command_buffers[0]) != VK_SUCCESS) {
@@ -438,6 +445,10 @@ void ImGuiRenderer::InitImGui(GLFWWindowHandle window) {
     io.KeyMap[ImGuiKey_Y] = GLFW_KEY_Y;
     io.KeyMap[ImGuiKey_Z] = GLFW_KEY_Z;
 
+    if (glfw_interface.glfw_window == nullptr) {
+        return;  // headless, no window to take input or cursors from
+    }
+
     io.SetClipboardTextFn = SetClipboardText;
     io.GetClipboardTextFn = GetClipboardText;
     io.ClipboardUserData = glfw_interface.glfw_window;
@@ -483,23 +494,21 @@ void ImGuiRenderer::InitImGui(GLFWWindowHandle window) {
 void ImGuiRenderer::InitVulkanAssets() {
     uploadFonts();
 
-    imgui_vertex_shader_ = vulkan_backend_->createShaderModule("imgui_vertex");
-    imgui_vertex_shader_->loadSpirvShader("shaders/imgui_vs.spv");
+    imgui_vertex_shader_ = vulkan_backend_->loadShaderModule("imgui_vertex", "shaders/imgui_vs.spv");
 
     if (!imgui_vertex_shader_->isVertexFormatCompatible(getVertexFormatInfo())) {
         std::cerr << "[IMGUI Renderer] Requested Vertex format is not compatible with pipeline input!" << std::endl;
         return;
     }
 
-    imgui_fragment_shader_ = vulkan_backend_->createShaderModule("imgui_fragment");
-    imgui_fragment_shader_->loadSpirvShader("shaders/imgui_fs.spv");
+    imgui_fragment_shader_ = vulkan_backend_->loadShaderModule("imgui_fragment", "shaders/imgui_fs.spv");
 
     if (!imgui_vertex_shader_->isValid() || !imgui_fragment_shader_->isValid()) {
         std::cerr << "[IMGUI Renderer] Failed to validate shaders!" << std::endl;
         return;
     }
 
-    vk_drawing_buffers_ = vulkan_backend_->createSecondaryCommandBuffers(vulkan_backend_->getSwapChainSize());
+    vk_drawing_buffers_ = vulkan_backend_->createSecondaryCommandBuffers(vulkan_backend_->getFramesInFlight());
     if (vk_drawing_buffers_.empty()) {
         std::cerr << "[IMGUI Renderer] Failed to create secondary command buffers!" << std::endl;
         return;
@@ -532,15 +541,9 @@ void ImGuiRenderer::uploadFonts() {
 
 void ImGuiRenderer::createDescriptorSets(const std::map<uint32_t, VkDescriptorSetLayout>& descriptor_set_layouts) {
     const auto& layout = descriptor_set_layouts.find(UI_UNIFORM_SET_ID)->second;
-    std::vector<VkDescriptorSetLayout> layouts(vulkan_backend_->getSwapChainSize(), layout);
-    VkDescriptorSetAllocateInfo alloc_info{};
-    alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-    alloc_info.descriptorPool = vulkan_backend_->getDescriptorPool();
-    alloc_info.descriptorSetCount = vulkan_backend_->getSwapChainSize();
-    alloc_info.pSetLayouts = layouts.data();
-
-    std::vector<VkDescriptorSet> layout_descriptor_sets(vulkan_backend_->getSwapChainSize());
-    if (vkAllocateDescriptorSets(vulkan_backend_->getDevice(), &alloc_info, layout_descriptor_sets.data()) != VK_SUCCESS) {
+    std::vector<VkDescriptorSetLayout> layouts(vulkan_backend_->getFramesInFlight(), layout);
+    std::vector<VkDescriptorSet> layout_descriptor_sets;
+    if (!vulkan_backend_->allocateDescriptorSets(layouts, layout_descriptor_sets)) {
         std::cerr << "[IMGUI Renderer] Failed to allocate Mesh descriptor sets!" << std::endl;
         return;
     }
@@ -561,6 +564,14 @@ void ImGuiRenderer::createBuffers() {
         return;
     }
 
+    // grow the buffers if the UI outgrew them. the old ones may still be read by frames in flight
+    if (static_cast<uint32_t>(draw_data->TotalVtxCount) > max_vertex_count_) {
+        vulkan_backend_->destroyBufferDeferred(vertex_buffer_);
+    }
+    if (static_cast<uint32_t>(draw_data->TotalIdxCount) > max_index_count_) {
+        vulkan_backend_->destroyBufferDeferred(index_buffer_);
+    }
+
     if (vertex_buffer_.vk_buffer == VK_NULL_HANDLE) {
         max_vertex_count_ = draw_data->TotalVtxCount * 5; // leave enough room for 
         auto empty_vertex_buffer = std::vector<ImDrawVert>(max_vertex_count_, ImDrawVert());
@@ -576,23 +587,14 @@ void ImGuiRenderer::createBuffers() {
 
 void ImGuiRenderer::updateBuffers() {
     ImDrawData* draw_data = ImGui::GetDrawData();
-    ImDrawVert* vtx_dst = nullptr;
-    ImDrawIdx* idx_dst = nullptr;
-    size_t vertex_size = draw_data->TotalVtxCount * sizeof(ImDrawVert);
-    size_t index_size = draw_data->TotalIdxCount * sizeof(ImDrawIdx);
-
-    VkResult result = vkMapMemory(vulkan_backend_->getDevice(), vertex_buffer_.vk_buffer_memory, 0, vertex_size, 0, (void**)(&vtx_dst));
-    if (result != VK_SUCCESS) {
-        std::cerr << "[IMGUI Renderer] Failed to map UI vertex buffer" << std::endl;
+    if (vertex_buffer_.memory.mapped_data == nullptr || index_buffer_.memory.mapped_data == nullptr) {
+        std::cerr << "[IMGUI Renderer] UI buffers are not host visible" << std::endl;
         return;
     }
 
-    result = vkMapMemory(vulkan_backend_->getDevice(), index_buffer_.vk_buffer_memory, 0, index_size, 0, (void**)(&idx_dst));
-    if (result != VK_SUCCESS) {
-        vkUnmapMemory(vulkan_backend_->getDevice(), vertex_buffer_.vk_buffer_memory);
-        std::cerr << "[IMGUI Renderer] Failed to map UI index buffer" << std::endl;
-        return;
-    }
+    // the buffers live in persistently mapped, host coherent memory so there is no need to map or flush them
+    ImDrawVert* vtx_dst = static_cast<ImDrawVert*>(vertex_buffer_.memory.mapped_data);
+    ImDrawIdx* idx_dst = static_cast<ImDrawIdx*>(index_buffer_.memory.mapped_data);
 
     for (int n = 0; n < draw_data->CmdListsCount; n++)
     {
@@ -602,19 +604,4 @@ void ImGuiRenderer::updateBuffers() {
         vtx_dst += cmd_list->VtxBuffer.Size;
         idx_dst += cmd_list->IdxBuffer.Size;
     }
-
-    VkMappedMemoryRange range[2] = {};
-    range[0].sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
-    range[0].memory = vertex_buffer_.vk_buffer_memory;
-    range[0].size = VK_WHOLE_SIZE;
-    range[1].sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
-    range[1].memory = index_buffer_.vk_buffer_memory;
-    range[1].size = VK_WHOLE_SIZE;
-    result = vkFlushMappedMemoryRanges(vulkan_backend_->getDevice(), 2, range);
-    if (result != VK_SUCCESS) {
-        std::cerr << "[IMGUI Renderer] Failed to flush UI buffers" << std::endl;
-    }
-
-    vkUnmapMemory(vulkan_backend_->getDevice(), vertex_buffer_.vk_buffer_memory);
-    vkUnmapMemory(vulkan_backend_->getDevice(), index_buffer_.vk_buffer_memory);
 }
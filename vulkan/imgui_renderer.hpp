@@ -30,13 +30,12 @@ public:
 
 	float getHighDpiScale() const { return high_dpi_scale_; }
 
-	bool createGraphicsPipeline(const RenderPass& render_pass, uint32_t subpass_number);
+	PipelineBuild createGraphicsPipeline(const RenderPass& render_pass, uint32_t subpass_number);
 	void cleanupGraphicsPipeline();
-	DescriptorPoolConfig getDescriptorsCount() const;
 
 	void beginFrame();
 	void endFrame();
-	RecordCommandsResult renderFrame(uint32_t swapchain_image, VkRenderPassBeginInfo& render_pass_info, const ProfileConfig& profile_config);
+	RecordCommandsResult renderFrame(uint32_t frame_index, VkRenderPassBeginInfo& render_pass_info, const ProfileConfig& profile_config);
 
 private:
 	void InitImGui(GLFWWindowHandle window);
@@ -56,8 +55,8 @@ private:
 	uint32_t max_vertex_count_ = 0;
 	uint32_t max_index_count_ = 0;
 	
-	std::shared_ptr<ShaderModule> imgui_vertex_shader_;
-	std::shared_ptr<ShaderModule> imgui_fragment_shader_;
+	std::shared_ptr<const ShaderModule> imgui_vertex_shader_;
+	std::shared_ptr<const ShaderModule> imgui_fragment_shader_;
 	std::shared_ptr<Texture> fonts_texture_;
 
 	UiTransform ui_transform_push_constant_;
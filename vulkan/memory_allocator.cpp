@@ -0,0 +1,269 @@
+/*
+* memory_allocator.cpp
+*
+* Copyright (C) 2021 Riccardo Marson
+*/
+
+#include "memory_allocator.hpp"
+
+#include <algorithm>
+
+namespace {
+    // true if the last byte of resource A and the first byte of resource B fall in the same "page" of size page_size
+    // (see bufferImageGranularity in the Vulkan spec)
+    bool onSamePage(VkDeviceSize a_last_byte, VkDeviceSize b_first_byte, VkDeviceSize page_size) {
+        return (a_last_byte & ~(page_size - 1)) == (b_first_byte & ~(page_size - 1));
+    }
+}
+
+MemoryAllocator::MemoryAllocator(VkDevice device, VkPhysicalDevice physical_device, VkDeviceSize block_size) :
+    device_(device),
+    block_size_(block_size) {
+
+    vkGetPhysicalDeviceMemoryProperties(physical_device, &memory_properties_);
+
+    VkPhysicalDeviceProperties device_properties;
+    vkGetPhysicalDeviceProperties(physical_device, &device_properties);
+    buffer_image_granularity_ = std::max(device_properties.limits.bufferImageGranularity, VkDeviceSize(1));
+}
+
+MemoryAllocator::~MemoryAllocator() {
+    releaseAllBlocks();
+}
+
+MemoryAllocation MemoryAllocator::allocate(const VkMemoryRequirements& mem_reqs, VkMemoryPropertyFlags properties, bool linear_resource) {
+    MemoryAllocation allocation;
+
+    uint32_t memory_type = findMemoryType(mem_reqs.memoryTypeBits, properties);
+    if (memory_type == UINT32_MAX) {
+        std::cerr << "Failed to find a suitable memory type!" << std::endl;
+        return allocation;
+    }
+
+    // don't let a single block take a big chunk of a small heap (e.g. the host visible device local heap)
+    auto heap_size = memory_properties_.memoryHeaps[memory_properties_.memoryTypes[memory_type].heapIndex].size;
+    auto preferred_block_size = std::min(block_size_, heap_size / 8);
+
+    if (mem_reqs.size <= preferred_block_size / 2) {
+        for (auto& block : blocks_) {
+            if (block.second.memory_type != memory_type || block.second.dedicated) {
+                continue;
+            }
+            if (allocateFromBlock(block.second, mem_reqs, linear_resource, allocation)) {
+                return allocation;
+            }
+        }
+
+        auto block = createBlock(memory_type, preferred_block_size, false);
+        if (block != nullptr && allocateFromBlock(*block, mem_reqs, linear_resource, allocation)) {
+            return allocation;
+        }
+    }
+
+    // large resources (or a failed block allocation) get a block of their own
+    auto block = createBlock(memory_type, mem_reqs.size, true);
+    if (block == nullptr || !allocateFromBlock(*block, mem_reqs, linear_resource, allocation)) {
+        std::cerr << "Failed to allocate " << mem_reqs.size << " bytes of device memory!" << std::endl;
+        return MemoryAllocation{};
+    }
+
+    return allocation;
+}
+
+void MemoryAllocator::free(MemoryAllocation& allocation) {
+    if (!allocation.isValid()) {
+        return;
+    }
+
+    auto block_iter = blocks_.find(allocation.block_id);
+    if (block_iter == blocks_.end()) {
+        std::cerr << "Trying to free an allocation from an unknown memory block!" << std::endl;
+        allocation = MemoryAllocation{};
+        return;
+    }
+
+    auto& block = block_iter->second;
+    auto range = std::find_if(block.ranges.begin(), block.ranges.end(), [&allocation](const Range& r) { return r.offset == allocation.offset && !r.free; });
+    if (range == block.ranges.end()) {
+        std::cerr << "Trying to free an allocation that is not live!" << std::endl;
+        allocation = MemoryAllocation{};
+        return;
+    }
+
+    range->free = true;
+    range->linear = true;
+
+    // merge with the neighbouring free ranges
+    auto next = std::next(range);
+    if (next != block.ranges.end() && next->free) {
+        range->size += next->size;
+        block.ranges.erase(next);
+    }
+    if (range != block.ranges.begin()) {
+        auto prev = std::prev(range);
+        if (prev->free) {
+            prev->size += range->size;
+            block.ranges.erase(range);
+        }
+    }
+
+    --block.allocations_count;
+    allocation = MemoryAllocation{};
+
+    // regular blocks are kept around for reuse until releaseAllBlocks
+    if (block.dedicated && block.allocations_count == 0) {
+        destroyBlock(block);
+        blocks_.erase(block_iter);
+    }
+}
+
+void MemoryAllocator::releaseAllBlocks() {
+    for (auto& block : blocks_) {
+        if (block.second.allocations_count > 0) {
+            std::cerr << "Memory block " << block.first << " released with " << block.second.allocations_count << " live allocations!" << std::endl;
+        }
+        destroyBlock(block.second);
+    }
+    blocks_.clear();
+}
+
+MemoryStats MemoryAllocator::getStats() const {
+    MemoryStats stats;
+    for (auto& block : blocks_) {
+        ++stats.blocks_count;
+        stats.allocations_count += block.second.allocations_count;
+        stats.bytes_reserved += block.second.size;
+        for (auto& range : block.second.ranges) {
+            if (range.free) {
+                stats.largest_free_range = std::max(stats.largest_free_range, range.size);
+            } else {
+                stats.bytes_used += range.size;
+            }
+        }
+    }
+    return stats;
+}
+
+void MemoryAllocator::printStats() const {
+    auto stats = getStats();
+    std::cout << "Device Memory:" << std::endl;
+    std::cout << "\tblocks: " << stats.blocks_count << ", allocations: " << stats.allocations_count << std::endl;
+    std::cout << "\tused: " << stats.bytes_used << " / " << stats.bytes_reserved << " bytes" << std::endl;
+    std::cout << "\tlargest free range: " << stats.largest_free_range << " bytes, fragmentation: " << stats.fragmentation() << std::endl;
+
+    for (auto& block : blocks_) {
+        VkDeviceSize used = 0;
+        for (auto& range : block.second.ranges) {
+            used += range.free ? 0 : range.size;
+        }
+        std::cout << "\t\tblock " << block.first << " [type " << block.second.memory_type << (block.second.dedicated ? ", dedicated" : "") << "]: "
+                  << block.second.allocations_count << " allocations, " << used << " / " << block.second.size << " bytes" << std::endl;
+    }
+}
+
+uint32_t MemoryAllocator::findMemoryType(uint32_t type_filter, VkMemoryPropertyFlags properties) const {
+    for (uint32_t i = 0; i < memory_properties_.memoryTypeCount; i++) {
+        if ((type_filter & (1 << i)) && (memory_properties_.memoryTypes[i].propertyFlags & properties) == properties) {
+            return i;
+        }
+    }
+
+    return UINT32_MAX;
+}
+
+MemoryAllocator::MemoryBlock* MemoryAllocator::createBlock(uint32_t memory_type, VkDeviceSize size, bool dedicated) {
+    VkMemoryAllocateInfo alloc_info{};
+    alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    alloc_info.allocationSize = size;
+    alloc_info.memoryTypeIndex = memory_type;
+
+    VkDeviceMemory vk_memory;
+    if (vkAllocateMemory(device_, &alloc_info, nullptr, &vk_memory) != VK_SUCCESS) {
+        std::cerr << "Failed to allocate device memory block of " << size << " bytes!" << std::endl;
+        return nullptr;
+    }
+
+    MemoryBlock block;
+    block.id = next_block_id_++;
+    block.memory_type = memory_type;
+    block.size = size;
+    block.dedicated = dedicated;
+    block.vk_memory = vk_memory;
+    block.ranges.push_back(Range{ 0, size, true, true });
+
+    // map host visible blocks once, allocations will get a pointer into the mapped range
+    if (memory_properties_.memoryTypes[memory_type].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+        if (vkMapMemory(device_, vk_memory, 0, VK_WHOLE_SIZE, 0, &block.mapped_data) != VK_SUCCESS) {
+            std::cerr << "Failed to map host visible memory block!" << std::endl;
+            vkFreeMemory(device_, vk_memory, nullptr);
+            return nullptr;
+        }
+    }
+
+    auto id = block.id;
+    blocks_[id] = std::move(block);
+    return &blocks_[id];
+}
+
+void MemoryAllocator::destroyBlock(MemoryBlock& block) {
+    if (block.mapped_data != nullptr) {
+        vkUnmapMemory(device_, block.vk_memory);
+        block.mapped_data = nullptr;
+    }
+    vkFreeMemory(device_, block.vk_memory, nullptr);
+    block.vk_memory = VK_NULL_HANDLE;
+    block.ranges.clear();
+}
+
+bool MemoryAllocator::allocateFromBlock(MemoryBlock& block, const VkMemoryRequirements& mem_reqs, bool linear_resource, MemoryAllocation& allocation) {
+    auto alignment = std::max(mem_reqs.alignment, VkDeviceSize(1));
+
+    for (auto iter = block.ranges.begin(); iter != block.ranges.end(); ++iter) {
+        if (!iter->free || iter->size < mem_reqs.size) {
+            continue;
+        }
+
+        VkDeviceSize offset = alignUp(iter->offset, alignment);
+
+        // linear and non-linear resources can't share a page of bufferImageGranularity
+        if (iter != block.ranges.begin()) {
+            auto prev = std::prev(iter);
+            if (!prev->free && prev->linear != linear_resource && onSamePage(prev->offset + prev->size - 1, offset, buffer_image_granularity_)) {
+                offset = alignUp(offset, buffer_image_granularity_);
+            }
+        }
+
+        VkDeviceSize range_end = iter->offset + iter->size;
+        if (offset + mem_reqs.size > range_end) {
+            continue;
+        }
+
+        auto next = std::next(iter);
+        if (next != block.ranges.end() && !next->free && next->linear != linear_resource && onSamePage(offset + mem_reqs.size - 1, next->offset, buffer_image_granularity_)) {
+            continue;
+        }
+
+        // split the free range into [padding][allocation][remainder]
+        if (offset > iter->offset) {
+            block.ranges.insert(iter, Range{ iter->offset, offset - iter->offset, true, true });
+        }
+        block.ranges.insert(iter, Range{ offset, mem_reqs.size, false, linear_resource });
+        if (range_end > offset + mem_reqs.size) {
+            block.ranges.insert(iter, Range{ offset + mem_reqs.size, range_end - offset - mem_reqs.size, true, true });
+        }
+        block.ranges.erase(iter);
+
+        ++block.allocations_count;
+
+        allocation.vk_memory = block.vk_memory;
+        allocation.offset = offset;
+        allocation.size = mem_reqs.size;
+        allocation.memory_type = block.memory_type;
+        allocation.block_id = block.id;
+        allocation.mapped_data = block.mapped_data != nullptr ? static_cast<char*>(block.mapped_data) + offset : nullptr;
+
+        return true;
+    }
+
+    return false;
+}
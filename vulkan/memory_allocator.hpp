@@ -0,0 +1,76 @@
+/*
+* memory_allocator.hpp
+*
+* Copyright (C) 2021 Riccardo Marson
+*/
+
+#pragma once
+
+#include "common_definitions.hpp"
+
+// alignment must be a power of two
+inline VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment) {
+    return (value + alignment - 1) & ~(alignment - 1);
+}
+
+struct MemoryStats {
+    uint32_t blocks_count = 0;
+    uint32_t allocations_count = 0;
+    VkDeviceSize bytes_reserved = 0;  // total size of all the VkDeviceMemory blocks
+    VkDeviceSize bytes_used = 0;  // sum of all live allocations (including alignment padding)
+    VkDeviceSize largest_free_range = 0;
+
+    // 0 when all free memory is in one contiguous range, tends to 1 as the free space gets split in small ranges
+    float fragmentation() const {
+        auto bytes_free = bytes_reserved - bytes_used;
+        return bytes_free > 0 ? 1.0f - float(largest_free_range) / float(bytes_free) : 0.0f;
+    }
+};
+
+// Sub-allocates buffers and images from large per-memory-type VkDeviceMemory blocks.
+// Host visible blocks are persistently mapped for their whole lifetime.
+class MemoryAllocator {
+public:
+    MemoryAllocator(VkDevice device, VkPhysicalDevice physical_device, VkDeviceSize block_size = 64 * 1024 * 1024);
+    ~MemoryAllocator();
+
+    // linear_resource must be true for buffers and linear tiled images, false for optimal tiled images
+    MemoryAllocation allocate(const VkMemoryRequirements& mem_reqs, VkMemoryPropertyFlags properties, bool linear_resource);
+    void free(MemoryAllocation& allocation);
+    void releaseAllBlocks();
+
+    MemoryStats getStats() const;
+    void printStats() const;
+
+private:
+    struct Range {
+        VkDeviceSize offset = 0;
+        VkDeviceSize size = 0;
+        bool free = true;
+        bool linear = true;
+    };
+
+    struct MemoryBlock {
+        uint32_t id = 0;
+        uint32_t memory_type = 0;
+        VkDeviceSize size = 0;
+        bool dedicated = false;
+        uint32_t allocations_count = 0;
+        VkDeviceMemory vk_memory = VK_NULL_HANDLE;
+        void* mapped_data = nullptr;
+        std::list<Range> ranges;  // sorted by offset, covers the whole block
+    };
+
+    uint32_t findMemoryType(uint32_t type_filter, VkMemoryPropertyFlags properties) const;
+    MemoryBlock* createBlock(uint32_t memory_type, VkDeviceSize size, bool dedicated);
+    void destroyBlock(MemoryBlock& block);
+    bool allocateFromBlock(MemoryBlock& block, const VkMemoryRequirements& mem_reqs, bool linear_resource, MemoryAllocation& allocation);
+
+    VkDevice device_;
+    VkPhysicalDeviceMemoryProperties memory_properties_{};
+    VkDeviceSize buffer_image_granularity_ = 1;
+    VkDeviceSize block_size_;
+    uint32_t next_block_id_ = 1;
+
+    std::map<uint32_t, MemoryBlock> blocks_;
+};
@@ -13,6 +13,7 @@
 
 #include <glm/gtx/matrix_decompose.hpp>
 
+#include <algorithm>
 #include <random>
 
 ParticleEmitterBase::ParticleEmitterBase(const ParticleEmitterConfig& config, VulkanBackend* backend) :
@@ -28,11 +29,13 @@ ParticleEmitterBase::~ParticleEmitterBase() {
     graphics_pipeline_.reset();
     backend_->destroyBuffer(particle_buffer_);
     backend_->destroyBuffer(particle_respawn_buffer_);
-    backend_->destroyUniformBuffer(graphics_view_proj_buffer_);
-    backend_->destroyUniformBuffer(compute_camera_buffer_);
-    backend_->freeCommandBuffers(compute_command_buffers_);
+    for (auto& draw_buffer : draw_buffers_) {
+        backend_->destroyBuffer(draw_buffer);
+    }
+    backend_->freeComputeCommandBuffers(compute_command_buffers_);
     backend_->freeCommandBuffers(graphics_command_buffers_);
     texture_atlas_.reset();
+    scene_depth_buffers_.clear();
     compute_shader_.reset();
     vertex_shader_.reset();
     fragment_shader_.reset();
@@ -65,7 +68,7 @@ bool ParticleEmitterBase::createParticles(uint32_t count) {
 
     std::random_device r;
 
-    std::default_random_engine e(r());
+    std::default_random_engine e(config_.random_seed != 0 ? config_.random_seed : r());
     std::uniform_real_distribution<float> uniform_dist_x(min_x, max_x);
     std::uniform_real_distribution<float> uniform_dist_y(min_y, max_y);
     std::uniform_real_distribution<float> uniform_dist_z(min_z, max_z);
@@ -88,36 +91,114 @@ void ParticleEmitterBase::setTransform(const glm::mat4& transform) {
     transform_ = transform;
 }
 
-RecordCommandsResult ParticleEmitterBase::update(float delta_time_s,  const SceneData& scene_data) {
+RecordCommandsResult ParticleEmitterBase::update(float delta_time_s, const SceneData& scene_data) {
     compute_camera_.view_matrix = scene_data.view;
     compute_camera_.proj_matrix = scene_data.proj;
     compute_camera_.framebuffer_size = { backend_->getSwapChainExtent().width, backend_->getSwapChainExtent().height };
-    backend_->updateBuffer<CameraData>(compute_camera_buffer_.buffers[0], { compute_camera_ });
+    compute_camera_uniform_ = backend_->pushUniformData<CameraData>(compute_camera_);
     ViewProj view_proj  { scene_data.view, scene_data.proj };
-    for (auto& buffer : graphics_view_proj_buffer_.buffers) {
-        backend_->updateBuffer<ViewProj>(buffer, {view_proj} );
-    }
+    graphics_view_proj_uniform_ = backend_->pushUniformData<ViewProj>(view_proj);
     global_state_pc_.delta_time_s = delta_time_s;
 
+    // updates run before the frame fence is waited on, so the buffer of this frame may still be pending from
+    // frames in flight updates ago. waiting for value 0 returns straight away
+    const uint32_t frame_index = backend_->getCurrentFrameIndex();
+    compute_submit_values_.resize(compute_command_buffers_.size(), 0);
+    backend_->waitForComputeValue(compute_submit_values_[frame_index]);
+
     // record compute commands now as they don't depend on the swapchain
-    return recordComputeCommands();
+    auto result = recordComputeCommands(frame_index);
+    compute_submit_values_[frame_index] = backend_->getComputeTimelineValue() + 1;  // the caller submits it next
+    return result;
 }
 
-bool ParticleEmitterBase::createComputePipeline(std::shared_ptr<Texture>& scene_depth_buffer) {
+PipelineBuild ParticleEmitterBase::createComputePipeline(const std::vector<std::shared_ptr<Texture>>& scene_depth_buffers) {
     if (compute_pipeline_) {
         compute_pipeline_.reset();
     }
 
     ComputePipelineConfig config;
     config.compute = compute_shader_;
+    config.dynamic_bindings = { COMPUTE_CAMERA_BINDING_NAME };
 
     compute_pipeline_ = backend_->createComputePipeline("Emitter CP");
+    scene_depth_buffers_ = scene_depth_buffers;
 
-    if (compute_pipeline_->buildPipeline(config)) {
+    return backend_->buildPipelineAsync(*compute_pipeline_, config).then([this]() {
         createComputeDescriptorSets(compute_pipeline_->descriptorSets());
-        updateComputeDescriptorSets(compute_pipeline_->descriptorMetadata(), scene_depth_buffer);
+        updateComputeDescriptorSets(compute_pipeline_->descriptorMetadata(), scene_depth_buffers_);
+
+        // the particles start out owned by the graphics family, which did the uploads. hand them over for the first
+        // update. the scene depth is shared by all the emitters and handed over once, by whoever owns the scene
+        if (backend_->hasDedicatedComputeQueue()) {
+            auto cmd_buffer = backend_->beginSingleTimeCommands();
+            backend_->releaseToCompute(cmd_buffer, getSimulationResources());
+            for (uint32_t i = 0; i < draw_buffers_.size(); ++i) {
+                backend_->releaseToCompute(cmd_buffer, getDrawResources(i));
+            }
+            backend_->endSingleTimeCommands();
+        }
 
         return true;
+    });
+}
+
+void ParticleEmitterBase::acquireFromCompute(VkCommandBuffer graphics_cmd, uint32_t frame_index) {
+    backend_->acquireFromCompute(graphics_cmd, getDrawResources(frame_index));
+}
+
+void ParticleEmitterBase::releaseToCompute(VkCommandBuffer graphics_cmd, uint32_t frame_index) {
+    backend_->releaseToCompute(graphics_cmd, getDrawResources(frame_index));
+}
+
+QueueSharedResources ParticleEmitterBase::getSimulationResources() const {
+    QueueSharedResources resources;
+    resources.buffers = { particle_buffer_.vk_buffer, particle_respawn_buffer_.vk_buffer };
+    return resources;
+}
+
+QueueSharedResources ParticleEmitterBase::getDrawResources(uint32_t frame_index) const {
+    QueueSharedResources resources;
+    resources.buffers = { draw_buffers_[frame_index].vk_buffer };
+    return resources;
+}
+
+QueueSharedResources ParticleEmitterBase::getComputeResources(uint32_t frame_index) const {
+    auto resources = getDrawResources(frame_index);
+    if (frame_index < scene_depth_buffers_.size()) {
+        resources.images.push_back({ scene_depth_buffers_[frame_index]->getImage(), VK_IMAGE_LAYOUT_GENERAL });
     }
-    return false;
+    return resources;
+}
+
+void ParticleEmitterBase::beginComputeTransfers(VkCommandBuffer compute_cmd, uint32_t frame_index) {
+    // the simulation buffers stay with compute for good once they have been taken over from the uploads
+    if (!simulation_acquired_) {
+        backend_->acquireFromGraphics(compute_cmd, getSimulationResources());
+        simulation_acquired_ = true;
+    }
+    backend_->acquireFromGraphics(compute_cmd, getComputeResources(frame_index));
+}
+
+void ParticleEmitterBase::endComputeTransfers(VkCommandBuffer compute_cmd, uint32_t frame_index) {
+    const auto& source = getDrawSource();
+    const auto& draw_buffer = draw_buffers_[frame_index];
+
+    VkBufferMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.buffer = source.vk_buffer;
+    barrier.offset = 0;
+    barrier.size = VK_WHOLE_SIZE;
+    vkCmdPipelineBarrier(compute_cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+
+    VkBufferCopy region{};
+    region.size = std::min(source.buffer_size, draw_buffer.buffer_size);
+    vkCmdCopyBuffer(compute_cmd, source.vk_buffer, draw_buffer.vk_buffer, 1, &region);
+
+    // graphics waits on the compute timeline before reading the copy, with a dedicated compute queue it also needs this
+    backend_->releaseToGraphics(compute_cmd, getComputeResources(frame_index));
 }
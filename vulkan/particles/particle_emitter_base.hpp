@@ -12,6 +12,7 @@
 
 class Texture;
 class VulkanBackend;
+struct QueueSharedResources;
 class ShaderModule;
 class ComputePipeline;
 class GraphicsPipeline;
@@ -25,15 +26,14 @@ struct ParticleEmitterConfig {
 	glm::vec3 min_starting_velocity;
 	glm::vec3 max_starting_velocity;
 	float lifetime_after_collision = 0.0f; // s
+	uint32_t random_seed = 0;  // for the starting particles, 0 picks a different one every time
 
 	// graphics settings
 	std::string texture_atlas;
 	uint32_t subpass_number = 0;
 
-	// profiler settings
+	// profiler settings, see getUpdateScopeName and getDrawScopeName
 	bool profile = false;
-	uint32_t start_query_num = 0;
-	uint32_t stop_query_num = 0;
 };
 
 class ParticleEmitterBase {
@@ -41,27 +41,46 @@ public:
 	virtual ~ParticleEmitterBase();
 
 	const std::string& getName() const { return config_.name; }
+	std::string getUpdateScopeName() const { return config_.name + " update"; }  // GPU profiler scopes
+	std::string getDrawScopeName() const { return config_.name + " draw"; }
 	
 	void setTransform(const glm::mat4& transform);
+	// records the compute step of the current frame, the caller submits it with submitComputeCommands straight away.
+	// it only has to wait for getFrameGraphicsValue, the previous frame can still be drawing
 	RecordCommandsResult update(float delta_time_s, const SceneData& scene_data);
-	virtual RecordCommandsResult renderFrame(uint32_t swapchain_image, VkRenderPassBeginInfo& render_pass_info) = 0;
+	virtual RecordCommandsResult renderFrame(uint32_t frame_index, VkRenderPassBeginInfo& render_pass_info) = 0;
 
 	bool createParticles(uint32_t count);
-	bool createComputePipeline(std::shared_ptr<Texture>& scene_depth_buffer);
+	// one scene depth buffer per frame in flight, the update of a frame reads the one the same frame wrote last time around
+	PipelineBuild createComputePipeline(const std::vector<std::shared_ptr<Texture>>& scene_depth_buffers);
 
-	virtual DescriptorPoolConfig getDescriptorsCount() const = 0;
-	virtual bool createGraphicsPipeline(const RenderPass& render_pass, uint32_t subpass_number) = 0;
+	// the simulation can run on a dedicated compute queue. every update copies the particles into the draw buffer of its
+	// frame, so the next update can run while graphics is still drawing this one. these hand the draw buffer of the frame
+	// over between the queues and must wrap every graphics frame that follows a submitted compute update, outside the
+	// render pass. the scene depth the update reads is handed over by the owner of the scene, along with these
+	void acquireFromCompute(VkCommandBuffer graphics_cmd, uint32_t frame_index);
+	void releaseToCompute(VkCommandBuffer graphics_cmd, uint32_t frame_index);
+
+	virtual PipelineBuild createGraphicsPipeline(const RenderPass& render_pass, uint32_t subpass_number) = 0;
 
 protected:
 	explicit ParticleEmitterBase(const ParticleEmitterConfig& config, VulkanBackend* backend);
 
 	virtual bool createAssets(std::vector<Particle>& particles) = 0;
-	virtual void createUniformBuffers() = 0;
 	virtual void createGraphicsDescriptorSets(const std::map<uint32_t, VkDescriptorSetLayout>& descriptor_set_layouts) = 0;
 	virtual void updateGraphicsDescriptorSets(const DescriptorSetMetadata& metadata) = 0;
 	virtual void createComputeDescriptorSets(const std::map<uint32_t, VkDescriptorSetLayout>& descriptor_set_layouts) = 0;
-	virtual void updateComputeDescriptorSets(const DescriptorSetMetadata& metadata, std::shared_ptr<Texture>& scene_depth_buffer) = 0;
-	virtual RecordCommandsResult recordComputeCommands() = 0;
+	virtual void updateComputeDescriptorSets(const DescriptorSetMetadata& metadata, const std::vector<std::shared_ptr<Texture>>& scene_depth_buffers) = 0;
+	virtual RecordCommandsResult recordComputeCommands(uint32_t frame_index) = 0;  // into compute_command_buffers_[frame_index]
+	virtual QueueSharedResources getSimulationResources() const;  // only compute uses them, handed over once after the upload
+	virtual const Buffer& getDrawSource() const { return particle_buffer_; }  // what the update copies into draw_buffers_
+	QueueSharedResources getDrawResources(uint32_t frame_index) const;  // what graphics reads in that frame
+	QueueSharedResources getComputeResources(uint32_t frame_index) const;  // the above plus the scene depth of the frame
+
+	// around the dispatch of every update: take the draw buffer and the scene depth of the frame from graphics, then
+	// copy the simulation into the draw buffer and hand both back
+	void beginComputeTransfers(VkCommandBuffer compute_cmd, uint32_t frame_index);
+	void endComputeTransfers(VkCommandBuffer compute_cmd, uint32_t frame_index);
 
 	std::shared_ptr<Texture> getTexture() { return texture_atlas_; }
 
@@ -71,28 +90,32 @@ protected:
 	VulkanBackend* backend_;
 	Buffer particle_buffer_;
 	Buffer particle_respawn_buffer_;
+	std::vector<Buffer> draw_buffers_;  // one copy of getDrawSource per frame in flight, the only buffers graphics reads
+	bool simulation_acquired_ = false;  // by the compute queue, with the first update
 	std::shared_ptr<Texture> texture_atlas_;
+	std::vector<std::shared_ptr<Texture>> scene_depth_buffers_;
 
-	std::shared_ptr<ShaderModule> vertex_shader_;
-	std::shared_ptr<ShaderModule> geometry_shader_;
-	std::shared_ptr<ShaderModule> fragment_shader_;
+	std::shared_ptr<const ShaderModule> vertex_shader_;
+	std::shared_ptr<const ShaderModule> geometry_shader_;
+	std::shared_ptr<const ShaderModule> fragment_shader_;
 
 	std::vector<VkDescriptorSet> vk_descriptor_sets_graphics_;
-	std::vector<VkDescriptorSet> vk_descriptor_sets_compute_;
+	std::vector<VkDescriptorSet> vk_descriptor_sets_compute_;  // the particles set, then one camera set per frame in flight
 
 	struct CameraData {
 		glm::mat4 view_matrix; 
 		glm::mat4 proj_matrix;
 		glm::ivec2 framebuffer_size;
 	} compute_camera_;  
-	UniformBuffer compute_camera_buffer_;
-	UniformBuffer graphics_view_proj_buffer_;
+	UniformAllocation compute_camera_uniform_;
+	UniformAllocation graphics_view_proj_uniform_;  // only bound by emitters that draw with the view_proj uniform
 
 	ParticlesGlobalState global_state_pc_;
 
-	std::shared_ptr<ShaderModule> compute_shader_;
+	std::shared_ptr<const ShaderModule> compute_shader_;
 	std::unique_ptr<ComputePipeline> compute_pipeline_;
 	std::unique_ptr<GraphicsPipeline> graphics_pipeline_;
-	std::vector<VkCommandBuffer> compute_command_buffers_;
+	std::vector<VkCommandBuffer> compute_command_buffers_;  // one per frame in flight
+	std::vector<uint64_t> compute_submit_values_;  // compute timeline value of the last submission of each of them
 	std::vector<VkCommandBuffer> graphics_command_buffers_; 
 };
\ No newline at end of file
@@ -17,17 +17,15 @@ public:
 	explicit RainEmitterGS(const ParticleEmitterConfig& config, VulkanBackend* backend);
 	virtual ~RainEmitterGS();
 	
-	virtual RecordCommandsResult renderFrame(uint32_t swapchain_image, VkRenderPassBeginInfo& render_pass_info) override;
+	virtual RecordCommandsResult renderFrame(uint32_t frame_index, VkRenderPassBeginInfo& render_pass_info) override;
 
-	virtual DescriptorPoolConfig getDescriptorsCount() const override;
-	virtual bool createGraphicsPipeline(const RenderPass& render_pass, uint32_t subpass_number) override;
+	virtual PipelineBuild createGraphicsPipeline(const RenderPass& render_pass, uint32_t subpass_number) override;
 
 private:
 	virtual bool createAssets(std::vector<Particle>& particles) override;
-	virtual void createUniformBuffers() override;
 	virtual void createGraphicsDescriptorSets(const std::map<uint32_t, VkDescriptorSetLayout>& descriptor_set_layouts) override;
 	virtual void updateGraphicsDescriptorSets(const DescriptorSetMetadata& metadata) override;
 	virtual void createComputeDescriptorSets(const std::map<uint32_t, VkDescriptorSetLayout>& descriptor_set_layouts) override;
-	virtual void updateComputeDescriptorSets(const DescriptorSetMetadata& metadata, std::shared_ptr<Texture>& scene_depth_buffer) override;
-	virtual RecordCommandsResult recordComputeCommands() override;
+	virtual void updateComputeDescriptorSets(const DescriptorSetMetadata& metadata, const std::vector<std::shared_ptr<Texture>>& scene_depth_buffers) override;
+	virtual RecordCommandsResult recordComputeCommands(uint32_t frame_index) override;
 };
\ No newline at end of file
@@ -43,7 +43,6 @@ const std::string COMPUTE_RESPAWN_BUFFER_BINDING_NAME = "respawn_buffer";
 const std::string COMPUTE_VERTEX_BUFFER_BINDING_NAME = "vertex_buffer";
 
 const uint32_t COMPUTE_CAMERA_SET_ID = 1; 
-const std::string CAMERA_BINDING_NAME = "camera"; 
 
 }
 
@@ -89,12 +88,16 @@ bool RainEmitterPR::createAssets(std::vector<Particle>& particles) {
         particle_indices[i + 4] = 0xFFFFFFFF;
     }
 
-    particle_vertex_buffer_ = backend_->createVertexBuffer<ParticleVertex>(config_.name + "_particle_verts", particle_vertices, false /*host_visible*/, true /*compute_visible*/);
-    // because this vertex buffer is also accessible from the compute pipeline as a storage texel buffer, we need an additional buffer view
+    // compute writes the quads here, every update then copies them into the vertex buffer of its frame
+    particle_vertex_buffer_ = backend_->createStorageTexelBuffer<ParticleVertex>(config_.name + "_particle_verts", particle_vertices, false /*host_visible*/, VK_BUFFER_USAGE_TRANSFER_SRC_BIT);
     if (!backend_->createBufferView(particle_vertex_buffer_, VK_FORMAT_R32G32B32A32_SFLOAT)) {
         return false;
     }
 
+    for (uint32_t i = 0; i < backend_->getFramesInFlight(); ++i) {
+        draw_buffers_.push_back(backend_->createVertexBuffer<ParticleVertex>(config_.name + "_particle_verts_draw_" + std::to_string(i), particle_vertices, false /*host_visible*/));
+    }
+
     particle_index_buffer_ = backend_->createIndexBuffer<uint32_t>(config_.name + "_particle_idx", particle_indices, false);
 
     if (!config_.texture_atlas.empty()) {
@@ -104,29 +107,26 @@ bool RainEmitterPR::createAssets(std::vector<Particle>& particles) {
     }
 
     // create a compute pipeline for this emitter 
-    compute_shader_ = backend_->createShaderModule(config_.name + "_compute_shader");
-    compute_shader_->loadSpirvShader("shaders/rainfall_pr_cp.spv");
+    compute_shader_ = backend_->loadShaderModule(config_.name + "_compute_shader", "shaders/rainfall_pr_cp.spv");
 
-    compute_command_buffers_ = backend_->createPrimaryCommandBuffers(1);
+    compute_command_buffers_ = backend_->createComputeCommandBuffers(backend_->getFramesInFlight());
 
     // graphics pipeline assets
-    vertex_shader_ = backend_->createShaderModule("rain_drops_pr_vs");
-	vertex_shader_->loadSpirvShader("shaders/rain_drops_pr_vs.spv");
+    vertex_shader_ = backend_->loadShaderModule("rain_drops_pr_vs", "shaders/rain_drops_pr_vs.spv");
 
 	if (!vertex_shader_->isVertexFormatCompatible(ParticleVertex::getFormatInfo())) {
 		std::cerr << "ParticleVertex format is not compatible with pipeline input for " << vertex_shader_->getName() << std::endl;
 		return false;
 	}
 
-	fragment_shader_ = backend_->createShaderModule("rain_drops_pr_fs");
-	fragment_shader_->loadSpirvShader("shaders/rain_drops_pr_fs.spv");
+	fragment_shader_ = backend_->loadShaderModule("rain_drops_pr_fs", "shaders/rain_drops_pr_fs.spv");
 
 	if (!vertex_shader_->isValid() || !fragment_shader_->isValid()) {
 		std::cerr << "Failed to validate rain drops shaders!" << std::endl;
 		return false;
 	}
 
-    graphics_command_buffers_ = backend_->createSecondaryCommandBuffers(backend_->getSwapChainSize());
+    graphics_command_buffers_ = backend_->createSecondaryCommandBuffers(backend_->getFramesInFlight());
     if (graphics_command_buffers_.empty()) {
         return false;
     }
@@ -134,8 +134,8 @@ bool RainEmitterPR::createAssets(std::vector<Particle>& particles) {
    return true;
 }
 
-RecordCommandsResult RainEmitterPR::renderFrame(uint32_t swapchain_image, VkRenderPassBeginInfo& render_pass_info) {
-    std::vector<VkCommandBuffer> command_buffers = { graphics_command_buffers_[swapchain_image] };
+RecordCommandsResult RainEmitterPR::renderFrame(uint32_t frame_index, VkRenderPassBeginInfo& render_pass_info) {
+    std::vector<VkCommandBuffer> command_buffers = { graphics_command_buffers_[frame_index] };
     backend_->resetCommandBuffers(command_buffers);
 
     VkCommandBufferInheritanceInfo inherit_info{};
@@ -159,20 +159,24 @@ RecordCommandsResult RainEmitterPR::renderFrame(uint32_t swapchain_image, VkRend
 
 	vkCmdBindPipeline(command_buffers[0], VK_PIPELINE_BIND_POINT_GRAPHICS, graphics_pipeline_->handle());
 
-    uint32_t offset = swapchain_image;
+    uint32_t offset = frame_index;
     vkCmdBindDescriptorSets(command_buffers[0], VK_PIPELINE_BIND_POINT_GRAPHICS, graphics_pipeline_->layout(), PARTICLES_UNIFORM_SET_ID, 1, &vk_descriptor_sets_graphics_[offset], 0, nullptr);
 
     vkCmdPushConstants(command_buffers[0], graphics_pipeline_->layout(), VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(glm::mat4), &compute_camera_.proj_matrix);
 
 	VkDeviceSize offsets[] = { 0 };
-	vkCmdBindVertexBuffers(command_buffers[0], 0, 1, &particle_vertex_buffer_.vk_buffer, offsets);
+	vkCmdBindVertexBuffers(command_buffers[0], 0, 1, &draw_buffers_[frame_index].vk_buffer, offsets);
     vkCmdBindIndexBuffer(command_buffers[0], particle_index_buffer_.vk_buffer, 0, VK_INDEX_TYPE_UINT32);
 
-	backend_->writeTimestampQuery(command_buffers[0], VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, 4); // does nothing if not in debug
+	if (config_.profile) {
+		backend_->beginGpuScope(command_buffers[0], getDrawScopeName(), PipelineStatisticsType::GRAPHICS);
+	}
 
     vkCmdDrawIndexed(command_buffers[0], index_count_, 1, 0, 0, 0);
 	
-	backend_->writeTimestampQuery(command_buffers[0], VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 5); // does nothing if not in debug
+	if (config_.profile) {
+		backend_->endGpuScope(command_buffers[0], getDrawScopeName());
+	}
 
      if (vkEndCommandBuffer(command_buffers[0]) != VK_SUCCESS) {
         std::cerr << "[IMGUI Renderer] Failed to record command buffer!" << std::endl;
@@ -182,20 +186,7 @@ RecordCommandsResult RainEmitterPR::renderFrame(uint32_t swapchain_image, VkRend
     return makeRecordCommandsResult(true, command_buffers);
 }
 
-void RainEmitterPR::createUniformBuffers() {
-    compute_camera_buffer_ = backend_->createUniformBuffer<CameraData>(config_.name + "_compute_camera", 1);
-}
-
-DescriptorPoolConfig RainEmitterPR::getDescriptorsCount() const {
-    DescriptorPoolConfig config;
-    config.uniform_buffers_count = 1;
-    config.image_samplers_count = 1;
-    config.storage_texel_buffers_count = 3;
-    config.image_storage_buffers_count = 1;
-    return config;
-}
-
-bool  RainEmitterPR::createGraphicsPipeline(const RenderPass& render_pass, uint32_t subpass_number) {
+PipelineBuild  RainEmitterPR::createGraphicsPipeline(const RenderPass& render_pass, uint32_t subpass_number) {
     GraphicsPipelineConfig config;
 	config.vertex = vertex_shader_;
 	config.fragment = fragment_shader_;
@@ -210,71 +201,69 @@ bool  RainEmitterPR::createGraphicsPipeline(const RenderPass& render_pass, uint3
 
 	graphics_pipeline_ = backend_->createGraphicsPipeline("Rain Drops GP");
 
-    if (graphics_pipeline_->buildPipeline(config)) {
-        createUniformBuffers();
+    return backend_->buildPipelineAsync(*graphics_pipeline_, config).then([this]() {
         createGraphicsDescriptorSets(graphics_pipeline_->descriptorSets());
         updateGraphicsDescriptorSets(graphics_pipeline_->descriptorMetadata());
         return true;
-    }
-	
-	return false;
+    });
 }
 
-RecordCommandsResult RainEmitterPR::recordComputeCommands() {
-    backend_->waitComputeQueueIdle();  // prevents the buffers being reset while in use. possibly overkill
-
-    backend_->resetCommandBuffers(compute_command_buffers_);
+RecordCommandsResult RainEmitterPR::recordComputeCommands(uint32_t frame_index) {
+    std::vector<VkCommandBuffer> command_buffers = { compute_command_buffers_[frame_index] };
+    backend_->resetCommandBuffers(command_buffers);
 
     VkCommandBufferBeginInfo begin_info{};
     begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
     begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
     begin_info.pInheritanceInfo = nullptr;
 
-    if (vkBeginCommandBuffer(compute_command_buffers_[0], &begin_info) != VK_SUCCESS) {
+    if (vkBeginCommandBuffer(command_buffers[0], &begin_info) != VK_SUCCESS) {
         std::cerr << "Failed to begin recording compute command buffer for particle emitter " << config_.name << std::endl;
-        return makeRecordCommandsResult(false, compute_command_buffers_);
+        return makeRecordCommandsResult(false, command_buffers);
     }
 
-    if (config_.profile) {
-        backend_->resetTimestampQueries(compute_command_buffers_[0], config_.start_query_num, 2);
-    }
+    beginComputeTransfers(command_buffers[0], frame_index);
 
-    vkCmdBindPipeline(compute_command_buffers_[0], VK_PIPELINE_BIND_POINT_COMPUTE, compute_pipeline_->handle());
-    vkCmdBindDescriptorSets(compute_command_buffers_[0], VK_PIPELINE_BIND_POINT_COMPUTE, compute_pipeline_->layout(), COMPUTE_PARTICLE_BUFFER_SET_ID, 1, &vk_descriptor_sets_compute_[COMPUTE_PARTICLE_BUFFER_SET_ID], 0, nullptr);
-    vkCmdBindDescriptorSets(compute_command_buffers_[0], VK_PIPELINE_BIND_POINT_COMPUTE, compute_pipeline_->layout(), COMPUTE_CAMERA_SET_ID, 1, &vk_descriptor_sets_compute_[COMPUTE_CAMERA_SET_ID], 0, nullptr);
+    vkCmdBindPipeline(command_buffers[0], VK_PIPELINE_BIND_POINT_COMPUTE, compute_pipeline_->handle());
+    vkCmdBindDescriptorSets(command_buffers[0], VK_PIPELINE_BIND_POINT_COMPUTE, compute_pipeline_->layout(), COMPUTE_PARTICLE_BUFFER_SET_ID, 1, &vk_descriptor_sets_compute_[COMPUTE_PARTICLE_BUFFER_SET_ID], 0, nullptr);
+    // the camera set of this frame, with the scene depth of this frame
+    vkCmdBindDescriptorSets(command_buffers[0], VK_PIPELINE_BIND_POINT_COMPUTE, compute_pipeline_->layout(), COMPUTE_CAMERA_SET_ID, 1, &vk_descriptor_sets_compute_[COMPUTE_CAMERA_SET_ID + frame_index], 1, &compute_camera_uniform_.dynamic_offset);
 
-    vkCmdPushConstants(compute_command_buffers_[0], compute_pipeline_->layout(), VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(ParticlesGlobalState), &global_state_pc_);
+    vkCmdPushConstants(command_buffers[0], compute_pipeline_->layout(), VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(ParticlesGlobalState), &global_state_pc_);
 
     if (config_.profile) {
-        backend_->writeTimestampQuery(compute_command_buffers_[0], VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, config_.start_query_num);
+        backend_->beginGpuScope(command_buffers[0], getUpdateScopeName(), PipelineStatisticsType::COMPUTE);
     }
 
-    vkCmdDispatch(compute_command_buffers_[0], global_state_pc_.particles_count / 32 + 1, 1, 1);
+    vkCmdDispatch(command_buffers[0], global_state_pc_.particles_count / 32 + 1, 1, 1);
 
     if (config_.profile) {
-        backend_->writeTimestampQuery(compute_command_buffers_[0], VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, config_.stop_query_num);
+        backend_->endGpuScope(command_buffers[0], getUpdateScopeName());
     }
 
-    if (vkEndCommandBuffer(compute_command_buffers_[0]) != VK_SUCCESS) {
+    endComputeTransfers(command_buffers[0], frame_index);
+
+    if (vkEndCommandBuffer(command_buffers[0]) != VK_SUCCESS) {
         std::cerr << "Failed to record compute command buffer for particle emitter " << config_.name << std::endl;
-        return makeRecordCommandsResult(false, compute_command_buffers_);
+        return makeRecordCommandsResult(false, command_buffers);
     }
 
-    return makeRecordCommandsResult(true, compute_command_buffers_);
+    return makeRecordCommandsResult(true, command_buffers);
+}
+
+QueueSharedResources RainEmitterPR::getSimulationResources() const {
+    auto resources = ParticleEmitterBase::getSimulationResources();
+    resources.buffers.push_back(particle_vertex_buffer_.vk_buffer);
+    return resources;
 }
 
 void RainEmitterPR::createComputeDescriptorSets(const std::map<uint32_t, VkDescriptorSetLayout>& descriptor_set_layouts) {
     const auto& particle_buffers_layout = descriptor_set_layouts.find(COMPUTE_PARTICLE_BUFFER_SET_ID)->second;
     const auto& camera_layout = descriptor_set_layouts.find(COMPUTE_CAMERA_SET_ID)->second;
-    std::vector<VkDescriptorSetLayout> layouts = { particle_buffers_layout, camera_layout };
-    VkDescriptorSetAllocateInfo alloc_info{};
-    alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-    alloc_info.descriptorPool = backend_->getDescriptorPool();
-    alloc_info.descriptorSetCount = static_cast<uint32_t>(layouts.size());
-    alloc_info.pSetLayouts = layouts.data();
-
-    std::vector<VkDescriptorSet> layout_descriptor_sets(layouts.size());
-    if (vkAllocateDescriptorSets(backend_->getDevice(), &alloc_info, layout_descriptor_sets.data()) != VK_SUCCESS) {
+    std::vector<VkDescriptorSetLayout> layouts = { particle_buffers_layout };
+    layouts.insert(layouts.end(), backend_->getFramesInFlight(), camera_layout);
+    std::vector<VkDescriptorSet> layout_descriptor_sets;
+    if (!backend_->allocateDescriptorSets(layouts, layout_descriptor_sets)) {
         std::cerr << "Failed to allocate Mesh descriptor sets!" << std::endl;
         return;
     }
@@ -284,16 +273,10 @@ void RainEmitterPR::createComputeDescriptorSets(const std::map<uint32_t, VkDescr
 
 void RainEmitterPR::createGraphicsDescriptorSets(const std::map<uint32_t, VkDescriptorSetLayout>& descriptor_set_layouts) {
     const auto& particles_layout = descriptor_set_layouts.find(PARTICLES_UNIFORM_SET_ID)->second;
-    std::vector<VkDescriptorSetLayout> layouts(backend_->getSwapChainSize(), particles_layout);
+    std::vector<VkDescriptorSetLayout> layouts(backend_->getFramesInFlight(), particles_layout);
 
-    VkDescriptorSetAllocateInfo alloc_info{};
-    alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-    alloc_info.descriptorPool = backend_->getDescriptorPool();
-    alloc_info.descriptorSetCount = static_cast<uint32_t>(layouts.size());
-    alloc_info.pSetLayouts = layouts.data();
-
-    std::vector<VkDescriptorSet> layout_descriptor_sets(backend_->getSwapChainSize());
-    if (vkAllocateDescriptorSets(backend_->getDevice(), &alloc_info, layout_descriptor_sets.data()) != VK_SUCCESS) {
+    std::vector<VkDescriptorSet> layout_descriptor_sets;
+    if (!backend_->allocateDescriptorSets(layouts, layout_descriptor_sets)) {
         std::cerr << "Failed to allocate Mesh descriptor sets!" << std::endl;
         return;
     }
@@ -306,14 +289,17 @@ void RainEmitterPR::updateGraphicsDescriptorSets(const DescriptorSetMetadata& me
     texture_atlas_->updateDescriptorSets(vk_descriptor_sets_graphics_, particles_bindings.find(PARTICLES_TEXTURE_ATLAS_BINDING_NAME)->second);
 }
 
-void RainEmitterPR::updateComputeDescriptorSets(const DescriptorSetMetadata& metadata, std::shared_ptr<Texture>& scene_depth_buffer) {
+void RainEmitterPR::updateComputeDescriptorSets(const DescriptorSetMetadata& metadata, const std::vector<std::shared_ptr<Texture>>& scene_depth_buffers) {
     const auto& particles_bindings = metadata.set_bindings.find(COMPUTE_PARTICLE_BUFFER_SET_ID)->second;
     auto particles_set = std::vector<VkDescriptorSet>{vk_descriptor_sets_compute_[COMPUTE_PARTICLE_BUFFER_SET_ID]};
     backend_->updateDescriptorSets(particle_buffer_, particles_set, particles_bindings.find(COMPUTE_PARTICLE_BUFFER_BINDING_NAME)->second);
     backend_->updateDescriptorSets(particle_respawn_buffer_, particles_set, particles_bindings.find(COMPUTE_RESPAWN_BUFFER_BINDING_NAME)->second);
     backend_->updateDescriptorSets(particle_vertex_buffer_, particles_set, particles_bindings.find(COMPUTE_VERTEX_BUFFER_BINDING_NAME)->second);
     const auto& camera_bindings = metadata.set_bindings.find(COMPUTE_CAMERA_SET_ID)->second;
-    auto camera_set = std::vector<VkDescriptorSet>{vk_descriptor_sets_compute_[COMPUTE_CAMERA_SET_ID]};
-    backend_->updateDescriptorSets(compute_camera_buffer_, camera_set, camera_bindings.find(CAMERA_BINDING_NAME)->second);
-    scene_depth_buffer->updateDescriptorSets(camera_set, camera_bindings.find(SCENE_DEPTH_BUFFER_STORAGE)->second);
+    auto camera_sets = std::vector<VkDescriptorSet>(vk_descriptor_sets_compute_.begin() + COMPUTE_CAMERA_SET_ID, vk_descriptor_sets_compute_.end());
+    backend_->updateDynamicDescriptorSets(sizeof(CameraData), camera_sets, camera_bindings.find(COMPUTE_CAMERA_BINDING_NAME)->second);
+    for (size_t i = 0; i < camera_sets.size(); ++i) {
+        auto camera_set = std::vector<VkDescriptorSet>{ camera_sets[i] };
+        scene_depth_buffers[i]->updateDescriptorSets(camera_set, camera_bindings.find(SCENE_DEPTH_BUFFER_STORAGE)->second);
+    }
 }
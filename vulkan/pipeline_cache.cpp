@@ -0,0 +1,192 @@
+/*
+* pipeline_cache.cpp
+*
+* Copyright (C) 2021 Riccardo Marson
+*/
+
+#include "pipeline_cache.hpp"
+
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+namespace {
+    std::string cacheFileName(const VkPhysicalDeviceProperties& properties) {
+        std::stringstream name;
+        name << "pipeline_cache_";
+        for (uint32_t i = 0; i < VK_UUID_SIZE; ++i) {
+            name << std::hex << std::setw(2) << std::setfill('0') << static_cast<uint32_t>(properties.pipelineCacheUUID[i]);
+        }
+        name << "_" << std::dec << properties.driverVersion << ".bin";
+        return name.str();
+    }
+
+    double elapsedMs(std::chrono::steady_clock::time_point start) {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+}
+
+PipelineCache::PipelineCache(VkDevice device, VkPhysicalDevice physical_device, const std::string& directory) :
+    device_(device) {
+    vkGetPhysicalDeviceProperties(physical_device, &device_properties_);
+    file_path_ = directory.empty() ? cacheFileName(device_properties_) : directory + "/" + cacheFileName(device_properties_);
+
+    auto initial_data = loadCacheFile();
+    if (!initial_data.empty() && !isHeaderCompatible(initial_data)) {
+        std::cerr << "Pipeline cache " << file_path_ << " was written by a different device or driver, ignoring it" << std::endl;
+        initial_data.clear();
+    }
+
+    VkPipelineCacheCreateInfo create_info{};
+    create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+    create_info.initialDataSize = initial_data.size();
+    create_info.pInitialData = initial_data.empty() ? nullptr : initial_data.data();
+
+    if (vkCreatePipelineCache(device_, &create_info, nullptr, &vk_pipeline_cache_) != VK_SUCCESS) {
+        // some drivers reject data that passes the header check, start from scratch rather than going without a cache
+        create_info.initialDataSize = 0;
+        create_info.pInitialData = nullptr;
+        initial_data.clear();
+
+        if (vkCreatePipelineCache(device_, &create_info, nullptr, &vk_pipeline_cache_) != VK_SUCCESS) {
+            std::cerr << "Failed to create pipeline cache!" << std::endl;
+            vk_pipeline_cache_ = VK_NULL_HANDLE;
+            return;
+        }
+    }
+
+    stats_.loaded_bytes = initial_data.size();
+}
+
+PipelineCache::~PipelineCache() {
+    if (vk_pipeline_cache_ != VK_NULL_HANDLE) {
+        vkDestroyPipelineCache(device_, vk_pipeline_cache_, nullptr);
+    }
+}
+
+VkResult PipelineCache::createGraphicsPipeline(const VkGraphicsPipelineCreateInfo& create_info, VkPipeline& pipeline) {
+    auto size_before = getDataSize();
+    auto start = std::chrono::steady_clock::now();
+
+    VkResult result = vkCreateGraphicsPipelines(device_, vk_pipeline_cache_, 1, &create_info, nullptr, &pipeline);
+    if (result == VK_SUCCESS) {
+        recordCreation(size_before, elapsedMs(start));
+    }
+
+    return result;
+}
+
+VkResult PipelineCache::createComputePipeline(const VkComputePipelineCreateInfo& create_info, VkPipeline& pipeline) {
+    auto size_before = getDataSize();
+    auto start = std::chrono::steady_clock::now();
+
+    VkResult result = vkCreateComputePipelines(device_, vk_pipeline_cache_, 1, &create_info, nullptr, &pipeline);
+    if (result == VK_SUCCESS) {
+        recordCreation(size_before, elapsedMs(start));
+    }
+
+    return result;
+}
+
+bool PipelineCache::save() const {
+    if (vk_pipeline_cache_ == VK_NULL_HANDLE) {
+        return false;
+    }
+
+    size_t data_size = 0;
+    if (vkGetPipelineCacheData(device_, vk_pipeline_cache_, &data_size, nullptr) != VK_SUCCESS || data_size == 0) {
+        return false;
+    }
+
+    std::vector<char> data(data_size);
+    if (vkGetPipelineCacheData(device_, vk_pipeline_cache_, &data_size, data.data()) != VK_SUCCESS) {
+        std::cerr << "Failed to retrieve pipeline cache data!" << std::endl;
+        return false;
+    }
+
+    std::ofstream file(file_path_, std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) {
+        std::cerr << "Failed to open " << file_path_ << " for writing!" << std::endl;
+        return false;
+    }
+
+    file.write(data.data(), static_cast<std::streamsize>(data_size));
+    return file.good();
+}
+
+PipelineCacheStats PipelineCache::getStats() const {
+    std::lock_guard<std::mutex> lock(stats_mutex_);
+    return stats_;
+}
+
+void PipelineCache::printStats() const {
+    auto stats = getStats();
+
+    std::cout << "Pipeline cache (" << file_path_ << ", " << stats.loaded_bytes << " bytes loaded):" << std::endl;
+    std::cout << '\t' << stats.hits << " hits, " << stats.hits_ms << " ms";
+    if (stats.hits > 0) {
+        std::cout << " (" << stats.hits_ms / stats.hits << " ms avg)";
+    }
+    std::cout << std::endl;
+    std::cout << '\t' << stats.misses << " misses, " << stats.misses_ms << " ms";
+    if (stats.misses > 0) {
+        std::cout << " (" << stats.misses_ms / stats.misses << " ms avg)";
+    }
+    std::cout << std::endl;
+}
+
+std::vector<char> PipelineCache::loadCacheFile() const {
+    std::ifstream file(file_path_, std::ios::binary | std::ios::ate);
+    if (!file.is_open()) {
+        return {};
+    }
+
+    auto file_size = static_cast<size_t>(file.tellg());
+    std::vector<char> data(file_size);
+    file.seekg(0);
+    file.read(data.data(), static_cast<std::streamsize>(file_size));
+
+    if (!file.good()) {
+        std::cerr << "Failed to read pipeline cache " << file_path_ << std::endl;
+        return {};
+    }
+
+    return data;
+}
+
+bool PipelineCache::isHeaderCompatible(const std::vector<char>& data) const {
+    VkPipelineCacheHeaderVersionOne header{};
+    if (data.size() < sizeof(header)) {
+        return false;
+    }
+
+    std::memcpy(&header, data.data(), sizeof(header));
+
+    return header.headerSize >= sizeof(header) &&
+        header.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+        header.vendorID == device_properties_.vendorID &&
+        header.deviceID == device_properties_.deviceID &&
+        std::memcmp(header.pipelineCacheUUID, device_properties_.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+}
+
+size_t PipelineCache::getDataSize() const {
+    size_t data_size = 0;
+    vkGetPipelineCacheData(device_, vk_pipeline_cache_, &data_size, nullptr);
+    return data_size;
+}
+
+void PipelineCache::recordCreation(size_t size_before, double elapsed_ms) {
+    // with several threads compiling at once another pipeline may grow the cache in between, which can only turn
+    // a hit into a miss, never the opposite
+    bool hit = getDataSize() == size_before;
+
+    std::lock_guard<std::mutex> lock(stats_mutex_);
+    if (hit) {
+        ++stats_.hits;
+        stats_.hits_ms += elapsed_ms;
+    } else {
+        ++stats_.misses;
+        stats_.misses_ms += elapsed_ms;
+    }
+}
@@ -0,0 +1,55 @@
+/*
+* pipeline_cache.hpp
+*
+* Copyright (C) 2021 Riccardo Marson
+*/
+
+#pragma once
+
+#include "common_definitions.hpp"
+
+#include <mutex>
+
+struct PipelineCacheStats {
+    uint32_t hits = 0;
+    uint32_t misses = 0;
+    double hits_ms = 0.0;  // total time spent creating pipelines that were found in the cache
+    double misses_ms = 0.0;
+    size_t loaded_bytes = 0;  // 0 when there was no usable cache on disk
+};
+
+// Wraps the VkPipelineCache used by every pipeline builder, persisted to a file named after the device pipeline cache
+// UUID and the driver version so that a driver update or a different GPU never picks up stale data.
+// The driver doesn't tell whether a pipeline came from the cache, so a creation that doesn't grow the cache data
+// is counted as a hit.
+class PipelineCache {
+public:
+    PipelineCache(VkDevice device, VkPhysicalDevice physical_device, const std::string& directory = "");
+    ~PipelineCache();
+
+    bool isValid() const { return vk_pipeline_cache_ != VK_NULL_HANDLE; }
+    VkPipelineCache handle() const { return vk_pipeline_cache_; }
+    const std::string& getFilePath() const { return file_path_; }
+
+    VkResult createGraphicsPipeline(const VkGraphicsPipelineCreateInfo& create_info, VkPipeline& pipeline);
+    VkResult createComputePipeline(const VkComputePipelineCreateInfo& create_info, VkPipeline& pipeline);
+
+    bool save() const;
+
+    PipelineCacheStats getStats() const;
+    void printStats() const;
+
+private:
+    std::vector<char> loadCacheFile() const;
+    bool isHeaderCompatible(const std::vector<char>& data) const;
+    size_t getDataSize() const;
+    void recordCreation(size_t size_before, double elapsed_ms);
+
+    VkDevice device_;
+    VkPhysicalDeviceProperties device_properties_{};
+    std::string file_path_;
+    VkPipelineCache vk_pipeline_cache_ = VK_NULL_HANDLE;
+
+    mutable std::mutex stats_mutex_;
+    PipelineCacheStats stats_;
+};
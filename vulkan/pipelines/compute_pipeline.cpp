@@ -6,6 +6,8 @@
 
 #include "compute_pipeline.hpp"
 #include "../shader_module.hpp"
+#include "../pipeline_cache.hpp"
+#include "../descriptor_set_layout_cache.hpp"
 
 bool ComputePipeline::buildPipeline(const ComputePipelineConfig& config) {
     if (!config.compute) {
@@ -28,18 +30,14 @@ bool ComputePipeline::buildPipeline(const ComputePipelineConfig& config) {
     for (const auto& meta : compute_descriptor_metadata.set_bindings) {
         pipeline_descriptor_metadata.set_bindings[meta.first] = meta.second;
     }
+    applyDynamicBindings(config.dynamic_bindings, pipeline_descriptor_metadata, layout_bindings_by_set);
 
     // create descriptor layouts for all sets of binding points in the pipeline
     std::map<uint32_t, VkDescriptorSetLayout> descriptors_set_layouts;
     std::map<uint32_t, std::vector< VkDescriptorSet>> descriptor_sets;
     for (auto& set : layout_bindings_by_set) {
-        VkDescriptorSetLayoutCreateInfo layout_create_info{};
-        layout_create_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-        layout_create_info.bindingCount = static_cast<uint32_t>(set.second.size());
-        layout_create_info.pBindings = set.second.data();
-
-        VkDescriptorSetLayout descriptor_set_layout;
-        if (vkCreateDescriptorSetLayout(device_, &layout_create_info, nullptr, &descriptor_set_layout) != VK_SUCCESS) {
+        auto descriptor_set_layout = layout_cache_->getLayout(set.first, set.second);  // shared with pipelines declaring the same set
+        if (descriptor_set_layout == VK_NULL_HANDLE) {
             std::cerr << "Failed to create compute pipeline descriptor set layout!" << std::endl;
             return false;
         }
@@ -50,6 +48,9 @@ bool ComputePipeline::buildPipeline(const ComputePipelineConfig& config) {
     // auxiliary array to make sure the layouts are ordered and contiguous in memory
     std::vector<VkDescriptorSetLayout> descriptors_set_layouts_aux;
     for (auto& layout : descriptors_set_layouts) {
+        while (descriptors_set_layouts_aux.size() < layout.first) {
+            descriptors_set_layouts_aux.push_back(layout_cache_->getLayout({}));  // a set the pipeline doesn't use, before one it does
+        }
         descriptors_set_layouts_aux.push_back(layout.second);
     }
 
@@ -91,7 +92,7 @@ bool ComputePipeline::buildPipeline(const ComputePipelineConfig& config) {
     create_info.basePipelineIndex = -1;
 
     VkPipeline vk_pipeline;
-    if (vkCreateComputePipelines(device_, VK_NULL_HANDLE, 1, &create_info, nullptr, &vk_pipeline) != VK_SUCCESS) {
+    if (pipeline_cache_->createComputePipeline(create_info, vk_pipeline) != VK_SUCCESS) {
         std::cerr << "Failed to create Compute pipeline!" << std::endl;
         return false;
     }
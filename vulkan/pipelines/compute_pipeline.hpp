@@ -12,7 +12,10 @@ class VulkanBackend;
 class ShaderModule;
 
 struct ComputePipelineConfig {
-    std::shared_ptr<ShaderModule> compute;
+    std::shared_ptr<const ShaderModule> compute;
+
+    // uniform or storage buffers bound with a dynamic offset, by binding name
+    std::set<std::string> dynamic_bindings;
 };
 
 class ComputePipeline : public VulkanPipeline {
@@ -24,8 +27,8 @@ class ComputePipeline : public VulkanPipeline {
  private:
     friend class VulkanBackend;
     
-    ComputePipeline(VkDevice device, const std::string& name) : 
-            VulkanPipeline(device, name) {
+    ComputePipeline(VkDevice device, PipelineCache* pipeline_cache, DescriptorSetLayoutCache* layout_cache, const std::string& name) : 
+            VulkanPipeline(device, pipeline_cache, layout_cache, name) {
                pipeline_type_ = PipelineType::COMPUTE;
             }
 };
@@ -14,12 +14,12 @@ class ShaderModule;
 
 
 struct GraphicsPipelineConfig : public FixedFunctionConfig  {
-    std::shared_ptr<ShaderModule> vertex;
-    std::shared_ptr<ShaderModule> geometry;
-    std::shared_ptr<ShaderModule> fragment;
+    std::shared_ptr<const ShaderModule> vertex;
+    std::shared_ptr<const ShaderModule> geometry;
+    std::shared_ptr<const ShaderModule> fragment;
     struct TessellationShaders {
-        std::shared_ptr<ShaderModule> control;
-        std::shared_ptr<ShaderModule> evaluation;
+        std::shared_ptr<const ShaderModule> control;
+        std::shared_ptr<const ShaderModule> evaluation;
 
         operator bool() const { return control && evaluation; }
     }tessellation;
@@ -34,8 +34,8 @@ class GraphicsPipeline : public GraphicsPipelineBase {
  private:
     friend class VulkanBackend;
     
-    GraphicsPipeline(VkDevice device, const std::string& name) : 
-            GraphicsPipelineBase(device, name) {
+    GraphicsPipeline(VkDevice device, PipelineCache* pipeline_cache, DescriptorSetLayoutCache* layout_cache, const std::string& name) : 
+            GraphicsPipelineBase(device, pipeline_cache, layout_cache, name) {
                 pipeline_type_ = PipelineType::GRAPHICS;
             }
 
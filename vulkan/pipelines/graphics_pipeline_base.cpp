@@ -6,6 +6,7 @@
 
 #include "graphics_pipeline_base.hpp"
 #include "../render_pass.hpp"
+#include "../pipeline_cache.hpp"
 
 bool GraphicsPipelineBase::buildPipeline(const FixedFunctionConfig& config, 
                               const GraphicsPipelineLayoutInfo& layout_info,
@@ -137,7 +138,7 @@ bool GraphicsPipelineBase::buildPipeline(const FixedFunctionConfig& config,
     pipeline_info.basePipelineIndex = -1; // Optional
     
     VkPipeline vk_pipeline;
-    if (vkCreateGraphicsPipelines(device_, VK_NULL_HANDLE, 1, &pipeline_info, nullptr, &vk_pipeline) != VK_SUCCESS) {
+    if (pipeline_cache_->createGraphicsPipeline(pipeline_info, vk_pipeline) != VK_SUCCESS) {
         std::cerr << "Failed to create Graphics pipeline!" << std::endl;
         return false;
     }
@@ -27,6 +27,9 @@ struct FixedFunctionConfig {
 
     const RenderPass* render_pass;
     uint32_t subpass_number = 0;
+
+    // uniform or storage buffers bound with a dynamic offset, by binding name
+    std::set<std::string> dynamic_bindings;
 };
 
 struct GraphicsPipelineLayoutInfo {
@@ -42,8 +45,8 @@ class GraphicsPipelineBase : public VulkanPipeline {
         virtual ~GraphicsPipelineBase() = default;
 
     protected:
-        GraphicsPipelineBase(VkDevice device, const std::string& name) : 
-            VulkanPipeline(device, name) {}
+        GraphicsPipelineBase(VkDevice device, PipelineCache* pipeline_cache, DescriptorSetLayoutCache* layout_cache, const std::string& name) : 
+            VulkanPipeline(device, pipeline_cache, layout_cache, name) {}
 
         bool buildPipeline(const FixedFunctionConfig& config, 
                                       const GraphicsPipelineLayoutInfo& layout_info,
@@ -6,6 +6,7 @@
 
 #include "mesh_pipeline.hpp"
 #include "../shader_module.hpp"
+#include "../descriptor_set_layout_cache.hpp"
 
 bool MeshPipeline::buildPipeline(const MeshPipelineConfig& config) {
     GraphicsPipelineLayoutInfo layout_info;
@@ -103,16 +104,13 @@ bool MeshPipeline::assembleMeshPipelineLayoutInfo(const MeshPipelineConfig& conf
         }
     }
 
+    applyDynamicBindings(config.dynamic_bindings, layout_info.pipeline_descriptor_metadata, layout_bindings_by_set);
+
     // create descriptor layouts for all sets of binding points in the pipeline
     std::map<uint32_t, std::vector< VkDescriptorSet>> descriptor_sets;
     for (auto& set : layout_bindings_by_set) {
-        VkDescriptorSetLayoutCreateInfo layout_create_info{};
-        layout_create_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-        layout_create_info.bindingCount = static_cast<uint32_t>(set.second.size());
-        layout_create_info.pBindings = set.second.data();
-
-        VkDescriptorSetLayout descriptor_set_layout;
-        if (vkCreateDescriptorSetLayout(device_, &layout_create_info, nullptr, &descriptor_set_layout) != VK_SUCCESS) {
+        auto descriptor_set_layout = layout_cache_->getLayout(set.first, set.second);  // shared with pipelines declaring the same set
+        if (descriptor_set_layout == VK_NULL_HANDLE) {
             std::cerr << "Failed to create graphics pipeline descriptor set layout!" << std::endl;
             return false;
         }
@@ -122,6 +120,9 @@ bool MeshPipeline::assembleMeshPipelineLayoutInfo(const MeshPipelineConfig& conf
 
     // auxiliary array to make sure the layouts are ordered and contiguous in memory
     for (auto& layout : layout_info.descriptors_set_layouts) {
+        while (layout_info.descriptors_set_layouts_aux.size() < layout.first) {
+            layout_info.descriptors_set_layouts_aux.push_back(layout_cache_->getLayout({}));  // a set the pipeline doesn't use, before one it does
+        }
         layout_info.descriptors_set_layouts_aux.push_back(layout.second);
     }
 
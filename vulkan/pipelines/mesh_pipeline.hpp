@@ -14,9 +14,9 @@ class ShaderModule;
 
 
 struct MeshPipelineConfig : public FixedFunctionConfig  {
-    std::shared_ptr<ShaderModule> task;
-    std::shared_ptr<ShaderModule> mesh;
-    std::shared_ptr<ShaderModule> fragment;
+    std::shared_ptr<const ShaderModule> task;
+    std::shared_ptr<const ShaderModule> mesh;
+    std::shared_ptr<const ShaderModule> fragment;
 };
 
 class MeshPipeline : public GraphicsPipelineBase {
@@ -28,8 +28,8 @@ class MeshPipeline : public GraphicsPipelineBase {
  private:
     friend class VulkanBackend;
     
-    MeshPipeline(VkDevice device, const std::string& name) : 
-            GraphicsPipelineBase(device, name) {
+    MeshPipeline(VkDevice device, PipelineCache* pipeline_cache, DescriptorSetLayoutCache* layout_cache, const std::string& name) : 
+            GraphicsPipelineBase(device, pipeline_cache, layout_cache, name) {
                 pipeline_type_ = PipelineType::GRAPHICS_MESH;
             }
 
@@ -8,7 +8,11 @@
 
 #include "../common_definitions.hpp"
 
+#include <future>
+
 class ShaderModule;
+class PipelineCache;
+class DescriptorSetLayoutCache;
 
 using BindingsMap = std::map<std::string, uint32_t>;
 struct DescriptorSetMetadata {
@@ -25,15 +29,55 @@ enum class PipelineType {
     RAYTRACING 
 };
 
+// One or more pipelines compiling on worker threads. finish waits for all of them and, if they all succeeded, runs
+// the continuations (descriptor sets and anything else that needs the built pipeline) on the calling thread.
+// A build must always be finished, even when giving up, before the pipelines it references are destroyed
+class PipelineBuild {
+public:
+    PipelineBuild() = default;
+    explicit PipelineBuild(bool result) : failed_(!result) {}  // for work that was done (or failed) synchronously
+    explicit PipelineBuild(std::future<bool>&& result) { results_.push_back(std::move(result)); }
+
+    PipelineBuild&& then(std::function<bool()> continuation) && { 
+        continuations_.push_back(std::move(continuation)); 
+        return std::move(*this); 
+    }
+    
+    void append(PipelineBuild&& other) {
+        failed_ = failed_ || other.failed_;
+        std::move(other.results_.begin(), other.results_.end(), std::back_inserter(results_));
+        std::move(other.continuations_.begin(), other.continuations_.end(), std::back_inserter(continuations_));
+        other.results_.clear();
+        other.continuations_.clear();
+    }
+
+    bool finish() {
+        bool success = !failed_;
+        for (auto& result : results_) {
+            success = result.get() && success;  // wait for everything, even after a failure
+        }
+        results_.clear();
+
+        for (auto& continuation : continuations_) {
+            success = success && continuation();
+        }
+        continuations_.clear();
+
+        return success;
+    }
+
+private:
+    bool failed_ = false;
+    std::vector<std::future<bool>> results_;
+    std::vector<std::function<bool()>> continuations_;
+};
+
 class VulkanPipeline {
  public:
 
     virtual ~VulkanPipeline() {
         if (isValid()) {
-            for (auto& descr_set_layout : vk_descriptor_set_layouts_) {
-                vkDestroyDescriptorSetLayout(device_, descr_set_layout.second, nullptr);
-            }
-            
+            // descriptor set layouts belong to the backend layout cache
             vkDestroyPipeline(device_, vk_pipeline_, nullptr);
             vkDestroyPipelineLayout(device_, vk_pipeline_layout_, nullptr);
             vk_descriptor_set_layouts_.clear();
@@ -50,14 +94,48 @@ class VulkanPipeline {
     const PushConstantsMap& pushConstants() const { return push_constants_; }
 
 protected:
-    VulkanPipeline(VkDevice device, const std::string& name) :
+    VulkanPipeline(VkDevice device, PipelineCache* pipeline_cache, DescriptorSetLayoutCache* layout_cache, const std::string& name) :
+        name_(name),
         device_(device),
-        name_(name) {}
+        pipeline_cache_(pipeline_cache),
+        layout_cache_(layout_cache) {}
+
+    // reflection reports the descriptor types declared in the shaders. the buffers named in dynamic_bindings are
+    // bound with an offset into the backend uniform ring, so they become their dynamic counterparts
+    static void applyDynamicBindings(const std::set<std::string>& dynamic_bindings, const DescriptorSetMetadata& metadata,
+                                     std::map<uint32_t, std::vector<VkDescriptorSetLayoutBinding>>& layout_bindings_by_set) {
+        for (auto& set : layout_bindings_by_set) {
+            auto set_metadata = metadata.set_bindings.find(set.first);
+            if (set_metadata == metadata.set_bindings.end()) {
+                continue;
+            }
+
+            for (const auto& name : dynamic_bindings) {
+                auto binding_iter = set_metadata->second.find(name);
+                if (binding_iter == set_metadata->second.end()) {
+                    continue;
+                }
+
+                for (auto& binding : set.second) {  // a binding declared by more than one stage appears more than once
+                    if (binding.binding != binding_iter->second) {
+                        continue;
+                    }
+                    if (binding.descriptorType == VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER) {
+                        binding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+                    } else if (binding.descriptorType == VK_DESCRIPTOR_TYPE_STORAGE_BUFFER) {
+                        binding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+                    }
+                }
+            }
+        }
+    }
 
     std::string name_;
     PipelineType pipeline_type_ = PipelineType::UNKNOWN;
 
     VkDevice device_;
+    PipelineCache* pipeline_cache_;  // owned by the backend
+    DescriptorSetLayoutCache* layout_cache_;  // owned by the backend
     VkPipelineLayout vk_pipeline_layout_ = VK_NULL_HANDLE;
     VkPipeline vk_pipeline_ = VK_NULL_HANDLE;
     std::map<uint32_t, VkDescriptorSetLayout> vk_descriptor_set_layouts_;
@@ -0,0 +1,170 @@
+/*
+* profilers.cpp
+*
+* Copyright (C) 2021 Riccardo Marson
+*/
+
+#include "profilers.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <limits>
+
+namespace {
+	thread_local void* tls_thread_events = nullptr;
+
+	void writeEvent(std::ofstream& out, bool& first, const std::string& name, const char* category, int64_t begin_ns, int64_t end_ns, int64_t origin_ns, uint32_t tid) {
+		out << (first ? "\n" : ",\n");
+		first = false;
+		// complete events, times in microseconds
+		out << "{\"name\":\"" << escapeJson(name) << "\",\"cat\":\"" << escapeJson(category) << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << tid
+			<< ",\"ts\":" << (begin_ns - origin_ns) * 1e-3 << ",\"dur\":" << std::max<int64_t>(end_ns - begin_ns, 0) * 1e-3 << "}";
+	}
+
+	void writeThreadName(std::ofstream& out, bool& first, const std::string& name, uint32_t tid) {
+		out << (first ? "\n" : ",\n");
+		first = false;
+		out << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << tid << ",\"args\":{\"name\":\"" << escapeJson(name) << "\"}}";
+	}
+}
+
+std::string escapeJson(const std::string& text) {
+	std::string escaped;
+	escaped.reserve(text.size());
+	for (auto c : text) {
+		if (c == '"' || c == '\\') {
+			escaped += '\\';
+			escaped += c;
+		} else if (static_cast<unsigned char>(c) < 0x20) {
+			escaped += ' ';
+		} else {
+			escaped += c;
+		}
+	}
+	return escaped;
+}
+
+CpuProfiler& CpuProfiler::instance() {
+	static CpuProfiler profiler;
+	return profiler;
+}
+
+int64_t CpuProfiler::now() {
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void CpuProfiler::setThreadName(const std::string& name) {
+	if (!isEnabled()) {
+		return;  // don't allocate a ring for threads that may never record anything
+	}
+
+	auto& events = threadEvents();
+	std::lock_guard<std::mutex> lock(events.mutex);
+	events.name = name;
+}
+
+uint32_t CpuProfiler::beginScope() {
+	return threadEvents().depth++;
+}
+
+void CpuProfiler::endScope(const char* name, int64_t begin_ns, uint32_t depth) {
+	auto end_ns = now();
+	auto& events = threadEvents();
+	events.depth = depth;
+
+	std::lock_guard<std::mutex> lock(events.mutex);
+	auto& event = events.ring[events.recorded % kEventsPerThread];
+	event.name = name;
+	event.begin_ns = begin_ns;
+	event.end_ns = end_ns;
+	event.depth = depth;
+	++events.recorded;
+}
+
+bool CpuProfiler::exportChromeTrace(const std::string& path, const std::vector<std::pair<std::string, std::vector<TraceEvent>>>& external_tracks) {
+	// copy the rings first, the threads keep recording (and may rename themselves) while the file is written
+	struct ThreadCopy {
+		uint32_t id = 0;
+		std::string name;
+		std::vector<Event> events;
+	};
+	std::vector<ThreadCopy> threads_events;
+	{
+		std::lock_guard<std::mutex> threads_lock(threads_mutex_);
+		for (auto& thread : threads_) {
+			std::lock_guard<std::mutex> lock(thread->mutex);
+			auto count = static_cast<size_t>(std::min<uint64_t>(thread->recorded, kEventsPerThread));
+			std::vector<Event> events;
+			events.reserve(count);
+			for (uint64_t i = thread->recorded - count; i < thread->recorded; ++i) {
+				events.push_back(thread->ring[i % kEventsPerThread]);
+			}
+			threads_events.push_back({ thread->id, thread->name, std::move(events) });
+		}
+	}
+
+	int64_t origin_ns = std::numeric_limits<int64_t>::max();
+	for (const auto& thread : threads_events) {
+		for (const auto& event : thread.events) {
+			origin_ns = std::min(origin_ns, event.begin_ns);
+		}
+	}
+	for (const auto& track : external_tracks) {
+		for (const auto& event : track.second) {
+			origin_ns = std::min(origin_ns, event.begin_ns);
+		}
+	}
+
+	std::ofstream out(path, std::ios::out | std::ios::trunc);
+	if (!out.is_open()) {
+		std::cerr << "Failed to open " << path << " to write the profiler trace!" << std::endl;
+		return false;
+	}
+
+	out << std::fixed << std::setprecision(3);  // microseconds, hours long traces must not switch to exponents
+
+	size_t events_count = 0;
+	bool first = true;
+	out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+
+	for (const auto& thread : threads_events) {
+		auto tid = thread.id;
+		writeThreadName(out, first, thread.name.empty() ? "Thread " + std::to_string(tid) : thread.name, tid);
+		for (const auto& event : thread.events) {
+			writeEvent(out, first, event.name, "cpu", event.begin_ns, event.end_ns, origin_ns, tid);
+		}
+		events_count += thread.events.size();
+	}
+
+	// external tracks go after the threads
+	auto tid = static_cast<uint32_t>(threads_events.size()) + 1;
+	for (const auto& track : external_tracks) {
+		writeThreadName(out, first, track.first, tid);
+		for (const auto& event : track.second) {
+			writeEvent(out, first, event.name, track.first.c_str(), event.begin_ns, event.end_ns, origin_ns, tid);
+		}
+		events_count += track.second.size();
+		++tid;
+	}
+
+	out << "\n]}\n";
+	out.close();
+
+	std::cout << "Profiler trace: " << events_count << " events written to " << path << std::endl;
+	return true;
+}
+
+CpuProfiler::ThreadEvents& CpuProfiler::threadEvents() {
+	if (tls_thread_events == nullptr) {
+		auto events = std::make_unique<ThreadEvents>();
+		events->ring.resize(kEventsPerThread);
+
+		std::lock_guard<std::mutex> lock(threads_mutex_);
+		events->id = static_cast<uint32_t>(threads_.size()) + 1;
+		tls_thread_events = events.get();
+		threads_.push_back(std::move(events));
+	}
+
+	return *static_cast<ThreadEvents*>(tls_thread_events);
+}
@@ -1,8 +1,13 @@
 #pragma once
 
+#include <atomic>
 #include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
 #include <string>
 #include <iostream>
+#include <vector>
 
 class OneShotProfiler {
 public:
@@ -21,3 +26,93 @@ private:
 	std::string name_;
 	std::chrono::time_point<std::chrono::high_resolution_clock> start_;
 };
+
+// quotes and backslashes escaped, control characters replaced by spaces
+std::string escapeJson(const std::string& text);
+
+// an event on a track of its own in the exported trace, e.g. a GPU scope. times are on the CpuProfiler clock
+struct TraceEvent {
+	std::string name;
+	int64_t begin_ns = 0;
+	int64_t end_ns = 0;
+	uint32_t depth = 0;
+};
+
+// Hierarchical CPU profiler. Scopes are marked with CPU_PROFILE_SCOPE("name"), the name must be a string literal
+// (or anything else that outlives the profiler) so that recording a scope never allocates. Each thread records
+// into a ring buffer of its own, allocated the first time it records, which keeps the last kEventsPerThread scopes.
+// Scopes nest by time on each thread. The whole lot can be exported as a Chrome trace (chrome://tracing or
+// ui.perfetto.dev), together with tracks of events recorded elsewhere, like the GPU scopes.
+class CpuProfiler {
+public:
+	static const size_t kEventsPerThread = 16384;
+
+	static CpuProfiler& instance();
+	static int64_t now();  // steady clock, in nanoseconds
+
+	void setEnabled(bool enabled) { enabled_ = enabled; }
+	bool isEnabled() const { return enabled_; }
+
+	void setThreadName(const std::string& name);  // shown in the trace, for the calling thread. ignored while disabled
+
+	// for ScopedCpuProfile
+	uint32_t beginScope();  // returns the depth of the new scope
+	void endScope(const char* name, int64_t begin_ns, uint32_t depth);
+
+	// external_tracks are extra tracks by name, e.g. { "GPU", gpu_events }
+	bool exportChromeTrace(const std::string& path, const std::vector<std::pair<std::string, std::vector<TraceEvent>>>& external_tracks = {});
+
+private:
+	struct Event {
+		const char* name = nullptr;
+		int64_t begin_ns = 0;
+		int64_t end_ns = 0;
+		uint32_t depth = 0;
+	};
+
+	struct ThreadEvents {
+		uint32_t id = 0;
+		std::string name;
+		uint32_t depth = 0;  // scopes open on the thread, only touched by the thread itself
+		std::mutex mutex;  // uncontended, unless an export is reading the ring
+		std::vector<Event> ring;
+		uint64_t recorded = 0;  // over the lifetime of the thread, the ring holds the last kEventsPerThread
+	};
+
+	ThreadEvents& threadEvents();
+
+	std::atomic<bool> enabled_{ false };
+	std::mutex threads_mutex_;
+	std::vector<std::unique_ptr<ThreadEvents>> threads_;  // never shrinks, threads that exited keep their events
+};
+
+class ScopedCpuProfile {
+public:
+	explicit ScopedCpuProfile(const char* name) : name_(name) {
+		auto& profiler = CpuProfiler::instance();
+		if (profiler.isEnabled()) {
+			depth_ = profiler.beginScope();
+			begin_ns_ = CpuProfiler::now();
+			active_ = true;
+		}
+	}
+
+	~ScopedCpuProfile() {
+		if (active_) {
+			CpuProfiler::instance().endScope(name_, begin_ns_, depth_);
+		}
+	}
+
+	ScopedCpuProfile(const ScopedCpuProfile&) = delete;
+	ScopedCpuProfile& operator=(const ScopedCpuProfile&) = delete;
+
+private:
+	const char* name_;
+	int64_t begin_ns_ = 0;
+	uint32_t depth_ = 0;
+	bool active_ = false;
+};
+
+#define CPU_PROFILE_CONCAT_IMPL(a, b) a##b
+#define CPU_PROFILE_CONCAT(a, b) CPU_PROFILE_CONCAT_IMPL(a, b)
+#define CPU_PROFILE_SCOPE(name) ScopedCpuProfile CPU_PROFILE_CONCAT(cpu_profile_scope_, __LINE__)(name)
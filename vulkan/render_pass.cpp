@@ -93,7 +93,7 @@ bool RenderPass::buildRenderPass(const RenderPassConfig& config) {
         color_attachment_resolve.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
         color_attachment_resolve.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
         color_attachment_resolve.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-        color_attachment_resolve.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+        color_attachment_resolve.finalLayout = backend_->getPresentImageLayout();
 
         attachments.push_back(color_attachment_resolve);
         if (depth_attachment_idx >= 0) {
@@ -10,6 +10,7 @@
 #include "static_mesh.hpp"
 #include "shader_module.hpp"
 #include "pipelines/graphics_pipeline.hpp"
+#include "pipelines/compute_pipeline.hpp"
 #include "render_pass.hpp"
 
 #define TINYGLTF_IMPLEMENTATION
@@ -21,6 +22,9 @@
 #include <glm/gtc/type_ptr.hpp>
 #include <glm/gtc/quaternion.hpp>
 
+#include <cstring>
+#include <limits>
+
 namespace gltf = tinygltf;
 
 namespace {
@@ -100,6 +104,19 @@ namespace {
                 vertex_buffer.push_back(vert);
             }
 
+            // bounding sphere around the centre of the box, not the tightest but good enough for culling
+            glm::vec3 bounds_min = glm::vec3(std::numeric_limits<float>::max());
+            glm::vec3 bounds_max = glm::vec3(std::numeric_limits<float>::lowest());
+            for (size_t v = vertex_start; v < vertex_buffer.size(); v++) {
+                bounds_min = glm::min(bounds_min, vertex_buffer[v].pos);
+                bounds_max = glm::max(bounds_max, vertex_buffer[v].pos);
+            }
+            glm::vec3 bounds_centre = vertex_count > 0 ? (bounds_min + bounds_max) * 0.5f : glm::vec3(0.0f);
+            float bounds_radius = 0.0f;
+            for (size_t v = vertex_start; v < vertex_buffer.size(); v++) {
+                bounds_radius = std::max(bounds_radius, glm::length(vertex_buffer[v].pos - bounds_centre));
+            }
+
             if (has_indices)
             {
                 const gltf::Accessor& accessor = model.accessors[p.indices > -1 ? p.indices : 0];
@@ -142,6 +159,8 @@ namespace {
             surface.vertex_start = vertex_start;
             surface.index_start = index_start;
             surface.material_weak = material;
+            surface.material_idx = p.material > -1 ? static_cast<uint32_t>(p.material) : 0;
+            surface.bounding_sphere = glm::vec4(bounds_centre, bounds_radius);
         }
     }
 
@@ -234,6 +253,28 @@ namespace {
         return 1.0f;
     }
 
+    // the six planes of the frustum of a world space view, normals pointing inwards and normalised, so that
+    // dot(plane.xyz, p) + plane.w is the distance of p from the plane
+    void frustumPlanes(const glm::mat4& view, const glm::mat4& proj, glm::vec4 planes[6]) {
+        // same as worldToVulkan in common.glsl. the y flip of projectionToVulkan only swaps the top and bottom planes
+        const glm::mat4 world_to_vulkan(glm::vec4(0.0f, 0.0f, -1.0f, 0.0f),
+                                        glm::vec4(-1.0f, 0.0f, 0.0f, 0.0f),
+                                        glm::vec4(0.0f, 1.0f, 0.0f, 0.0f),
+                                        glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
+        auto rows = glm::transpose(proj * world_to_vulkan * view);
+
+        planes[0] = rows[3] + rows[0];  // left
+        planes[1] = rows[3] - rows[0];  // right
+        planes[2] = rows[3] + rows[1];  // bottom
+        planes[3] = rows[3] - rows[1];  // top
+        planes[4] = rows[2];  // near, depth is 0 to 1
+        planes[5] = rows[3] - rows[2];  // far
+
+        for (int i = 0; i < 6; ++i) {
+            planes[i] /= glm::length(glm::vec3(planes[i]));
+        }
+    }
+
 }
 
 std::unique_ptr<SceneManager> SceneManager::create(VulkanBackend* backend) {
@@ -249,6 +290,15 @@ SceneManager::~SceneManager() {
     cleanupSwapChainAssets();
     backend_->destroyBuffer(scene_index_buffer_);
     backend_->destroyBuffer(scene_vertex_buffer_);
+    backend_->destroyBuffer(indirect_commands_buffer_);
+    backend_->destroyBuffer(draw_data_buffer_);
+    backend_->destroyBuffer(materials_buffer_);
+    backend_->destroyBuffer(draw_bounds_buffer_);
+    for (auto& culled_draws : culled_draws_) {
+        backend_->destroyBuffer(culled_draws.commands);
+        backend_->destroyBuffer(culled_draws.count);
+    }
+    culled_draws_.clear();
     for (auto& mat : materials_) {
         backend_->destroyUniformBuffer(mat->material_uniform);
     }
@@ -285,6 +335,9 @@ bool SceneManager::loadFromGlb(const std::string& file_path) {
 
     // global buffers
 
+    // all texture and geometry uploads are recorded in one command buffer and waited on once at the end
+    backend_->beginUploadBatch();
+
     // load all textures
     for (auto& gltf_tex : gltf_model.textures) {
         auto& gltf_image = gltf_model.images[gltf_tex.source];
@@ -294,6 +347,15 @@ bool SceneManager::loadFromGlb(const std::string& file_path) {
         textures_.push_back(std::move(texture));
     }
 
+    // in bindless mode materials point straight into the backend textures array, otherwise into textures_
+    auto texture_index = [this](int gltf_index) {
+        if (!backend_->bindlessTexturesEnabled()) {
+            return gltf_index;
+        }
+        auto bindless_index = textures_[gltf_index]->getBindlessIndex();
+        return bindless_index == INVALID_BINDLESS_INDEX ? -1 : static_cast<int>(bindless_index);
+    };
+
     // load all materials (with limited material support)
     for (auto& gltf_mat : gltf_model.materials) {
         auto material = std::make_shared<Material>();
@@ -305,23 +367,23 @@ bool SceneManager::loadFromGlb(const std::string& file_path) {
         auto& pbr_metal_rough = gltf_mat.pbrMetallicRoughness;
 
         if (pbr_metal_rough.baseColorTexture.index > -1) {
-            material->material_data.diffuse_idx = pbr_metal_rough.baseColorTexture.index;
+            material->material_data.diffuse_idx = texture_index(pbr_metal_rough.baseColorTexture.index);
         }
         if (pbr_metal_rough.metallicRoughnessTexture.index > -1) {
-            material->material_data.metal_rough_idx = pbr_metal_rough.metallicRoughnessTexture.index;
+            material->material_data.metal_rough_idx = texture_index(pbr_metal_rough.metallicRoughnessTexture.index);
         } else {
             material->material_data.metallic_factor = static_cast<float>(pbr_metal_rough.metallicFactor);
             material->material_data.roughness_factor = static_cast<float>(pbr_metal_rough.roughnessFactor);
         }
         if (gltf_mat.normalTexture.index > -1) {
-            material->material_data.normal_idx = gltf_mat.normalTexture.index;
+            material->material_data.normal_idx = texture_index(gltf_mat.normalTexture.index);
         }
         if (gltf_mat.emissiveTexture.index > -1) {
-            material->material_data.emissive_idx = gltf_mat.emissiveTexture.index;
+            material->material_data.emissive_idx = texture_index(gltf_mat.emissiveTexture.index);
         }
 
         material->material_uniform = backend_->createUniformBuffer<MaterialData>("material_" + std::to_string(materials_.size()));
-        for (size_t i = 0; i < backend_->getSwapChainSize(); i++) {
+        for (size_t i = 0; i < backend_->getFramesInFlight(); i++) {
             backend_->updateBuffer<MaterialData>(material->material_uniform.buffers[i], { material->material_data });
         }
        
@@ -346,6 +408,12 @@ bool SceneManager::loadFromGlb(const std::string& file_path) {
 
     scene_vertex_buffer_ = backend_->createVertexBuffer<Vertex>("scene_manager_vb", vertex_buffer, false);
     scene_index_buffer_ = backend_->createIndexBuffer<uint32_t>("scene_manager_ib", index_buffer, false);
+    createIndirectDrawBuffers();
+
+    if (!backend_->endUploadBatch()) {
+        std::cerr << "[SceneManager] Failed to upload the scene data for " << file_path << std::endl;
+        return false;
+    }
 
     return true;
 }
@@ -408,27 +476,6 @@ void SceneManager::enableShadows() {
     shadows_enabled_ = true;
 }
 
-DescriptorPoolConfig SceneManager::getDescriptorsCount(uint32_t expected_pipelines_count) const {
-    DescriptorPoolConfig config;
-    for (auto& mesh : meshes_) {
-        auto mesh_config = mesh->getDescriptorsCount();
-        config = config + mesh_config;
-    }
-
-    config.uniform_buffers_count += 1;
-    config.image_storage_buffers_count += 1;
-    config.image_samplers_count += uint32_t(textures_.size());
-
-    config = config * expected_pipelines_count;
-    
-    if (shadows_enabled_) {
-        config.uniform_buffers_count += 2;
-        config.image_samplers_count += 1;
-    }
-
-    return config;
-}
-
 std::shared_ptr<StaticMesh> SceneManager::getMeshByIndex(uint32_t idx) {
     if (idx < meshes_.size()) {
         return meshes_[idx];
@@ -459,29 +506,36 @@ std::shared_ptr<Material> SceneManager::getMaterial(uint32_t idx) {
     return std::shared_ptr<Material>();
 }
 
-bool SceneManager::createGraphicsPipeline(const std::string& program_name, const RenderPass& render_pass, uint32_t subpass_number) { 
-    auto vertex_shader_name = program_name + "_vs";
-    auto fragment_shader_name = program_name + "_fs";
+PipelineBuild SceneManager::createGraphicsPipeline(const std::string& program_name, const RenderPass& render_pass, uint32_t subpass_number) { 
+    // the indirect variant reads the transforms and materials from storage buffers, indexed per draw. it samples the
+    // textures with indices that change within a draw, so it needs the bindless array and non-uniform indexing
+    const auto& capabilities = backend_->getDeviceCapabilities();
+    indirect_draw_ = indirect_draw_requested_ && draws_count_ > 0 && backend_->bindlessTexturesEnabled() &&
+        capabilities.multi_draw_indirect && capabilities.non_uniform_texture_indexing;
+    // the culled lists only exist if the device could draw them
+    gpu_culling_ = indirect_draw_ && !culled_draws_.empty() && VkDrawIndexedIndirectCountKHR != nullptr;
+
+    auto vertex_shader_name = program_name + (indirect_draw_ ? "_indirect_vs" : "_vs");
+    // the bindless variant samples the backend textures array instead of a per-scene array of fixed size
+    auto fragment_shader_name = program_name + (indirect_draw_ ? "_indirect_fs" : (backend_->bindlessTexturesEnabled() ? "_bindless_fs" : "_fs"));
 
-    vertex_shader_ = backend_->createShaderModule(vertex_shader_name);
-	vertex_shader_->loadSpirvShader(std::string("shaders/") + vertex_shader_name + ".spv");
+    vertex_shader_ = backend_->loadShaderModule(vertex_shader_name, std::string("shaders/") + vertex_shader_name + ".spv");
 
 	if (!vertex_shader_->isVertexFormatCompatible(Vertex::getFormatInfo())) {
 		std::cerr << "Vertex format is not compatible with pipeline input for " << vertex_shader_->getName() << std::endl;
-		return false;
+		return PipelineBuild(false);
 	}
 
-	fragment_shader_ = backend_->createShaderModule(fragment_shader_name);
-	fragment_shader_->loadSpirvShader(std::string("shaders/") + fragment_shader_name + ".spv");
+	fragment_shader_ = backend_->loadShaderModule(fragment_shader_name, std::string("shaders/") + fragment_shader_name + ".spv");
 
 	if (!vertex_shader_->isValid() || !fragment_shader_->isValid()) {
 		std::cerr << "Failed to validate rain drops shaders!" << std::endl;
-		return false;
+		return PipelineBuild(false);
 	}
 
-    command_buffers_ = backend_->createSecondaryCommandBuffers(backend_->getSwapChainSize());
+    command_buffers_ = backend_->createSecondaryCommandBuffers(backend_->getFramesInFlight());
     if (command_buffers_.empty()) {
-        return false;
+        return PipelineBuild(false);
     }
 
     scene_subpass_number_ = subpass_number;
@@ -497,18 +551,29 @@ bool SceneManager::createGraphicsPipeline(const std::string& program_name, const
 	config.vertex_buffer_attrib_desc =vertex_shader_->getInputAttributes();
 	config.render_pass = &render_pass;
 	config.subpass_number = scene_subpass_number_;
+	config.dynamic_bindings = { SCENE_DATA_BINDING_NAME, MODEL_DATA_BINDING_NAME, MODEL_TRANSFORMS_BINDING_NAME };
+
+    createUniforms();  // the emitters need the depth buffer before this build is finished
 
-	if (scene_graphics_pipeline_->buildPipeline(config)) {
-        createUniforms();
+	auto build = backend_->buildPipelineAsync(*scene_graphics_pipeline_, config).then([this]() {
         createSceneDescriptorSets();
         createGeometryDescriptorSets();
         return true;
+    });
+
+    if (shadows_enabled_) {
+        build.append(setupShadowMapAssets());
+    }
+    if (gpu_culling_) {
+        build.append(createCullingPipeline());
     }
 
-	return false;
+	return build;
 }
 
 void SceneManager::prepareForRendering() {
+    updateCullingDescriptorSets();  // the shadow map is culled too
+
     if (shadows_enabled_) {
         renderStaticShadowMap();
     }
@@ -517,10 +582,19 @@ void SceneManager::prepareForRendering() {
 }
 
 void SceneManager::update() {
+    CPU_PROFILE_SCOPE("SceneManager::update");
     scene_data_.view = lookAtMatrix();
 
-    for (size_t i = 0; i < backend_->getSwapChainSize(); i++) {
-        backend_->updateBuffer<SceneData>(scene_data_buffer_.buffers[i], { scene_data_ });
+    scene_data_uniform_ = backend_->pushUniformData<SceneData>(scene_data_);
+
+    if (indirect_draw_) {
+        // all the transforms at once, indexed by the draw data
+        transforms_.resize(meshes_.size());
+        for (size_t i = 0; i < meshes_.size(); ++i) {
+            transforms_[i] = meshes_[i]->getTransform();
+        }
+        transforms_uniform_ = backend_->pushUniformArray<glm::mat4>(transforms_);
+        return;
     }
 
     for (auto& mesh : meshes_) {
@@ -528,8 +602,9 @@ void SceneManager::update() {
     }
 }
 
-RecordCommandsResult SceneManager::renderFrame(uint32_t swapchain_image, VkRenderPassBeginInfo& render_pass_info, const ProfileConfig& profile_config) {
-    std::vector<VkCommandBuffer> command_buffers = { command_buffers_[swapchain_image] };
+RecordCommandsResult SceneManager::renderFrame(uint32_t frame_index, VkRenderPassBeginInfo& render_pass_info, const ProfileConfig& profile_config) {
+    CPU_PROFILE_SCOPE("SceneManager::renderFrame");
+    std::vector<VkCommandBuffer> command_buffers = { command_buffers_[frame_index] };
     backend_->resetCommandBuffers(command_buffers);
 
     VkCommandBufferInheritanceInfo inherit_info{};
@@ -551,18 +626,19 @@ RecordCommandsResult SceneManager::renderFrame(uint32_t swapchain_image, VkRende
         return makeRecordCommandsResult(false, command_buffers);
     }
 
-    bindSceneDescriptors(command_buffers[0], *scene_graphics_pipeline_, swapchain_image);
+    bindSceneDescriptors(command_buffers[0], *scene_graphics_pipeline_, frame_index);
 
 	vkCmdBindPipeline(command_buffers[0], VK_PIPELINE_BIND_POINT_GRAPHICS, scene_graphics_pipeline_->handle());
 
     if (profile_config.profile_draw) {
-	    backend_->writeTimestampQuery(command_buffers[0], VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, profile_config.start_query_num); // does nothing if not in debug
+	    auto statistics = profile_config.pipeline_statistics ? PipelineStatisticsType::GRAPHICS : PipelineStatisticsType::NONE;
+	    backend_->beginGpuScope(command_buffers[0], profile_config.scope_name, statistics); // does nothing unless the profiler is enabled
     }
 
-	drawGeometry(command_buffers[0], scene_graphics_pipeline_->layout(), swapchain_image);
+	drawGeometry(command_buffers[0], scene_graphics_pipeline_->layout(), frame_index, true, gpu_culling_ ? &culled_draws_[frame_index] : nullptr);
 
     if (profile_config.profile_draw) {
-	    backend_->writeTimestampQuery(command_buffers[0], VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, profile_config.stop_query_num); // does nothing if not in debug
+	    backend_->endGpuScope(command_buffers[0], profile_config.scope_name);
     }
 
     if (vkEndCommandBuffer(command_buffers[0]) != VK_SUCCESS) {
@@ -579,30 +655,49 @@ void SceneManager::cleanupSwapChainAssets() {
     if (scene_graphics_pipeline_) {
         scene_graphics_pipeline_.reset();
     }
+    culling_pipeline_.reset();
 }
 
 void SceneManager::createUniforms() {
-    scene_data_buffer_ = backend_->createUniformBuffer<SceneData>("scene_data"); // the buffer lifecycle is managed by the backend
-
-    for (auto& mesh : meshes_) {
-        mesh->createUniformBuffer();
+    auto extent = backend_->getSwapChainExtent();
+    // create image buffers to store per-fragment depth and normal information that can be shared across pipelines
+    scene_depth_buffers_.clear();
+    for (uint32_t i = 0; i < backend_->getFramesInFlight(); ++i) {
+        auto depth_buffer = backend_->createTexture("scene_depth_buffer_storage_" + std::to_string(i));
+        depth_buffer->createDepthStorageImage(extent.width, extent.height, true /*as rgba*/);
+        scene_depth_buffers_.push_back(depth_buffer);
     }
+}
 
-    auto extent = backend_->getSwapChainExtent();
-    // create an image buffer to store per-fragment depth and normal information that can be shared across pipelines
-    scene_depth_buffer_ = backend_->createTexture("scene_depth_buffer_storage");
-    scene_depth_buffer_->createDepthStorageImage(extent.width, extent.height, true /*as rgba*/);
+QueueSharedResources SceneManager::getComputeSharedResources(uint32_t frame_index) const {
+    QueueSharedResources resources;
+    if (frame_index < scene_depth_buffers_.size()) {
+        resources.images.push_back({ scene_depth_buffers_[frame_index]->getImage(), VK_IMAGE_LAYOUT_GENERAL });
+    }
+    return resources;
 }
 
-void SceneManager::deleteUniforms() {
-    backend_->destroyUniformBuffer(scene_data_buffer_);
+void SceneManager::releaseToCompute() {
+    if (!backend_->hasDedicatedComputeQueue()) {
+        return;
+    }
 
-    for (auto& mesh : meshes_) {
-        mesh->deleteUniformBuffer();
+    auto cmd_buffer = backend_->beginSingleTimeCommands();
+    for (uint32_t i = 0; i < scene_depth_buffers_.size(); ++i) {
+        backend_->releaseToCompute(cmd_buffer, getComputeSharedResources(i));
     }
+    backend_->endSingleTimeCommands();
+}
 
-    scene_depth_buffer_.reset();
+void SceneManager::deleteUniforms() {
+    scene_depth_buffers_.clear();
     vk_descriptor_sets_.clear();
+    vk_indirect_descriptor_sets_.clear();
+    vk_culling_input_set_ = VK_NULL_HANDLE;
+    for (auto& culled_draws : culled_draws_) {
+        culled_draws.vk_descriptor_set = VK_NULL_HANDLE;
+    }
+    scene_set_template_.reset();
 
     if (shadows_enabled_) {
         shadow_map_render_pass_.reset();
@@ -614,69 +709,50 @@ void SceneManager::deleteUniforms() {
 
 void SceneManager::createSceneDescriptorSets() {
     const auto& layout = scene_graphics_pipeline_->descriptorSets().find(SCENE_UNIFORM_SET_ID)->second;
-    std::vector<VkDescriptorSetLayout> layouts(backend_->getSwapChainSize(), layout);
+    std::vector<VkDescriptorSetLayout> layouts(backend_->getFramesInFlight(), layout);
 
     if (shadows_enabled_) {
         const auto& shadow_layout = scene_graphics_pipeline_->descriptorSets().find(SHADOW_MAP_SET_ID)->second;
-        for (uint32_t i = 0; i < backend_->getSwapChainSize(); ++i) {
+        for (uint32_t i = 0; i < backend_->getFramesInFlight(); ++i) {
             layouts.push_back(shadow_layout);
         }
     }
 
-    VkDescriptorSetAllocateInfo alloc_info{};
-    alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-    alloc_info.descriptorPool = backend_->getDescriptorPool();
-    alloc_info.descriptorSetCount = uint32_t(layouts.size());
-    alloc_info.pSetLayouts = layouts.data();
-
-    vk_descriptor_sets_.resize(layouts.size());
-    if (vkAllocateDescriptorSets(backend_->getDevice(), &alloc_info, vk_descriptor_sets_.data()) != VK_SUCCESS) {
+    if (!backend_->allocateDescriptorSets(layouts, vk_descriptor_sets_)) {
         std::cerr << "Failed to allocate Mesh descriptor sets!" << std::endl;
         return;
     }
+
+    scene_set_template_ = backend_->createDescriptorUpdateTemplate(*scene_graphics_pipeline_, SCENE_UNIFORM_SET_ID);
 }
 
 void SceneManager::updateSceneDescriptorSets() {
-    const auto& bindings = scene_graphics_pipeline_->descriptorMetadata().set_bindings.find(SCENE_UNIFORM_SET_ID)->second;
     auto first = vk_descriptor_sets_.begin();
-    auto last = vk_descriptor_sets_.begin() + backend_->getSwapChainSize();
+    auto last = vk_descriptor_sets_.begin() + backend_->getFramesInFlight();
     auto scene_descriptors = std::vector<VkDescriptorSet>(first, last);
-    backend_->updateDescriptorSets(scene_data_buffer_, scene_descriptors, bindings.find(SCENE_DATA_BINDING_NAME)->second);
 
-    if (bindings.find(SCENE_TEXTURES_ARRAY) != bindings.end()) {
-        auto textures_binding_point = bindings.find(SCENE_TEXTURES_ARRAY)->second;
-
-        std::vector<VkDescriptorImageInfo> image_infos;
-        for (auto& texture : textures_) {
-            VkDescriptorImageInfo image_info{};
-            image_info.imageLayout = texture->getImageLayout();
-            image_info.imageView = texture->getImageView();
-            image_info.sampler = texture->getImageSampler();
-
-            image_infos.push_back(image_info);
-        }
+    // the scene set has the most bindings of all, they are written at once for each frame
+    if (!scene_set_template_) {
+        return;
+    }
 
-        for (size_t i = 0; i < scene_descriptors.size(); i++) {
-            VkWriteDescriptorSet descriptor_write{};
-            descriptor_write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-            descriptor_write.dstSet = scene_descriptors[i];
-            descriptor_write.dstBinding = textures_binding_point;
-            descriptor_write.dstArrayElement = 0;
-            descriptor_write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-            descriptor_write.descriptorCount = static_cast<uint32_t>(image_infos.size());
-            descriptor_write.pImageInfo = image_infos.data();
-
-            vkUpdateDescriptorSets(backend_->getDevice(), 1, &descriptor_write, 0, nullptr);
+    scene_set_template_->setBuffer(SCENE_DATA_BINDING_NAME, backend_->getUniformRingBufferInfo(sizeof(SceneData)));
+    if (scene_set_template_->hasBinding(SCENE_TEXTURES_ARRAY)) {
+        for (uint32_t i = 0; i < textures_.size(); ++i) {
+            scene_set_template_->setImage(SCENE_TEXTURES_ARRAY, textures_[i]->getDescriptorImageInfo(), i);
         }
     }
-
-    if (bindings.find(SCENE_DEPTH_BUFFER_STORAGE) != bindings.end()){
-        scene_depth_buffer_->updateDescriptorSets(scene_descriptors, bindings.find(SCENE_DEPTH_BUFFER_STORAGE)->second);
+    for (size_t i = 0; i < scene_descriptors.size(); ++i) {
+        // each frame writes the depth storage of its own
+        if (scene_set_template_->hasBinding(SCENE_DEPTH_BUFFER_STORAGE)) {
+            scene_set_template_->setImage(SCENE_DEPTH_BUFFER_STORAGE, scene_depth_buffers_[i]->getDescriptorImageInfo());
+        }
+        scene_set_template_->update(scene_descriptors[i]);
     }
 
     if (shadows_enabled_) {
         const auto& shadow_bindings = scene_graphics_pipeline_->descriptorMetadata().set_bindings.find(SHADOW_MAP_SET_ID)->second;
-        first = vk_descriptor_sets_.begin() + backend_->getSwapChainSize();
+        first = vk_descriptor_sets_.begin() + backend_->getFramesInFlight();
         last = vk_descriptor_sets_.end();
         auto shadow_descriptors = std::vector<VkDescriptorSet>(first, last);
         backend_->updateDescriptorSets(shadow_map_data_buffer_, shadow_descriptors, shadow_bindings.find(SHADOW_MAP_PROJ_NAME)->second);
@@ -687,41 +763,261 @@ void SceneManager::updateSceneDescriptorSets() {
 void SceneManager::createGeometryDescriptorSets() {
     // all pipelines that want to draw the scene geometry need to bind the same sets, so we only need to
     // generate them only once and they will be compatible with all pipelines
+    if (indirect_draw_) {
+        // the storage buffers are the same every frame, the transforms are selected by the dynamic offset
+        const auto& layouts = scene_graphics_pipeline_->descriptorSets();
+        if (!backend_->allocateDescriptorSets({ layouts.find(MODEL_UNIFORM_SET_ID)->second, layouts.find(SURFACE_UNIFORM_SET_ID)->second }, vk_indirect_descriptor_sets_)) {
+            std::cerr << "Failed to allocate indirect draw descriptor sets!" << std::endl;
+        }
+        return;
+    }
+
     for (auto& mesh : meshes_) {
         mesh->createDescriptorSets(scene_graphics_pipeline_->descriptorSets());
     }
 }
 
-void SceneManager::updateGeometryDescriptorSets(const DescriptorSetMetadata& metadata, bool with_material) {
+void SceneManager::updateGeometryDescriptorSets(const GraphicsPipeline& pipeline, bool with_material) {
+    if (indirect_draw_) {
+        if (vk_indirect_descriptor_sets_.empty()) {
+            return;
+        }
+
+        auto model_set_template = backend_->createDescriptorUpdateTemplate(pipeline, MODEL_UNIFORM_SET_ID);
+        if (model_set_template) {
+            model_set_template->setBuffer(DRAW_DATA_BINDING_NAME, { draw_data_buffer_.vk_buffer, 0, VK_WHOLE_SIZE });
+            model_set_template->setBuffer(MODEL_TRANSFORMS_BINDING_NAME, backend_->getUniformRingBufferInfo(sizeof(glm::mat4) * meshes_.size()));
+            model_set_template->update(vk_indirect_descriptor_sets_[0]);
+        }
+
+        if (with_material) {
+            auto surface_set_template = backend_->createDescriptorUpdateTemplate(pipeline, SURFACE_UNIFORM_SET_ID);
+            if (surface_set_template) {
+                surface_set_template->setBuffer(MATERIALS_BINDING_NAME, { materials_buffer_.vk_buffer, 0, VK_WHOLE_SIZE });
+                surface_set_template->update(vk_indirect_descriptor_sets_[1]);
+            }
+        }
+        return;
+    }
+
     for (auto& mesh : meshes_) {
-        mesh->updateDescriptorSets(metadata, with_material);
+        mesh->updateDescriptorSets(pipeline.descriptorMetadata(), with_material);
     }
 }
 
+void SceneManager::createIndirectDrawBuffers() {
+    std::vector<VkDrawIndexedIndirectCommand> commands;
+    std::vector<DrawData> draws;
+    for (uint32_t m = 0; m < meshes_.size(); ++m) {
+        for (const auto& surface : meshes_[m]->getSurfaces()) {
+            VkDrawIndexedIndirectCommand command{};
+            command.indexCount = surface.index_count;
+            command.instanceCount = 1;
+            command.firstIndex = surface.index_start;
+            command.vertexOffset = static_cast<int32_t>(surface.vertex_start);
+            command.firstInstance = static_cast<uint32_t>(draws.size());  // gl_InstanceIndex in the shaders
+            commands.push_back(command);
+
+            DrawData draw;
+            draw.transform_idx = m;
+            draw.material_idx = surface.material_idx;
+            draws.push_back(draw);
+        }
+    }
+
+    if (commands.empty()) {
+        return;
+    }
+
+    std::vector<MaterialData> materials;
+    for (const auto& material : materials_) {
+        materials.push_back(material->material_data);
+    }
+    if (materials.empty()) {
+        materials.push_back(MaterialData{});
+    }
+
+    indirect_commands_buffer_ = backend_->createStorageBuffer<VkDrawIndexedIndirectCommand>("scene_manager_indirect_commands", commands, false, VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT);
+    draw_data_buffer_ = backend_->createStorageBuffer<DrawData>("scene_manager_draw_data", draws);
+    materials_buffer_ = backend_->createStorageBuffer<MaterialData>("scene_manager_materials", materials);
+    draws_count_ = static_cast<uint32_t>(commands.size());
+
+    if (!gpu_culling_requested_ || !backend_->getDeviceCapabilities().draw_indirect_count) {
+        return;
+    }
+
+    std::vector<glm::vec4> bounds;
+    for (const auto& mesh : meshes_) {
+        for (const auto& surface : mesh->getSurfaces()) {
+            bounds.push_back(surface.bounding_sphere);
+        }
+    }
+    draw_bounds_buffer_ = backend_->createStorageBuffer<glm::vec4>("scene_manager_draw_bounds", bounds);
+
+    // a list per frame in flight, as the camera is culled every frame, plus one for the shadow map
+    std::vector<VkDrawIndexedIndirectCommand> culled_commands(commands.size());
+    std::vector<DrawCount> count(1);
+    culled_draws_.resize(backend_->getFramesInFlight() + 1);
+    for (size_t i = 0; i < culled_draws_.size(); ++i) {
+        auto name = "scene_manager_culled_" + std::to_string(i);
+        culled_draws_[i].commands = backend_->createStorageBuffer<VkDrawIndexedIndirectCommand>(name + "_commands", culled_commands, false, VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT);
+        culled_draws_[i].count = backend_->createStorageBuffer<DrawCount>(name + "_count", count, true, VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT);
+    }
+}
+
+PipelineBuild SceneManager::createCullingPipeline() {
+    auto compute_shader = backend_->loadShaderModule("scene_culling_cp", "shaders/scene_culling_cp.spv");
+    if (!compute_shader->isValid()) {
+        std::cerr << "Failed to validate the scene culling shader!" << std::endl;
+        return PipelineBuild(false);
+    }
+
+    ComputePipelineConfig config;
+    config.compute = compute_shader;
+    config.dynamic_bindings = { MODEL_TRANSFORMS_BINDING_NAME };  // the same ring allocation as the draws
+
+    culling_pipeline_ = backend_->createComputePipeline("Scene culling");
+
+    return backend_->buildPipelineAsync(*culling_pipeline_, config).then([this]() {
+        createCullingDescriptorSets();
+        return true;
+    });
+}
+
+void SceneManager::createCullingDescriptorSets() {
+    const auto& layouts = culling_pipeline_->descriptorSets();
+    std::vector<VkDescriptorSetLayout> set_layouts = { layouts.find(CULLING_INPUT_SET_ID)->second };
+    for (size_t i = 0; i < culled_draws_.size(); ++i) {
+        set_layouts.push_back(layouts.find(CULLING_OUTPUT_SET_ID)->second);
+    }
+
+    std::vector<VkDescriptorSet> descriptor_sets;
+    if (!backend_->allocateDescriptorSets(set_layouts, descriptor_sets)) {
+        std::cerr << "Failed to allocate scene culling descriptor sets!" << std::endl;
+        return;
+    }
+
+    vk_culling_input_set_ = descriptor_sets[0];
+    for (size_t i = 0; i < culled_draws_.size(); ++i) {
+        culled_draws_[i].vk_descriptor_set = descriptor_sets[i + 1];
+    }
+}
+
+void SceneManager::updateCullingDescriptorSets() {
+    if (!gpu_culling_ || vk_culling_input_set_ == VK_NULL_HANDLE) {
+        return;
+    }
+
+    auto input_set_template = backend_->createDescriptorUpdateTemplate(*culling_pipeline_, CULLING_INPUT_SET_ID);
+    if (input_set_template) {
+        input_set_template->setBuffer(DRAW_DATA_BINDING_NAME, { draw_data_buffer_.vk_buffer, 0, VK_WHOLE_SIZE });
+        input_set_template->setBuffer(MODEL_TRANSFORMS_BINDING_NAME, backend_->getUniformRingBufferInfo(sizeof(glm::mat4) * meshes_.size()));
+        input_set_template->setBuffer(DRAW_BOUNDS_BINDING_NAME, { draw_bounds_buffer_.vk_buffer, 0, VK_WHOLE_SIZE });
+        input_set_template->setBuffer(INPUT_COMMANDS_BINDING_NAME, { indirect_commands_buffer_.vk_buffer, 0, VK_WHOLE_SIZE });
+        input_set_template->update(vk_culling_input_set_);
+    }
+
+    auto output_set_template = backend_->createDescriptorUpdateTemplate(*culling_pipeline_, CULLING_OUTPUT_SET_ID);
+    if (output_set_template) {
+        for (const auto& culled_draws : culled_draws_) {
+            output_set_template->setBuffer(OUTPUT_COMMANDS_BINDING_NAME, { culled_draws.commands.vk_buffer, 0, VK_WHOLE_SIZE });
+            output_set_template->setBuffer(DRAW_COUNT_BINDING_NAME, { culled_draws.count.vk_buffer, 0, VK_WHOLE_SIZE });
+            output_set_template->update(culled_draws.vk_descriptor_set);
+        }
+    }
+}
+
+void SceneManager::cullGeometry(VkCommandBuffer cmd_buffer, uint32_t frame_index) {
+    if (!gpu_culling_) {
+        return;
+    }
+
+    CPU_PROFILE_SCOPE("SceneManager::cullGeometry");
+    auto& culled_draws = culled_draws_[frame_index];
+
+    // the device is done with the last frame that used this list, its count is the latest one available
+    DrawCount count;
+    std::memcpy(&count, culled_draws.count.memory.mapped_data, sizeof(DrawCount));
+    culling_stats_ = { count.visible, count.culled };
+
+    backend_->beginGpuScope(cmd_buffer, "Scene culling", PipelineStatisticsType::COMPUTE);
+    recordCulling(cmd_buffer, scene_data_.view, scene_data_.proj, culled_draws);
+    backend_->endGpuScope(cmd_buffer, "Scene culling");
+}
+
+void SceneManager::recordCulling(VkCommandBuffer cmd_buffer, const glm::mat4& view, const glm::mat4& proj, const CulledDraws& culled_draws) {
+    // only the count needs resetting, the commands are overwritten up to the new count
+    vkCmdFillBuffer(cmd_buffer, culled_draws.count.vk_buffer, 0, sizeof(DrawCount), 0);
+
+    VkMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    vkCmdPipelineBarrier(cmd_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+    CullingData culling_data;
+    frustumPlanes(view, proj, culling_data.frustum_planes);
+    culling_data.draws_count = draws_count_;
+
+    vkCmdBindPipeline(cmd_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, culling_pipeline_->handle());
+    vkCmdBindDescriptorSets(cmd_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, culling_pipeline_->layout(), CULLING_INPUT_SET_ID, 1, &vk_culling_input_set_, 1, &transforms_uniform_.dynamic_offset);
+    vkCmdBindDescriptorSets(cmd_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, culling_pipeline_->layout(), CULLING_OUTPUT_SET_ID, 1, &culled_draws.vk_descriptor_set, 0, nullptr);
+    vkCmdPushConstants(cmd_buffer, culling_pipeline_->layout(), VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(CullingData), &culling_data);
+
+    vkCmdDispatch(cmd_buffer, draws_count_ / 64 + 1, 1, 1);
+
+    // the draws read the list and its count, the host reads the count for the stats once the commands have completed
+    barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_HOST_READ_BIT;
+    vkCmdPipelineBarrier(cmd_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+}
+
 
 void SceneManager::updateDescriptorSets() {
+    backend_->beginDescriptorBatch();
     updateSceneDescriptorSets();
-    updateGeometryDescriptorSets(scene_graphics_pipeline_->descriptorMetadata(), true);
+    updateGeometryDescriptorSets(*scene_graphics_pipeline_, true);
+    backend_->endDescriptorBatch();
 }
 
-void SceneManager::bindSceneDescriptors(VkCommandBuffer& cmd_buffer, const GraphicsPipeline& pipeline, uint32_t swapchain_index) {
-    uint32_t scene_data_offset = swapchain_index;
+void SceneManager::bindSceneDescriptors(VkCommandBuffer& cmd_buffer, const GraphicsPipeline& pipeline, uint32_t frame_index) {
+    uint32_t scene_data_offset = frame_index;
 	// scene data
-	vkCmdBindDescriptorSets(cmd_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline.layout(), SCENE_UNIFORM_SET_ID, 1, &vk_descriptor_sets_[scene_data_offset], 0, nullptr);
+	vkCmdBindDescriptorSets(cmd_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline.layout(), SCENE_UNIFORM_SET_ID, 1, &vk_descriptor_sets_[scene_data_offset], 1, &scene_data_uniform_.dynamic_offset);
 	if (shadows_enabled_) {
         // shadow map data
-        uint32_t shadow_map_offset = backend_->getSwapChainSize() + scene_data_offset;
+        uint32_t shadow_map_offset = backend_->getFramesInFlight() + scene_data_offset;
 	    vkCmdBindDescriptorSets(cmd_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline.layout(), SHADOW_MAP_SET_ID, 1, &vk_descriptor_sets_[shadow_map_offset], 0, nullptr);
     }
+    if (pipeline.descriptorSets().count(BINDLESS_TEXTURES_SET_ID) > 0) {
+        // all textures
+        auto bindless_set = backend_->getBindlessTexturesSet();
+        vkCmdBindDescriptorSets(cmd_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline.layout(), BINDLESS_TEXTURES_SET_ID, 1, &bindless_set, 0, nullptr);
+    }
 }
 
-void SceneManager::drawGeometry(VkCommandBuffer& cmd_buffer, VkPipelineLayout pipeline_layout, uint32_t swapchain_index, bool with_material) {
+void SceneManager::drawGeometry(VkCommandBuffer& cmd_buffer, VkPipelineLayout pipeline_layout, uint32_t frame_index, bool with_material, const CulledDraws* culled_draws) {
     VkDeviceSize offsets[] = { 0 };
     vkCmdBindVertexBuffers(cmd_buffer, 0, 1, &scene_vertex_buffer_.vk_buffer, offsets);
     vkCmdBindIndexBuffer(cmd_buffer, scene_index_buffer_.vk_buffer, 0, VK_INDEX_TYPE_UINT32);
 
+    if (indirect_draw_) {
+        // every surface in one call, no per-mesh or per-surface binds
+        vkCmdBindDescriptorSets(cmd_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_layout, MODEL_UNIFORM_SET_ID, 1, &vk_indirect_descriptor_sets_[0], 1, &transforms_uniform_.dynamic_offset);
+        if (with_material) {
+            vkCmdBindDescriptorSets(cmd_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_layout, SURFACE_UNIFORM_SET_ID, 1, &vk_indirect_descriptor_sets_[1], 0, nullptr);
+        }
+        if (culled_draws != nullptr) {
+            // only the surfaces that survived culling, the count is written on the device
+            VkDrawIndexedIndirectCountKHR(cmd_buffer, culled_draws->commands.vk_buffer, 0, culled_draws->count.vk_buffer, 0, draws_count_, sizeof(VkDrawIndexedIndirectCommand));
+        } else {
+            vkCmdDrawIndexedIndirect(cmd_buffer, indirect_commands_buffer_.vk_buffer, 0, draws_count_, sizeof(VkDrawIndexedIndirectCommand));
+        }
+        return;
+    }
+
     for (auto& mesh : meshes_) {
-        mesh->drawGeometry(cmd_buffer, pipeline_layout, swapchain_index, with_material);
+        mesh->drawGeometry(cmd_buffer, pipeline_layout, frame_index, with_material);
     }
 }
 
@@ -787,12 +1083,12 @@ glm::mat4 SceneManager::shadowMapProjection() const {
     return glm::perspective(glm::radians(120.0f), ar, 0.1f, 1000.0f);
 }
 
-void SceneManager::setupShadowMapAssets() {
+PipelineBuild SceneManager::setupShadowMapAssets() {
     shadow_map_data_.light_view = lightViewMatrix();
     shadow_map_data_.shadow_proj = shadowMapProjection();
 
-    shadow_map_data_buffer_ = backend_->createUniformBuffer<ShadowMapData>("shadow_map_data", backend_->getSwapChainSize());
-    for (size_t i = 0; i < backend_->getSwapChainSize(); i++) {
+    shadow_map_data_buffer_ = backend_->createUniformBuffer<ShadowMapData>("shadow_map_data", backend_->getFramesInFlight());
+    for (size_t i = 0; i < backend_->getFramesInFlight(); i++) {
        backend_->updateBuffer<ShadowMapData>(shadow_map_data_buffer_.buffers[i], { shadow_map_data_ });
     }
 
@@ -824,15 +1120,15 @@ void SceneManager::setupShadowMapAssets() {
 	shadow_map_render_pass_ = backend_->createRenderPass( "Shadow Map Pass");
 
     if (!shadow_map_render_pass_->buildRenderPass(render_pass_config)) {
-        return;
+        return PipelineBuild(false);
     }
 
-    auto vertex_shader = backend_->createShaderModule("shadow_map_vs");
-	vertex_shader->loadSpirvShader("shaders/shadow_map_vs.spv");
+    auto vertex_shader_name = std::string(indirect_draw_ ? "shadow_map_indirect_vs" : "shadow_map_vs");
+    auto vertex_shader = backend_->loadShaderModule(vertex_shader_name, "shaders/" + vertex_shader_name + ".spv");
 
 	if (!vertex_shader->isVertexFormatCompatible(Vertex::getFormatInfo())) {
 		std::cerr << "Vertex format is not compatible with pipeline input for " << vertex_shader->getName() << std::endl;
-		return;
+		return PipelineBuild(false);
 	}
 
     GraphicsPipelineConfig config;
@@ -843,44 +1139,43 @@ void SceneManager::setupShadowMapAssets() {
 	config.vertex_buffer_attrib_desc = vertex_shader->getInputAttributes();
 	config.render_pass = &(*shadow_map_render_pass_);
 	config.subpass_number = 0;
+	config.dynamic_bindings = { MODEL_DATA_BINDING_NAME, MODEL_TRANSFORMS_BINDING_NAME };
 
 	shadow_map_pipeline_ = backend_->createGraphicsPipeline( "Shadow Map Generation");
 
-    if (!shadow_map_pipeline_->buildPipeline(config)) {
-        std::cerr << " " << std::endl;
-        return;
-    }
+    return backend_->buildPipelineAsync(*shadow_map_pipeline_, config);
 }
 
 void SceneManager::createShadowMapDescriptors() {
     const auto& layout = shadow_map_pipeline_->descriptorSets().find(SHADOW_MAP_DATA_UNIFORM_SET_ID)->second;
-    VkDescriptorSetAllocateInfo alloc_info{};
-    alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-    alloc_info.descriptorPool = backend_->getDescriptorPool();
-    alloc_info.descriptorSetCount = 1;
-    alloc_info.pSetLayouts = &layout;
-
-    VkDescriptorSet layout_descriptor_set;
-    if (vkAllocateDescriptorSets(backend_->getDevice(), &alloc_info, &layout_descriptor_set) != VK_SUCCESS) {
+
+    std::vector<VkDescriptorSet> layout_descriptor_sets;
+    if (!backend_->allocateDescriptorSets({ layout }, layout_descriptor_sets)) {
         std::cerr << "Failed to allocate shadow map pipeline descriptor set!" << std::endl;
         return;
     }
 
-    vk_shadow_descriptor_sets_.push_back(layout_descriptor_set);
+    vk_shadow_descriptor_sets_.push_back(layout_descriptor_sets[0]);
 }
 
 void SceneManager::renderStaticShadowMap() {
-    setupShadowMapAssets();
     createShadowMapDescriptors();
 
     update();  // needed to load all the mesh uniforms
 
     const auto& bindings = shadow_map_pipeline_->descriptorMetadata().set_bindings.find(SHADOW_MAP_DATA_UNIFORM_SET_ID)->second;
     backend_->updateDescriptorSets(shadow_map_data_buffer_, vk_shadow_descriptor_sets_, bindings.find(SHADOW_MAP_DATA_BINDING_NAME)->second);
-    updateGeometryDescriptorSets(shadow_map_pipeline_->descriptorMetadata(), false /*no material*/);
+    updateGeometryDescriptorSets(*shadow_map_pipeline_, false /*no material*/);
 
     auto cmd_buffer = backend_->beginSingleTimeCommands();
 
+    // the shadow map only needs what the light can see
+    const CulledDraws* culled_draws = nullptr;
+    if (gpu_culling_) {
+        culled_draws = &culled_draws_.back();
+        recordCulling(cmd_buffer, shadow_map_data_.light_view, shadow_map_data_.shadow_proj, *culled_draws);
+    }
+
     VkRenderPassBeginInfo render_pass_info{};
 	render_pass_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
 	render_pass_info.renderPass = shadow_map_render_pass_->handle();
@@ -899,9 +1194,15 @@ void SceneManager::renderStaticShadowMap() {
 
 	vkCmdBindDescriptorSets(cmd_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, shadow_map_pipeline_->layout(), SHADOW_MAP_DATA_UNIFORM_SET_ID, 1, &vk_shadow_descriptor_sets_[0], 0, nullptr);
 
-	drawGeometry(cmd_buffer, shadow_map_pipeline_->layout(), 0, false /*no material*/);
+	drawGeometry(cmd_buffer, shadow_map_pipeline_->layout(), 0, false /*no material*/, culled_draws);
 
     vkCmdEndRenderPass(cmd_buffer);
 
-    backend_->endSingleTimeCommands(cmd_buffer);
+    backend_->endSingleTimeCommands();
+
+    if (culled_draws != nullptr) {
+        DrawCount count;
+        std::memcpy(&count, culled_draws->count.memory.mapped_data, sizeof(DrawCount));
+        shadow_culling_stats_ = { count.visible, count.culled };
+    }
 }
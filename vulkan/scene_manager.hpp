@@ -15,7 +15,16 @@ class Texture;
 class StaticMesh;
 class ShaderModule;
 class GraphicsPipeline;
+class ComputePipeline;
 class RenderPass;
+class DescriptorUpdateTemplate;
+struct QueueSharedResources;
+
+// draws kept and dropped by the last GPU culling pass of a view
+struct CullingStats {
+	uint32_t visible = 0;
+	uint32_t culled = 0;
+};
 
 /*
 * Lights, Cameras and Static Environment geometry
@@ -42,6 +51,17 @@ public:
 	void setLightColour(const glm::vec4& colour, float intensity = 1.0f);
 	void setAmbientColour(const glm::vec4& colour, float intensity = 1.0f);
 	void enableShadows();
+	// draw all the static geometry with one vkCmdDrawIndexedIndirect, where supported (on by default). must be called
+	// before createGraphicsPipeline
+	void setIndirectDraw(bool enable) { indirect_draw_requested_ = enable; }
+	bool indirectDrawEnabled() const { return indirect_draw_; }
+	uint32_t getDrawsCount() const { return draws_count_; }  // surfaces in the scene
+	// cull the indirect draws against the view frustum on the GPU, where the device can draw with an indirect
+	// count (on by default). must be called before loadFromGlb
+	void setGpuCulling(bool enable) { gpu_culling_requested_ = enable; }
+	bool gpuCullingEnabled() const { return gpu_culling_; }
+	CullingStats getCullingStats() const { return culling_stats_; }  // camera, read back a few frames late
+	CullingStats getShadowCullingStats() const { return shadow_culling_stats_; }  // light, when the shadow map was rendered
 	
 	const SceneData& getSceneData() const { return scene_data_; }
 
@@ -50,22 +70,36 @@ public:
 	std::shared_ptr<Texture> getTexture(uint32_t idx);
 	std::shared_ptr<Material> getMaterial(uint32_t idx);
 
-	DescriptorPoolConfig getDescriptorsCount(uint32_t expected_pipelines_count) const;
-	bool createGraphicsPipeline(const std::string& program_name, const RenderPass& render_pass, uint32_t subpass_number);
+	PipelineBuild createGraphicsPipeline(const std::string& program_name, const RenderPass& render_pass, uint32_t subpass_number);
 
 	void prepareForRendering();
 	void update();
-	RecordCommandsResult renderFrame(uint32_t swapchain_image, VkRenderPassBeginInfo& render_pass_info, const ProfileConfig& profile_config);
+	// records the culling dispatch for this frame. must be called outside the render pass, before renderFrame
+	void cullGeometry(VkCommandBuffer cmd_buffer, uint32_t frame_index);
+	RecordCommandsResult renderFrame(uint32_t frame_index, VkRenderPassBeginInfo& render_pass_info, const ProfileConfig& profile_config);
 	void cleanupSwapChainAssets();
 
-	std::shared_ptr<Texture>& getSceneDepthBuffer() { return scene_depth_buffer_; }
+	// one depth buffer storage per frame in flight, each frame writes its own. compute work reads the one of the frame
+	// it is recorded for, so that it can run alongside the drawing of the previous frame
+	const std::vector<std::shared_ptr<Texture>>& getSceneDepthBuffers() const { return scene_depth_buffers_; }
+	// read by compute work on a dedicated queue. releaseToCompute hands them all over once after the pipelines are
+	// built, each frame then moves its own back and forth along with the resources of the compute work
+	QueueSharedResources getComputeSharedResources(uint32_t frame_index) const;
+	void releaseToCompute();
 	
 private:
+	// a list of indirect commands that survived culling and its count, written by the culling pass
+	struct CulledDraws {
+		Buffer commands;
+		Buffer count;  // DrawCount, host visible for the stats
+		VkDescriptorSet vk_descriptor_set = VK_NULL_HANDLE;
+	};
+
 	void updateCameraTransform();
 	glm::mat4 lookAtMatrix() const;
 	glm::mat4 lightViewMatrix() const;
 	glm::mat4 shadowMapProjection() const;
-	void setupShadowMapAssets();
+	PipelineBuild setupShadowMapAssets();
 	void createShadowMapDescriptors();
 
 	void createUniforms();
@@ -73,23 +107,30 @@ private:
 	void createSceneDescriptorSets();
 	void updateSceneDescriptorSets();
 	void createGeometryDescriptorSets();
-	void updateGeometryDescriptorSets(const DescriptorSetMetadata& metadata, bool with_material = true);
+	void updateGeometryDescriptorSets(const GraphicsPipeline& pipeline, bool with_material = true);
+	void createIndirectDrawBuffers();
+	PipelineBuild createCullingPipeline();
+	void createCullingDescriptorSets();
+	void updateCullingDescriptorSets();
+	void recordCulling(VkCommandBuffer cmd_buffer, const glm::mat4& view, const glm::mat4& proj, const CulledDraws& culled_draws);
 	void updateDescriptorSets();
 
-	void bindSceneDescriptors(VkCommandBuffer& cmd_buffer, const GraphicsPipeline& pipeline, uint32_t swapchain_index);
-	void drawGeometry(VkCommandBuffer& cmd_buffer, VkPipelineLayout pipeline_layout, uint32_t swapchain_index, bool with_material = true);
+	void bindSceneDescriptors(VkCommandBuffer& cmd_buffer, const GraphicsPipeline& pipeline, uint32_t frame_index);
+	// culled_draws replaces the full list of indirect commands, when set
+	void drawGeometry(VkCommandBuffer& cmd_buffer, VkPipelineLayout pipeline_layout, uint32_t frame_index, bool with_material = true, const CulledDraws* culled_draws = nullptr);
 	
 	void renderStaticShadowMap();
 	
 	VulkanBackend* backend_;
 	SceneData scene_data_;
-	UniformBuffer scene_data_buffer_;
-	std::shared_ptr<Texture> scene_depth_buffer_;
+	UniformAllocation scene_data_uniform_;  // this frame's copy of scene_data_ in the uniform ring
+	std::vector<std::shared_ptr<Texture>> scene_depth_buffers_;  // one per frame in flight
 	std::vector<VkDescriptorSet> vk_descriptor_sets_;
+	std::unique_ptr<DescriptorUpdateTemplate> scene_set_template_;
 	std::vector<VkCommandBuffer> command_buffers_; 
 
-	std::shared_ptr<ShaderModule> vertex_shader_;
-	std::shared_ptr<ShaderModule> fragment_shader_;
+	std::shared_ptr<const ShaderModule> vertex_shader_;
+	std::shared_ptr<const ShaderModule> fragment_shader_;
 	std::unique_ptr<GraphicsPipeline> scene_graphics_pipeline_;
 	uint32_t scene_subpass_number_;
 
@@ -99,6 +140,27 @@ private:
 	std::vector<std::shared_ptr<Material>> materials_;
 	std::vector<std::shared_ptr<StaticMesh>> meshes_;
 
+	// indirect draws, built once at load time
+	bool indirect_draw_requested_ = true;
+	bool indirect_draw_ = false;
+	uint32_t draws_count_ = 0;
+	Buffer indirect_commands_buffer_;  // VkDrawIndexedIndirectCommand per surface
+	Buffer draw_data_buffer_;  // DrawData per surface
+	Buffer materials_buffer_;
+	std::vector<glm::mat4> transforms_;  // per mesh, pushed to the uniform ring every frame
+	UniformAllocation transforms_uniform_;
+	std::vector<VkDescriptorSet> vk_indirect_descriptor_sets_;  // model and surface sets, shared by the scene and shadow pipelines
+
+	// GPU culling of the indirect draws
+	bool gpu_culling_requested_ = true;
+	bool gpu_culling_ = false;
+	Buffer draw_bounds_buffer_;  // bounding sphere per surface
+	std::vector<CulledDraws> culled_draws_;  // one per frame in flight, then one for the shadow map
+	std::unique_ptr<ComputePipeline> culling_pipeline_;
+	VkDescriptorSet vk_culling_input_set_ = VK_NULL_HANDLE;
+	CullingStats culling_stats_;
+	CullingStats shadow_culling_stats_;
+
 	float gltf_scale_factor_ = 1.0f;
 	glm::vec3 camera_position_ = { 0.0f, 0.0f, 0.0f };
 	glm::vec3 camera_forward_ = { 1.0f, 0.0f, 0.0f };
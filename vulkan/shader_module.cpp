@@ -10,7 +10,9 @@
 #include "spirv_reflect.h"
 
 #include <algorithm>
+#include <cstring>
 #include <iostream>
+#include <type_traits>
 
 // utility functions
 
@@ -149,6 +151,80 @@ namespace {
         }
         return result;
     }
+
+    // reflection cache file layout: magic, version, SPIR-V hash, then the extracted data in the order it is declared
+    // in ShaderModule. only trivially copyable values and length-prefixed strings are written. the extracted data only
+    // depends on the SPIR-V, pipelines decide which bindings are dynamic
+    const uint32_t kReflectionCacheMagic = 0x4c464552;  // "REFL"
+    const uint32_t kReflectionCacheVersion = 3;
+
+    class BinaryWriter {
+    public:
+        template<typename T>
+        void write(const T& value) {
+            static_assert(std::is_trivially_copyable<T>::value, "only plain data can be written");
+            const char* bytes = reinterpret_cast<const char*>(&value);
+            data_.insert(data_.end(), bytes, bytes + sizeof(T));
+        }
+
+        void writeString(const std::string& value) {
+            write(static_cast<uint32_t>(value.size()));
+            data_.insert(data_.end(), value.begin(), value.end());
+        }
+
+        const std::vector<char>& data() const { return data_; }
+
+    private:
+        std::vector<char> data_;
+    };
+
+    class BinaryReader {
+    public:
+        explicit BinaryReader(const std::vector<char>& data) : data_(data) {}
+
+        // once a read fails all the following ones fail too, so errors only need checking at the end
+        template<typename T>
+        bool read(T& value) {
+            static_assert(std::is_trivially_copyable<T>::value, "only plain data can be read");
+            if (!ok_ || offset_ + sizeof(T) > data_.size()) {
+                ok_ = false;
+                return false;
+            }
+            std::memcpy(&value, data_.data() + offset_, sizeof(T));
+            offset_ += sizeof(T);
+            return true;
+        }
+
+        bool readString(std::string& value) {
+            uint32_t size = 0;
+            if (!read(size) || offset_ + size > data_.size()) {
+                ok_ = false;
+                return false;
+            }
+            value.assign(data_.data() + offset_, size);
+            offset_ += size;
+            return true;
+        }
+
+        // reads an element count and rejects it if the elements cannot fit in the bytes left, so that a corrupted
+        // count fails the read instead of allocating. the count is 0 after a failure
+        bool readCount(uint32_t& count, size_t min_element_size) {
+            if (!read(count) || count > (data_.size() - offset_) / min_element_size) {
+                ok_ = false;
+                count = 0;
+                return false;
+            }
+            return true;
+        }
+
+        bool ok() const { return ok_; }
+        bool atEnd() const { return offset_ == data_.size(); }
+
+    private:
+        const std::vector<char>& data_;
+        size_t offset_ = 0;
+        bool ok_ = true;
+    };
 }
 
 // ShaderModule
@@ -171,12 +247,16 @@ std::shared_ptr<ShaderModule> ShaderModule::createShaderModule(const std::string
 }
 
 void ShaderModule::loadSpirvShader(const std::string& spirv_file_path) {
-    // create shader module
     auto code = readFile(spirv_file_path);
     if (code.empty()) {
         return;
     }
 
+    loadSpirvShader(code, spirv_file_path);
+}
+
+void ShaderModule::loadSpirvShader(const std::vector<char>& code, const std::string& spirv_file_path) {
+    // create shader module
     VkShaderModuleCreateInfo create_info{};
     create_info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
     create_info.codeSize = code.size();
@@ -187,12 +267,34 @@ void ShaderModule::loadSpirvShader(const std::string& spirv_file_path) {
         return;
     }
 
+    // reflection only runs when there is no up to date sidecar
+    const auto cache_path = reflectionCachePath(spirv_file_path);
+    const auto spirv_hash = hashFileContents(code);
+    if (loadReflectionCache(cache_path, spirv_hash)) {
+        return;
+    }
+
+    if (reflect(code)) {
+        saveReflectionCache(cache_path, spirv_hash);
+    }
+}
+
+std::string ShaderModule::reflectionCachePath(const std::string& spirv_file_path) {
+    const std::string extension = ".spv";
+    if (spirv_file_path.size() > extension.size() && 
+        spirv_file_path.compare(spirv_file_path.size() - extension.size(), extension.size(), extension) == 0) {
+        return spirv_file_path.substr(0, spirv_file_path.size() - extension.size()) + ".refl";
+    }
+    return spirv_file_path + ".refl";
+}
+
+bool ShaderModule::reflect(const std::vector<char>& code) {
     SpvReflectShaderModule reflect_module = {};
     SpvReflectResult result = spvReflectCreateShaderModule(code.size(), code.data(), &reflect_module);
     if (result != SPV_REFLECT_RESULT_SUCCESS) {
         std::cerr << "Failed to create SPIRV Reflect module!" << std::endl;
         cleanup();
-        return;
+        return false;
     }
 
     vk_shader_stage_ = static_cast<VkShaderStageFlagBits>(reflect_module.shader_stage);
@@ -203,6 +305,148 @@ void ShaderModule::loadSpirvShader(const std::string& spirv_file_path) {
     if (vk_shader_stage_ == VK_SHADER_STAGE_VERTEX_BIT) {
         extractInputVariables(reflect_module);
     }
+
+    spvReflectDestroyShaderModule(&reflect_module);
+
+    return isValid();
+}
+
+bool ShaderModule::loadReflectionCache(const std::string& cache_path, uint64_t spirv_hash) {
+    std::ifstream file(cache_path, std::ios::ate | std::ios::binary);
+    if (!file.is_open()) {
+        return false;
+    }
+
+    std::vector<char> data(static_cast<size_t>(file.tellg()));
+    file.seekg(0);
+    file.read(data.data(), static_cast<std::streamsize>(data.size()));
+    if (!file.good()) {
+        return false;
+    }
+
+    BinaryReader reader(data);
+
+    uint32_t magic = 0, version = 0;
+    uint64_t cached_hash = 0;
+    if (!reader.read(magic) || magic != kReflectionCacheMagic ||
+        !reader.read(version) || version != kReflectionCacheVersion ||
+        !reader.read(cached_hash) || cached_hash != spirv_hash) {
+        return false;  // stale or written by an older build, regenerated by the caller
+    }
+
+    uint32_t stage = 0;
+    uint32_t sets_count = 0;
+    reader.read(stage);
+    reader.readCount(sets_count, 2 * sizeof(uint32_t));  // id and bindings count
+    vk_shader_stage_ = stage;
+
+    layout_sets_.resize(sets_count);
+    for (auto& set : layout_sets_) {
+        uint32_t bindings_count = 0;
+        reader.read(set.id);
+        // binding, type, count and stage flags, then the length of the name
+        reader.readCount(bindings_count, 5 * sizeof(uint32_t));
+
+        set.layout_bindings.resize(bindings_count);
+        for (auto& binding : set.layout_bindings) {
+            reader.read(binding.binding);
+            reader.read(binding.descriptorType);
+            reader.read(binding.descriptorCount);
+            reader.read(binding.stageFlags);
+            binding.pImmutableSamplers = nullptr;
+        }
+
+        set.create_info = {};
+        set.create_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+        set.create_info.bindingCount = static_cast<uint32_t>(set.layout_bindings.size());
+        set.create_info.pBindings = set.layout_bindings.data();
+
+        auto& bindings_map = descriptors_metadata_.set_bindings[set.id];
+        for (const auto& binding : set.layout_bindings) {
+            std::string name;
+            reader.readString(name);
+            bindings_map[name] = binding.binding;
+        }
+    }
+
+    uint32_t push_constants_count = 0;
+    reader.readCount(push_constants_count, sizeof(uint32_t) + sizeof(VkPushConstantRange));
+    push_constants_.resize(push_constants_count);
+    for (auto& block : push_constants_) {
+        reader.readString(block.name);
+        reader.read(block.push_constant_range);
+    }
+
+    uint32_t attributes_count = 0;
+    reader.read(input_binding_description_);
+    reader.readCount(attributes_count, sizeof(VkVertexInputAttributeDescription));
+    input_attributes_.resize(attributes_count);
+    for (auto& attribute : input_attributes_) {
+        reader.read(attribute);
+    }
+
+    if (!reader.ok() || !reader.atEnd()) {
+        std::cerr << "Reflection cache " << cache_path << " is corrupted, regenerating it" << std::endl;
+        resetReflectionData();
+        return false;
+    }
+
+    return true;
+}
+
+void ShaderModule::saveReflectionCache(const std::string& cache_path, uint64_t spirv_hash) const {
+    BinaryWriter writer;
+    writer.write(kReflectionCacheMagic);
+    writer.write(kReflectionCacheVersion);
+    writer.write(spirv_hash);
+    writer.write(static_cast<uint32_t>(vk_shader_stage_));
+
+    writer.write(static_cast<uint32_t>(layout_sets_.size()));
+    for (const auto& set : layout_sets_) {
+        writer.write(set.id);
+        writer.write(static_cast<uint32_t>(set.layout_bindings.size()));
+        for (const auto& binding : set.layout_bindings) {
+            writer.write(binding.binding);
+            writer.write(binding.descriptorType);
+            writer.write(binding.descriptorCount);
+            writer.write(binding.stageFlags);
+        }
+
+        // binding names, in the same order as the bindings
+        const auto& bindings_map = descriptors_metadata_.set_bindings.find(set.id)->second;
+        for (const auto& binding : set.layout_bindings) {
+            auto name_it = std::find_if(bindings_map.begin(), bindings_map.end(), 
+                                        [&binding](const auto& entry) { return entry.second == binding.binding; });
+            writer.writeString(name_it != bindings_map.end() ? name_it->first : std::string());
+        }
+    }
+
+    writer.write(static_cast<uint32_t>(push_constants_.size()));
+    for (const auto& block : push_constants_) {
+        writer.writeString(block.name);
+        writer.write(block.push_constant_range);
+    }
+
+    writer.write(input_binding_description_);
+    writer.write(static_cast<uint32_t>(input_attributes_.size()));
+    for (const auto& attribute : input_attributes_) {
+        writer.write(attribute);
+    }
+
+    std::ofstream file(cache_path, std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) {
+        return;  // read-only install, reflection will run on every start
+    }
+    file.write(writer.data().data(), static_cast<std::streamsize>(writer.data().size()));
+}
+
+void ShaderModule::resetReflectionData() {
+    vk_shader_stage_ = VK_SHADER_STAGE_FLAG_BITS_MAX_ENUM;
+    layout_sets_.clear();
+    push_constants_.clear();
+    input_binding_description_ = {};
+    input_attributes_.clear();
+    descriptors_metadata_ = {};
 }
 
 void ShaderModule::extractUniformBufferLayouts(SpvReflectShaderModule& reflect_module) {
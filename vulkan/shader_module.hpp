@@ -32,6 +32,8 @@ public:
 	static std::shared_ptr<ShaderModule> createShaderModule(const std::string& name, VkDevice device);
 
 	void loadSpirvShader(const std::string& spirv_file_path);
+	// spirv_file_path is where code was read from, its reflection data is cached next to it in a .refl file
+	void loadSpirvShader(const std::vector<char>& code, const std::string& spirv_file_path);
 	bool isValid() const { return vk_shader_ != VK_NULL_HANDLE; }
 	const std::string& getName() const { return name_; }
 	VkShaderStageFlags getShaderStage() const { return vk_shader_stage_; }
@@ -39,11 +41,17 @@ public:
 	const std::vector<DescriptorSetLayouts>& getDescriptorSetLayouts() const { return layout_sets_; }
 	const std::vector<PushConstantBlock>& getPushConstants() const { return push_constants_; }
 	VkVertexInputBindingDescription getInputBindingDescription() const { return input_binding_description_; }  
-	const std::vector<VkVertexInputAttributeDescription>& getInputAttributes() { return input_attributes_; }
+	const std::vector<VkVertexInputAttributeDescription>& getInputAttributes() const { return input_attributes_; }
 	bool isVertexFormatCompatible(const VertexFormatInfo& format_info) const;
 	const DescriptorSetMetadata& getDescriptorsMetadata() const { return descriptors_metadata_; }
 
+	static std::string reflectionCachePath(const std::string& spirv_file_path);
+
 private:	
+	bool reflect(const std::vector<char>& code);
+	bool loadReflectionCache(const std::string& cache_path, uint64_t spirv_hash);
+	void saveReflectionCache(const std::string& cache_path, uint64_t spirv_hash) const;
+	void resetReflectionData();
 	void extractUniformBufferLayouts(SpvReflectShaderModule& reflect_module);
 	void extractPushConstants(SpvReflectShaderModule& reflect_module);
 	void extractInputVariables(SpvReflectShaderModule& reflect_module);
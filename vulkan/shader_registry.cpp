@@ -0,0 +1,46 @@
+/*
+* shader_registry.cpp
+*
+* Copyright (C) 2021 Riccardo Marson
+*/
+
+#include "shader_registry.hpp"
+#include "shader_module.hpp"
+#include "file_system.hpp"
+
+std::shared_ptr<const ShaderModule> ShaderRegistry::load(const std::string& name, const std::string& spirv_file_path) {
+    auto path_it = modules_by_path_.find(spirv_file_path);
+    if (path_it != modules_by_path_.end()) {
+        return path_it->second;
+    }
+
+    auto code = readFile(spirv_file_path);
+    if (code.empty()) {
+        std::cerr << "Failed to read shader " << spirv_file_path << std::endl;
+        return ShaderModule::createShaderModule(name, device_);  // invalid, callers check isValid()
+    }
+
+    auto hash = hashFileContents(code);
+    auto hash_it = modules_by_hash_.find(hash);
+    if (hash_it != modules_by_hash_.end() && hash_it->second.code == code) {
+        modules_by_path_[spirv_file_path] = hash_it->second.module;
+        return hash_it->second.module;
+    }
+
+    auto shader_module = ShaderModule::createShaderModule(name, device_);
+    shader_module->loadSpirvShader(code, spirv_file_path);
+    if (!shader_module->isValid()) {
+        return shader_module;  // not cached, so that a fixed file is picked up on the next request
+    }
+
+    modules_by_path_[spirv_file_path] = shader_module;
+    if (hash_it == modules_by_hash_.end()) {
+        modules_by_hash_[hash] = { std::move(code), shader_module };
+    }  // else a collision, the module is only shared by path
+    return shader_module;
+}
+
+void ShaderRegistry::clear() {
+    modules_by_path_.clear();
+    modules_by_hash_.clear();
+}
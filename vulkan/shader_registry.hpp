@@ -0,0 +1,37 @@
+/*
+* shader_registry.hpp
+*
+* Copyright (C) 2021 Riccardo Marson
+*/
+
+#pragma once
+
+#include "common_definitions.hpp"
+
+#include <unordered_map>
+
+class ShaderModule;
+
+// Hands out shared, immutable shader modules. Each .spv file is read, reflected and turned into a VkShaderModule
+// only the first time it is requested; later requests for the same path, or for a different path with identical
+// contents, get the same instance back. Shaders are assumed not to change on disk while the app is running.
+class ShaderRegistry {
+public:
+    explicit ShaderRegistry(VkDevice device) : device_(device) {}
+
+    std::shared_ptr<const ShaderModule> load(const std::string& name, const std::string& spirv_file_path);
+    void clear();  // modules still referenced elsewhere stay alive until released
+
+    size_t getModulesCount() const { return modules_by_hash_.size(); }
+
+private:
+    // the SPIR-V is kept to tell apart different files that happen to have the same hash
+    struct HashedModule {
+        std::vector<char> code;
+        std::shared_ptr<const ShaderModule> module;
+    };
+
+    VkDevice device_;
+    std::unordered_map<std::string, std::shared_ptr<const ShaderModule>> modules_by_path_;
+    std::unordered_map<uint64_t, HashedModule> modules_by_hash_;
+};
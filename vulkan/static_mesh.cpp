@@ -33,37 +33,14 @@ void StaticMesh::setTransform(const glm::mat4& transform) {
 }
 
 void StaticMesh::update() {
-    for (size_t i = 0; i < backend_->getSwapChainSize(); i++) {
-        backend_->updateBuffer<ModelData>(uniform_buffer_.buffers[i], { model_data_ });
-    }
-}
-
-void StaticMesh::createUniformBuffer() {
-    uniform_buffer_ = backend_->createUniformBuffer<ModelData>(name_ + "_model_data"); // the buffer lifecycle is managed by the backend
-}
-
-void StaticMesh::deleteUniformBuffer() {
-    backend_->destroyUniformBuffer(uniform_buffer_);
-}
-
-DescriptorPoolConfig StaticMesh::getDescriptorsCount() const {
-    DescriptorPoolConfig config;
-    config.uniform_buffers_count = uint32_t(surfaces_.size() * 1 + 1);
-
-    return config;
+    model_data_uniform_ = backend_->pushUniformData<ModelData>(model_data_);
 }
 
 void StaticMesh::createDescriptorSets(const std::map<uint32_t, VkDescriptorSetLayout>& descriptor_set_layouts) {
     const auto& layout = descriptor_set_layouts.find(MODEL_UNIFORM_SET_ID)->second;
-    std::vector<VkDescriptorSetLayout> layouts(backend_->getSwapChainSize(), layout);
-    VkDescriptorSetAllocateInfo alloc_info{};
-    alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-    alloc_info.descriptorPool = backend_->getDescriptorPool();
-    alloc_info.descriptorSetCount = backend_->getSwapChainSize();
-    alloc_info.pSetLayouts = layouts.data();
-
-    std::vector<VkDescriptorSet> layout_descriptor_sets(backend_->getSwapChainSize());
-    if (vkAllocateDescriptorSets(backend_->getDevice(), &alloc_info, layout_descriptor_sets.data()) != VK_SUCCESS) {
+    std::vector<VkDescriptorSetLayout> layouts(backend_->getFramesInFlight(), layout);
+    std::vector<VkDescriptorSet> layout_descriptor_sets;
+    if (!backend_->allocateDescriptorSets(layouts, layout_descriptor_sets)) {
         std::cerr << "Failed to allocate Mesh descriptor sets!" << std::endl;
         return;
     }
@@ -77,7 +54,7 @@ void StaticMesh::createDescriptorSets(const std::map<uint32_t, VkDescriptorSetLa
 
 void StaticMesh::updateDescriptorSets(const DescriptorSetMetadata& metadata, bool with_material) {
     const auto& bindings = metadata.set_bindings.find(MODEL_UNIFORM_SET_ID)->second;
-    backend_->updateDescriptorSets(uniform_buffer_, vk_descriptor_sets_, bindings.find(MODEL_DATA_BINDING_NAME)->second);
+    backend_->updateDynamicDescriptorSets(sizeof(ModelData), vk_descriptor_sets_, bindings.find(MODEL_DATA_BINDING_NAME)->second);
 
     if (with_material) {
         for (auto& surface : surfaces_) {
@@ -86,12 +63,12 @@ void StaticMesh::updateDescriptorSets(const DescriptorSetMetadata& metadata, boo
     }
 }
 
-void StaticMesh::drawGeometry(VkCommandBuffer& cmd_buffer, VkPipelineLayout pipeline_layout, uint32_t swapchain_index, bool with_material) {
-    vkCmdBindDescriptorSets(cmd_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_layout, MODEL_UNIFORM_SET_ID, 1, &vk_descriptor_sets_[swapchain_index], 0, nullptr);
+void StaticMesh::drawGeometry(VkCommandBuffer& cmd_buffer, VkPipelineLayout pipeline_layout, uint32_t frame_index, bool with_material) {
+    vkCmdBindDescriptorSets(cmd_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_layout, MODEL_UNIFORM_SET_ID, 1, &vk_descriptor_sets_[frame_index], 1, &model_data_uniform_.dynamic_offset);
 
     for (auto& surface : surfaces_) {
         if (with_material) {
-            vkCmdBindDescriptorSets(cmd_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_layout, SURFACE_UNIFORM_SET_ID, 1, &surface.vk_descriptor_sets[swapchain_index], 0, nullptr);
+            vkCmdBindDescriptorSets(cmd_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_layout, SURFACE_UNIFORM_SET_ID, 1, &surface.vk_descriptor_sets[frame_index], 0, nullptr);
         }
         vkCmdDrawIndexed(cmd_buffer, surface.index_count, 1, surface.index_start, surface.vertex_start, 0);
     }
@@ -99,15 +76,9 @@ void StaticMesh::drawGeometry(VkCommandBuffer& cmd_buffer, VkPipelineLayout pipe
 
 void StaticMesh::Surface::createDescriptorSets(VulkanBackend* backend, const std::map<uint32_t, VkDescriptorSetLayout>& descriptor_set_layouts) {
     const auto& layout = descriptor_set_layouts.find(SURFACE_UNIFORM_SET_ID)->second;
-    std::vector<VkDescriptorSetLayout> layouts(backend->getSwapChainSize(), layout);
-    VkDescriptorSetAllocateInfo alloc_info{};
-    alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-    alloc_info.descriptorPool = backend->getDescriptorPool();
-    alloc_info.descriptorSetCount = backend->getSwapChainSize();
-    alloc_info.pSetLayouts = layouts.data();
-
-    std::vector<VkDescriptorSet> layout_descriptor_sets(backend->getSwapChainSize());
-    if (vkAllocateDescriptorSets(backend->getDevice(), &alloc_info, layout_descriptor_sets.data()) != VK_SUCCESS) {
+    std::vector<VkDescriptorSetLayout> layouts(backend->getFramesInFlight(), layout);
+    std::vector<VkDescriptorSet> layout_descriptor_sets;
+    if (!backend->allocateDescriptorSets(layouts, layout_descriptor_sets)) {
         std::cerr << "Failed to allocate Mesh descriptor sets!" << std::endl;
         return;
     }
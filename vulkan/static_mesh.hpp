@@ -25,6 +25,8 @@ public:
 		uint32_t index_start;
 		uint32_t index_count;
 		std::weak_ptr<Material> material_weak;
+		uint32_t material_idx = 0;  // in the scene materials, for indirect draws
+		glm::vec4 bounding_sphere = glm::vec4(0.0f);  // local space, xyz centre and w radius. for GPU culling
 
 		std::vector<VkDescriptorSet> vk_descriptor_sets;
 
@@ -39,20 +41,17 @@ public:
 
 	const std::string& getName() const { return name_; }
 	Surface& addSurface();
+	const std::vector<Surface>& getSurfaces() const { return surfaces_; }
 
 	void setTransform(const glm::mat4& transform);
 	const glm::mat4& getTransform() const { return model_data_.transform_matrix; }
 	void update();
 
-	void createUniformBuffer();
-	const UniformBuffer& getUniformBuffer() const { return uniform_buffer_; }
-	void deleteUniformBuffer();
-	DescriptorPoolConfig getDescriptorsCount() const;
 	void createDescriptorSets(const std::map<uint32_t, VkDescriptorSetLayout>& descriptor_set_layouts);
 	void updateDescriptorSets(const DescriptorSetMetadata& metadata, bool with_material = true);
 	std::vector<VkDescriptorSet>& getDescriptorSets() { return vk_descriptor_sets_; }
 
-	void drawGeometry(VkCommandBuffer& cmd_buffer, VkPipelineLayout pipeline_layout, uint32_t swapchain_index, bool with_material = true);
+	void drawGeometry(VkCommandBuffer& cmd_buffer, VkPipelineLayout pipeline_layout, uint32_t frame_index, bool with_material = true);
 
 private:
 	std::string name_;
@@ -60,7 +59,7 @@ private:
 	VulkanBackend* backend_;
 
 	ModelData model_data_;
-	UniformBuffer uniform_buffer_;
+	UniformAllocation model_data_uniform_;  // this frame's copy of model_data_ in the uniform ring
 	std::vector<VkDescriptorSet> vk_descriptor_sets_;
 
 	std::vector<Surface> surfaces_;
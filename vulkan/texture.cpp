@@ -10,6 +10,8 @@
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb_image.h>
 
+#include <algorithm>
+
 
 namespace {
     bool isFormatSupported(VkPhysicalDevice physical_device, VkFormat format, VkImageTiling tiling, VkFormatFeatureFlags features) {
@@ -42,6 +44,9 @@ Texture::~Texture() {
 }
 
 void Texture::cleanup() {
+    backend_->releaseBindlessTexture(bindless_index_);
+    bindless_index_ = INVALID_BINDLESS_INDEX;
+
     if (isValid()) {
         if (vk_sampler_ != VK_NULL_HANDLE) {
             vkDestroySampler(device_, vk_sampler_, nullptr);
@@ -51,7 +56,7 @@ void Texture::cleanup() {
             vkDestroyImageView(device_, vk_sampler_image_view_, nullptr);
         }
         vkDestroyImage(device_, vk_image_, nullptr);
-        vkFreeMemory(device_, vk_memory_, nullptr);
+        backend_->freeDeviceMemory(memory_);
     }
 }
 
@@ -120,20 +125,39 @@ void Texture::loadImageRGBA(uint32_t width, uint32_t height, uint32_t channels,
     vk_mem_props_ = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
     vk_num_samples_ = VK_SAMPLE_COUNT_1_BIT;
 
-    Buffer staging_buffer = backend_->createBuffer<stbi_uc>("image_staging_buffer", pixels, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_SHARING_MODE_EXCLUSIVE, true);
-    backend_->updateBuffer<stbi_uc>(staging_buffer, pixels);
-
     if (!createImage()) {
-        vkDestroyBuffer(device_, staging_buffer.vk_buffer, nullptr);
-        vkFreeMemory(device_, staging_buffer.vk_buffer_memory, nullptr);
         if (vk_image_ != VK_NULL_HANDLE) {
             vkDestroyImage(device_, vk_image_, nullptr);
         }
         return;
     }
 
+    vk_image_view_ = backend_->createImageView(vk_image_, vk_format_, VK_IMAGE_ASPECT_COLOR_BIT, mip_levels_);
+
+    if (vk_image_view_ == VK_NULL_HANDLE) {
+        vkDestroyImage(device_, vk_image_, nullptr);
+        vk_image_ = VK_NULL_HANDLE;
+        backend_->freeDeviceMemory(memory_);
+        return;
+    }
+
+    StagingRegion staging_region = backend_->stageUploadData(pixels.data(), pixels.size());
+    if (!staging_region.isValid()) {
+        std::cerr << "Failed to stage pixels for texture " << name_ << std::endl;
+        // nothing was recorded for the image yet, drop it so the texture doesn't look usable
+        vkDestroyImageView(device_, vk_image_view_, nullptr);
+        vk_image_view_ = VK_NULL_HANDLE;
+        vkDestroyImage(device_, vk_image_, nullptr);
+        vk_image_ = VK_NULL_HANDLE;
+        backend_->freeDeviceMemory(memory_);
+        return;
+    }
+
+    // copy, transitions and mip blits all go in the same command buffer (or in the caller's batch)
+    backend_->beginUploadBatch();
+
     transitionImageLayout(vk_image_, vk_format_, VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
-    copyBufferToImage(staging_buffer.vk_buffer, vk_image_, width_, height_);
+    copyBufferToImage(staging_region.vk_buffer, staging_region.offset, vk_image_, width_, height_);
     
     if (genMipMaps) {
         generateMipMaps();
@@ -142,15 +166,7 @@ void Texture::loadImageRGBA(uint32_t width, uint32_t height, uint32_t channels,
         transitionImageLayout(vk_image_, vk_format_, VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
     }
 
-    vk_image_view_ = backend_->createImageView(vk_image_, vk_format_, VK_IMAGE_ASPECT_COLOR_BIT, mip_levels_);
-
-    if (vk_image_view_ == VK_NULL_HANDLE) {
-        vkDestroyImage(device_, vk_image_, nullptr);
-        vkFreeMemory(device_, vk_memory_, nullptr);
-    }
-
-    vkDestroyBuffer(device_, staging_buffer.vk_buffer, nullptr);
-    vkFreeMemory(device_, staging_buffer.vk_buffer_memory, nullptr);
+    backend_->endUploadBatch();
 }
 
 void Texture::createColourAttachment(uint32_t width, uint32_t height, VkFormat format, VkSampleCountFlagBits num_samples, bool enable_sampling) {
@@ -184,7 +200,7 @@ void Texture::createColourAttachment(uint32_t width, uint32_t height, VkFormat f
 
     if (vk_image_view_ == VK_NULL_HANDLE) {
         vkDestroyImage(device_, vk_image_, nullptr);
-        vkFreeMemory(device_, vk_memory_, nullptr);
+        backend_->freeDeviceMemory(memory_);
     }
 
     transitionImageLayout(vk_image_, vk_format_, VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
@@ -230,7 +246,7 @@ void Texture::createDepthStencilAttachment(uint32_t width, uint32_t height, VkSa
 
     if (vk_image_view_ == VK_NULL_HANDLE) {
         vkDestroyImage(device_, vk_image_, nullptr);
-        vkFreeMemory(device_, vk_memory_, nullptr);
+        backend_->freeDeviceMemory(memory_);
     }
 
     transitionImageLayout(vk_image_, vk_format_, VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL);
@@ -243,7 +259,7 @@ void Texture::createDepthStencilAttachment(uint32_t width, uint32_t height, VkSa
         if (vk_sampler_image_view_ == VK_NULL_HANDLE) {
             vkDestroyImageView(device_, vk_image_view_, nullptr);
             vkDestroyImage(device_, vk_image_, nullptr);
-            vkFreeMemory(device_, vk_memory_, nullptr);   
+            backend_->freeDeviceMemory(memory_);   
         }
     }
 }
@@ -281,9 +297,11 @@ void Texture::createDepthStorageImage(uint32_t width, uint32_t height, bool as_r
 
     if (vk_image_view_ == VK_NULL_HANDLE) {
         vkDestroyImage(device_, vk_image_, nullptr);
-        vkFreeMemory(device_, vk_memory_, nullptr);
+        backend_->freeDeviceMemory(memory_);
     }
 
+    backend_->beginUploadBatch();
+
     transitionImageLayout(vk_image_, vk_format_, VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL);
 
     auto cmd_buffer = backend_->beginSingleTimeCommands();
@@ -296,7 +314,9 @@ void Texture::createDepthStorageImage(uint32_t width, uint32_t height, bool as_r
     range.layerCount = 1;
     range.levelCount = 1;
     vkCmdClearColorImage(cmd_buffer, vk_image_, VK_IMAGE_LAYOUT_GENERAL, &clear_colour, 1, &range);
-    backend_->endSingleTimeCommands(cmd_buffer);
+    backend_->endSingleTimeCommands();
+
+    backend_->endUploadBatch();
 }
 
 VkImageView Texture::getSamplerImageView() const {
@@ -334,14 +354,14 @@ bool Texture::createImage() {
     VkMemoryRequirements mem_reqs;
     vkGetImageMemoryRequirements(device_, vk_image_, &mem_reqs);
 
-    vk_memory_ = backend_->allocateDeviceMemory(mem_reqs, vk_mem_props_);
+    memory_ = backend_->allocateDeviceMemory(mem_reqs, vk_mem_props_, vk_tiling_ == VK_IMAGE_TILING_LINEAR);
 
-    if (vk_memory_ == VK_NULL_HANDLE) {
+    if (!memory_.isValid()) {
         std::cerr << "Failed to allocate image memory!" << std::endl;
         return false;
     }
 
-    vkBindImageMemory(device_, vk_image_, vk_memory_, 0);
+    vkBindImageMemory(device_, vk_image_, memory_.vk_memory, memory_.offset);
 
     return true;
 }
@@ -421,16 +441,16 @@ void Texture::transitionImageLayout(VkImage image, VkFormat format, VkImageAspec
         1, &barrier
     );
 
-    backend_->endSingleTimeCommands(command_buffer);
+    backend_->endSingleTimeCommands();
 
     vk_layout_ = new_layout;
 }
 
-void Texture::copyBufferToImage(VkBuffer buffer, VkImage image, uint32_t width, uint32_t height) {
+void Texture::copyBufferToImage(VkBuffer buffer, VkDeviceSize buffer_offset, VkImage image, uint32_t width, uint32_t height) {
     VkCommandBuffer command_buffer = backend_->beginSingleTimeCommands();
 
     VkBufferImageCopy region{};
-    region.bufferOffset = 0;
+    region.bufferOffset = buffer_offset;
     region.bufferRowLength = 0;
     region.bufferImageHeight = 0;
 
@@ -455,7 +475,7 @@ void Texture::copyBufferToImage(VkBuffer buffer, VkImage image, uint32_t width,
         &region
     );
 
-    backend_->endSingleTimeCommands(command_buffer);
+    backend_->endSingleTimeCommands();
 }
 
 void Texture::generateMipMaps() {
@@ -542,7 +562,7 @@ void Texture::generateMipMaps() {
         0, nullptr,
         1, &barrier);
 
-    backend_->endSingleTimeCommands(command_buffer);
+    backend_->endSingleTimeCommands();
 
     vk_layout_ = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
 }
@@ -555,8 +575,9 @@ void Texture::createSampler() {
     sampler_info.addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT;
     sampler_info.addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT;
     sampler_info.addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT;
-    sampler_info.anisotropyEnable = VK_TRUE;
-    sampler_info.maxAnisotropy = 16.0f;
+    const auto& capabilities = backend_->getDeviceCapabilities();
+    sampler_info.anisotropyEnable = capabilities.sampler_anisotropy ? VK_TRUE : VK_FALSE;
+    sampler_info.maxAnisotropy = std::min(16.0f, capabilities.max_sampler_anisotropy);
     sampler_info.borderColor = VK_BORDER_COLOR_INT_OPAQUE_BLACK;
     sampler_info.unnormalizedCoordinates = VK_FALSE;
     sampler_info.compareEnable = VK_FALSE;
@@ -568,34 +589,27 @@ void Texture::createSampler() {
 
     if (vkCreateSampler(device_, &sampler_info, nullptr, &vk_sampler_) != VK_SUCCESS) {
         std::cerr << "Failed to create texture sampler!" << std::endl;
+        return;
+    }
+
+    // attachments change layout as they are rendered to, they are bound per pipeline instead
+    if (vk_layout_ == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL && bindless_index_ == INVALID_BINDLESS_INDEX) {
+        bindless_index_ = backend_->addBindlessTexture(vk_image_view_, vk_sampler_, vk_layout_);
     }
 }
 
 void Texture::updateDescriptorSets(std::vector<VkDescriptorSet>& descriptor_sets, uint32_t binding_point) {
-    VkImageView image_view;
+    backend_->updateImageDescriptorSets({ getDescriptorImageInfo() }, vk_descriptor_type_, descriptor_sets, binding_point);
+}
+
+VkDescriptorImageInfo Texture::getDescriptorImageInfo() const {
+    VkDescriptorImageInfo image_info{};
+    image_info.imageLayout = vk_layout_;
     if (vk_sampler_ != VK_NULL_HANDLE && vk_sampler_image_view_ != VK_NULL_HANDLE) {
-        image_view = vk_sampler_image_view_;
+        image_info.imageView = vk_sampler_image_view_;
     } else {
-        image_view = vk_image_view_;
-    }
-
-    for (size_t i = 0; i < descriptor_sets.size(); i++) {
-        VkDescriptorImageInfo image_info{};
-        image_info.imageLayout = vk_layout_;
-        image_info.imageView = image_view;
-        image_info.sampler = vk_sampler_;
-
-        VkWriteDescriptorSet descriptor_write{};
-        descriptor_write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-        descriptor_write.dstSet = descriptor_sets[i];
-        descriptor_write.dstBinding = binding_point;
-        descriptor_write.dstArrayElement = 0;
-        descriptor_write.descriptorType = vk_descriptor_type_;
-        descriptor_write.descriptorCount = 1;
-        descriptor_write.pBufferInfo = nullptr; // Optional
-        descriptor_write.pImageInfo = &image_info; 
-        descriptor_write.pTexelBufferView = nullptr; // Optional
-
-        vkUpdateDescriptorSets(device_, 1, &descriptor_write, 0, nullptr);
+        image_info.imageView = vk_image_view_;
     }
+    image_info.sampler = vk_sampler_;
+    return image_info;
 }
@@ -25,13 +25,16 @@ public:
     void createColourAttachment(uint32_t width, uint32_t height, VkFormat format, VkSampleCountFlagBits num_samples, bool enable_sampling = false);
     void createDepthStencilAttachment(uint32_t width, uint32_t height, VkSampleCountFlagBits num_samples, bool enable_sampling = false);
     void createDepthStorageImage(uint32_t width, uint32_t height, bool as_rgba32 = false);
-    bool isValid() const { return vk_image_ != VK_NULL_HANDLE && vk_memory_ != VK_NULL_HANDLE && vk_image_view_ != VK_NULL_HANDLE; }
+    bool isValid() const { return vk_image_ != VK_NULL_HANDLE && memory_.isValid() && vk_image_view_ != VK_NULL_HANDLE; }
 
+    // read-only textures (the ones loaded from pixels) also get a slot in the bindless textures array, if enabled
     void createSampler();
     bool hasValidSampler() const { return vk_sampler_ != VK_NULL_HANDLE; }
+    uint32_t getBindlessIndex() const { return bindless_index_; }  // stable for the lifetime of the texture
     
     // used for descriptor sets that have one binding point dedicates to one texture
     void updateDescriptorSets(std::vector<VkDescriptorSet>& descriptor_sets, uint32_t binding_point);
+    VkDescriptorImageInfo getDescriptorImageInfo() const;  // what updateDescriptorSets writes, for update templates
     void updateImageLayout(VkImageLayout new_layout) { vk_layout_ = new_layout; }
 
     VkFormat getFormat() const { return vk_format_; }
@@ -46,7 +49,7 @@ private:
     void cleanup();
 
     void transitionImageLayout(VkImage image, VkFormat format, VkImageAspectFlags aspect_flags, VkImageLayout old_layout, VkImageLayout new_layout);
-    void copyBufferToImage(VkBuffer buffer, VkImage image, uint32_t width, uint32_t height);
+    void copyBufferToImage(VkBuffer buffer, VkDeviceSize buffer_offset, VkImage image, uint32_t width, uint32_t height);
     void generateMipMaps();
 
     std::string name_;
@@ -66,8 +69,9 @@ private:
     VkMemoryPropertyFlags vk_mem_props_ = VK_MEMORY_PROPERTY_FLAG_BITS_MAX_ENUM;
     VkImageUsageFlags vk_usage_flags_ = VK_IMAGE_USAGE_FLAG_BITS_MAX_ENUM;
     VkSampleCountFlagBits vk_num_samples_ = VK_SAMPLE_COUNT_1_BIT;
-    VkDeviceMemory vk_memory_ = VK_NULL_HANDLE;
+    MemoryAllocation memory_;
     VkImageView vk_image_view_ = VK_NULL_HANDLE;
     VkImageView vk_sampler_image_view_ = VK_NULL_HANDLE;
     VkSampler vk_sampler_ = VK_NULL_HANDLE;
+    uint32_t bindless_index_ = INVALID_BINDLESS_INDEX;
 };
\ No newline at end of file
@@ -0,0 +1,55 @@
+/*
+* thread_pool.cpp
+*
+* Copyright (C) 2021 Riccardo Marson
+*/
+
+#include "thread_pool.hpp"
+#include "profilers.hpp"
+
+#include <algorithm>
+
+ThreadPool::ThreadPool(uint32_t threads_count) {
+    if (threads_count == 0) {
+        auto cores = std::thread::hardware_concurrency();  // may be 0 if it can't be determined
+        threads_count = std::max(cores, 2u) - 1;
+    }
+
+    for (uint32_t i = 0; i < threads_count; ++i) {
+        workers_.emplace_back([this, i]() {
+            CpuProfiler::instance().setThreadName("Worker " + std::to_string(i));
+            workerLoop();
+        });
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    condition_.notify_all();
+
+    for (auto& worker : workers_) {
+        worker.join();
+    }
+}
+
+void ThreadPool::workerLoop() {
+    while (true) {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            condition_.wait(lock, [this]() { return stopping_ || !tasks_.empty(); });
+
+            if (tasks_.empty()) {
+                return;  // stopping and nothing left to do
+            }
+
+            task = std::move(tasks_.front());
+            tasks_.pop();
+        }
+
+        task();
+    }
+}
@@ -0,0 +1,57 @@
+/*
+* thread_pool.hpp
+*
+* Copyright (C) 2021 Riccardo Marson
+*/
+
+#pragma once
+
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads pulling tasks from a single queue. Used for work that the Vulkan spec lets us
+// spread across threads, like pipeline compilation.
+class ThreadPool {
+public:
+    explicit ThreadPool(uint32_t threads_count = 0);  // 0 uses one thread per core, minus the main thread
+    ~ThreadPool();  // runs the tasks still queued before joining
+
+    uint32_t getThreadsCount() const { return static_cast<uint32_t>(workers_.size()); }
+
+    template<typename Task>
+    auto submit(Task&& task) -> std::future<decltype(task())>;
+
+private:
+    void workerLoop();
+
+    std::vector<std::thread> workers_;
+    std::queue<std::function<void()>> tasks_;
+    std::mutex mutex_;
+    std::condition_variable condition_;
+    bool stopping_ = false;
+};
+
+// inlines
+
+template<typename Task>
+auto ThreadPool::submit(Task&& task) -> std::future<decltype(task())> {
+    using ResultType = decltype(task());
+
+    // std::function needs a copyable callable, packaged_task is move only
+    auto packaged_task = std::make_shared<std::packaged_task<ResultType()>>(std::forward<Task>(task));
+    auto result = packaged_task->get_future();
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        tasks_.emplace([packaged_task]() { (*packaged_task)(); });
+    }
+    condition_.notify_one();
+
+    return result;
+}
@@ -0,0 +1,94 @@
+/*
+* uniform_ring.cpp
+*
+* Copyright (C) 2021 Riccardo Marson
+*/
+
+#include "uniform_ring.hpp"
+#include "memory_allocator.hpp"
+
+#include <algorithm>
+
+UniformRing::UniformRing(VkDevice device, MemoryAllocator* allocator, VkDeviceSize min_offset_alignment, uint32_t frames_count, const std::vector<uint32_t>& queue_families, VkDeviceSize frame_size) :
+    device_(device),
+    allocator_(allocator),
+    alignment_(std::max(min_offset_alignment, VkDeviceSize(1))),
+    frames_count_(frames_count) {
+
+    // every slice must start on an aligned offset as well
+    frame_size_ = alignUp(frame_size, alignment_);
+
+    VkBufferCreateInfo buffer_info{};
+    buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    buffer_info.size = frame_size_ * frames_count_;
+    buffer_info.usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+    if (queue_families.size() > 1) {
+        buffer_info.sharingMode = VK_SHARING_MODE_CONCURRENT;
+        buffer_info.queueFamilyIndexCount = static_cast<uint32_t>(queue_families.size());
+        buffer_info.pQueueFamilyIndices = queue_families.data();
+    } else {
+        buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    }
+
+    if (vkCreateBuffer(device_, &buffer_info, nullptr, &vk_buffer_) != VK_SUCCESS) {
+        std::cerr << "Failed to create uniform ring buffer!" << std::endl;
+        vk_buffer_ = VK_NULL_HANDLE;
+        return;
+    }
+
+    VkMemoryRequirements mem_reqs;
+    vkGetBufferMemoryRequirements(device_, vk_buffer_, &mem_reqs);
+
+    memory_ = allocator_->allocate(mem_reqs, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, true);
+    if (!memory_.isValid() || memory_.mapped_data == nullptr) {
+        std::cerr << "Failed to allocate uniform ring buffer memory!" << std::endl;
+        allocator_->free(memory_);
+        vkDestroyBuffer(device_, vk_buffer_, nullptr);
+        vk_buffer_ = VK_NULL_HANDLE;
+        return;
+    }
+
+    vkBindBufferMemory(device_, vk_buffer_, memory_.vk_memory, memory_.offset);
+}
+
+UniformRing::~UniformRing() {
+    if (vk_buffer_ != VK_NULL_HANDLE) {
+        vkDestroyBuffer(device_, vk_buffer_, nullptr);
+    }
+    allocator_->free(memory_);
+}
+
+void UniformRing::nextFrame() {
+    frame_index_ = (frame_index_ + 1) % frames_count_;
+    head_ = 0;
+}
+
+void UniformRing::reset() {
+    frame_index_ = 0;
+    head_ = 0;
+}
+
+UniformAllocation UniformRing::allocate(VkDeviceSize size, void** mapped_data) {
+    *mapped_data = nullptr;
+
+    if (!isValid()) {
+        return UniformAllocation{};
+    }
+
+    VkDeviceSize offset = alignUp(head_, alignment_);
+    if (offset + size > frame_size_) {
+        std::cerr << "Uniform ring frame slice is full! (" << frame_size_ << " bytes)" << std::endl;
+        return UniformAllocation{};
+    }
+
+    head_ = offset + size;
+    peak_usage_ = std::max(peak_usage_, head_);
+
+    VkDeviceSize ring_offset = frame_index_ * frame_size_ + offset;
+    *mapped_data = static_cast<char*>(memory_.mapped_data) + ring_offset;
+
+    UniformAllocation allocation;
+    allocation.vk_buffer = vk_buffer_;
+    allocation.dynamic_offset = static_cast<uint32_t>(ring_offset);
+    return allocation;
+}
@@ -0,0 +1,74 @@
+/*
+* uniform_ring.hpp
+*
+* Copyright (C) 2021 Riccardo Marson
+*/
+
+#pragma once
+
+#include "common_definitions.hpp"
+
+class MemoryAllocator;
+
+// Linear allocator for uniform data that changes every frame.
+// One host visible buffer, persistently mapped and split in one slice per frame. Every push is a bump of the
+// slice head plus a memcpy, and returns the offset to pass to vkCmdBindDescriptorSets for a dynamic uniform binding.
+// Arrays can be pushed too, for dynamic storage buffer bindings: min_offset_alignment must then cover both kinds.
+class UniformRing {
+public:
+    // with more than one queue family the buffer is shared concurrently by all of them
+    UniformRing(VkDevice device, MemoryAllocator* allocator, VkDeviceSize min_offset_alignment, uint32_t frames_count, const std::vector<uint32_t>& queue_families = {}, VkDeviceSize frame_size = 256 * 1024);
+    ~UniformRing();
+
+    bool isValid() const { return vk_buffer_ != VK_NULL_HANDLE; }
+    VkBuffer getBuffer() const { return vk_buffer_; }
+    VkDeviceSize getFrameSize() const { return frame_size_; }
+    VkDeviceSize getPeakUsage() const { return peak_usage_; }
+
+    // the caller must guarantee that the GPU is done with the frame slice being recycled
+    void nextFrame();
+    void reset();
+
+    template<typename DataType>
+    UniformAllocation push(const DataType& data);
+    template<typename DataType>
+    UniformAllocation pushArray(const std::vector<DataType>& data);
+
+private:
+    UniformAllocation allocate(VkDeviceSize size, void** mapped_data);
+
+    VkDevice device_;
+    MemoryAllocator* allocator_;
+    VkDeviceSize alignment_;
+    uint32_t frames_count_;
+    VkDeviceSize frame_size_;
+
+    VkBuffer vk_buffer_ = VK_NULL_HANDLE;
+    MemoryAllocation memory_;
+
+    uint32_t frame_index_ = 0;
+    VkDeviceSize head_ = 0;  // relative to the start of the current frame slice
+    VkDeviceSize peak_usage_ = 0;
+};
+
+// inlines
+
+template<typename DataType>
+UniformAllocation UniformRing::push(const DataType& data) {
+    void* mapped_data = nullptr;
+    auto allocation = allocate(sizeof(DataType), &mapped_data);
+    if (mapped_data != nullptr) {
+        memcpy(mapped_data, &data, sizeof(DataType));
+    }
+    return allocation;
+}
+
+template<typename DataType>
+UniformAllocation UniformRing::pushArray(const std::vector<DataType>& data) {
+    void* mapped_data = nullptr;
+    auto allocation = allocate(sizeof(DataType) * data.size(), &mapped_data);
+    if (mapped_data != nullptr) {
+        memcpy(mapped_data, data.data(), sizeof(DataType) * data.size());
+    }
+    return allocation;
+}
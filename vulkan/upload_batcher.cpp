@@ -0,0 +1,478 @@
+/*
+* upload_batcher.cpp
+*
+* Copyright (C) 2021 Riccardo Marson
+*/
+
+#include "upload_batcher.hpp"
+#include "memory_allocator.hpp"
+
+#include <algorithm>
+
+namespace {
+    VkCommandPool createPool(VkDevice device, uint32_t queue_family_index) {
+        VkCommandPoolCreateInfo pool_info{};
+        pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+        pool_info.queueFamilyIndex = queue_family_index;
+        pool_info.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT | VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+
+        VkCommandPool pool;
+        if (vkCreateCommandPool(device, &pool_info, nullptr, &pool) != VK_SUCCESS) {
+            std::cerr << "Failed to create upload command pool!" << std::endl;
+            return VK_NULL_HANDLE;
+        }
+        return pool;
+    }
+
+    VkCommandBuffer allocateCommandBuffer(VkDevice device, VkCommandPool pool) {
+        VkCommandBufferAllocateInfo alloc_info{};
+        alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        alloc_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        alloc_info.commandPool = pool;
+        alloc_info.commandBufferCount = 1;
+
+        VkCommandBuffer command_buffer;
+        if (vkAllocateCommandBuffers(device, &alloc_info, &command_buffer) != VK_SUCCESS) {
+            std::cerr << "Failed to allocate upload command buffer!" << std::endl;
+            return VK_NULL_HANDLE;
+        }
+        return command_buffer;
+    }
+
+    void beginCommandBuffer(VkCommandBuffer command_buffer) {
+        VkCommandBufferBeginInfo begin_info{};
+        begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+        vkBeginCommandBuffer(command_buffer, &begin_info);
+    }
+}
+
+UploadBatcher::UploadBatcher(VkDevice device, MemoryAllocator* allocator, const UploadQueues& queues, VkDeviceSize copy_offset_alignment, VkDeviceSize staging_size) :
+    device_(device),
+    allocator_(allocator),
+    queues_(queues),
+    alignment_(std::max(copy_offset_alignment, VkDeviceSize(16))),  // 16 covers the texel size of every format we upload
+    default_staging_size_(staging_size) {
+
+    vk_graphics_pool_ = createPool(device_, queues_.graphics_family);
+    if (vk_graphics_pool_ == VK_NULL_HANDLE) {
+        return;
+    }
+
+    if (usesTransferQueue()) {
+        vk_transfer_pool_ = createPool(device_, queues_.transfer_family);
+        if (vk_transfer_pool_ == VK_NULL_HANDLE) {
+            queues_.transfer_queue = VK_NULL_HANDLE;  // fall back to the graphics queue
+        }
+    }
+
+    if (createContext(current_)) {
+        createStagingChunk(default_staging_size_, current_.staging);
+    }
+}
+
+UploadBatcher::~UploadBatcher() {
+    if (isRecording()) {
+        std::cerr << "Upload batcher destroyed with pending commands!" << std::endl;
+    }
+
+    for (auto& context : pending_) {
+        vkWaitForFences(device_, 1, &context.fence, VK_TRUE, UINT64_MAX);
+        destroyContext(context);
+    }
+    for (auto& context : free_) {
+        destroyContext(context);
+    }
+    destroyContext(current_);
+
+    if (vk_transfer_pool_ != VK_NULL_HANDLE) {
+        vkDestroyCommandPool(device_, vk_transfer_pool_, nullptr);
+    }
+    if (vk_graphics_pool_ != VK_NULL_HANDLE) {
+        vkDestroyCommandPool(device_, vk_graphics_pool_, nullptr);
+    }
+}
+
+void UploadBatcher::beginBatch() {
+    ++batch_depth_;
+}
+
+bool UploadBatcher::endBatch() {
+    if (batch_depth_ == 0) {
+        std::cerr << "UploadBatcher::endBatch called without a matching beginBatch!" << std::endl;
+        return false;
+    }
+
+    if (--batch_depth_ > 0) {
+        return true;
+    }
+
+    return flush();
+}
+
+uint64_t UploadBatcher::endBatchAsync() {
+    if (batch_depth_ == 0) {
+        std::cerr << "UploadBatcher::endBatchAsync called without a matching beginBatch!" << std::endl;
+        return 0;
+    }
+
+    if (--batch_depth_ > 0 || !isRecording()) {
+        return 0;
+    }
+
+    if (!submitCurrent()) {
+        recycleContext(current_);  // nothing of it is in flight, or nothing that could be waited for
+        return 0;
+    }
+
+    // ids are handed out in submission order, anything below next_upload_id_ that isn't pending has completed
+    uint64_t upload_id = next_upload_id_++;
+    current_.id = upload_id;
+
+    // the submitted context stays alive until its fence is signalled, record the next uploads in a fresh one
+    pending_.push_back(std::move(current_));
+    current_ = UploadContext{};
+    if (!free_.empty()) {
+        current_ = std::move(free_.back());
+        free_.pop_back();
+    } else {
+        createContext(current_);
+    }
+
+    return upload_id;
+}
+
+bool UploadBatcher::isComplete(uint64_t upload_id) {
+    if (upload_id == 0 || upload_id >= next_upload_id_) {
+        return false;  // never submitted
+    }
+
+    collectCompleted();
+    return std::none_of(pending_.begin(), pending_.end(), [upload_id](const UploadContext& c) { return c.id == upload_id; });
+}
+
+void UploadBatcher::collectCompleted() {
+    for (auto iter = pending_.begin(); iter != pending_.end();) {
+        if (vkGetFenceStatus(device_, iter->fence) == VK_SUCCESS) {
+            recycleContext(*iter);
+            free_.push_back(std::move(*iter));
+            iter = pending_.erase(iter);
+        } else {
+            ++iter;
+        }
+    }
+}
+
+VkCommandBuffer UploadBatcher::commandBuffer() {
+    if (!current_.graphics_recording) {
+        beginCommandBuffer(current_.graphics_cmd);
+        current_.graphics_recording = true;
+    }
+
+    return current_.graphics_cmd;
+}
+
+VkCommandBuffer UploadBatcher::transferCommandBuffer() {
+    if (!usesTransferQueue()) {
+        return commandBuffer();
+    }
+
+    if (!current_.transfer_recording) {
+        beginCommandBuffer(current_.transfer_cmd);
+        current_.transfer_recording = true;
+    }
+
+    return current_.transfer_cmd;
+}
+
+StagingRegion UploadBatcher::stage(const void* data, VkDeviceSize size) {
+    auto& staging = current_.staging;
+    VkDeviceSize offset = alignUp(current_.staging_head, alignment_);
+
+    if (offset + size > staging.size) {
+        // pending commands may still read from the current chunk, so it can only be released with the context
+        StagingChunk new_chunk;
+        if (!createStagingChunk(std::max(std::max(staging.size * 2, default_staging_size_), alignUp(size, alignment_)), new_chunk)) {
+            return StagingRegion{};
+        }
+
+        if (isRecording()) {
+            current_.retired_staging.push_back(staging);
+        } else {
+            destroyStagingChunk(staging);
+        }
+        staging = new_chunk;
+        offset = 0;
+    }
+
+    memcpy(static_cast<char*>(staging.memory.mapped_data) + offset, data, size);
+    current_.staging_head = offset + size;
+
+    StagingRegion region;
+    region.vk_buffer = staging.vk_buffer;
+    region.offset = offset;
+    return region;
+}
+
+void UploadBatcher::copyToBuffer(const void* data, VkDeviceSize size, VkBuffer dst_buffer, VkDeviceSize dst_offset) {
+    StagingRegion region = stage(data, size);
+    if (!region.isValid()) {
+        std::cerr << "Failed to stage " << size << " bytes for upload!" << std::endl;
+        return;
+    }
+
+    VkBufferCopy copy_region{};
+    copy_region.srcOffset = region.offset;
+    copy_region.dstOffset = dst_offset;
+    copy_region.size = size;
+    vkCmdCopyBuffer(transferCommandBuffer(), region.vk_buffer, dst_buffer, 1, &copy_region);
+
+    if (usesTransferQueue()) {
+        // release the buffer on the transfer queue and acquire it on the graphics queue
+        VkBufferMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+        barrier.srcQueueFamilyIndex = queues_.transfer_family;
+        barrier.dstQueueFamilyIndex = queues_.graphics_family;
+        barrier.buffer = dst_buffer;
+        barrier.offset = dst_offset;
+        barrier.size = size;
+
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = 0;
+        vkCmdPipelineBarrier(current_.transfer_cmd,
+            VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0,
+            0, nullptr,
+            1, &barrier,
+            0, nullptr);
+
+        barrier.srcAccessMask = 0;
+        barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+        vkCmdPipelineBarrier(commandBuffer(),
+            VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0,
+            0, nullptr,
+            1, &barrier,
+            0, nullptr);
+    }
+
+    flushIfNotBatching();
+}
+
+bool UploadBatcher::flushIfNotBatching() {
+    if (isBatching()) {
+        return true;
+    }
+    return flush();
+}
+
+bool UploadBatcher::flush() {
+    if (!isRecording()) {
+        return true;
+    }
+
+    bool result = submitCurrent();
+    if (result) {
+        vkWaitForFences(device_, 1, &current_.fence, VK_TRUE, UINT64_MAX);
+    }
+    recycleContext(current_);
+
+    return result;
+}
+
+bool UploadBatcher::submitCurrent() {
+    bool transfer_submitted = false;
+    if (current_.transfer_recording) {
+        vkEndCommandBuffer(current_.transfer_cmd);
+        current_.transfer_recording = false;
+
+        VkSubmitInfo submit_info{};
+        submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submit_info.commandBufferCount = 1;
+        submit_info.pCommandBuffers = &current_.transfer_cmd;
+        submit_info.signalSemaphoreCount = 1;
+        submit_info.pSignalSemaphores = &current_.transfer_done;
+
+        if (vkQueueSubmit(queues_.transfer_queue, 1, &submit_info, VK_NULL_HANDLE) != VK_SUCCESS) {
+            std::cerr << "Failed to submit upload command buffer to the transfer queue!" << std::endl;
+            // the graphics commands acquire buffers that were never released and would signal the fence for copies
+            // that didn't happen, so the whole context is dropped
+            if (current_.graphics_recording) {
+                vkEndCommandBuffer(current_.graphics_cmd);
+                current_.graphics_recording = false;
+            }
+            return false;
+        }
+        transfer_submitted = true;
+    }
+
+    // it acquires the transferred buffers and signals the fence
+    VkCommandBuffer graphics_cmd = commandBuffer();
+
+    // make every transfer write visible to whatever runs next on the device
+    VkMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+
+    vkCmdPipelineBarrier(graphics_cmd,
+        VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0,
+        1, &barrier,
+        0, nullptr,
+        0, nullptr);
+
+    vkEndCommandBuffer(graphics_cmd);
+    current_.graphics_recording = false;
+
+    VkPipelineStageFlags wait_stage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+    VkSubmitInfo submit_info{};
+    submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submit_info.commandBufferCount = 1;
+    submit_info.pCommandBuffers = &graphics_cmd;
+    if (transfer_submitted) {
+        submit_info.waitSemaphoreCount = 1;
+        submit_info.pWaitSemaphores = &current_.transfer_done;
+        submit_info.pWaitDstStageMask = &wait_stage;
+    }
+
+    if (vkQueueSubmit(queues_.graphics_queue, 1, &submit_info, current_.fence) != VK_SUCCESS) {
+        std::cerr << "Failed to submit upload command buffer!" << std::endl;
+        if (transfer_submitted) {
+            // the copies may still be reading the staging memory, and nothing will wait on their semaphore
+            vkQueueWaitIdle(queues_.transfer_queue);
+            recreateTransferSemaphore(current_);
+        }
+        return false;
+    }
+
+    ++submits_count_;
+    return true;
+}
+
+bool UploadBatcher::createContext(UploadContext& context) {
+    context.graphics_cmd = allocateCommandBuffer(device_, vk_graphics_pool_);
+    if (context.graphics_cmd == VK_NULL_HANDLE) {
+        return false;
+    }
+
+    VkFenceCreateInfo fence_info{};
+    fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+
+    if (vkCreateFence(device_, &fence_info, nullptr, &context.fence) != VK_SUCCESS) {
+        std::cerr << "Failed to create upload fence!" << std::endl;
+        context.fence = VK_NULL_HANDLE;
+        return false;
+    }
+
+    if (usesTransferQueue()) {
+        context.transfer_cmd = allocateCommandBuffer(device_, vk_transfer_pool_);
+
+        VkSemaphoreCreateInfo semaphore_info{};
+        semaphore_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+        if (context.transfer_cmd == VK_NULL_HANDLE || vkCreateSemaphore(device_, &semaphore_info, nullptr, &context.transfer_done) != VK_SUCCESS) {
+            std::cerr << "Failed to create the transfer queue upload context!" << std::endl;
+            context.transfer_done = VK_NULL_HANDLE;
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void UploadBatcher::destroyContext(UploadContext& context) {
+    for (auto& chunk : context.retired_staging) {
+        destroyStagingChunk(chunk);
+    }
+    destroyStagingChunk(context.staging);
+
+    if (context.transfer_done != VK_NULL_HANDLE) {
+        vkDestroySemaphore(device_, context.transfer_done, nullptr);
+    }
+    if (context.fence != VK_NULL_HANDLE) {
+        vkDestroyFence(device_, context.fence, nullptr);
+    }
+    // command buffers are released with their pools
+    context = UploadContext{};
+}
+
+void UploadBatcher::recycleContext(UploadContext& context) {
+    vkResetFences(device_, 1, &context.fence);
+    vkResetCommandBuffer(context.graphics_cmd, 0);
+    if (context.transfer_cmd != VK_NULL_HANDLE) {
+        vkResetCommandBuffer(context.transfer_cmd, 0);
+    }
+
+    context.staging_head = 0;
+    for (auto& chunk : context.retired_staging) {
+        destroyStagingChunk(chunk);
+    }
+    context.retired_staging.clear();
+
+    // don't keep a staging buffer sized for a one-off bulk load around
+    if (context.staging.size > default_staging_size_) {
+        destroyStagingChunk(context.staging);
+    }
+
+    context.id = 0;
+}
+
+void UploadBatcher::recreateTransferSemaphore(UploadContext& context) {
+    // a signalled binary semaphore can't be signalled again, and there's no way to unsignal it from the host
+    vkDestroySemaphore(device_, context.transfer_done, nullptr);
+
+    VkSemaphoreCreateInfo semaphore_info{};
+    semaphore_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+    if (vkCreateSemaphore(device_, &semaphore_info, nullptr, &context.transfer_done) != VK_SUCCESS) {
+        std::cerr << "Failed to recreate the transfer queue upload semaphore!" << std::endl;
+        context.transfer_done = VK_NULL_HANDLE;
+        queues_.transfer_queue = VK_NULL_HANDLE;  // fall back to the graphics queue
+    }
+}
+
+bool UploadBatcher::createStagingChunk(VkDeviceSize size, StagingChunk& chunk) {
+    VkBufferCreateInfo buffer_info{};
+    buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    buffer_info.size = size;
+    buffer_info.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+
+    // buffer copies read it on the transfer queue, image copies on the graphics queue
+    std::array<uint32_t, 2> queue_families = { queues_.transfer_family, queues_.graphics_family };
+    if (usesTransferQueue()) {
+        buffer_info.sharingMode = VK_SHARING_MODE_CONCURRENT;
+        buffer_info.queueFamilyIndexCount = static_cast<uint32_t>(queue_families.size());
+        buffer_info.pQueueFamilyIndices = queue_families.data();
+    } else {
+        buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    }
+
+    if (vkCreateBuffer(device_, &buffer_info, nullptr, &chunk.vk_buffer) != VK_SUCCESS) {
+        std::cerr << "Failed to create staging buffer!" << std::endl;
+        chunk = StagingChunk{};
+        return false;
+    }
+
+    VkMemoryRequirements mem_reqs;
+    vkGetBufferMemoryRequirements(device_, chunk.vk_buffer, &mem_reqs);
+
+    chunk.memory = allocator_->allocate(mem_reqs, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, true);
+    if (!chunk.memory.isValid() || chunk.memory.mapped_data == nullptr) {
+        std::cerr << "Failed to allocate staging buffer memory!" << std::endl;
+        allocator_->free(chunk.memory);
+        vkDestroyBuffer(device_, chunk.vk_buffer, nullptr);
+        chunk = StagingChunk{};
+        return false;
+    }
+
+    vkBindBufferMemory(device_, chunk.vk_buffer, chunk.memory.vk_memory, chunk.memory.offset);
+    chunk.size = size;
+
+    return true;
+}
+
+void UploadBatcher::destroyStagingChunk(StagingChunk& chunk) {
+    if (chunk.vk_buffer != VK_NULL_HANDLE) {
+        vkDestroyBuffer(device_, chunk.vk_buffer, nullptr);
+    }
+    allocator_->free(chunk.memory);
+    chunk = StagingChunk{};
+}
@@ -0,0 +1,109 @@
+/*
+* upload_batcher.hpp
+*
+* Copyright (C) 2021 Riccardo Marson
+*/
+
+#pragma once
+
+#include "common_definitions.hpp"
+
+class MemoryAllocator;
+
+// a range of the staging buffer holding data waiting to be copied to device local memory
+struct StagingRegion {
+    VkBuffer vk_buffer = VK_NULL_HANDLE;
+    VkDeviceSize offset = 0;
+
+    bool isValid() const { return vk_buffer != VK_NULL_HANDLE; }
+};
+
+struct UploadQueues {
+    VkQueue graphics_queue = VK_NULL_HANDLE;
+    uint32_t graphics_family = 0;
+    VkQueue transfer_queue = VK_NULL_HANDLE;  // optional, only set when the device has a dedicated transfer family
+    uint32_t transfer_family = 0;
+};
+
+// Collects staging copies, layout transitions and any other one-off transfer work into a single command buffer.
+// Outside of a batch every command buffer is submitted as soon as the caller is done with it (same as the old
+// single time commands), inside a batch everything is submitted together by endBatch, which waits on a fence once,
+// or by endBatchAsync, which returns straight away and lets the frame loop poll for completion.
+// When the device exposes a transfer-only queue family, buffer copies are recorded on that queue and handed over to
+// the graphics family with a queue family ownership transfer. Image work (layout transitions, mip blits) always runs on
+// the graphics queue.
+class UploadBatcher {
+public:
+    UploadBatcher(VkDevice device, MemoryAllocator* allocator, const UploadQueues& queues, VkDeviceSize copy_offset_alignment, VkDeviceSize staging_size = 16 * 1024 * 1024);
+    ~UploadBatcher();
+
+    bool isValid() const { return current_.graphics_cmd != VK_NULL_HANDLE; }
+    bool isBatching() const { return batch_depth_ > 0; }
+    bool usesTransferQueue() const { return queues_.transfer_queue != VK_NULL_HANDLE; }
+    uint32_t getSubmitsCount() const { return submits_count_; }
+
+    // batches can be nested, only the outermost end call submits
+    void beginBatch();
+    bool endBatch();
+    uint64_t endBatchAsync();  // returns the id to poll with isComplete, 0 if nothing was submitted (or the submit failed)
+
+    bool isComplete(uint64_t upload_id);  // false for ids that were never submitted
+    void collectCompleted();  // recycles the resources of the async uploads that have completed
+
+    VkCommandBuffer commandBuffer();  // graphics queue, starts recording if needed
+    StagingRegion stage(const void* data, VkDeviceSize size);
+    void copyToBuffer(const void* data, VkDeviceSize size, VkBuffer dst_buffer, VkDeviceSize dst_offset = 0);
+
+    bool flushIfNotBatching();
+    bool flush();  // submits the recorded commands and waits for them to complete
+
+private:
+    struct StagingChunk {
+        VkBuffer vk_buffer = VK_NULL_HANDLE;
+        MemoryAllocation memory;
+        VkDeviceSize size = 0;
+    };
+
+    // everything one submission needs. kept alive until its fence is signalled
+    struct UploadContext {
+        uint64_t id = 0;  // assigned when submitted with endBatchAsync
+        VkCommandBuffer graphics_cmd = VK_NULL_HANDLE;
+        VkCommandBuffer transfer_cmd = VK_NULL_HANDLE;
+        VkSemaphore transfer_done = VK_NULL_HANDLE;
+        VkFence fence = VK_NULL_HANDLE;
+        bool graphics_recording = false;
+        bool transfer_recording = false;
+
+        StagingChunk staging;
+        VkDeviceSize staging_head = 0;
+        std::vector<StagingChunk> retired_staging;  // outgrown while commands were pending, released with the context
+    };
+
+    bool createContext(UploadContext& context);
+    void destroyContext(UploadContext& context);
+    void recycleContext(UploadContext& context);
+    void recreateTransferSemaphore(UploadContext& context);
+    VkCommandBuffer transferCommandBuffer();
+    bool submitCurrent();
+    bool isRecording() const { return current_.graphics_recording || current_.transfer_recording; }
+
+    bool createStagingChunk(VkDeviceSize size, StagingChunk& chunk);
+    void destroyStagingChunk(StagingChunk& chunk);
+
+    VkDevice device_;
+    MemoryAllocator* allocator_;
+    UploadQueues queues_;
+    VkDeviceSize alignment_;
+    VkDeviceSize default_staging_size_;
+
+    VkCommandPool vk_graphics_pool_ = VK_NULL_HANDLE;
+    VkCommandPool vk_transfer_pool_ = VK_NULL_HANDLE;
+
+    UploadContext current_;
+    std::list<UploadContext> pending_;
+    std::vector<UploadContext> free_;
+
+    uint32_t batch_depth_ = 0;
+    uint32_t submits_count_ = 0;
+    uint64_t next_upload_id_ = 1;
+};
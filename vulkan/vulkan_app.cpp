@@ -9,17 +9,76 @@
 #define GLFW_INCLUDE_VULKAN
 #include <GLFW/glfw3.h>
 
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+
 // Additional Helper Functions
 namespace {
     void framebufferResizeCallback(GLFWwindow* window, int width, int height) {
         auto app = reinterpret_cast<VulkanApp*>(glfwGetWindowUserPointer(window));
         app->onWindowResized();
     }
+
+    // the whole argument must be a number, anything else is a usage error
+    template<typename T>
+    bool parseNumber(const std::string& option, const char* text, T& value) {
+        const char* end = text + std::strlen(text);
+        auto result = std::from_chars(text, end, value);
+        if (result.ec != std::errc() || result.ptr != end) {
+            std::cerr << "Invalid value for " << option << ": " << text << ", expected an unsigned integer" << std::endl;
+            return false;
+        }
+        return true;
+    }
 }
 
 // VulkanApp
 
-bool VulkanApp::setup() {
+bool VulkanApp::setup(int argc, char** argv) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--headless") {
+            headless_ = true;
+        } else if (arg == "--frames" && i + 1 < argc) {
+            if (!parseNumber(arg, argv[++i], headless_frames_)) {
+                return false;
+            }
+        } else if (arg == "--frames-in-flight" && i + 1 < argc) {
+            uint32_t frames_in_flight = 0;
+            if (!parseNumber(arg, argv[++i], frames_in_flight)) {
+                return false;
+            }
+            vulkan_backend_.setFramesInFlight(frames_in_flight);
+        } else if (arg == "--device" && i + 1 < argc) {
+            vulkan_backend_.setPreferredDevice(argv[++i]);
+        } else if (arg == "--no-bindless") {
+            vulkan_backend_.setBindlessTextures(false);
+        } else if (arg == "--no-indirect") {
+            scene_indirect_draw_ = false;
+        } else if (arg == "--no-culling") {
+            scene_gpu_culling_ = false;
+        } else if (arg == "--trace" && i + 1 < argc) {
+            trace_path_ = argv[++i];
+        }
+    }
+
+    if (!trace_path_.empty()) {
+        CpuProfiler::instance().setEnabled(true);
+        CpuProfiler::instance().setThreadName("Main");
+        vulkan_backend_.setGpuTracing(true);
+    }
+
+    if (headless_) {
+        VkInstance instance;
+        if (!vulkan_backend_.createInstance(0, nullptr, instance)) {
+            return false;
+        }
+
+        vulkan_backend_.setHeadless({ base_width_, base_height_ });
+        return vulkan_backend_.startUp();
+    }
+
     createWindow();
 
     uint32_t glfw_extension_count = 0;
@@ -53,6 +112,10 @@ bool VulkanApp::setup() {
 }
 
 bool VulkanApp::run() {
+    if (!trace_path_.empty()) {
+        vulkan_backend_.enableGpuProfiler();  // the app may enable it again with different settings
+    }
+
     if (!loadAssets()) {
         return false;
     }
@@ -61,15 +124,23 @@ bool VulkanApp::run() {
         return false;
     }
 
+    vulkan_backend_.printMemoryStats();
+
     mainLoop();
 
     vulkan_backend_.waitDeviceIdle();
 
+    if (!trace_path_.empty()) {
+        vulkan_backend_.exportProfilerTrace(trace_path_);
+    }
+
     cleanup();
 
     vulkan_backend_.shutDown();
-    glfwDestroyWindow(window_);
-    glfwTerminate();
+    if (!headless_) {
+        glfwDestroyWindow(window_);
+        glfwTerminate();
+    }
 
     return true;
 }
@@ -100,7 +171,22 @@ void VulkanApp::createWindow() {
 }
 
 void VulkanApp::mainLoop() {
-    while (!glfwWindowShouldClose(window_)) {
+    if (headless_) {
+        auto start_time = std::chrono::steady_clock::now();
+        while (frame_ < headless_frames_ && !quit_requested_) {
+            CPU_PROFILE_SCOPE("VulkanApp::frame");
+            updateScene();
+            drawFrame();
+        }
+        vulkan_backend_.waitDeviceIdle();
+
+        auto elapsed_ms = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start_time).count() * 1e-3;
+        std::cout << "Rendered " << frame_ << " headless frames in " << elapsed_ms << " ms (" << elapsed_ms / std::max(frame_, uint64_t(1)) << " ms/frame)" << std::endl;
+        return;
+    }
+
+    while (!glfwWindowShouldClose(window_) && !quit_requested_) {
+        CPU_PROFILE_SCOPE("VulkanApp::frame");
         glfwPollEvents();
         updateScene();
         drawFrame();
@@ -109,11 +195,18 @@ void VulkanApp::mainLoop() {
 
 bool VulkanApp::recreateSwapChain() {
     int width = 0, height = 0;
-    glfwGetFramebufferSize(window_, &width, &height);
-    while (width == 0 || height == 0) {
-        // window is minimized, paused until it's in foreground again
+    if (headless_) {
+        // there's no window, the offscreen target keeps its size
+        auto extent = vulkan_backend_.getSwapChainExtent();
+        width = static_cast<int>(extent.width);
+        height = static_cast<int>(extent.height);
+    } else {
         glfwGetFramebufferSize(window_, &width, &height);
-        glfwWaitEvents();
+        while (width == 0 || height == 0) {
+            // window is minimized, paused until it's in foreground again
+            glfwGetFramebufferSize(window_, &width, &height);
+            glfwWaitEvents();
+        }
     }
 
     vulkan_backend_.waitDeviceIdle();
@@ -134,6 +227,7 @@ bool VulkanApp::recreateSwapChain() {
 }
 
 void VulkanApp::drawFrame() {
+    CPU_PROFILE_SCOPE("VulkanApp::drawFrame");
     if (force_recreate_swapchain_) {
         if (!recreateSwapChain()) {
             std::cerr << "Failed to re-create swap chain!" << std::endl;
@@ -155,7 +249,11 @@ void VulkanApp::drawFrame() {
 
     ++frame_;
     
-    auto commands = renderFrame(next_swapchain_image);
+    RecordCommandsResult commands;
+    {
+        CPU_PROFILE_SCOPE("VulkanApp::renderFrame");
+        commands = renderFrame(vulkan_backend_.getCurrentFrameIndex(), next_swapchain_image);
+    }
     auto success = std::get<0>(commands);
 
     if (success) {
@@ -12,10 +12,14 @@ struct GLFWwindow;
 
 class VulkanApp {
 public:
-    bool setup();
+    // --headless renders offscreen without creating a window, --frames <n> sets how many frames it renders before exiting
+    // --device <index|name> overrides the automatic device selection, --frames-in-flight <n> trades latency for throughput
+    // --trace <file> records the CPU profiler scopes and the GPU scopes, and writes them as a Chrome trace on exit
+    bool setup(int argc = 0, char** argv = nullptr);
     bool run();
 
     void onWindowResized() { window_resized_ = true; }
+    void requestQuit() { quit_requested_ = true; }  // the main loop exits after the current frame
 
 protected:
     // boilerplate creation and cleanup
@@ -32,7 +36,7 @@ protected:
     virtual bool loadAssets() = 0;
     virtual bool setupScene() = 0;
     virtual void updateScene() = 0;
-    virtual RecordCommandsResult renderFrame(uint32_t swapchain_image) = 0;
+    virtual RecordCommandsResult renderFrame(uint32_t frame_index, uint32_t swapchain_image) = 0;  // frame_index indexes per-frame resources
     virtual void cleanupSwapChainAssets() = 0;
     virtual void cleanup() = 0;
 
@@ -42,9 +46,17 @@ protected:
     GLFWwindow* window_ = nullptr;
     bool window_resized_ = false;
     bool force_recreate_swapchain_ = false;
+    bool quit_requested_ = false;
     std::string window_title_;
 
+    // headless
+    bool headless_ = false;
+    uint64_t headless_frames_ = 1000;
+
     VulkanBackend vulkan_backend_;
+    std::string trace_path_;
+    bool scene_indirect_draw_ = true;  // passed to the scene manager by the apps, --no-indirect turns it off
+    bool scene_gpu_culling_ = true;  // same, --no-culling
     uint64_t frame_ = 0;
     bool hide_ui_ = false;
 };
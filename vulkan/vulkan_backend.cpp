@@ -16,6 +16,9 @@
 #include <optional>
 #include <algorithm>
 #include <thread>
+#include <cstdlib>
+#include <cctype>
+#include <charconv>
 
 // Additional Helper Functions
 
@@ -25,7 +28,7 @@ namespace {
         "VK_LAYER_KHRONOS_validation"
     };
 
-    std::vector<const char*> required_device_ext = {
+    const std::vector<const char*> required_device_ext = {
         VK_KHR_SWAPCHAIN_EXTENSION_NAME
     };
 
@@ -42,6 +45,8 @@ namespace {
     struct QueueFamilyIndices {
         std::optional<uint32_t> graphics_family;
         std::optional<uint32_t> present_family;
+        std::optional<uint32_t> transfer_family;  // dedicated transfer queue, if the device has one
+        std::optional<uint32_t> compute_family;  // dedicated compute queue, if the device has one
 
         bool isValid() {
             return graphics_family.has_value() && present_family.has_value();
@@ -73,14 +78,27 @@ namespace {
         return true;
     }
 
-    bool checkRequiredDeviceExtensions(VkPhysicalDevice device) {
+    // without a window there is nothing to present to, so the swapchain extension is not needed (or available on some ICDs)
+    std::vector<const char*> enabledDeviceExtensions(bool headless) {
+        std::vector<const char*> extensions;
+        for (auto extension : required_device_ext) {
+            if (headless && std::string(extension) == VK_KHR_SWAPCHAIN_EXTENSION_NAME) {
+                continue;
+            }
+            extensions.push_back(extension);
+        }
+        return extensions;
+    }
+
+    bool checkRequiredDeviceExtensions(VkPhysicalDevice device, bool headless) {
         uint32_t extension_count = 0;
         vkEnumerateDeviceExtensionProperties(device, nullptr, &extension_count, nullptr);
 
         std::vector<VkExtensionProperties> available_extensions(extension_count);
         vkEnumerateDeviceExtensionProperties(device, nullptr, &extension_count, available_extensions.data());
 
-        std::set<std::string> required_extensions(required_device_ext.begin(), required_device_ext.end());
+        auto enabled_extensions = enabledDeviceExtensions(headless);
+        std::set<std::string> required_extensions(enabled_extensions.begin(), enabled_extensions.end());
 
         std::cout << "Available Device Extensions:" << std::endl;
 
@@ -113,7 +131,7 @@ namespace {
         return required_extensions.empty();
     }
 
-    bool checkMeshShaderSupport(VkPhysicalDevice device) {
+    bool checkDeviceExtensionSupport(VkPhysicalDevice device, const char* extension_name) {
         uint32_t extension_count;
         vkEnumerateDeviceExtensionProperties(device, nullptr, &extension_count, nullptr);
 
@@ -122,15 +140,168 @@ namespace {
 
         if (std::find_if(available_extensions.begin(), 
                              available_extensions.end(), 
-                             [](const VkExtensionProperties& p) { return std::string(p.extensionName) == VK_NV_MESH_SHADER_EXTENSION_NAME; }) 
+                             [extension_name](const VkExtensionProperties& p) { return std::string(p.extensionName) == extension_name; }) 
                 != available_extensions.end()) {
-            required_device_ext.push_back(VK_NV_MESH_SHADER_EXTENSION_NAME);
             return true;      
         }
 
         return false;
     }
 
+    bool checkMeshShaderSupport(VkPhysicalDevice device) {
+        return checkDeviceExtensionSupport(device, VK_NV_MESH_SHADER_EXTENSION_NAME);
+    }
+
+    // vkCmdDrawIndexedIndirectCountKHR. the extension has no feature bit, unlike the core 1.2 version
+    bool checkDrawIndirectCountSupport(VkPhysicalDevice device) {
+        return checkDeviceExtensionSupport(device, VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
+    }
+
+    bool checkTimelineSemaphoreSupport(VkPhysicalDevice device) {
+        VkPhysicalDeviceTimelineSemaphoreFeatures timeline_features{};
+        timeline_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES;
+        timeline_features.pNext = nullptr;
+
+        VkPhysicalDeviceFeatures2 device_features2{};
+        device_features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+        device_features2.pNext = &timeline_features;
+        vkGetPhysicalDeviceFeatures2(device, &device_features2);
+
+        return timeline_features.timelineSemaphore == VK_TRUE;
+    }
+
+    bool checkHostQueryResetSupport(VkPhysicalDevice device) {
+        VkPhysicalDeviceHostQueryResetFeatures host_query_reset_features{};
+        host_query_reset_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_HOST_QUERY_RESET_FEATURES;
+        host_query_reset_features.pNext = nullptr;
+
+        VkPhysicalDeviceFeatures2 device_features2{};
+        device_features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+        device_features2.pNext = &host_query_reset_features;
+        vkGetPhysicalDeviceFeatures2(device, &device_features2);
+
+        return host_query_reset_features.hostQueryReset == VK_TRUE;
+    }
+
+    // whether shaders can index sampled image arrays with values that differ across invocations (nonuniformEXT)
+    bool checkNonUniformTextureIndexingSupport(VkPhysicalDevice device) {
+        VkPhysicalDeviceDescriptorIndexingFeatures indexing_features{};
+        indexing_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES;
+        indexing_features.pNext = nullptr;
+
+        VkPhysicalDeviceFeatures2 device_features2{};
+        device_features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+        device_features2.pNext = &indexing_features;
+        vkGetPhysicalDeviceFeatures2(device, &device_features2);
+
+        return indexing_features.shaderSampledImageArrayNonUniformIndexing == VK_TRUE;
+    }
+
+    // the size of the bindless textures array, unless the device limits are lower
+    const uint32_t kMaxBindlessTextures = 4096;
+
+    // returns how many textures the bindless array can hold, 0 if the device can't do it
+    uint32_t bindlessTexturesCapacity(VkPhysicalDevice device) {
+        VkPhysicalDeviceDescriptorIndexingFeatures indexing_features{};
+        indexing_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES;
+        indexing_features.pNext = nullptr;
+
+        VkPhysicalDeviceFeatures2 device_features2{};
+        device_features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+        device_features2.pNext = &indexing_features;
+        vkGetPhysicalDeviceFeatures2(device, &device_features2);
+
+        if (indexing_features.runtimeDescriptorArray != VK_TRUE ||
+            indexing_features.descriptorBindingPartiallyBound != VK_TRUE ||
+            indexing_features.descriptorBindingSampledImageUpdateAfterBind != VK_TRUE ||
+            indexing_features.descriptorBindingUpdateUnusedWhilePending != VK_TRUE) {
+            return 0;
+        }
+
+        VkPhysicalDeviceDescriptorIndexingProperties indexing_properties{};
+        indexing_properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_PROPERTIES;
+        indexing_properties.pNext = nullptr;
+
+        VkPhysicalDeviceProperties2 device_properties2{};
+        device_properties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+        device_properties2.pNext = &indexing_properties;
+        vkGetPhysicalDeviceProperties2(device, &device_properties2);
+
+        if (device_properties2.properties.limits.maxBoundDescriptorSets <= BINDLESS_TEXTURES_SET_ID) {
+            return 0;
+        }
+
+        return std::min({ kMaxBindlessTextures,
+            indexing_properties.maxDescriptorSetUpdateAfterBindSampledImages,
+            indexing_properties.maxDescriptorSetUpdateAfterBindSamplers,
+            indexing_properties.maxPerStageDescriptorUpdateAfterBindSampledImages,
+            indexing_properties.maxPerStageDescriptorUpdateAfterBindSamplers });
+    }
+
+    const char* deviceTypeName(VkPhysicalDeviceType type) {
+        switch (type) {
+            case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU: return "discrete";
+            case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU: return "integrated";
+            case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU: return "virtual";
+            case VK_PHYSICAL_DEVICE_TYPE_CPU: return "cpu";
+            default: return "other";
+        }
+    }
+
+    // higher is better. the device type dominates, then device local memory and the optional features break the ties
+    uint64_t scoreDevice(VkPhysicalDevice device) {
+        VkPhysicalDeviceProperties device_properties;
+        vkGetPhysicalDeviceProperties(device, &device_properties);
+
+        VkPhysicalDeviceFeatures device_features;
+        vkGetPhysicalDeviceFeatures(device, &device_features);
+
+        VkPhysicalDeviceMemoryProperties memory_properties;
+        vkGetPhysicalDeviceMemoryProperties(device, &memory_properties);
+
+        uint64_t score = 0;
+        switch (device_properties.deviceType) {
+            case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU: score += 100000; break;
+            case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU: score += 50000; break;
+            case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU: score += 20000; break;
+            case VK_PHYSICAL_DEVICE_TYPE_CPU: score += 10000; break;
+            default: break;
+        }
+
+        VkDeviceSize device_local_bytes = 0;
+        for (uint32_t i = 0; i < memory_properties.memoryHeapCount; ++i) {
+            if (memory_properties.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) {
+                device_local_bytes += memory_properties.memoryHeaps[i].size;
+            }
+        }
+        score += std::min<uint64_t>(device_local_bytes / (64 * 1024 * 1024), 5000);  // one point every 64MB, capped at ~320GB
+
+        if (checkMeshShaderSupport(device)) {
+            score += 1000;
+        }
+        if (device_features.geometryShader) {
+            score += 1000;
+        }
+        if (device_properties.limits.timestampComputeAndGraphics) {
+            score += 500;
+        }
+        if (device_features.samplerAnisotropy) {
+            score += 100;
+        }
+
+        return score;
+    }
+
+    // matches either the index in the enumeration order or a substring of the device name
+    bool deviceMatches(const std::string& selector, uint32_t index, const VkPhysicalDeviceProperties& device_properties) {
+        if (!selector.empty() && std::all_of(selector.begin(), selector.end(), ::isdigit)) {
+            uint32_t selected_index = 0;
+            auto result = std::from_chars(selector.data(), selector.data() + selector.size(), selected_index);
+            return result.ec == std::errc() && selected_index == index;  // too large to be an index matches nothing
+        }
+        return std::string(device_properties.deviceName).find(selector) != std::string::npos;
+    }
+
     QueueFamilyIndices findQueueFamilies(VkPhysicalDevice device, VkSurfaceKHR window_surface) {
         QueueFamilyIndices indices;
 
@@ -144,14 +315,19 @@ namespace {
         for (const auto& queue_family : queue_families) {
             // to keep things simple, grab a queue that can support both graphics and compute
             // note: transfer is implictly supported by both graphics and compute queues
-            if (queue_family.queueFlags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT)) {
+            const VkQueueFlags graphics_and_compute = VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT;
+            if ((queue_family.queueFlags & graphics_and_compute) == graphics_and_compute) {
                 indices.graphics_family = i;
             }
             // we also need a queue that can support drawing to a window (can be the graphics queue or not)
-            VkBool32 presentSupport = false;
-            vkGetPhysicalDeviceSurfaceSupportKHR(device, i, window_surface, &presentSupport);
-            if (presentSupport) {
-                indices.present_family = i;
+            if (window_surface == VK_NULL_HANDLE) {
+                indices.present_family = indices.graphics_family;  // headless, nothing is ever presented
+            } else {
+                VkBool32 presentSupport = false;
+                vkGetPhysicalDeviceSurfaceSupportKHR(device, i, window_surface, &presentSupport);
+                if (presentSupport) {
+                    indices.present_family = i;
+                }
             }
 
             if (indices.isValid()) {
@@ -161,6 +337,24 @@ namespace {
             i++;
         }
 
+        // a family that only does transfers usually maps to the copy engines, so uploads can run alongside rendering
+        for (uint32_t family = 0; family < queue_family_count; ++family) {
+            auto flags = queue_families[family].queueFlags;
+            if ((flags & VK_QUEUE_TRANSFER_BIT) && !(flags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT))) {
+                indices.transfer_family = family;
+                break;
+            }
+        }
+
+        // same for a family that does compute but not graphics, it usually maps to the async compute engines
+        for (uint32_t family = 0; family < queue_family_count; ++family) {
+            auto flags = queue_families[family].queueFlags;
+            if ((flags & VK_QUEUE_COMPUTE_BIT) && !(flags & VK_QUEUE_GRAPHICS_BIT)) {
+                indices.compute_family = family;
+                break;
+            }
+        }
+
         return indices;
     }
 
@@ -219,19 +413,6 @@ namespace {
         }
     }
 
-    uint32_t findMemoryType(uint32_t typeFilter, VkPhysicalDevice physical_device, VkMemoryPropertyFlags properties) {
-        VkPhysicalDeviceMemoryProperties mem_properties;
-        vkGetPhysicalDeviceMemoryProperties(physical_device, &mem_properties);
-
-        for (uint32_t i = 0; i < mem_properties.memoryTypeCount; i++) {
-            if ((typeFilter & (1 << i)) && (mem_properties.memoryTypes[i].propertyFlags & properties) == properties) {
-                return i;
-            }
-        }
-
-        return 0;
-    }
-
     VkSampleCountFlagBits getMaxSupportedSampleCount(VkPhysicalDevice physical_device) {
         VkPhysicalDeviceProperties physicalDeviceProperties;
         vkGetPhysicalDeviceProperties(physical_device, &physicalDeviceProperties);
@@ -302,14 +483,34 @@ bool VulkanBackend::startUp() {
 
 void VulkanBackend::shutDown() {
     cleanupSwapChain();
+    destroyTimelineSemaphores();
     
-    if (timestampQueriesEnabled()) {
-        vkDestroyQueryPool(device_, timestamp_queries_pool_, nullptr);
-    }
+    gpu_profiler_.reset();
 
     vkDestroyCommandPool(device_, command_pool_, nullptr);
+    vkDestroyCommandPool(device_, compute_command_pool_, nullptr);
+    upload_batcher_.reset();
+
+    pipeline_thread_pool_.reset();
+    shader_registry_.reset();
+    auto descriptor_stats = descriptor_allocator_->getStats();
+    std::cout << "Descriptor pools: " << descriptor_stats.pools_count << " (" << descriptor_stats.pool_overflows << " overflows)" << std::endl;
+    descriptor_allocator_.reset();
+    std::cout << "Descriptor writes: " << descriptor_writer_->getWritesCount() << " in " << descriptor_writer_->getFlushesCount() << " calls" << std::endl;
+    descriptor_writer_.reset();
+    bindless_textures_.reset();
+    std::cout << "Descriptor set layouts: " << layout_cache_->getLayoutsCount() << " unique, " << layout_cache_->getHitsCount() << " shared" << std::endl;
+    layout_cache_.reset();
+    pipeline_cache_->printStats();
+    pipeline_cache_->save();
+    pipeline_cache_.reset();
+
+    uniform_ring_.reset();
+    memory_allocator_.reset();
     vkDestroyDevice(device_, nullptr);
-    vkDestroySurfaceKHR(vk_instance_, window_surface_, nullptr);
+    if (window_surface_ != VK_NULL_HANDLE) {
+        vkDestroySurfaceKHR(vk_instance_, window_surface_, nullptr);
+    }
     vkDestroyInstance(vk_instance_, nullptr);
 
     swap_chain_images_.clear();
@@ -327,8 +528,8 @@ void VulkanBackend::waitGraphicsQueueIdle() const {
     vkQueueWaitIdle(graphics_queue_);
 }
 
-std::shared_ptr<ShaderModule> VulkanBackend::createShaderModule(const std::string& name) const {
-    return ShaderModule::createShaderModule(name, device_);
+std::shared_ptr<const ShaderModule> VulkanBackend::loadShaderModule(const std::string& name, const std::string& spirv_file_path) {
+    return shader_registry_->load(name, spirv_file_path);
 }
 
 std::shared_ptr<Texture> VulkanBackend::createTexture(const std::string& name) {
@@ -375,6 +576,58 @@ std::vector<VkCommandBuffer> VulkanBackend::createSecondaryCommandBuffers(uint32
     return secondary_cmd_buffers;
 }
 
+std::vector<VkCommandBuffer> VulkanBackend::createComputeCommandBuffers(uint32_t count) const {
+    std::vector<VkCommandBuffer> cmd_buffers(count);
+
+    VkCommandBufferAllocateInfo alloc_info{};
+    alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    alloc_info.commandPool = compute_command_pool_;
+    alloc_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    alloc_info.commandBufferCount = count;
+
+    if (vkAllocateCommandBuffers(device_, &alloc_info, cmd_buffers.data()) != VK_SUCCESS) {
+        std::cerr << "Failed to allocate compute command buffers!" << std::endl;
+        cmd_buffers.clear();
+        return cmd_buffers;
+    }
+
+    return cmd_buffers;
+}
+
+VkCommandBuffer VulkanBackend::getFrameCommandBuffer() {
+    auto& frame = frames_[active_frame_];
+
+    if (frame.used_command_buffers == frame.command_buffers.size()) {
+        VkCommandBufferAllocateInfo alloc_info{};
+        alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        alloc_info.commandPool = frame.command_pool;
+        alloc_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        alloc_info.commandBufferCount = 1;
+
+        VkCommandBuffer command_buffer;
+        if (vkAllocateCommandBuffers(device_, &alloc_info, &command_buffer) != VK_SUCCESS) {
+            std::cerr << "Failed to allocate frame command buffer!" << std::endl;
+            return VK_NULL_HANDLE;
+        }
+        frame.command_buffers.push_back(command_buffer);
+    }
+
+    return frame.command_buffers[frame.used_command_buffers++];
+}
+
+void VulkanBackend::deferDestruction(std::function<void()> destroy) {
+    frames_[active_frame_].deferred_destruction.push_back(std::move(destroy));
+}
+
+void VulkanBackend::destroyBufferDeferred(Buffer& buffer) {
+    if (buffer.vk_buffer == VK_NULL_HANDLE) {
+        return;
+    }
+
+    deferDestruction([this, buffer]() mutable { destroyBuffer(buffer); });
+    buffer = Buffer{};
+}
+
 void VulkanBackend::resetCommandBuffers(std::vector<VkCommandBuffer>& cmd_buffers) const {
     for (auto& buffer : cmd_buffers) {
         vkResetCommandBuffer(buffer, 0);
@@ -386,33 +639,146 @@ void VulkanBackend::freeCommandBuffers(std::vector<VkCommandBuffer>& cmd_buffers
     cmd_buffers.clear();
 }
 
+void VulkanBackend::freeComputeCommandBuffers(std::vector<VkCommandBuffer>& cmd_buffers) const {
+    vkFreeCommandBuffers(device_, compute_command_pool_, static_cast<uint32_t>(cmd_buffers.size()), cmd_buffers.data());
+    cmd_buffers.clear();
+}
+
+void VulkanBackend::releaseToCompute(VkCommandBuffer graphics_cmd, const QueueSharedResources& resources) const {
+    recordOwnershipTransfer(graphics_cmd, resources, graphics_family_, compute_family_, true);
+}
+
+void VulkanBackend::acquireFromGraphics(VkCommandBuffer compute_cmd, const QueueSharedResources& resources) const {
+    recordOwnershipTransfer(compute_cmd, resources, graphics_family_, compute_family_, false);
+}
+
+void VulkanBackend::releaseToGraphics(VkCommandBuffer compute_cmd, const QueueSharedResources& resources) const {
+    recordOwnershipTransfer(compute_cmd, resources, compute_family_, graphics_family_, true);
+}
+
+void VulkanBackend::acquireFromCompute(VkCommandBuffer graphics_cmd, const QueueSharedResources& resources) const {
+    recordOwnershipTransfer(graphics_cmd, resources, compute_family_, graphics_family_, false);
+}
+
+void VulkanBackend::recordOwnershipTransfer(VkCommandBuffer command_buffer, const QueueSharedResources& resources, uint32_t src_family, uint32_t dst_family, bool release) const {
+    if (!hasDedicatedComputeQueue()) {
+        return;
+    }
+
+    // the release makes the writes available, the acquire makes them visible. the other half of each barrier is ignored
+    VkAccessFlags src_access = release ? VK_ACCESS_MEMORY_WRITE_BIT : 0;
+    VkAccessFlags dst_access = release ? 0 : VK_ACCESS_MEMORY_READ_BIT | VK_ACCESS_MEMORY_WRITE_BIT;
+    VkPipelineStageFlags src_stage = release ? VK_PIPELINE_STAGE_ALL_COMMANDS_BIT : VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+    VkPipelineStageFlags dst_stage = release ? VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT : VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+
+    std::vector<VkBufferMemoryBarrier> buffer_barriers;
+    for (auto buffer : resources.buffers) {
+        VkBufferMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+        barrier.srcAccessMask = src_access;
+        barrier.dstAccessMask = dst_access;
+        barrier.srcQueueFamilyIndex = src_family;
+        barrier.dstQueueFamilyIndex = dst_family;
+        barrier.buffer = buffer;
+        barrier.offset = 0;
+        barrier.size = VK_WHOLE_SIZE;
+        buffer_barriers.push_back(barrier);
+    }
+
+    std::vector<VkImageMemoryBarrier> image_barriers;
+    for (const auto& image : resources.images) {
+        VkImageMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.srcAccessMask = src_access;
+        barrier.dstAccessMask = dst_access;
+        barrier.oldLayout = image.second;
+        barrier.newLayout = image.second;
+        barrier.srcQueueFamilyIndex = src_family;
+        barrier.dstQueueFamilyIndex = dst_family;
+        barrier.image = image.first;
+        barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        barrier.subresourceRange.baseMipLevel = 0;
+        barrier.subresourceRange.levelCount = 1;
+        barrier.subresourceRange.baseArrayLayer = 0;
+        barrier.subresourceRange.layerCount = 1;
+        image_barriers.push_back(barrier);
+    }
+
+    vkCmdPipelineBarrier(command_buffer, src_stage, dst_stage, 0,
+        0, nullptr,
+        static_cast<uint32_t>(buffer_barriers.size()), buffer_barriers.data(),
+        static_cast<uint32_t>(image_barriers.size()), image_barriers.data());
+}
+
 std::unique_ptr<RenderPass> VulkanBackend::createRenderPass(const std::string& name) {
     return std::unique_ptr<RenderPass>(new RenderPass(device_, this, name));
 }
 
  std::unique_ptr<GraphicsPipeline> VulkanBackend::createGraphicsPipeline(const std::string& name) {
-   return std::unique_ptr<GraphicsPipeline>(new GraphicsPipeline(device_, name));
+   return std::unique_ptr<GraphicsPipeline>(new GraphicsPipeline(device_, pipeline_cache_.get(), layout_cache_.get(), name));
 }
 
 std::unique_ptr<MeshPipeline> VulkanBackend::createMeshPipeline(const std::string& name) {
-    if (mesh_shader_available_) {
-        return std::unique_ptr<MeshPipeline>(new MeshPipeline(device_, name));
+    if (device_capabilities_.mesh_shader) {
+        return std::unique_ptr<MeshPipeline>(new MeshPipeline(device_, pipeline_cache_.get(), layout_cache_.get(), name));
     }
     return std::unique_ptr<MeshPipeline>();
 }
 
+PipelineBuild VulkanBackend::buildPipelineAsync(GraphicsPipeline& pipeline, const GraphicsPipelineConfig& config) {
+    // the config is copied, the pipeline is only touched by the worker until the build is finished
+    return PipelineBuild(pipeline_thread_pool_->submit([&pipeline, config]() { CPU_PROFILE_SCOPE("Build pipeline"); return pipeline.buildPipeline(config); }));
+}
+
+PipelineBuild VulkanBackend::buildPipelineAsync(MeshPipeline& pipeline, const MeshPipelineConfig& config) {
+    return PipelineBuild(pipeline_thread_pool_->submit([&pipeline, config]() { CPU_PROFILE_SCOPE("Build pipeline"); return pipeline.buildPipeline(config); }));
+}
+
+PipelineBuild VulkanBackend::buildPipelineAsync(ComputePipeline& pipeline, const ComputePipelineConfig& config) {
+    return PipelineBuild(pipeline_thread_pool_->submit([&pipeline, config]() { CPU_PROFILE_SCOPE("Build pipeline"); return pipeline.buildPipeline(config); }));
+}
+
+bool VulkanBackend::finishPipelineBuilds(std::vector<PipelineBuild>& builds) {
+    CPU_PROFILE_SCOPE("VulkanBackend::finishPipelineBuilds");
+    // the continuations write the descriptor sets of their pipelines, nothing binds them until all are finished
+    beginDescriptorBatch();
+    bool success = true;
+    for (auto& build : builds) {
+        success = build.finish() && success;
+    }
+    builds.clear();
+    endDescriptorBatch();
+    return success;
+}
+
 std::unique_ptr<ComputePipeline> VulkanBackend::createComputePipeline(const std::string& name) {
-    return std::unique_ptr<ComputePipeline>(new ComputePipeline(device_, name));
+    return std::unique_ptr<ComputePipeline>(new ComputePipeline(device_, pipeline_cache_.get(), layout_cache_.get(), name));
 }
 
 VkResult VulkanBackend::startNextFrame(uint32_t& swapchain_image, bool window_resized) {
+    CPU_PROFILE_SCOPE("VulkanBackend::startNextFrame");
     if (window_resized) {
         return VK_ERROR_OUT_OF_DATE_KHR;
     }
 
-    vkWaitForFences(device_, 1, &in_flight_fences_[active_swapchain_image_], VK_TRUE, UINT64_MAX);
+    auto& frame = frames_[active_frame_];
+    vkWaitForFences(device_, 1, &frame.in_flight_fence, VK_TRUE, UINT64_MAX);
+    upload_batcher_->collectCompleted();
+
+    // the GPU is done with everything this frame recorded last time around
+    runDeferredDestruction(frame);
+    vkResetCommandPool(device_, frame.command_pool, 0);
+    frame.used_command_buffers = 0;
+    frame.transient_descriptors->reset();
+
+    if (headless_) {
+        // offscreen images are handed out in order, images_in_flight_ takes care of reuse
+        swapchain_image = next_offscreen_image_;
+        next_offscreen_image_ = (next_offscreen_image_ + 1) % static_cast<uint32_t>(swap_chain_images_.size());
+        return VK_SUCCESS;
+    }
 
-    VkResult result = vkAcquireNextImageKHR(device_, swap_chain_, UINT64_MAX, image_available_semaphores_[active_swapchain_image_], VK_NULL_HANDLE, &swapchain_image);
+    VkResult result = vkAcquireNextImageKHR(device_, swap_chain_, UINT64_MAX, frame.image_available, VK_NULL_HANDLE, &swapchain_image);
 
     auto needs_rebuilding = (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR);
     auto error = (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR);
@@ -428,28 +794,50 @@ VkResult VulkanBackend::startNextFrame(uint32_t& swapchain_image, bool window_re
 }
 
 VkResult VulkanBackend::submitGraphicsCommands(uint32_t swapchain_image, const std::vector<VkCommandBuffer>& command_buffers) {
+    CPU_PROFILE_SCOPE("VulkanBackend::submitGraphicsCommands");
     // Check if a previous frame is using this image (i.e. there is its fence to wait on)
     if (images_in_flight_[swapchain_image] != VK_NULL_HANDLE) {
         vkWaitForFences(device_, 1, &images_in_flight_[swapchain_image], VK_TRUE, UINT64_MAX);
     }
     // Mark the image as now being in use by this frame
-    images_in_flight_[swapchain_image] = in_flight_fences_[active_swapchain_image_];
+    auto& frame = frames_[active_frame_];
+    images_in_flight_[swapchain_image] = frame.in_flight_fence;
 
     VkSubmitInfo submit_info{};
     submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
 
-    std::vector<VkSemaphore> wait_semaphores = { image_available_semaphores_[active_swapchain_image_] };
-    std::vector<VkPipelineStageFlags> wait_stages_mask = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
-    std::vector<VkSemaphore> signal_semaphores = { render_finished_semaphores_[active_swapchain_image_] };
+    std::vector<VkSemaphore> wait_semaphores;
+    std::vector<VkPipelineStageFlags> wait_stages_mask;
+    std::vector<VkSemaphore> signal_semaphores;
+
+    if (!headless_) {
+        wait_semaphores.push_back(frame.image_available);
+        wait_stages_mask.push_back(VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT);
+        signal_semaphores.push_back(frame.render_finished);
+    }
 
-    if (graphics_should_wait_for_compute_) {
-        wait_semaphores.push_back(compute_finished_semaphore_);
-        wait_stages_mask.push_back(VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT);
+    // values for the binary semaphores are ignored, but the arrays have to match the semaphore arrays
+    std::vector<uint64_t> wait_values(wait_semaphores.size(), 0);
+    std::vector<uint64_t> signal_values(signal_semaphores.size(), 0);
 
-        signal_semaphores.push_back(drawing_finished_sempahore_);
-        graphics_should_wait_for_compute_ = false;
+    if (compute_timeline_value_ > compute_value_waited_by_graphics_) {
+        wait_semaphores.push_back(compute_timeline_);
+        wait_stages_mask.push_back(VK_PIPELINE_STAGE_ALL_COMMANDS_BIT);
+        wait_values.push_back(compute_timeline_value_);
     }
+
+    const uint64_t graphics_value = graphics_timeline_value_ + 1;
+    signal_semaphores.push_back(graphics_timeline_);
+    signal_values.push_back(graphics_value);
+
+    VkTimelineSemaphoreSubmitInfo timeline_info{};
+    timeline_info.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+    timeline_info.waitSemaphoreValueCount = static_cast<uint32_t>(wait_values.size());
+    timeline_info.pWaitSemaphoreValues = wait_values.data();
+    timeline_info.signalSemaphoreValueCount = static_cast<uint32_t>(signal_values.size());
+    timeline_info.pSignalSemaphoreValues = signal_values.data();
    
+    submit_info.pNext = &timeline_info;
     submit_info.waitSemaphoreCount = static_cast<uint32_t>(wait_semaphores.size());
     submit_info.pWaitSemaphores = wait_semaphores.data();
     submit_info.pWaitDstStageMask = wait_stages_mask.data();
@@ -458,19 +846,35 @@ VkResult VulkanBackend::submitGraphicsCommands(uint32_t swapchain_image, const s
     submit_info.signalSemaphoreCount = static_cast<uint32_t>(signal_semaphores.size());
     submit_info.pSignalSemaphores = signal_semaphores.data();
 
-    vkResetFences(device_, 1, &in_flight_fences_[active_swapchain_image_]);
+    vkResetFences(device_, 1, &frame.in_flight_fence);
 
-    VkResult result = vkQueueSubmit(graphics_queue_, 1, &submit_info, in_flight_fences_[active_swapchain_image_]);
+    VkResult result = vkQueueSubmit(graphics_queue_, 1, &submit_info, frame.in_flight_fence);
     if (result != VK_SUCCESS) {
         std::cerr << "Failed to submit draw command buffer!" << std::endl;
         return result;
     }
 
+    graphics_timeline_value_ = graphics_value;
+    compute_value_waited_by_graphics_ = compute_timeline_value_;
+    frame.graphics_value = graphics_value;
+
+    // this frame's uniforms now belong to the GPU, start writing the next slice
+    uniform_ring_->nextFrame();
+    if (gpu_profiler_) {
+        gpu_profiler_->nextFrame(compute_timeline_value_);
+    }
+
+    if (headless_) {
+        active_frame_ = (active_frame_ + 1) % max_frames_in_flight_;
+        ++current_frame_;
+        return result;
+    }
+
     VkPresentInfoKHR present_info{};
     present_info.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
 
     present_info.waitSemaphoreCount = 1;
-    present_info.pWaitSemaphores = &render_finished_semaphores_[active_swapchain_image_];
+    present_info.pWaitSemaphores = &frame.render_finished;
 
     VkSwapchainKHR swap_chains[] = { swap_chain_ };
     present_info.swapchainCount = 1;
@@ -488,142 +892,207 @@ VkResult VulkanBackend::submitGraphicsCommands(uint32_t swapchain_image, const s
         return result;
     }
 
-    active_swapchain_image_ = (active_swapchain_image_ + 1) % max_frames_in_flight_;
+    active_frame_ = (active_frame_ + 1) % max_frames_in_flight_;
     ++current_frame_;
 
     return result;
 }
 
-VkResult VulkanBackend::submitComputeCommands(const std::vector<VkCommandBuffer>& command_buffers) {
-    VkSubmitInfo submit_info{};
-    submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+VkResult VulkanBackend::submitComputeCommands(const std::vector<VkCommandBuffer>& command_buffers, std::optional<uint64_t> wait_graphics_value) {
+    CPU_PROFILE_SCOPE("VulkanBackend::submitComputeCommands");
+    std::vector<VkSemaphore> wait_semaphores;
+    std::vector<VkPipelineStageFlags> wait_stages_mask;
+    std::vector<uint64_t> wait_values;
 
-    VkSemaphore wait_semaphores[] = { drawing_finished_sempahore_ };
-    VkPipelineStageFlags wait_stages[] = { VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT };
+    // chain after the previous compute step, so consecutive submissions never overlap
+    if (compute_timeline_value_ > 0) {
+        wait_semaphores.push_back(compute_timeline_);
+        wait_stages_mask.push_back(VK_PIPELINE_STAGE_ALL_COMMANDS_BIT);
+        wait_values.push_back(compute_timeline_value_);
+    }
 
-    if (current_frame_ > 0) {
-        submit_info.waitSemaphoreCount = 1;
-        submit_info.pWaitSemaphores = wait_semaphores;
-        submit_info.pWaitDstStageMask = wait_stages;
-    } else {
-        // on the first frame don't wait for the graphics queue as it's not been dispatched yet
-        submit_info.waitSemaphoreCount = 0;
-        submit_info.pWaitSemaphores = nullptr;
-        submit_info.pWaitDstStageMask = nullptr;
+    // waiting for value 0 is a no-op, which also covers the first frame when nothing has been drawn yet
+    uint64_t graphics_value = wait_graphics_value.value_or(graphics_timeline_value_);
+    if (graphics_value > 0) {
+        wait_semaphores.push_back(graphics_timeline_);
+        wait_stages_mask.push_back(VK_PIPELINE_STAGE_ALL_COMMANDS_BIT);
+        wait_values.push_back(graphics_value);
     }
 
+    const uint64_t compute_value = compute_timeline_value_ + 1;
+
+    VkTimelineSemaphoreSubmitInfo timeline_info{};
+    timeline_info.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+    timeline_info.waitSemaphoreValueCount = static_cast<uint32_t>(wait_values.size());
+    timeline_info.pWaitSemaphoreValues = wait_values.data();
+    timeline_info.signalSemaphoreValueCount = 1;
+    timeline_info.pSignalSemaphoreValues = &compute_value;
+
+    VkSubmitInfo submit_info{};
+    submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submit_info.pNext = &timeline_info;
+    submit_info.waitSemaphoreCount = static_cast<uint32_t>(wait_semaphores.size());
+    submit_info.pWaitSemaphores = wait_semaphores.data();
+    submit_info.pWaitDstStageMask = wait_stages_mask.data();
     submit_info.commandBufferCount = static_cast<uint32_t>(command_buffers.size());
     submit_info.pCommandBuffers = command_buffers.data();
-
-    VkSemaphore signal_semaphores[] = { compute_finished_semaphore_ };
     submit_info.signalSemaphoreCount = 1;
-    submit_info.pSignalSemaphores = signal_semaphores;
+    submit_info.pSignalSemaphores = &compute_timeline_;
 
-    graphics_should_wait_for_compute_ = true;
     VkResult result = vkQueueSubmit(compute_queue_, 1, &submit_info, VK_NULL_HANDLE);
     if (result != VK_SUCCESS) {
         std::cerr << "Failed to submit compute command buffer!" << std::endl;
         return result;
     }
 
+    compute_timeline_value_ = compute_value;
+
     return result;
 }
 
-VkCommandBuffer VulkanBackend::beginSingleTimeCommands() {
-    VkCommandBufferAllocateInfo alloc_info{};
-    alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-    alloc_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-    alloc_info.commandPool = command_pool_;
-    alloc_info.commandBufferCount = 1;
+uint64_t VulkanBackend::getCompletedGraphicsValue() const {
+    uint64_t value = 0;
+    vkGetSemaphoreCounterValue(device_, graphics_timeline_, &value);
+    return value;
+}
 
-    VkCommandBuffer command_buffer;
-    vkAllocateCommandBuffers(device_, &alloc_info, &command_buffer);
+uint64_t VulkanBackend::getCompletedComputeValue() const {
+    uint64_t value = 0;
+    vkGetSemaphoreCounterValue(device_, compute_timeline_, &value);
+    return value;
+}
+
+bool VulkanBackend::waitForGraphicsValue(uint64_t value, uint64_t timeout) const {
+    return waitForTimelineValue(graphics_timeline_, value, timeout);
+}
 
-    VkCommandBufferBeginInfo begin_info{};
-    begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-    begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+bool VulkanBackend::waitForComputeValue(uint64_t value, uint64_t timeout) const {
+    return waitForTimelineValue(compute_timeline_, value, timeout);
+}
 
-    vkBeginCommandBuffer(command_buffer, &begin_info);
+bool VulkanBackend::waitForTimelineValue(VkSemaphore timeline, uint64_t value, uint64_t timeout) const {
+    VkSemaphoreWaitInfo wait_info{};
+    wait_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+    wait_info.semaphoreCount = 1;
+    wait_info.pSemaphores = &timeline;
+    wait_info.pValues = &value;
 
-    return command_buffer;
+    return vkWaitSemaphores(device_, &wait_info, timeout) == VK_SUCCESS;
 }
 
-void VulkanBackend::endSingleTimeCommands(VkCommandBuffer command_buffer) {
-    vkEndCommandBuffer(command_buffer);
+VkCommandBuffer VulkanBackend::beginSingleTimeCommands() {
+    return upload_batcher_->commandBuffer();
+}
 
-    VkSubmitInfo submit_info{};
-    submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-    submit_info.commandBufferCount = 1;
-    submit_info.pCommandBuffers = &command_buffer;
+void VulkanBackend::endSingleTimeCommands() {
+    upload_batcher_->flushIfNotBatching();
+}
 
-    vkQueueSubmit(graphics_queue_, 1, &submit_info, VK_NULL_HANDLE);
-    vkQueueWaitIdle(graphics_queue_);
+void VulkanBackend::beginUploadBatch() {
+    upload_batcher_->beginBatch();
+}
 
-    vkFreeCommandBuffers(device_, command_pool_, 1, &command_buffer);
+bool VulkanBackend::endUploadBatch() {
+    return upload_batcher_->endBatch();
 }
 
-bool VulkanBackend::enableTimestampQueries(uint32_t queries_count) {
-    VkPhysicalDeviceProperties device_properties;
-    vkGetPhysicalDeviceProperties(physical_device_, &device_properties);
-    if (!device_properties.limits.timestampComputeAndGraphics) {
-        std::cerr << device_properties.deviceName << " does not support timestamps." << std::endl;
+uint64_t VulkanBackend::endUploadBatchAsync() {
+    return upload_batcher_->endBatchAsync();
+}
+
+bool VulkanBackend::isUploadComplete(uint64_t upload_id) {
+    return upload_batcher_->isComplete(upload_id);
+}
+
+bool VulkanBackend::enableGpuProfiler(uint32_t scopes_per_frame, bool pipeline_statistics) {
+    if (!device_capabilities_.timestamps || !device_capabilities_.host_query_reset) {
+        std::cerr << "The selected device does not support timestamps on all queues, or resetting queries from the host." << std::endl;
         return false;
     }
 
-    VkQueryPoolCreateInfo info{};
-    info.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
-    info.pNext = nullptr;
-    info.flags = 0;
-    info.queryType = VK_QUERY_TYPE_TIMESTAMP;
-    info.queryCount = queries_count;
-    info.pipelineStatistics = 0;
+    VkPhysicalDeviceProperties device_properties;
+    vkGetPhysicalDeviceProperties(physical_device_, &device_properties);
 
-    VkResult result = vkCreateQueryPool(device_, &info, nullptr, &timestamp_queries_pool_);
-    if (result != VK_SUCCESS) {
-        std::cerr << "Failed to create Timestamp Query Pool!" << std::endl;
-        return false;
+    VkQueryPipelineStatisticFlags graphics_statistics = 0;
+    if (pipeline_statistics && device_capabilities_.pipeline_statistics) {
+        graphics_statistics = VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_VERTICES_BIT |
+            VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_PRIMITIVES_BIT |
+            VK_QUERY_PIPELINE_STATISTIC_VERTEX_SHADER_INVOCATIONS_BIT |
+            VK_QUERY_PIPELINE_STATISTIC_CLIPPING_INVOCATIONS_BIT |
+            VK_QUERY_PIPELINE_STATISTIC_CLIPPING_PRIMITIVES_BIT |
+            VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT;
+        if (device_capabilities_.geometry_shader) {
+            graphics_statistics |= VK_QUERY_PIPELINE_STATISTIC_GEOMETRY_SHADER_INVOCATIONS_BIT | VK_QUERY_PIPELINE_STATISTIC_GEOMETRY_SHADER_PRIMITIVES_BIT;
+        }
+    } else if (pipeline_statistics) {
+        std::cerr << "The selected device does not support pipeline statistics queries." << std::endl;
     }
 
-    timestamp_queries_ = queries_count;
-    timestamp_period_ = device_properties.limits.timestampPeriod;
+    // one more slice than frames in flight: when a slice comes around again the fence of the frame that used it
+    // has been waited on, so reading it back doesn't stall
+    gpu_profiler_ = std::make_unique<GpuProfiler>(device_, compute_timeline_, device_properties.limits.timestampPeriod, max_frames_in_flight_ + 1, scopes_per_frame, graphics_statistics);
+    if (!gpu_profiler_->isValid()) {
+        gpu_profiler_.reset();
+        return false;
+    }
 
+    gpu_profiler_->setTracing(gpu_tracing_);
     return true;
 }
 
-void VulkanBackend::writeTimestampQuery(VkCommandBuffer& command_buffer, VkPipelineStageFlagBits stage, uint32_t query_num) {
-    if (timestampQueriesEnabled()) {
-        vkCmdWriteTimestamp(command_buffer, stage, timestamp_queries_pool_, query_num);
+void VulkanBackend::setGpuTracing(bool tracing) {
+    gpu_tracing_ = tracing;
+    if (gpu_profiler_) {
+        gpu_profiler_->setTracing(tracing);
     }
 }
 
-std::vector<float> VulkanBackend::retrieveTimestampQueries(bool should_wait, int max_tries) {
-    if (!timestampQueriesEnabled()) {
-        return std::vector<float>();
+bool VulkanBackend::exportProfilerTrace(const std::string& path) {
+    std::vector<std::pair<std::string, std::vector<TraceEvent>>> gpu_tracks;
+    if (gpu_profiler_) {
+        // everything that was submitted is complete, the slices not read back yet can be collected straight away
+        vkDeviceWaitIdle(device_);
+        gpu_profiler_->collectAll();
+        if (calibrateGpuClock()) {
+            gpu_tracks.emplace_back("GPU", gpu_profiler_->getTraceEvents());
+        }
     }
 
-    auto result_ms = tryRetrieveTimestampQueries();
+    return CpuProfiler::instance().exportChromeTrace(path, gpu_tracks);
+}
 
-    auto counter = 0;
-    if (should_wait && result_ms.empty()) {
-        while (result_ms.empty() && counter < max_tries) {
-            result_ms = tryRetrieveTimestampQueries();
-            std::this_thread::sleep_for(std::chrono::microseconds(5));
-            ++counter;
-        }
+bool VulkanBackend::calibrateGpuClock() {
+    // a timestamp written by a one-off submission is matched with the CPU times around it. the clocks drift apart
+    // slowly, calibrating right before exporting keeps the error small over the events in the trace
+    auto command_buffer = beginSingleTimeCommands();
+    gpu_profiler_->writeCalibrationTimestamp(command_buffer);
+    auto cpu_before = CpuProfiler::now();
+    endSingleTimeCommands();
+    auto cpu_after = CpuProfiler::now();
+
+    return gpu_profiler_->calibrate(cpu_before, cpu_after);
+}
+
+void VulkanBackend::beginGpuScope(VkCommandBuffer command_buffer, const std::string& name, PipelineStatisticsType statistics, VkPipelineStageFlagBits stage) {
+    if (gpu_profiler_) {
+        gpu_profiler_->beginScope(command_buffer, name, statistics, stage);
     }
-    
-    return result_ms;
 }
 
-void VulkanBackend::resetAllTimestampQueries(VkCommandBuffer& command_buffer) {
-    if (timestampQueriesEnabled()) {
-        vkCmdResetQueryPool(command_buffer, timestamp_queries_pool_, 0, timestamp_queries_);
+void VulkanBackend::endGpuScope(VkCommandBuffer command_buffer, const std::string& name, VkPipelineStageFlagBits stage) {
+    if (gpu_profiler_) {
+        gpu_profiler_->endScope(command_buffer, name, stage);
     }
 }
 
-void VulkanBackend::resetTimestampQueries(VkCommandBuffer& command_buffer, uint32_t first, uint32_t count) {
-    if (timestampQueriesEnabled()) {
-        vkCmdResetQueryPool(command_buffer, timestamp_queries_pool_, first, count);
+const GpuTimings& VulkanBackend::getGpuTimings() const {
+    static const GpuTimings no_timings;
+    return gpu_profiler_ ? gpu_profiler_->getTimings() : no_timings;
+}
+
+void VulkanBackend::clearGpuTimings() {
+    if (gpu_profiler_) {
+        gpu_profiler_->clearTimings();
     }
 }
 
@@ -646,6 +1115,9 @@ bool VulkanBackend::initVulkan() {
     if (!createSyncObjects()) {
         return false;
     }
+    if (!createTimelineSemaphores()) {
+        return false;
+    }
     return true;
 }
 
@@ -660,12 +1132,34 @@ bool VulkanBackend::selectDevice() {
     std::vector<VkPhysicalDevice> devices(device_count);
     vkEnumeratePhysicalDevices(vk_instance_, &device_count, devices.data());
 
-    for (const auto& device : devices) {
-        if (isDeviceSuitable(device)) {
-            physical_device_ = device;
-            max_msaa_samples_ = getMaxSupportedSampleCount(device);
-            mesh_shader_available_ = checkMeshShaderSupport(device);
-            break;
+    // the environment variable wins over the default, an explicit setPreferredDevice wins over both
+    std::string selector = preferred_device_;
+    const char* env_selector = std::getenv("VULKAN_EXPERIMENTS_DEVICE");
+    if (selector.empty() && env_selector != nullptr) {
+        selector = env_selector;
+    }
+
+    uint64_t best_score = 0;
+    VkPhysicalDevice preferred_device = VK_NULL_HANDLE;
+
+    for (uint32_t i = 0; i < device_count; ++i) {
+        VkPhysicalDeviceProperties device_properties;
+        vkGetPhysicalDeviceProperties(devices[i], &device_properties);
+
+        if (!isDeviceSuitable(devices[i])) {
+            std::cout << "Device " << i << ": " << device_properties.deviceName << " (" << deviceTypeName(device_properties.deviceType) << ") is not suitable" << std::endl;
+            continue;
+        }
+
+        auto score = scoreDevice(devices[i]);
+        std::cout << "Device " << i << ": " << device_properties.deviceName << " (" << deviceTypeName(device_properties.deviceType) << ") score " << score << std::endl;
+
+        if (physical_device_ == VK_NULL_HANDLE || score > best_score) {
+            physical_device_ = devices[i];
+            best_score = score;
+        }
+        if (!selector.empty() && preferred_device == VK_NULL_HANDLE && deviceMatches(selector, i, device_properties)) {
+            preferred_device = devices[i];
         }
     }
 
@@ -674,36 +1168,70 @@ bool VulkanBackend::selectDevice() {
         return false;
     }
 
+    if (!selector.empty()) {
+        if (preferred_device != VK_NULL_HANDLE) {
+            physical_device_ = preferred_device;
+        } else {
+            std::cerr << "Requested device \"" << selector << "\" not found or not suitable. Using the highest scoring one." << std::endl;
+        }
+    }
+
     VkPhysicalDeviceProperties device_properties;
     vkGetPhysicalDeviceProperties(physical_device_, &device_properties);
-    std::cout << "Selected Device: " << device_properties.deviceName << std::endl;
+
+    VkPhysicalDeviceFeatures device_features;
+    vkGetPhysicalDeviceFeatures(physical_device_, &device_features);
+
+    max_msaa_samples_ = getMaxSupportedSampleCount(physical_device_);
+
+    device_capabilities_ = DeviceCapabilities{};
+    device_capabilities_.geometry_shader = device_features.geometryShader == VK_TRUE;
+    device_capabilities_.mesh_shader = checkMeshShaderSupport(physical_device_);
+    device_capabilities_.timestamps = device_properties.limits.timestampComputeAndGraphics == VK_TRUE;
+    device_capabilities_.host_query_reset = checkHostQueryResetSupport(physical_device_);
+    device_capabilities_.pipeline_statistics = device_features.pipelineStatisticsQuery == VK_TRUE;
+    device_capabilities_.sampler_anisotropy = device_features.samplerAnisotropy == VK_TRUE;
+    device_capabilities_.max_sampler_anisotropy = device_capabilities_.sampler_anisotropy ? device_properties.limits.maxSamplerAnisotropy : 1.0f;
+    device_capabilities_.max_bindless_textures = bindlessTexturesCapacity(physical_device_);
+    device_capabilities_.bindless_textures = device_capabilities_.max_bindless_textures > 0;
+    device_capabilities_.multi_draw_indirect = device_features.multiDrawIndirect == VK_TRUE && device_features.drawIndirectFirstInstance == VK_TRUE;
+    device_capabilities_.non_uniform_texture_indexing = checkNonUniformTextureIndexingSupport(physical_device_);
+    device_capabilities_.draw_indirect_count = checkDrawIndirectCountSupport(physical_device_);
+
+    device_name_ = device_properties.deviceName;
+    std::cout << "Selected Device: " << device_name_ << std::endl;
+    std::cout << "\tgeometry shaders: " << (device_capabilities_.geometry_shader ? "yes" : "no") << std::endl;
+    std::cout << "\tmesh shaders: " << (device_capabilities_.mesh_shader ? "yes" : "no") << std::endl;
+    std::cout << "\ttimestamps: " << (device_capabilities_.timestamps ? "yes" : "no") << std::endl;
+    std::cout << "\tanisotropic filtering: " << (device_capabilities_.sampler_anisotropy ? "yes" : "no") << std::endl;
+    std::cout << "\tmulti draw indirect: " << (device_capabilities_.multi_draw_indirect ? "yes" : "no") << std::endl;
+    std::cout << "\tdraw indirect count: " << (device_capabilities_.draw_indirect_count ? "yes" : "no") << std::endl;
+    std::cout << "\tbindless textures: ";
+    if (device_capabilities_.bindless_textures) {
+        std::cout << "yes (" << device_capabilities_.max_bindless_textures << ")" << std::endl;
+    } else {
+        std::cout << "no" << std::endl;
+    }
     
     return true;
 }
 
 bool VulkanBackend::isDeviceSuitable(VkPhysicalDevice device) {
-    VkPhysicalDeviceProperties device_properties;
-    vkGetPhysicalDeviceProperties(device, &device_properties);
-
-    VkPhysicalDeviceFeatures device_features;
-    vkGetPhysicalDeviceFeatures(device, &device_features);
-
     QueueFamilyIndices indices = findQueueFamilies(device, window_surface_);
 
-    bool extensions_supported = checkRequiredDeviceExtensions(device) && checkRequiredInstanceExtensions(device);
+    bool extensions_supported = checkRequiredDeviceExtensions(device, headless_) && checkRequiredInstanceExtensions(device);
    
-    bool swap_chain_adequate = false;
-    if (extensions_supported) {
+    bool swap_chain_adequate = headless_;
+    if (extensions_supported && !headless_) {
         SwapChainSupportDetails swap_chain_support = querySwapChainSupport(device, window_surface_);
         swap_chain_adequate = !swap_chain_support.formats.empty() && !swap_chain_support.present_modes.empty();
     }
 
-    return device_properties.deviceType == VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU &&
-        device_features.geometryShader && 
-        device_features.samplerAnisotropy &&
-        indices.isValid() && 
+    // any device type will do, selectDevice ranks them and the optional features are checked by whoever needs them
+    return indices.isValid() && 
         extensions_supported && 
-        swap_chain_adequate;
+        swap_chain_adequate &&
+        checkTimelineSemaphoreSupport(device);
 }
 
 bool VulkanBackend::createLogicalDevice() {
@@ -712,11 +1240,17 @@ bool VulkanBackend::createLogicalDevice() {
 
     std::vector<VkDeviceQueueCreateInfo> queue_create_infos;
     std::set<uint32_t> uniqueQueueFamilies = { indices.graphics_family.value(), indices.present_family.value() };
+    if (indices.transfer_family.has_value()) {
+        uniqueQueueFamilies.insert(indices.transfer_family.value());
+    }
+    if (indices.compute_family.has_value()) {
+        uniqueQueueFamilies.insert(indices.compute_family.value());
+    }
 
     for (uint32_t queueFamily : uniqueQueueFamilies) {
         VkDeviceQueueCreateInfo queue_create_info{};
         queue_create_info.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
-        queue_create_info.queueFamilyIndex = indices.graphics_family.value();
+        queue_create_info.queueFamilyIndex = queueFamily;
         queue_create_info.queueCount = 1;
         queue_create_info.pQueuePriorities = &queue_priority;
         queue_create_infos.push_back(queue_create_info);
@@ -728,12 +1262,33 @@ bool VulkanBackend::createLogicalDevice() {
     mesh_shader_features.taskShader = VK_TRUE;
     mesh_shader_features.meshShader = VK_TRUE;
 
+    VkPhysicalDeviceDescriptorIndexingFeatures indexing_features{};
+    indexing_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES;
+    indexing_features.pNext = nullptr;
+
+    VkPhysicalDeviceHostQueryResetFeatures host_query_reset_features{};
+    host_query_reset_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_HOST_QUERY_RESET_FEATURES;
+    host_query_reset_features.pNext = nullptr;
+
+    VkPhysicalDeviceTimelineSemaphoreFeatures timeline_features{};
+    timeline_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES;
+    timeline_features.pNext = nullptr;
+
     VkPhysicalDeviceFeatures2 device_features2{};
     device_features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
-    device_features2.pNext = nullptr;
+    device_features2.pNext = &timeline_features;
 
-    if (mesh_shader_available_) {
-        device_features2.pNext = &mesh_shader_features;
+    void** features_tail = &timeline_features.pNext;
+    if (device_capabilities_.mesh_shader) {
+        *features_tail = &mesh_shader_features;
+        features_tail = &mesh_shader_features.pNext;
+    }
+    if (device_capabilities_.bindless_textures && bindless_textures_requested_) {
+        *features_tail = &indexing_features;
+        features_tail = &indexing_features.pNext;
+    }
+    if (device_capabilities_.host_query_reset) {
+        *features_tail = &host_query_reset_features;
     }
 
     vkGetPhysicalDeviceFeatures2(physical_device_, &device_features2);  // enable all supported features
@@ -744,8 +1299,16 @@ bool VulkanBackend::createLogicalDevice() {
     create_info.queueCreateInfoCount = static_cast<uint32_t>(queue_create_infos.size());
     create_info.pQueueCreateInfos = queue_create_infos.data();
     create_info.pEnabledFeatures = nullptr;  // deprecated in Vulkan 1.1
-    create_info.enabledExtensionCount = static_cast<uint32_t>(required_device_ext.size());
-    create_info.ppEnabledExtensionNames = required_device_ext.data();
+    auto device_extensions = enabledDeviceExtensions(headless_);
+    // optional extensions, only enabled on the devices that have them
+    if (device_capabilities_.mesh_shader) {
+        device_extensions.push_back(VK_NV_MESH_SHADER_EXTENSION_NAME);
+    }
+    if (device_capabilities_.draw_indirect_count) {
+        device_extensions.push_back(VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
+    }
+    create_info.enabledExtensionCount = static_cast<uint32_t>(device_extensions.size());
+    create_info.ppEnabledExtensionNames = device_extensions.data();
 
     if (enable_validation_layers) {
         create_info.enabledLayerCount = static_cast<uint32_t>(validation_layers.size()); // should be ignored by recent implementations
@@ -761,14 +1324,68 @@ bool VulkanBackend::createLogicalDevice() {
         return false;
     }
 
-    vkGetDeviceQueue(device_, indices.graphics_family.value(), 0, &graphics_queue_);
-    vkGetDeviceQueue(device_, indices.graphics_family.value(), 0, &compute_queue_); // we have selected a family that supports both graphics and compute
+    graphics_family_ = indices.graphics_family.value();
+    compute_family_ = indices.compute_family.value_or(graphics_family_);  // the graphics family supports compute too
+    vkGetDeviceQueue(device_, graphics_family_, 0, &graphics_queue_);
+    vkGetDeviceQueue(device_, compute_family_, 0, &compute_queue_);
     vkGetDeviceQueue(device_, indices.present_family.value(), 0, &present_queue_);
+    if (indices.transfer_family.has_value()) {
+        vkGetDeviceQueue(device_, indices.transfer_family.value(), 0, &transfer_queue_);
+    }
+
+    memory_allocator_ = std::make_unique<MemoryAllocator>(device_, physical_device_);
+
+    pipeline_cache_ = std::make_unique<PipelineCache>(device_, physical_device_);
+    if (!pipeline_cache_->isValid()) {
+        return false;
+    }
+    pipeline_thread_pool_ = std::make_unique<ThreadPool>();
+    shader_registry_ = std::make_unique<ShaderRegistry>(device_);
+    layout_cache_ = std::make_unique<DescriptorSetLayoutCache>(device_);
+    descriptor_allocator_ = std::make_unique<DescriptorAllocator>(device_);
+    descriptor_writer_ = std::make_unique<DescriptorWriter>(device_);
+    if (!createBindlessTextures()) {
+        return false;
+    }
+
+    // uniforms are written at the start of the frame, before waiting on the frame fence, so we need one
+    // slice more than the frames in flight to never overwrite data that the GPU is still reading
+    VkPhysicalDeviceProperties device_properties;
+    vkGetPhysicalDeviceProperties(physical_device_, &device_properties);
+    std::vector<uint32_t> uniform_families = { graphics_family_ };
+    if (hasDedicatedComputeQueue()) {
+        uniform_families.push_back(compute_family_);  // read by both queues every frame, there is nothing to transfer back and forth
+    }
+    auto ring_alignment = std::max(device_properties.limits.minUniformBufferOffsetAlignment, device_properties.limits.minStorageBufferOffsetAlignment);
+    uniform_ring_ = std::make_unique<UniformRing>(device_, memory_allocator_.get(), ring_alignment, max_frames_in_flight_ + 1, uniform_families);
+    if (!uniform_ring_->isValid()) {
+        return false;
+    }
+
+    UploadQueues upload_queues;
+    upload_queues.graphics_queue = graphics_queue_;
+    upload_queues.graphics_family = indices.graphics_family.value();
+    if (transfer_queue_ != VK_NULL_HANDLE) {
+        upload_queues.transfer_queue = transfer_queue_;
+        upload_queues.transfer_family = indices.transfer_family.value();
+    }
+
+    upload_batcher_ = std::make_unique<UploadBatcher>(device_, memory_allocator_.get(), upload_queues, device_properties.limits.optimalBufferCopyOffsetAlignment);
+    if (!upload_batcher_->isValid()) {
+        return false;
+    }
+    if (upload_batcher_->usesTransferQueue()) {
+        std::cout << "Using dedicated transfer queue family " << upload_queues.transfer_family << " for uploads." << std::endl;
+    }
 
     return true;
 }
 
 bool VulkanBackend::createSwapChain() {
+    if (headless_) {
+        return createOffscreenImages();
+    }
+
     swap_chain_support_ = querySwapChainSupport(physical_device_, window_surface_);
 
     swap_chain_extent_ = chooseSwapExtent(swap_chain_support_.capabilities, window_swap_extent_);
@@ -825,6 +1442,67 @@ bool VulkanBackend::createSwapChain() {
     return true;
 }
 
+bool VulkanBackend::createOffscreenImages() {
+    // one more image than frames in flight, same as a triple buffered swapchain
+    uint32_t image_count = max_frames_in_flight_ + 1;
+
+    swap_chain_extent_ = window_swap_extent_;
+    swap_chain_image_format_ = VK_FORMAT_R8G8B8A8_SRGB;  // guaranteed to be usable as a colour attachment
+    swap_chain_images_.resize(image_count, VK_NULL_HANDLE);
+    offscreen_image_memory_.resize(image_count);
+    next_offscreen_image_ = 0;
+
+    for (uint32_t i = 0; i < image_count; i++) {
+        VkImageCreateInfo image_info{};
+        image_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+        image_info.imageType = VK_IMAGE_TYPE_2D;
+        image_info.extent.width = swap_chain_extent_.width;
+        image_info.extent.height = swap_chain_extent_.height;
+        image_info.extent.depth = 1;
+        image_info.mipLevels = 1;
+        image_info.arrayLayers = 1;
+        image_info.format = swap_chain_image_format_;
+        image_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+        image_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        image_info.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;  // transfer src to read the frames back
+        image_info.samples = VK_SAMPLE_COUNT_1_BIT;
+        image_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+        if (vkCreateImage(device_, &image_info, nullptr, &swap_chain_images_[i]) != VK_SUCCESS) {
+            std::cerr << "Failed to create offscreen image " << i << "!" << std::endl;
+            swap_chain_images_[i] = VK_NULL_HANDLE;
+            return false;
+        }
+
+        VkMemoryRequirements mem_reqs;
+        vkGetImageMemoryRequirements(device_, swap_chain_images_[i], &mem_reqs);
+
+        offscreen_image_memory_[i] = allocateDeviceMemory(mem_reqs, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, false);
+        if (!offscreen_image_memory_[i].isValid()) {
+            std::cerr << "Failed to allocate offscreen image memory!" << std::endl;
+            return false;
+        }
+
+        vkBindImageMemory(device_, swap_chain_images_[i], offscreen_image_memory_[i].vk_memory, offscreen_image_memory_[i].offset);
+    }
+
+    return true;
+}
+
+void VulkanBackend::destroyOffscreenImages() {
+    for (auto image : swap_chain_images_) {
+        if (image != VK_NULL_HANDLE) {
+            vkDestroyImage(device_, image, nullptr);
+        }
+    }
+    for (auto& memory : offscreen_image_memory_) {
+        freeDeviceMemory(memory);
+    }
+
+    swap_chain_images_.clear();
+    offscreen_image_memory_.clear();
+}
+
 bool VulkanBackend::createImageViews() {
     swap_chain_image_views_.resize(swap_chain_images_.size());
 
@@ -851,59 +1529,69 @@ bool VulkanBackend::createCommandPool() {
         return false;
     }
 
+    pool_info.queueFamilyIndex = compute_family_;
+
+    if (vkCreateCommandPool(device_, &pool_info, nullptr, &compute_command_pool_) != VK_SUCCESS) {
+        std::cerr << "Failed to create compute command pool!" << std::endl;
+        return false;
+    }
+
     return true;
 }
 
-bool VulkanBackend::createDescriptorPool(const DescriptorPoolConfig& config) {
-    auto max_sets = config.max_sets;
-    if (max_sets == 0) {
-        max_sets = (config.uniform_buffers_count + config.image_samplers_count + config.storage_texel_buffers_count) * 2;
-    }
+bool VulkanBackend::allocateDescriptorSets(const std::vector<VkDescriptorSetLayout>& layouts, std::vector<VkDescriptorSet>& descriptor_sets) {
+    return descriptor_allocator_->allocate(layouts, descriptor_sets);
+}
 
-    std::vector<VkDescriptorPoolSize> pool_sizes{};
-    if (config.uniform_buffers_count > 0) {
-        VkDescriptorPoolSize uniform_pool;
-        uniform_pool.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-        uniform_pool.descriptorCount = config.uniform_buffers_count;
-        pool_sizes.push_back(uniform_pool);
-    }
-    if (config.image_samplers_count > 0) {
-        VkDescriptorPoolSize sampler_pool;
-        sampler_pool.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-        sampler_pool.descriptorCount = config.image_samplers_count;
-        pool_sizes.push_back(sampler_pool);
+bool VulkanBackend::allocateTransientDescriptorSets(const std::vector<VkDescriptorSetLayout>& layouts, std::vector<VkDescriptorSet>& descriptor_sets) {
+    return frames_[active_frame_].transient_descriptors->allocate(layouts, descriptor_sets);
+}
+
+bool VulkanBackend::createBindlessTextures() {
+    if (!bindless_textures_requested_ || !device_capabilities_.bindless_textures) {
+        return true;  // textures are bound per pipeline instead
     }
-    if (config.storage_texel_buffers_count > 0) {
-        VkDescriptorPoolSize texel_pool;
-        texel_pool.type = VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER;
-        texel_pool.descriptorCount = config.storage_texel_buffers_count;
-        pool_sizes.push_back(texel_pool);
+
+    bindless_textures_ = std::make_unique<BindlessTextureTable>(device_, device_capabilities_.max_bindless_textures);
+    if (!bindless_textures_->isValid()) {
+        return false;
     }
-    if (config.image_storage_buffers_count > 0) {
-        VkDescriptorPoolSize image_buffers_pool;
-        image_buffers_pool.type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
-        image_buffers_pool.descriptorCount = config.image_storage_buffers_count;
-        pool_sizes.push_back(image_buffers_pool);
+
+    // every pipeline declaring the bindless set must use this exact layout to bind the one set
+    layout_cache_->setExternalLayout(BINDLESS_TEXTURES_SET_ID, bindless_textures_->layout());
+    return true;
+}
+
+uint32_t VulkanBackend::addBindlessTexture(VkImageView image_view, VkSampler sampler, VkImageLayout image_layout) {
+    if (!bindless_textures_) {
+        return INVALID_BINDLESS_INDEX;
     }
+    return bindless_textures_->add(image_view, sampler, image_layout);
+}
 
-    VkDescriptorPoolCreateInfo pool_info{};
-    pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-    pool_info.poolSizeCount = static_cast<uint32_t>(pool_sizes.size());
-    pool_info.pPoolSizes = pool_sizes.data();
-    pool_info.maxSets = static_cast<uint32_t>(swap_chain_images_.size())* max_sets;
+void VulkanBackend::releaseBindlessTexture(uint32_t index) {
+    if (!bindless_textures_ || index == INVALID_BINDLESS_INDEX) {
+        return;
+    }
 
-    if (vkCreateDescriptorPool(device_, &pool_info, nullptr, &descriptor_pool_) != VK_SUCCESS) {
-        std::cerr << "Failed to create descriptor pool!" << std::endl;
-        return false;
+    if (frames_.empty()) {
+        bindless_textures_->release(index);  // no frames in flight
+    } else {
+        // frames in flight may still sample the old texture, the slot can't go to a new one until they are done
+        deferDestruction([this, index]() {
+            if (bindless_textures_) {
+                bindless_textures_->release(index);
+            }
+        });
     }
+}
 
-    return true;
+DescriptorAllocatorStats VulkanBackend::getTransientDescriptorStats() const {
+    return frames_[active_frame_].transient_descriptors->getStats();
 }
 
 bool VulkanBackend::createSyncObjects() {
-    image_available_semaphores_.resize(max_frames_in_flight_);
-    render_finished_semaphores_.resize(max_frames_in_flight_);
-    in_flight_fences_.resize(max_frames_in_flight_);
+    frames_.resize(max_frames_in_flight_);
     images_in_flight_.resize(swap_chain_images_.size(), VK_NULL_HANDLE);
 
     VkSemaphoreCreateInfo semaphore_info{};
@@ -913,98 +1601,137 @@ bool VulkanBackend::createSyncObjects() {
     fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
     fence_info.flags = VK_FENCE_CREATE_SIGNALED_BIT;  // avoids an infinite wait on the first wait on this fence if it has never signalled before
 
+    QueueFamilyIndices queue_family_indices = findQueueFamilies(physical_device_, window_surface_);
+
+    VkCommandPoolCreateInfo pool_info{};
+    pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    pool_info.queueFamilyIndex = queue_family_indices.graphics_family.value();
+    pool_info.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+
     for (uint32_t i = 0; i < max_frames_in_flight_; i++) {
-        if (vkCreateSemaphore(device_, &semaphore_info, nullptr, &image_available_semaphores_[i]) != VK_SUCCESS ||
-            vkCreateSemaphore(device_, &semaphore_info, nullptr, &render_finished_semaphores_[i]) != VK_SUCCESS ||
-            vkCreateFence(device_, &fence_info, nullptr, &in_flight_fences_[i]) != VK_SUCCESS) {
+        auto& frame = frames_[i];
+        if (vkCreateSemaphore(device_, &semaphore_info, nullptr, &frame.image_available) != VK_SUCCESS ||
+            vkCreateSemaphore(device_, &semaphore_info, nullptr, &frame.render_finished) != VK_SUCCESS ||
+            vkCreateFence(device_, &fence_info, nullptr, &frame.in_flight_fence) != VK_SUCCESS) {
 
             std::cerr << "Failed to create graphics / present sync objects for frame " << i << "!" << std::endl;
             return false;
         }
-    }
 
-    if (vkCreateSemaphore(device_, &semaphore_info, nullptr, &compute_finished_semaphore_) != VK_SUCCESS ||
-        vkCreateSemaphore(device_, &semaphore_info, nullptr, &drawing_finished_sempahore_) != VK_SUCCESS) {
+        if (vkCreateCommandPool(device_, &pool_info, nullptr, &frame.command_pool) != VK_SUCCESS) {
+            std::cerr << "Failed to create command pool for frame " << i << "!" << std::endl;
+            return false;
+        }
 
-        std::cerr << "Failed to create graphics / compute sync objects!" << std::endl;
-        return false;
+        frame.transient_descriptors = std::make_unique<DescriptorAllocator>(device_, 64);
     }
 
     return true;
 }
 
 void VulkanBackend::destroySyncObjects() {
-    for (uint32_t i = 0; i < max_frames_in_flight_; i++) {
-        vkDestroySemaphore(device_, image_available_semaphores_[i], nullptr);
-        vkDestroySemaphore(device_, render_finished_semaphores_[i], nullptr);
-        vkDestroyFence(device_, in_flight_fences_[i], nullptr);
+    // the device is idle at this point, so whatever was waiting for a frame to complete can go now
+    for (auto& frame : frames_) {
+        runDeferredDestruction(frame);
+
+        vkDestroySemaphore(device_, frame.image_available, nullptr);
+        vkDestroySemaphore(device_, frame.render_finished, nullptr);
+        vkDestroyFence(device_, frame.in_flight_fence, nullptr);
+        vkDestroyCommandPool(device_, frame.command_pool, nullptr);  // frees the frame command buffers too
+        frame.transient_descriptors.reset();
     }
 
-    vkDestroySemaphore(device_, compute_finished_semaphore_, nullptr);
-    vkDestroySemaphore(device_, drawing_finished_sempahore_, nullptr);
-    graphics_should_wait_for_compute_ = false;
-    image_available_semaphores_.clear();
-    render_finished_semaphores_.clear();
-    in_flight_fences_.clear();
+    frames_.clear();
     images_in_flight_.clear();
 }
 
-void VulkanBackend::cleanupSwapChain() {
+bool VulkanBackend::createTimelineSemaphores() {
+    VkSemaphoreTypeCreateInfo type_info{};
+    type_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+    type_info.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+    type_info.initialValue = 0;
+
+    VkSemaphoreCreateInfo semaphore_info{};
+    semaphore_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+    semaphore_info.pNext = &type_info;
 
-    vkDestroyDescriptorPool(device_, descriptor_pool_, nullptr);
+    if (vkCreateSemaphore(device_, &semaphore_info, nullptr, &graphics_timeline_) != VK_SUCCESS ||
+        vkCreateSemaphore(device_, &semaphore_info, nullptr, &compute_timeline_) != VK_SUCCESS) {
+
+        std::cerr << "Failed to create graphics / compute timeline semaphores!" << std::endl;
+        return false;
+    }
+
+    graphics_timeline_value_ = 0;
+    compute_timeline_value_ = 0;
+    compute_value_waited_by_graphics_ = 0;
+
+    return true;
+}
+
+void VulkanBackend::destroyTimelineSemaphores() {
+    vkDestroySemaphore(device_, graphics_timeline_, nullptr);
+    vkDestroySemaphore(device_, compute_timeline_, nullptr);
+    graphics_timeline_ = VK_NULL_HANDLE;
+    compute_timeline_ = VK_NULL_HANDLE;
+}
+
+void VulkanBackend::runDeferredDestruction(FrameContext& frame) {
+    for (auto& destroy : frame.deferred_destruction) {
+        destroy();
+    }
+    frame.deferred_destruction.clear();
+}
+
+void VulkanBackend::cleanupSwapChain() {
+    descriptor_allocator_->reset();  // the pools are kept for the next swapchain
 
     for (auto image_view : swap_chain_image_views_) {
         vkDestroyImageView(device_, image_view, nullptr);
     }
 
-    vkDestroySwapchainKHR(device_, swap_chain_, nullptr);
+    if (headless_) {
+        destroyOffscreenImages();
+    } else {
+        vkDestroySwapchainKHR(device_, swap_chain_, nullptr);
+    }
 
     destroySyncObjects();
+    active_frame_ = 0;
     current_frame_ = 0;
-    graphics_should_wait_for_compute_ = false;
 }
 
 bool VulkanBackend::recreateSwapChain() {
     cleanupSwapChain();
+    uniform_ring_->reset();  // the device is idle at this point
 
-    if (!createSyncObjects()) {
-        return false;
-    }
     if (!createSwapChain()) {
         return false;
     }
     if (!createImageViews()) {
         return false;
     }
+    if (!createSyncObjects()) {  // images_in_flight_ is sized on the new swapchain
+        return false;
+    }
     
     return true;
 }
 
-VkDeviceMemory VulkanBackend::allocateDeviceMemory(VkMemoryRequirements mem_reqs, VkMemoryPropertyFlags properties) {
-    VkMemoryAllocateInfo alloc_info{};
-    alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    alloc_info.allocationSize = mem_reqs.size;
-    alloc_info.memoryTypeIndex = findMemoryType(mem_reqs.memoryTypeBits, physical_device_, properties);
-
-    VkDeviceMemory buffer_memory;
-    if (vkAllocateMemory(device_, &alloc_info, nullptr, &buffer_memory) != VK_SUCCESS) {
-        std::cerr << "Failed to allocate vertex buffer memory!" << std::endl;
-        return VK_NULL_HANDLE;
-    }
+MemoryAllocation VulkanBackend::allocateDeviceMemory(VkMemoryRequirements mem_reqs, VkMemoryPropertyFlags properties, bool linear_resource) {
+    return memory_allocator_->allocate(mem_reqs, properties, linear_resource);
+}
 
-    return buffer_memory;
+void VulkanBackend::freeDeviceMemory(MemoryAllocation& allocation) {
+    memory_allocator_->free(allocation);
 }
 
-void VulkanBackend::copyBufferToGpuLocalMemory(VkBuffer src_buffer, VkBuffer dst_buffer, VkDeviceSize size) {
-    VkCommandBuffer command_buffer = beginSingleTimeCommands();
-   
-    VkBufferCopy copy_region{};
-    copy_region.srcOffset = 0; // Optional
-    copy_region.dstOffset = 0; // Optional
-    copy_region.size = size;
-    vkCmdCopyBuffer(command_buffer, src_buffer, dst_buffer, 1, &copy_region);
+void VulkanBackend::uploadToGpuLocalMemory(const void* src_data, VkDeviceSize size, VkBuffer dst_buffer) {
+    upload_batcher_->copyToBuffer(src_data, size, dst_buffer);
+}
 
-    endSingleTimeCommands(command_buffer);
+StagingRegion VulkanBackend::stageUploadData(const void* src_data, VkDeviceSize size) {
+    return upload_batcher_->stage(src_data, size);
 }
 
 bool VulkanBackend::createBufferView(Buffer& buffer, VkFormat format) {
@@ -1032,41 +1759,59 @@ void VulkanBackend::updateDescriptorSets(const UniformBuffer& buffer, std::vecto
         buffer_info.offset = 0;
         buffer_info.range = buffer.buffer_size;
 
-        VkWriteDescriptorSet descriptor_write{};
-        descriptor_write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-        descriptor_write.dstSet = descriptor_sets[i];
-        descriptor_write.dstBinding = binding;
-        descriptor_write.dstArrayElement = 0;
-        descriptor_write.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-        descriptor_write.descriptorCount = 1;
-        descriptor_write.pBufferInfo = &buffer_info;
-        descriptor_write.pImageInfo = nullptr; // Optional
-        descriptor_write.pTexelBufferView = nullptr; // Optional
+        descriptor_writer_->writeBuffer(descriptor_sets[i], binding, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, buffer_info);
+    }
+    descriptor_writer_->flushIfNotBatching();
+}
 
-        vkUpdateDescriptorSets(device_, 1, &descriptor_write, 0, nullptr);
+void VulkanBackend::updateDynamicDescriptorSets(VkDeviceSize data_size, std::vector<VkDescriptorSet>& descriptor_sets, uint32_t binding) {
+    auto buffer_info = getUniformRingBufferInfo(data_size);
+    for (size_t i = 0; i < descriptor_sets.size(); i++) {
+        descriptor_writer_->writeBuffer(descriptor_sets[i], binding, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, buffer_info);
     }
+    descriptor_writer_->flushIfNotBatching();
 }
 
 void VulkanBackend::updateDescriptorSets(const Buffer& buffer, std::vector<VkDescriptorSet>& descriptor_sets, uint32_t binding) {
     for (size_t i = 0; i < descriptor_sets.size(); i++) {
-        VkDescriptorBufferInfo buffer_info{};
-        buffer_info.buffer = buffer.vk_buffer;
-        buffer_info.offset = 0;
-        buffer_info.range = buffer.buffer_size;
+        descriptor_writer_->writeTexelBuffer(descriptor_sets[i], binding, VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER, buffer.vk_buffer_view);
+    }
+    descriptor_writer_->flushIfNotBatching();
+}
+
+void VulkanBackend::updateImageDescriptorSets(const std::vector<VkDescriptorImageInfo>& image_infos, VkDescriptorType type, std::vector<VkDescriptorSet>& descriptor_sets, uint32_t binding) {
+    for (size_t i = 0; i < descriptor_sets.size(); i++) {
+        descriptor_writer_->writeImages(descriptor_sets[i], binding, type, image_infos);
+    }
+    descriptor_writer_->flushIfNotBatching();
+}
 
-        VkWriteDescriptorSet descriptor_write{};
-        descriptor_write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-        descriptor_write.dstSet = descriptor_sets[i];
-        descriptor_write.dstBinding = binding;
-        descriptor_write.dstArrayElement = 0;
-        descriptor_write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER;
-        descriptor_write.descriptorCount = 1;
-        descriptor_write.pBufferInfo = &buffer_info;
-        descriptor_write.pImageInfo = nullptr; // Optional
-        descriptor_write.pTexelBufferView = &buffer.vk_buffer_view;
+VkDescriptorBufferInfo VulkanBackend::getUniformRingBufferInfo(VkDeviceSize data_size) const {
+    VkDescriptorBufferInfo buffer_info{};
+    buffer_info.buffer = uniform_ring_->getBuffer();
+    buffer_info.offset = 0;  // the actual offset is provided when binding the set
+    buffer_info.range = data_size;
+    return buffer_info;
+}
+
+std::unique_ptr<DescriptorUpdateTemplate> VulkanBackend::createDescriptorUpdateTemplate(const VulkanPipeline& pipeline, uint32_t set_id) {
+    auto layout = pipeline.descriptorSets().find(set_id);
+    auto names = pipeline.descriptorMetadata().set_bindings.find(set_id);
+    if (layout == pipeline.descriptorSets().end() || names == pipeline.descriptorMetadata().set_bindings.end()) {
+        return nullptr;
+    }
+
+    std::vector<VkDescriptorSetLayoutBinding> bindings;
+    if (!layout_cache_->getBindings(layout->second, bindings)) {
+        std::cerr << "No bindings for set " << set_id << " of pipeline " << pipeline.name() << ", can't create an update template!" << std::endl;
+        return nullptr;
+    }
 
-        vkUpdateDescriptorSets(device_, 1, &descriptor_write, 0, nullptr);
+    auto update_template = std::make_unique<DescriptorUpdateTemplate>(device_, layout->second, bindings, names->second);
+    if (!update_template->isValid()) {
+        return nullptr;
     }
+    return update_template;
 }
 
 void VulkanBackend::destroyBuffer(Buffer& buffer) {
@@ -1076,16 +1821,14 @@ void VulkanBackend::destroyBuffer(Buffer& buffer) {
     if (buffer.vk_buffer != VK_NULL_HANDLE) {
         vkDestroyBuffer(device_, buffer.vk_buffer, nullptr);
     }
-    if (buffer.vk_buffer_memory != VK_NULL_HANDLE) {
-        vkFreeMemory(device_, buffer.vk_buffer_memory, nullptr);
-    }
+    freeDeviceMemory(buffer.memory);
     buffer = Buffer{};
 }
 
 void VulkanBackend::destroyUniformBuffer(UniformBuffer& uniform_buffer) {
     for (auto& buffer : uniform_buffer.buffers) {
         vkDestroyBuffer(device_, buffer.vk_buffer, nullptr);
-        vkFreeMemory(device_, buffer.vk_buffer_memory, nullptr);
+        freeDeviceMemory(buffer.memory);
     }
     uniform_buffer.buffers.clear();
     uniform_buffer.buffer_size = 0;
@@ -1116,27 +1859,3 @@ VkImageView VulkanBackend::createImageView(VkImage image, VkFormat format, VkIma
 
     return image_view;
 }
-
-std::vector<float> VulkanBackend::tryRetrieveTimestampQueries() {
-    VkDeviceSize stride = 2 * sizeof(uint32_t); // query + availability
-    size_t result_size = timestamp_queries_ * stride;
-    std::vector<uint32_t> result(2 * static_cast<size_t>(timestamp_queries_));
-
-    vkGetQueryPoolResults(device_, timestamp_queries_pool_, 0, timestamp_queries_, result_size, static_cast<void*>(result.data()), stride, VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
-
-    std::vector<float> result_ms;
-    for (size_t q = 0; q < result.size(); q = q+2) {
-        auto value = result[q];
-        auto available = result[q + 1];
-        if (available > 0) {
-            result_ms.push_back(value * timestamp_period_ * float(1e-6));  // nanoseconds -> milliseconds
-        }
-    }
-
-    if (result_ms.size() != timestamp_queries_) {
-        // not all queries are available
-        result_ms.clear();
-    }
-
-    return result_ms;
-}
@@ -8,7 +8,21 @@
 
 #include "common_definitions.hpp"
 #include "extensions.hpp"
+#include "memory_allocator.hpp"
+#include "descriptor_allocator.hpp"
+#include "descriptor_writer.hpp"
+#include "descriptor_update_template.hpp"
+#include "bindless_texture_table.hpp"
+#include "descriptor_set_layout_cache.hpp"
+#include "pipeline_cache.hpp"
+#include "shader_registry.hpp"
+#include "thread_pool.hpp"
+#include "pipelines/pipeline.hpp"
+#include "uniform_ring.hpp"
+#include "upload_batcher.hpp"
+#include "gpu_profiler.hpp"
 #include <optional>
+#include <algorithm>
 
 // Interfaces
 class ShaderModule;
@@ -18,6 +32,31 @@ class GraphicsPipeline;
 class MeshPipeline;
 class ComputePipeline;
 class RenderPass;
+struct GraphicsPipelineConfig;
+struct MeshPipelineConfig;
+struct ComputePipelineConfig;
+
+// optional device features, recorded when the device is selected so that whatever depends on them can be disabled
+struct DeviceCapabilities {
+    bool geometry_shader = false;
+    bool mesh_shader = false;
+    bool timestamps = false;
+    bool host_query_reset = false;  // needed by the GPU profiler
+    bool pipeline_statistics = false;
+    bool sampler_anisotropy = false;
+    float max_sampler_anisotropy = 1.0f;
+    bool bindless_textures = false;  // descriptor indexing with update-after-bind sampled images
+    uint32_t max_bindless_textures = 0;
+    bool multi_draw_indirect = false;  // and non-zero firstInstance in the indirect commands
+    bool non_uniform_texture_indexing = false;  // texture array indices that vary within a draw
+    bool draw_indirect_count = false;  // VK_KHR_draw_indirect_count, the number of indirect draws read from a buffer
+};
+
+// buffers and images used by both the graphics and the compute queue. their colour images stay in the same layout
+struct QueueSharedResources {
+    std::vector<VkBuffer> buffers;
+    std::vector<std::pair<VkImage, VkImageLayout>> images;
+};
 
 // VulkanBackend
 
@@ -30,13 +69,40 @@ public:
         window_swap_extent_ = size;
     }
 
+    // render to a ring of offscreen images instead of a window swapchain. must be called before startUp
+    void setHeadless(VkExtent2D size) {
+        headless_ = true;
+        window_swap_extent_ = size;
+    }
+    bool isHeadless() const { return headless_; }
+
     void resetWindowSwapExtent(VkExtent2D extent) { window_swap_extent_ = extent; }
     VkExtent2D getSwapChainExtent() const { return window_swap_extent_; }
     uint32_t getSwapChainSize() const { return uint32_t(swap_chain_images_.size()); }
-    VkDescriptorPool getDescriptorPool() { return descriptor_pool_; }
+
+    // per-frame resources (command buffers, descriptor sets, uniform buffers) are sized by the frames in flight,
+    // not by the swapchain size, and indexed by getCurrentFrameIndex while recording a frame
+    void setFramesInFlight(uint32_t count) { max_frames_in_flight_ = std::max(count, 1u); }  // must be called before startUp
+    uint32_t getFramesInFlight() const { return max_frames_in_flight_; }
+    uint32_t getCurrentFrameIndex() const { return active_frame_; }
     VkDevice getDevice() { return device_; }
     VkSampleCountFlagBits getMaxMSAASamples() const { return max_msaa_samples_; }
-    bool meshShaderSupported() const { return mesh_shader_available_; }
+    const std::string& getDeviceName() const { return device_name_; }
+    const DeviceCapabilities& getDeviceCapabilities() const { return device_capabilities_; }
+    bool meshShaderSupported() const { return device_capabilities_.mesh_shader; }
+    bool geometryShaderSupported() const { return device_capabilities_.geometry_shader; }
+    bool hasDedicatedComputeQueue() const { return compute_family_ != graphics_family_; }  // compute runs asynchronously to graphics
+
+    // on by default where supported. when off (or unsupported) textures are bound per pipeline as before.
+    // must be called before startUp
+    void setBindlessTextures(bool enable) { bindless_textures_requested_ = enable; }
+    bool bindlessTexturesEnabled() const { return bindless_textures_ != nullptr; }
+    VkDescriptorSet getBindlessTexturesSet() const { return bindless_textures_ ? bindless_textures_->descriptorSet() : VK_NULL_HANDLE; }
+    uint32_t getBindlessTexturesCount() const { return bindless_textures_ ? bindless_textures_->getTexturesCount() : 0; }
+
+    // by default the highest scoring device is used. this (or the VULKAN_EXPERIMENTS_DEVICE environment variable)
+    // picks one by index or by a substring of its name instead. must be called before startUp
+    void setPreferredDevice(const std::string& device) { preferred_device_ = device; }
 
     bool startUp();
     void shutDown();
@@ -46,29 +112,60 @@ public:
 
     bool recreateSwapChain();
     
-    std::shared_ptr<ShaderModule> createShaderModule(const std::string& name) const;
+    std::shared_ptr<const ShaderModule> loadShaderModule(const std::string& name, const std::string& spirv_file_path);  // shared, loaded once per file
     std::shared_ptr<Texture> createTexture(const std::string& name);
     std::shared_ptr<StaticMesh> createStaticMesh(const std::string& name);
 
-    bool createDescriptorPool(const DescriptorPoolConfig& config);
+    // descriptor sets come from pools that grow on demand. persistent sets are valid until the swapchain is rebuilt,
+    // transient ones only for the frame being recorded, their pools are reset in bulk when the frame comes around again
+    bool allocateDescriptorSets(const std::vector<VkDescriptorSetLayout>& layouts, std::vector<VkDescriptorSet>& descriptor_sets);
+    bool allocateTransientDescriptorSets(const std::vector<VkDescriptorSetLayout>& layouts, std::vector<VkDescriptorSet>& descriptor_sets);
+    DescriptorAllocatorStats getDescriptorStats() const { return descriptor_allocator_->getStats(); }
+    DescriptorAllocatorStats getTransientDescriptorStats() const;  // of the frame being recorded
     std::vector<VkCommandBuffer> createPrimaryCommandBuffers(uint32_t count) const; // the caller is responsible for managing these
     std::vector<VkCommandBuffer> createSecondaryCommandBuffers(uint32_t count) const; // the caller is responsible for managing these
+    std::vector<VkCommandBuffer> createComputeCommandBuffers(uint32_t count) const; // primary, for submitComputeCommands
     void resetCommandBuffers(std::vector<VkCommandBuffer>& cmd_buffers) const;
+    VkCommandBuffer getFrameCommandBuffer();  // primary, only valid until the end of the current frame
+
+    // runs once the GPU has finished with the current frame, for resources that may still be in use
+    void deferDestruction(std::function<void()> destroy);
+    void destroyBufferDeferred(Buffer& buffer);
     void freeCommandBuffers(std::vector<VkCommandBuffer>& cmd_buffers) const;
+    void freeComputeCommandBuffers(std::vector<VkCommandBuffer>& cmd_buffers) const;
+
+    // queue family ownership transfers for resources shared by graphics and compute. every release must be matched by
+    // an acquire on the other queue, ordered after it by the timelines. they record nothing if there is no dedicated compute family
+    void releaseToCompute(VkCommandBuffer graphics_cmd, const QueueSharedResources& resources) const;
+    void acquireFromGraphics(VkCommandBuffer compute_cmd, const QueueSharedResources& resources) const;
+    void releaseToGraphics(VkCommandBuffer compute_cmd, const QueueSharedResources& resources) const;
+    void acquireFromCompute(VkCommandBuffer graphics_cmd, const QueueSharedResources& resources) const;
 
     std::unique_ptr<RenderPass> createRenderPass(const std::string& name);
     std::unique_ptr<GraphicsPipeline> createGraphicsPipeline(const std::string& name);
     std::unique_ptr<MeshPipeline> createMeshPipeline(const std::string& name);
     std::unique_ptr<ComputePipeline> createComputePipeline(const std::string& name);
 
+    // compile on the pipeline thread pool. the pipeline and anything its config points to (shaders, render pass)
+    // must stay alive until the returned build is finished
+    PipelineBuild buildPipelineAsync(GraphicsPipeline& pipeline, const GraphicsPipelineConfig& config);
+    PipelineBuild buildPipelineAsync(MeshPipeline& pipeline, const MeshPipelineConfig& config);
+    PipelineBuild buildPipelineAsync(ComputePipeline& pipeline, const ComputePipelineConfig& config);
+    bool finishPipelineBuilds(std::vector<PipelineBuild>& builds);  // finishes all of them, in order, in one descriptor batch
+
+    // extra_usage e.g. VK_BUFFER_USAGE_TRANSFER_SRC_BIT for buffers that are copied on the GPU
     template<typename DataType>
-    Buffer createVertexBuffer(const std::string& name, const std::vector<DataType>& src_buffer, bool host_visible = false, bool compute_visible = false);
+    Buffer createVertexBuffer(const std::string& name, const std::vector<DataType>& src_buffer, bool host_visible = false, bool compute_visible = false, VkBufferUsageFlags extra_usage = 0);
 
     template<typename DataType>
     Buffer createIndexBuffer(const std::string& name, const std::vector<DataType>& src_buffer, bool host_visible = false);
 
     template<typename DataType>
-    Buffer createStorageTexelBuffer(const std::string& name, const std::vector<DataType>& src_buffer, bool host_visible = false);
+    Buffer createStorageTexelBuffer(const std::string& name, const std::vector<DataType>& src_buffer, bool host_visible = false, VkBufferUsageFlags extra_usage = 0);
+
+    // extra_usage e.g. VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT for indirect draw commands
+    template<typename DataType>
+    Buffer createStorageBuffer(const std::string& name, const std::vector<DataType>& src_buffer, bool host_visible = false, VkBufferUsageFlags extra_usage = 0);
 
     template<typename DataType>
     void updateBuffer(Buffer& dst_buffer, const std::vector<DataType>& src_buffer);
@@ -78,25 +175,75 @@ public:
 
     bool createBufferView(Buffer& buffer, VkFormat format);
     
+    // descriptor writes are handed to the driver in one call per update function, or once for the whole batch.
+    // batches can be nested, the sets written in one can only be bound once the outermost batch is over
+    void beginDescriptorBatch() { descriptor_writer_->beginBatch(); }
+    void endDescriptorBatch() { descriptor_writer_->endBatch(); }
     void updateDescriptorSets(const UniformBuffer& buffer, std::vector<VkDescriptorSet>& descriptor_sets, uint32_t binding);
     void updateDescriptorSets(const Buffer& buffer, std::vector<VkDescriptorSet>& descriptor_sets, uint32_t binding);
+    void updateDynamicDescriptorSets(VkDeviceSize data_size, std::vector<VkDescriptorSet>& descriptor_sets, uint32_t binding);  // binds the uniform ring
+    void updateImageDescriptorSets(const std::vector<VkDescriptorImageInfo>& image_infos, VkDescriptorType type, std::vector<VkDescriptorSet>& descriptor_sets, uint32_t binding);
+    VkDescriptorBufferInfo getUniformRingBufferInfo(VkDeviceSize data_size) const;  // for update templates, same as updateDynamicDescriptorSets
+
+    // writes all the bindings of one set of the pipeline at once. null if the set isn't in the pipeline
+    std::unique_ptr<DescriptorUpdateTemplate> createDescriptorUpdateTemplate(const VulkanPipeline& pipeline, uint32_t set_id);
+
+    // per-frame uniform data. the returned offset is only valid until the end of the current frame
+    template<typename DataType>
+    UniformAllocation pushUniformData(const DataType& data) { return uniform_ring_->push<DataType>(data); }
+    template<typename DataType>
+    UniformAllocation pushUniformArray(const std::vector<DataType>& data) { return uniform_ring_->pushArray<DataType>(data); }  // for dynamic storage buffers
 
     void destroyBuffer(Buffer& buffer);
     void destroyUniformBuffer(UniformBuffer& uniform_buffer);
+
+    MemoryStats getMemoryStats() const { return memory_allocator_->getStats(); }
+    void printMemoryStats() const { memory_allocator_->printStats(); }
+    PipelineCacheStats getPipelineCacheStats() const { return pipeline_cache_->getStats(); }
     
     VkResult startNextFrame(uint32_t& next_swapchain_image, bool window_resized);
+    // graphics and compute each have a timeline semaphore. every submission signals the next value on the timeline of
+    // its queue, which can be read back with get*TimelineValue right after submitting.
+    // graphics waits for all the compute work submitted before it. compute waits for the previous compute submission and,
+    // by default, for the last graphics submission. pass an older graphics value to let compute run further ahead
     VkResult submitGraphicsCommands(uint32_t swapchain_image, const std::vector<VkCommandBuffer>& command_buffers);
-    VkResult submitComputeCommands(const std::vector<VkCommandBuffer>& command_buffers);
-
+    VkResult submitComputeCommands(const std::vector<VkCommandBuffer>& command_buffers, std::optional<uint64_t> wait_graphics_value = std::nullopt);
+
+    uint64_t getGraphicsTimelineValue() const { return graphics_timeline_value_; }  // last value submitted
+    // the graphics work that last used the per-frame resources of the current frame, frames in flight submissions ago
+    uint64_t getFrameGraphicsValue() const { return frames_[active_frame_].graphics_value; }
+    uint64_t getComputeTimelineValue() const { return compute_timeline_value_; }
+    uint64_t getCompletedGraphicsValue() const;  // last value the GPU has reached
+    uint64_t getCompletedComputeValue() const;
+    bool waitForGraphicsValue(uint64_t value, uint64_t timeout = UINT64_MAX) const;  // false on timeout
+    bool waitForComputeValue(uint64_t value, uint64_t timeout = UINT64_MAX) const;
+
+    // one-off commands are recorded in the upload batch. they are submitted by endSingleTimeCommands unless
+    // a batch is open, in which case they go with the rest of the batch in endUploadBatch. the work has only
+    // completed when endSingleTimeCommands returns if it was called outside a batch, callers that read back
+    // results straight away (the static shadow map culling stats, the GPU clock calibration) must not run inside one
     VkCommandBuffer beginSingleTimeCommands();
-    void endSingleTimeCommands(VkCommandBuffer command_buffer);
-
-    bool enableTimestampQueries(uint32_t queries_count);
-    bool timestampQueriesEnabled() const { return timestamp_queries_pool_ != VK_NULL_HANDLE && timestamp_queries_ > 0; }
-    void writeTimestampQuery(VkCommandBuffer& command_buffer, VkPipelineStageFlagBits stage, uint32_t query_num);
-    std::vector<float> retrieveTimestampQueries(bool should_wait = false, int max_tries = 100);
-    void resetAllTimestampQueries(VkCommandBuffer& command_buffer);
-    void resetTimestampQueries(VkCommandBuffer& command_buffer, uint32_t first, uint32_t count);
+    void endSingleTimeCommands();
+    void beginUploadBatch();
+    bool endUploadBatch();  // submits all the uploads recorded since beginUploadBatch and waits for them once
+    // submits without waiting, for streaming resources in mid-session. the uploaded resources can be used
+    // once isUploadComplete returns true for the returned id. 0 means nothing was submitted, either because nothing
+    // needed uploading or because the submission failed, and is never reported as complete
+    uint64_t endUploadBatchAsync();
+    bool isUploadComplete(uint64_t upload_id);
+
+    // named GPU timestamp scopes, see GpuProfiler. the scope calls do nothing unless the profiler is enabled
+    // pipeline statistics are only recorded by the scopes that ask for them, if the device supports them
+    bool enableGpuProfiler(uint32_t scopes_per_frame = 32, bool pipeline_statistics = false);
+    bool gpuProfilerEnabled() const { return gpu_profiler_ != nullptr; }
+    bool pipelineStatisticsEnabled() const { return gpu_profiler_ && gpu_profiler_->pipelineStatisticsEnabled(); }
+    void beginGpuScope(VkCommandBuffer command_buffer, const std::string& name, PipelineStatisticsType statistics = PipelineStatisticsType::NONE, VkPipelineStageFlagBits stage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT);
+    void endGpuScope(VkCommandBuffer command_buffer, const std::string& name, VkPipelineStageFlagBits stage = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT);
+    const GpuTimings& getGpuTimings() const;  // by scope name, max_frames_in_flight + 1 frames behind
+    void clearGpuTimings();
+    // keeps the individual GPU scopes, to export them with the CPU profiler events
+    void setGpuTracing(bool tracing);
+    bool exportProfilerTrace(const std::string& path);  // Chrome trace with the CPU threads and the GPU scopes on one timeline
 
 private:
     friend class Texture;
@@ -108,10 +255,16 @@ private:
     bool isDeviceSuitable(VkPhysicalDevice device);
     bool createLogicalDevice();
     bool createSwapChain();
+    bool createOffscreenImages();
+    void destroyOffscreenImages();
     bool createImageViews();
     bool createCommandPool();
     bool createSyncObjects();
     void destroySyncObjects();
+    bool createTimelineSemaphores();
+    void destroyTimelineSemaphores();
+    bool waitForTimelineValue(VkSemaphore timeline, uint64_t value, uint64_t timeout) const;
+    void recordOwnershipTransfer(VkCommandBuffer command_buffer, const QueueSharedResources& resources, uint32_t src_family, uint32_t dst_family, bool release) const;
 
     void cleanupSwapChain();
 
@@ -122,19 +275,45 @@ private:
                         VkSharingMode sharing_mode,
                         bool host_visible);
 
-    VkDeviceMemory allocateDeviceMemory(VkMemoryRequirements mem_reqs, VkMemoryPropertyFlags properties);
-    void copyBufferToGpuLocalMemory(VkBuffer src_buffer, VkBuffer dst_buffer, VkDeviceSize size);
+    MemoryAllocation allocateDeviceMemory(VkMemoryRequirements mem_reqs, VkMemoryPropertyFlags properties, bool linear_resource = true);
+    void freeDeviceMemory(MemoryAllocation& allocation);
+    void uploadToGpuLocalMemory(const void* src_data, VkDeviceSize size, VkBuffer dst_buffer);
+    StagingRegion stageUploadData(const void* src_data, VkDeviceSize size);
     VkImageView createImageView(VkImage image, VkFormat format, VkImageAspectFlags aspect_flags, uint32_t mip_levels = 1);
     
     VkPhysicalDevice getPhysicalDevice() const { return physical_device_; }
-    std::vector<float> tryRetrieveTimestampQueries();
-
-    const uint32_t max_frames_in_flight_ = 2;
-    size_t active_swapchain_image_ = 0;
+    VkImageLayout getPresentImageLayout() const { return headless_ ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR; }
+    bool createBindlessTextures();
+    uint32_t addBindlessTexture(VkImageView image_view, VkSampler sampler, VkImageLayout image_layout);  // for Texture
+    void releaseBindlessTexture(uint32_t index);
+    bool calibrateGpuClock();
+
+    // everything that must not be touched until the GPU is done with a frame
+    struct FrameContext {
+        VkFence in_flight_fence = VK_NULL_HANDLE;
+        VkSemaphore image_available = VK_NULL_HANDLE;
+        VkSemaphore render_finished = VK_NULL_HANDLE;
+        VkCommandPool command_pool = VK_NULL_HANDLE;  // reset when the frame comes around again
+        std::vector<VkCommandBuffer> command_buffers;
+        uint32_t used_command_buffers = 0;
+        std::unique_ptr<DescriptorAllocator> transient_descriptors;  // reset with the command pool
+        std::vector<std::function<void()>> deferred_destruction;
+        uint64_t graphics_value = 0;  // graphics timeline value of the last submission of this frame
+    };
+
+    void runDeferredDestruction(FrameContext& frame);
+
+    uint32_t max_frames_in_flight_ = 2;
+    uint32_t active_frame_ = 0;
     size_t current_frame_ = 0;  // total frame count since last swapchain reset
     VkExtent2D window_swap_extent_ = { 0, 0 };
     SwapChainSupportDetails swap_chain_support_;
-    bool mesh_shader_available_ = false;
+    DeviceCapabilities device_capabilities_;
+    std::string preferred_device_;
+    std::string device_name_;  // of the selected device
+    bool headless_ = false;
+    uint32_t next_offscreen_image_ = 0;
+    std::vector<MemoryAllocation> offscreen_image_memory_;  // headless only, backs swap_chain_images_
 
     VkInstance vk_instance_ = VK_NULL_HANDLE;
     VkSurfaceKHR window_surface_ = VK_NULL_HANDLE;
@@ -143,45 +322,56 @@ private:
     VkQueue graphics_queue_ = VK_NULL_HANDLE;
     VkQueue compute_queue_ = VK_NULL_HANDLE;
     VkQueue present_queue_ = VK_NULL_HANDLE; // display to window
+    VkQueue transfer_queue_ = VK_NULL_HANDLE;  // only set if the device has a dedicated transfer family
     VkSwapchainKHR swap_chain_ = VK_NULL_HANDLE;
     std::vector<VkImage> swap_chain_images_;
     VkFormat swap_chain_image_format_ = VK_FORMAT_UNDEFINED;
     VkExtent2D swap_chain_extent_ = { 0,0 };
     std::vector<VkImageView> swap_chain_image_views_;
     VkSampleCountFlagBits max_msaa_samples_ = VK_SAMPLE_COUNT_1_BIT;
-    VkCommandPool command_pool_ = VK_NULL_HANDLE;  // one for every queue
-    VkDescriptorPool descriptor_pool_ = VK_NULL_HANDLE;
-    VkQueryPool timestamp_queries_pool_ = VK_NULL_HANDLE;
-    uint32_t timestamp_queries_ = 0;
-    float timestamp_period_ = 1.f;
+    VkCommandPool command_pool_ = VK_NULL_HANDLE;  // graphics family
+    VkCommandPool compute_command_pool_ = VK_NULL_HANDLE;  // compute family, same as the graphics family unless there is a dedicated one
+    uint32_t graphics_family_ = 0;
+    uint32_t compute_family_ = 0;
+    std::unique_ptr<DescriptorAllocator> descriptor_allocator_;  // reset with the swapchain
+    std::unique_ptr<DescriptorWriter> descriptor_writer_;
+    std::unique_ptr<MemoryAllocator> memory_allocator_;
+    std::unique_ptr<PipelineCache> pipeline_cache_;
+    std::unique_ptr<ThreadPool> pipeline_thread_pool_;
+    std::unique_ptr<ShaderRegistry> shader_registry_;
+    std::unique_ptr<DescriptorSetLayoutCache> layout_cache_;
+    std::unique_ptr<BindlessTextureTable> bindless_textures_;  // null unless bindless textures are enabled
+    bool bindless_textures_requested_ = true;
+    std::unique_ptr<UniformRing> uniform_ring_;
+    std::unique_ptr<UploadBatcher> upload_batcher_;
+    std::unique_ptr<GpuProfiler> gpu_profiler_;  // null unless enabled
+    bool gpu_tracing_ = false;
 
     // synchronization between graphics and present queues
-    std::vector<VkSemaphore> image_available_semaphores_;
-    std::vector<VkSemaphore> render_finished_semaphores_;
-    std::vector<VkFence> in_flight_fences_;
+    std::vector<FrameContext> frames_;
     std::vector<VkFence> images_in_flight_;
 
-    // synchronization between graphics and compute queues
-    VkSemaphore compute_finished_semaphore_ = VK_NULL_HANDLE;
-    VkSemaphore drawing_finished_sempahore_ = VK_NULL_HANDLE;
-    bool graphics_should_wait_for_compute_ = false;
+    // synchronization between graphics and compute queues. the timelines outlive the swapchain, so values
+    // handed out before a resize stay valid
+    VkSemaphore graphics_timeline_ = VK_NULL_HANDLE;
+    VkSemaphore compute_timeline_ = VK_NULL_HANDLE;
+    uint64_t graphics_timeline_value_ = 0;
+    uint64_t compute_timeline_value_ = 0;
+    uint64_t compute_value_waited_by_graphics_ = 0;
 };
 
 // inlines
 
 template<typename DataType>
-Buffer VulkanBackend::createVertexBuffer(const std::string& name, const std::vector<DataType>& src_buffer, bool host_visible, bool compute_visible) {
-    VkBufferUsageFlags final_usage_flags = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT;
+Buffer VulkanBackend::createVertexBuffer(const std::string& name, const std::vector<DataType>& src_buffer, bool host_visible, bool compute_visible, VkBufferUsageFlags extra_usage) {
+    VkBufferUsageFlags final_usage_flags = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | extra_usage;
     if (compute_visible) {
         final_usage_flags |= VK_BUFFER_USAGE_STORAGE_TEXEL_BUFFER_BIT;
     }
 
     if (!host_visible) {
-        Buffer staging_buffer = createBuffer<DataType>(name, src_buffer, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_SHARING_MODE_EXCLUSIVE, true);
-        updateBuffer<DataType>(staging_buffer, src_buffer);
         Buffer vertex_buffer = createBuffer<DataType>(name, src_buffer, VK_BUFFER_USAGE_TRANSFER_DST_BIT | final_usage_flags, VK_SHARING_MODE_EXCLUSIVE, false);
-        copyBufferToGpuLocalMemory(staging_buffer.vk_buffer, vertex_buffer.vk_buffer, sizeof(DataType) * src_buffer.size());
-        destroyBuffer(staging_buffer);
+        uploadToGpuLocalMemory(src_buffer.data(), sizeof(DataType) * src_buffer.size(), vertex_buffer.vk_buffer);
         return vertex_buffer;
     } else {
         Buffer vertex_buffer = createBuffer<DataType>(name, src_buffer, final_usage_flags, VK_SHARING_MODE_EXCLUSIVE, true);
@@ -193,11 +383,8 @@ Buffer VulkanBackend::createVertexBuffer(const std::string& name, const std::vec
 template<typename DataType>
 Buffer VulkanBackend::createIndexBuffer(const std::string& name, const std::vector<DataType>& src_buffer, bool host_visible) {
     if (!host_visible) {
-        Buffer staging_buffer = createBuffer<DataType>(name, src_buffer, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_SHARING_MODE_EXCLUSIVE, true);
-        updateBuffer<DataType>(staging_buffer, src_buffer);
         Buffer index_buffer = createBuffer<DataType>(name, src_buffer, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_SHARING_MODE_EXCLUSIVE, false);
-        copyBufferToGpuLocalMemory(staging_buffer.vk_buffer, index_buffer.vk_buffer, sizeof(DataType) * src_buffer.size());
-        destroyBuffer(staging_buffer);
+        uploadToGpuLocalMemory(src_buffer.data(), sizeof(DataType) * src_buffer.size(), index_buffer.vk_buffer);
         return index_buffer;
     } else {
         Buffer index_buffer = createBuffer<DataType>(name, src_buffer, VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_SHARING_MODE_EXCLUSIVE, true);
@@ -207,15 +394,12 @@ Buffer VulkanBackend::createIndexBuffer(const std::string& name, const std::vect
 }
 
 template<typename DataType>
-Buffer VulkanBackend::createStorageTexelBuffer(const std::string& name, const std::vector<DataType>& src_buffer, bool host_visible) {
-    VkBufferUsageFlags final_usage_flags = VK_BUFFER_USAGE_STORAGE_TEXEL_BUFFER_BIT;
+Buffer VulkanBackend::createStorageTexelBuffer(const std::string& name, const std::vector<DataType>& src_buffer, bool host_visible, VkBufferUsageFlags extra_usage) {
+    VkBufferUsageFlags final_usage_flags = VK_BUFFER_USAGE_STORAGE_TEXEL_BUFFER_BIT | extra_usage;
 
     if (!host_visible) {
-        Buffer staging_buffer = createBuffer<DataType>(name, src_buffer, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_SHARING_MODE_EXCLUSIVE, true);
-        updateBuffer<DataType>(staging_buffer, src_buffer);
         Buffer vertex_buffer = createBuffer<DataType>(name, src_buffer, VK_BUFFER_USAGE_TRANSFER_DST_BIT | final_usage_flags, VK_SHARING_MODE_EXCLUSIVE, false);
-        copyBufferToGpuLocalMemory(staging_buffer.vk_buffer, vertex_buffer.vk_buffer, sizeof(DataType) * src_buffer.size());
-        destroyBuffer(staging_buffer);
+        uploadToGpuLocalMemory(src_buffer.data(), sizeof(DataType) * src_buffer.size(), vertex_buffer.vk_buffer);
         return vertex_buffer;
     } else {
         Buffer vertex_buffer = createBuffer<DataType>(name, src_buffer, final_usage_flags, VK_SHARING_MODE_EXCLUSIVE, true);
@@ -224,6 +408,21 @@ Buffer VulkanBackend::createStorageTexelBuffer(const std::string& name, const st
     }
 }
 
+template<typename DataType>
+Buffer VulkanBackend::createStorageBuffer(const std::string& name, const std::vector<DataType>& src_buffer, bool host_visible, VkBufferUsageFlags extra_usage) {
+    VkBufferUsageFlags final_usage_flags = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | extra_usage;
+
+    if (!host_visible) {
+        Buffer storage_buffer = createBuffer<DataType>(name, src_buffer, VK_BUFFER_USAGE_TRANSFER_DST_BIT | final_usage_flags, VK_SHARING_MODE_EXCLUSIVE, false);
+        uploadToGpuLocalMemory(src_buffer.data(), sizeof(DataType) * src_buffer.size(), storage_buffer.vk_buffer);
+        return storage_buffer;
+    } else {
+        Buffer storage_buffer = createBuffer<DataType>(name, src_buffer, final_usage_flags, VK_SHARING_MODE_EXCLUSIVE, true);
+        updateBuffer<DataType>(storage_buffer, src_buffer);
+        return storage_buffer;
+    }
+}
+
 template<typename DataType>
 Buffer VulkanBackend::createBuffer(const std::string& name, 
                                    const std::vector<DataType>& src_buffer, 
@@ -253,10 +452,10 @@ Buffer VulkanBackend::createBuffer(const std::string& name,
     VkMemoryRequirements mem_reqs;
     vkGetBufferMemoryRequirements(device_, vk_buffer, &mem_reqs);
 
-    VkDeviceMemory memory = allocateDeviceMemory(mem_reqs, mem_properties);
+    MemoryAllocation memory = allocateDeviceMemory(mem_reqs, mem_properties);
 
-    if (memory != VK_NULL_HANDLE) {
-        vkBindBufferMemory(device_, vk_buffer, memory, 0);
+    if (memory.isValid()) {
+        vkBindBufferMemory(device_, vk_buffer, memory.vk_memory, memory.offset);
     } else {
         vkDestroyBuffer(device_, vk_buffer, nullptr);
         return Buffer{};
@@ -268,19 +467,20 @@ Buffer VulkanBackend::createBuffer(const std::string& name,
     buffer.buffer_size = sizeof(DataType) * src_buffer.size();
     buffer.type = buffer_usage;
     buffer.vk_buffer = vk_buffer;
-    buffer.vk_buffer_memory = memory;
+    buffer.memory = memory;
 
     return buffer;
 }
 
 template<typename DataType>
 void VulkanBackend::updateBuffer(Buffer& dst_buffer, const std::vector<DataType>& src_buffer) {
-    // Note: Buffer must be host visible
-    void* data;
+    // Note: Buffer must be host visible. Host visible memory is persistently mapped by the allocator
+    if (dst_buffer.memory.mapped_data == nullptr) {
+        std::cerr << "Buffer " << dst_buffer.name << " is not host visible!" << std::endl;
+        return;
+    }
     size_t bytes = sizeof(DataType) * src_buffer.size();
-    vkMapMemory(device_, dst_buffer.vk_buffer_memory, 0, bytes, 0, &data);
-    memcpy(data, src_buffer.data(), bytes);
-    vkUnmapMemory(device_, dst_buffer.vk_buffer_memory);
+    memcpy(dst_buffer.memory.mapped_data, src_buffer.data(), bytes);
 }
 
 template<typename DataType>
@@ -294,7 +494,7 @@ UniformBuffer VulkanBackend::createUniformBuffer(const std::string base_name, si
     buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
     VkMemoryPropertyFlags mem_properties = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
 
-    count = count > 0 ? count : swap_chain_images_.size();
+    count = count > 0 ? count : max_frames_in_flight_;
     for (size_t i = 0; i < count; i++) {
         auto name = base_name + std::to_string(i);
 
@@ -307,10 +507,10 @@ UniformBuffer VulkanBackend::createUniformBuffer(const std::string base_name, si
         VkMemoryRequirements mem_reqs;
         vkGetBufferMemoryRequirements(device_, vk_buffer, &mem_reqs);
 
-        VkDeviceMemory memory = allocateDeviceMemory(mem_reqs, mem_properties);
+        MemoryAllocation memory = allocateDeviceMemory(mem_reqs, mem_properties);
 
-        if (memory != VK_NULL_HANDLE) {
-            vkBindBufferMemory(device_, vk_buffer, memory, 0);
+        if (memory.isValid()) {
+            vkBindBufferMemory(device_, vk_buffer, memory.vk_memory, memory.offset);
         }
         else {
             vkDestroyBuffer(device_, vk_buffer, nullptr);
@@ -321,7 +521,9 @@ UniformBuffer VulkanBackend::createUniformBuffer(const std::string base_name, si
         buffer.name = name;
         buffer.type = buffer_info.usage;
         buffer.vk_buffer = vk_buffer;
-        buffer.vk_buffer_memory = memory;
+        buffer.host_visible = true;
+        buffer.buffer_size = sizeof(DataType);
+        buffer.memory = memory;
 
         buffers.push_back(buffer);
     }